@@ -0,0 +1,248 @@
+/* File: Reads and writes uncompressed tar archives, so a whole batch of programs can come in as one file and its outputs go out as another.
+ *
+ * Reading never copies a member. Each archive_member points at its data where it lies in the archive, which the platform layer maps instead of reading.
+ * Plain ustar headers, ustar name prefixes, GNU long names and pax path records are understood, which covers what GNU tar, bsdtar and Python's tarfile write. Anything that isn't a regular file is skipped.
+ * Written archives are plain ustar, with a GNU long name entry before any member whose name doesn't fit in a header.
+ */
+
+#include "MarieAssembler.h"
+#include "Platform_MarieAssembler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAR_BLOCK_SIZE (512)
+#define TAR_GNU_LONG_NAME "././@LongLink"
+
+// Where each field is in a tar header, and how long it is.
+#define TAR_NAME (0)
+#define TAR_NAME_LENGTH (100)
+#define TAR_MODE (100)
+#define TAR_UID (108)
+#define TAR_GID (116)
+#define TAR_SIZE (124)
+#define TAR_SIZE_LENGTH (12)
+#define TAR_MTIME (136)
+#define TAR_CHECKSUM (148)
+#define TAR_CHECKSUM_LENGTH (8)
+#define TAR_TYPE (156)
+#define TAR_MAGIC (257)
+#define TAR_VERSION (263)
+#define TAR_PREFIX (345)
+#define TAR_PREFIX_LENGTH (155)
+
+translation_scope inline size_t TarPaddedSize(size_t Size) {
+	return (Size + TAR_BLOCK_SIZE - 1) & ~(size_t)(TAR_BLOCK_SIZE - 1);
+}
+
+/* Parses an octal header field, which may be padded with spaces and ended early by a space or a null.
+ * Returns FALSE if anything else is in it.
+ */
+translation_scope int ParseTarOctal(const char *Field, int Length, uint64_t *Value) {
+	int Index = 0;
+	*Value = 0;
+	while (Index < Length && Field[Index] == ' ') { Index++; }
+	for (; Index < Length && Field[Index] >= '0' && Field[Index] <= '7'; Index++) {
+		*Value = (*Value << 3) | (Field[Index] - '0');
+	}
+	return (Index == Length) || (Field[Index] == ' ') || (Field[Index] == 0);
+}
+
+// The header's checksum is the sum of its bytes, counting the checksum field itself as spaces.
+translation_scope uint32_t TarHeaderChecksum(const uint8_t *Header) {
+	uint32_t Result = ' ' * TAR_CHECKSUM_LENGTH;
+	for (int Index = 0; Index < TAR_BLOCK_SIZE; Index++) {
+		if (Index < TAR_CHECKSUM || Index >= TAR_CHECKSUM + TAR_CHECKSUM_LENGTH) { Result += Header[Index]; }
+	}
+	return Result;
+}
+
+// Copies text that is only null terminated if it is shorter than MaxLength, like a header field.
+translation_scope char *CopyTarString(const char *Text, size_t MaxLength) {
+	size_t Length = 0;
+	while (Length < MaxLength && Text[Length] != 0) { Length++; }
+	char *Result = malloc(Length + 1);
+	memcpy(Result, Text, Length);
+	Result[Length] = 0;
+	return Result;
+}
+
+// Finds the path record in a pax extended header, which is a list of "<length> <key>=<value>\n" records. Returns 0 if it doesn't have one.
+translation_scope char *FindPaxPath(const char *Data, size_t Size) {
+	size_t At = 0;
+	while (At < Size) {
+		size_t RecordLength = 0, Index = At;
+		for (; Index < Size && Data[Index] >= '0' && Data[Index] <= '9'; Index++) {
+			RecordLength = RecordLength * 10 + (Data[Index] - '0');
+		}
+		if (RecordLength == 0 || At + RecordLength > Size || Index >= Size || Data[Index] != ' ') { break; }
+		const char *Key = Data + Index + 1;
+		const size_t KeyValueLength = At + RecordLength - (Index + 1) - 1; // Without the trailing newline.
+		if (KeyValueLength > 5 && memcmp(Key, "path=", 5) == 0) {
+			return CopyTarString(Key + 5, KeyValueLength - 5);
+		}
+		At += RecordLength;
+	}
+	return 0;
+}
+
+int ReadTarArchive(char *Archive, size_t Size, archive_member **Members, int *MemberCount) {
+	int Success = TRUE;
+	int Capacity = 0;
+	*Members = 0;
+	*MemberCount = 0;
+
+	char *LongName = 0; // From a GNU long name or pax header, for the member after it.
+	size_t Offset = 0;
+	int ReachedEnd = FALSE;
+	while (Success && Offset + TAR_BLOCK_SIZE <= Size) {
+		const uint8_t *Header = (const uint8_t*)Archive + Offset;
+		const char *Fields = (const char*)Header;
+
+		int IsEnd = TRUE;
+		for (int Index = 0; Index < TAR_BLOCK_SIZE && IsEnd; Index++) { IsEnd = (Header[Index] == 0); }
+		if (IsEnd) {
+			ReachedEnd = TRUE;
+			break;
+		}
+
+		uint64_t Checksum = 0, MemberSize = 0;
+		if (!ParseTarOctal(Fields + TAR_CHECKSUM, TAR_CHECKSUM_LENGTH, &Checksum) || Checksum != TarHeaderChecksum(Header)) {
+			printf("[Error Archive] The header at byte %zu is damaged, or this isn't an uncompressed tar archive!\n", Offset);
+			Success = FALSE;
+			break;
+		}
+		if (!ParseTarOctal(Fields + TAR_SIZE, TAR_SIZE_LENGTH, &MemberSize)) {
+			printf("[Error Archive] The member at byte %zu is too large, or its size is damaged!\n", Offset);
+			Success = FALSE;
+			break;
+		}
+		const size_t DataOffset = Offset + TAR_BLOCK_SIZE;
+		if (MemberSize > Size - DataOffset) {
+			printf("[Error Archive] The archive ends partway through the member at byte %zu!\n", Offset);
+			Success = FALSE;
+			break;
+		}
+		char *Data = Archive + DataOffset;
+
+		const char Type = Fields[TAR_TYPE];
+		if (Type == 'L') {
+			free(LongName);
+			LongName = CopyTarString(Data, MemberSize);
+		}
+		else if (Type == 'x') {
+			char *PaxPath = FindPaxPath(Data, MemberSize);
+			if (PaxPath) {
+				free(LongName);
+				LongName = PaxPath;
+			}
+		}
+		else if (Type == '0' || Type == 0 || Type == '7') {
+			char *Name = LongName;
+			LongName = 0;
+			if (Name == 0) {
+				char *ShortName = CopyTarString(Fields + TAR_NAME, TAR_NAME_LENGTH);
+				const int IsUstar = (memcmp(Fields + TAR_MAGIC, "ustar", 5) == 0);
+				if (IsUstar && Fields[TAR_PREFIX] != 0) {
+					char *Prefix = CopyTarString(Fields + TAR_PREFIX, TAR_PREFIX_LENGTH);
+					Name = malloc(strlen(Prefix) + 1 + strlen(ShortName) + 1);
+					sprintf(Name, "%s/%s", Prefix, ShortName);
+					free(Prefix);
+					free(ShortName);
+				}
+				else {
+					Name = ShortName;
+				}
+			}
+
+			if (*MemberCount == Capacity) {
+				Capacity = Max(64, Capacity * 2);
+				*Members = realloc(*Members, Capacity * sizeof(archive_member));
+			}
+			(*Members)[(*MemberCount)++] = (archive_member){.Name = Name, .Data = Data, .Size = MemberSize};
+		}
+		else if (Type != 'g') {
+			// Directories, links and devices have nothing to assemble. A long name before one of them belongs to it.
+			free(LongName);
+			LongName = 0;
+		}
+
+		Offset = DataOffset + TarPaddedSize(MemberSize);
+	}
+	free(LongName);
+
+	// Archives are allowed to stop without the zero blocks that mark their end, but not partway through a header.
+	if (Success && !ReachedEnd && Offset < Size) {
+		printf("[Error Archive] The archive ends partway through the header at byte %zu!\n", Offset);
+		Success = FALSE;
+	}
+
+	if (!Success) {
+		FreeArchiveMembers(*Members, *MemberCount);
+		*Members = 0;
+		*MemberCount = 0;
+	}
+	return Success;
+}
+
+void FreeArchiveMembers(archive_member *Members, int MemberCount) {
+	for (int Index = 0; Index < MemberCount; Index++) {
+		free(Members[Index].Name);
+	}
+	free(Members);
+}
+
+translation_scope int WriteTarHeader(FILE *Out, const char *Name, int NameLength, const char *Prefix, int PrefixLength, char Type, size_t Size) {
+	uint8_t Header[TAR_BLOCK_SIZE] = {0};
+	char *Fields = (char*)Header;
+	memcpy(Fields + TAR_NAME, Name, NameLength);
+	memcpy(Fields + TAR_PREFIX, Prefix, PrefixLength);
+	memcpy(Fields + TAR_MODE, "0000644", 7);
+	memcpy(Fields + TAR_UID, "0000000", 7);
+	memcpy(Fields + TAR_GID, "0000000", 7);
+	snprintf(Fields + TAR_SIZE, TAR_SIZE_LENGTH, "%011llo", (unsigned long long)Size);
+	// No modification time, so the same programs always give the same archive.
+	memcpy(Fields + TAR_MTIME, "00000000000", 11);
+	Fields[TAR_TYPE] = Type;
+	memcpy(Fields + TAR_MAGIC, "ustar", 6);
+	memcpy(Fields + TAR_VERSION, "00", 2);
+	snprintf(Fields + TAR_CHECKSUM, TAR_CHECKSUM_LENGTH, "%06o", TarHeaderChecksum(Header));
+	Fields[TAR_CHECKSUM + 7] = ' ';
+	return fwrite(Header, 1, TAR_BLOCK_SIZE, Out) == TAR_BLOCK_SIZE;
+}
+
+translation_scope int WriteTarData(FILE *Out, const char *Data, size_t Size) {
+	local_persist const char Padding[TAR_BLOCK_SIZE] = {0};
+	const size_t PaddingSize = TarPaddedSize(Size) - Size;
+	return (fwrite(Data, 1, Size, Out) == Size) && (fwrite(Padding, 1, PaddingSize, Out) == PaddingSize);
+}
+
+int WriteTarMember(FILE *Out, const char *Name, const char *Data, size_t Size) {
+	int Success = TRUE;
+	const int NameLength = strlen(Name);
+	if (NameLength <= TAR_NAME_LENGTH) {
+		Success = WriteTarHeader(Out, Name, NameLength, "", 0, '0', Size);
+	}
+	else {
+		// Split at a slash, so the directories go in the prefix field, if that makes both halves fit.
+		int Split = -1;
+		for (int Index = Min(NameLength - 1, TAR_PREFIX_LENGTH); Index > 0 && Split == -1; Index--) {
+			if (Name[Index] == '/' && NameLength - Index - 1 <= TAR_NAME_LENGTH) { Split = Index; }
+		}
+		if (Split != -1) {
+			Success = WriteTarHeader(Out, Name + Split + 1, NameLength - Split - 1, Name, Split, '0', Size);
+		}
+		else {
+			Success = WriteTarHeader(Out, TAR_GNU_LONG_NAME, strlen(TAR_GNU_LONG_NAME), "", 0, 'L', NameLength + 1) &&
+			          WriteTarData(Out, Name, NameLength + 1) &&
+			          WriteTarHeader(Out, Name, TAR_NAME_LENGTH, "", 0, '0', Size);
+		}
+	}
+	return Success && WriteTarData(Out, Data, Size);
+}
+
+int FinishTarArchive(FILE *Out) {
+	local_persist const char EndOfArchive[TAR_BLOCK_SIZE * 2] = {0};
+	return fwrite(EndOfArchive, 1, sizeof(EndOfArchive), Out) == sizeof(EndOfArchive);
+}
@@ -0,0 +1,104 @@
+/* File: Bitset views of ProgramMetaData, one bit per word for each PMD_* flag.
+ * Finding gaps, runs of occupied words and how many words have a flag takes a few instructions per 64 words, instead of a branch per word.
+ */
+
+#include "MarieAssembler.h"
+#include "Platform_MarieAssembler.h"
+
+#include <string.h>
+#if defined(__SSE2__) || defined(_M_X64)
+# include <emmintrin.h>
+#endif
+
+#define PROGRAM_BITS_WORDS (Kilobyte(4) / 64)
+
+translation_scope inline int TestProgramBit(const program_bits *Bits, int Address) {
+	return (Bits->Words[Address / 64] >> (Address % 64)) & 1;
+}
+
+/* Returns the first address at or after From whose bit is set, or Kilobyte(4) if there isn't one.
+ */
+translation_scope int FindNextSetBit(const program_bits *Bits, int From) {
+	if (From >= Kilobyte(4)) { return Kilobyte(4); }
+	int WordIndex = From / 64;
+	uint64_t Word = Bits->Words[WordIndex] & (~0ull << (From % 64));
+	while (Word == 0) {
+		if (++WordIndex == PROGRAM_BITS_WORDS) { return Kilobyte(4); }
+		Word = Bits->Words[WordIndex];
+	}
+	return WordIndex * 64 + CountTrailingZeros64(Word);
+}
+
+/* Returns the first address at or after From whose bit is clear, or Kilobyte(4) if there isn't one.
+ */
+translation_scope int FindNextClearBit(const program_bits *Bits, int From) {
+	if (From >= Kilobyte(4)) { return Kilobyte(4); }
+	int WordIndex = From / 64;
+	uint64_t Word = ~Bits->Words[WordIndex] & (~0ull << (From % 64));
+	while (Word == 0) {
+		if (++WordIndex == PROGRAM_BITS_WORDS) { return Kilobyte(4); }
+		Word = ~Bits->Words[WordIndex];
+	}
+	return WordIndex * 64 + CountTrailingZeros64(Word);
+}
+
+/* Returns the last address whose bit is set, or -1 if none are.
+ */
+translation_scope int FindLastSetBit(const program_bits *Bits) {
+	for (int WordIndex = PROGRAM_BITS_WORDS - 1; WordIndex >= 0; WordIndex--) {
+		if (Bits->Words[WordIndex]) { return WordIndex * 64 + 63 - CountLeadingZeros64(Bits->Words[WordIndex]); }
+	}
+	return -1;
+}
+
+/* Finds the next run of set bits at or after *At. Its first address goes in *Start, and the address just past its end in *End and *At, so calling this again moves on to the next run.
+ * Returns FALSE once there are no more runs.
+ */
+translation_scope int NextSetRange(const program_bits *Bits, int *At, int *Start, int *End) {
+	*Start = FindNextSetBit(Bits, *At);
+	if (*Start == Kilobyte(4)) { return FALSE; }
+	*End = FindNextClearBit(Bits, *Start + 1);
+	*At = *End;
+	return TRUE;
+}
+
+translation_scope inline int CountSetBits(const program_bits *Bits) {
+	int Result = 0;
+	for (int WordIndex = 0; WordIndex < PROGRAM_BITS_WORDS; WordIndex++) {
+		Result += PopCount64(Bits->Words[WordIndex]);
+	}
+	return Result;
+}
+
+/* Rebuilds every bitset in Context->ProgramBits from Context->ProgramMetaData. Called by every pass once it is done changing ProgramMetaData.
+ */
+translation_scope void UpdateProgramBits(assembler_context *Context) {
+	const uint8_t *MetaData = Context->ProgramMetaData;
+	for (int WordIndex = 0; WordIndex < PROGRAM_BITS_WORDS; WordIndex++) {
+		const uint8_t *Bytes = MetaData + WordIndex * 64;
+#if defined(__SSE2__) || defined(_M_X64)
+		__m128i Lanes[4];
+		for (int Lane = 0; Lane < 4; Lane++) { Lanes[Lane] = _mm_loadu_si128((const __m128i*)(Bytes + Lane * 16)); }
+		for (int Bit = 0; Bit < PMDB_COUNT; Bit++) {
+			// Shift each flag up into the top bit of its byte, where movemask picks it out. Shifting 16 bit lanes carries the low byte's bits into the bottom of the high byte, never its top.
+			const __m128i Shift = _mm_cvtsi32_si128(7 - Bit);
+			uint64_t Word = 0;
+			for (int Lane = 0; Lane < 4; Lane++) {
+				Word |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_sll_epi16(Lanes[Lane], Shift)) << (Lane * 16);
+			}
+			Context->ProgramBits[Bit].Words[WordIndex] = Word;
+		}
+#else
+		for (int Bit = 0; Bit < PMDB_COUNT; Bit++) {
+			uint64_t Word = 0;
+			for (int Group = 0; Group < 8; Group++) {
+				uint64_t Eight;
+				memcpy(&Eight, Bytes + Group * 8, 8);
+				// Gathers the low bit of each byte into one byte, the first byte's bit lowest. Assumes a little endian host, like the rest of the assembler.
+				Word |= ((((Eight >> Bit) & 0x0101010101010101ull) * 0x0102040810204080ull) >> 56) << (Group * 8);
+			}
+			Context->ProgramBits[Bit].Words[WordIndex] = Word;
+		}
+#endif
+	}
+}
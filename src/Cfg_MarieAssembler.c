@@ -0,0 +1,270 @@
+/* File: Builds the control flow graph of an assembled program, and writes it out as Graphviz DOT or JSON.
+ * Execution starts at address 0. Anything execution can't get to from there is either data or dead code.
+ * Returns from subroutines are followed precisely: a jumpi through a return address only goes back to after the jns calls that were themselves reachable.
+ */
+
+#include "MarieAssembler.h"
+#include "Platform_MarieAssembler.h"
+#include "Memory_MarieAssembler.h"
+#include "Cfg_MarieAssembler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+translation_scope int IsAssembledInstruction(const assembler_context *Context, int Address) {
+	return (Context->ProgramMetaData[Address] & PMD_IsOccupied) && !(Context->ProgramMetaData[Address] & PMD_IsData);
+}
+
+/* Writes the successors of the word at Address into Edges, if Edges isn't 0. Returns how many there are.
+ * FirstCaller and NextCaller chain together every assembled jns by the return address it stores into.
+ */
+translation_scope int GetWordSuccessors(const assembler_context *Context, const control_flow_graph *Cfg, const int16_t *FirstCaller, const int16_t *NextCaller, int Address, cfg_edge *Edges) {
+	const uint16_t Word = Context->Program[Address];
+	const uint16_t X = Word & 0xFFF;
+	const uint16_t Next = (Address + 1) & 0xFFF;
+	int Count = 0;
+
+#define AddEdge(EdgeTo, EdgeKind) { if (Edges) { Edges[Count] = (cfg_edge){.To = (EdgeTo), .Kind = (EdgeKind)}; } Count++; }
+	switch (Word >> 12) {
+	case 0x0: { AddEdge((X + 1) & 0xFFF, EDGE_Call); } break; // jns
+	case 0x7: break; // halt
+	case 0x8: { // skipcond
+		AddEdge(Next, EDGE_Next);
+		AddEdge((Address + 2) & 0xFFF, EDGE_Skip);
+	} break;
+	case 0x9: { AddEdge(X, EDGE_Jump); } break;
+	case 0xC: { // jumpi
+		if (Cfg->Flags[X] & CFG_ReturnSlot) {
+			for (int Caller = FirstCaller[X]; Caller != -1; Caller = NextCaller[Caller]) {
+				AddEdge((Caller + 1) & 0xFFF, EDGE_Return);
+			}
+		}
+		else {
+			AddEdge(Context->Program[X] & 0xFFF, EDGE_Indirect);
+		}
+	} break;
+	case 0xF: break; // Not an instruction, the machine stops here
+	default: { AddEdge(Next, EDGE_Next); } break;
+	}
+#undef AddEdge
+
+	return Count;
+}
+
+/* Builds the control flow graph of the program in Context with a worklist, so each word and edge is only visited once.
+ */
+control_flow_graph* AnalyzeControlFlow(const assembler_context *Context) {
+	control_flow_graph *Cfg = calloc(1, sizeof(control_flow_graph));
+	int16_t *FirstCaller = malloc(Kilobyte(4) * sizeof(int16_t));
+	int16_t *NextCaller = malloc(Kilobyte(4) * sizeof(int16_t));
+	for (int Address = 0; Address < Kilobyte(4); Address++) { FirstCaller[Address] = -1; }
+	// Walking backwards and prepending keeps each chain in address order.
+	for (int Address = Kilobyte(4) - 1; Address >= 0; Address--) {
+		if (IsAssembledInstruction(Context, Address) && (Context->Program[Address] >> 12) == 0x0) {
+			const uint16_t Slot = Context->Program[Address] & 0xFFF;
+			NextCaller[Address] = FirstCaller[Slot];
+			FirstCaller[Slot] = Address;
+			Cfg->Flags[Slot] |= CFG_ReturnSlot;
+		}
+	}
+
+	for (int Address = 0; Address < Kilobyte(4); Address++) {
+		Cfg->EdgeStart[Address] = Cfg->EdgeCount;
+		Cfg->EdgeCount += GetWordSuccessors(Context, Cfg, FirstCaller, NextCaller, Address, 0);
+	}
+	Cfg->EdgeStart[Kilobyte(4)] = Cfg->EdgeCount;
+	Cfg->Edges = malloc(Max(1, Cfg->EdgeCount) * sizeof(cfg_edge));
+	for (int Address = 0; Address < Kilobyte(4); Address++) {
+		GetWordSuccessors(Context, Cfg, FirstCaller, NextCaller, Address, Cfg->Edges + Cfg->EdgeStart[Address]);
+	}
+
+	// Reachability. A return edge is only taken once the jns it returns to is reachable, and a jns that becomes reachable after its subroutine's return was found picks up its return edge then.
+	uint16_t *Worklist = malloc(Kilobyte(4) * sizeof(uint16_t));
+	uint8_t *ReturnTaken = calloc(Kilobyte(4), 1);
+	int WorklistCount = 0;
+#define Reach(Target) { const uint16_t ReachTarget = (Target); if (!(Cfg->Flags[ReachTarget] & CFG_Reachable)) { Cfg->Flags[ReachTarget] |= CFG_Reachable; Worklist[WorklistCount++] = ReachTarget; } }
+	Reach(0);
+	while (WorklistCount) {
+		const uint16_t Address = Worklist[--WorklistCount];
+		const uint16_t Word = Context->Program[Address];
+		if ((Word >> 12) == 0xC && (Cfg->Flags[Word & 0xFFF] & CFG_ReturnSlot)) {
+			ReturnTaken[Word & 0xFFF] = TRUE;
+		}
+		if ((Word >> 12) == 0x0 && ReturnTaken[Word & 0xFFF] && IsAssembledInstruction(Context, Address)) {
+			Reach((Address + 1) & 0xFFF);
+		}
+
+		for (int Index = Cfg->EdgeStart[Address]; Index < Cfg->EdgeStart[Address + 1]; Index++) {
+			const cfg_edge Edge = Cfg->Edges[Index];
+			if (Edge.Kind == EDGE_Return && !(Cfg->Flags[(Edge.To - 1) & 0xFFF] & CFG_Reachable)) { continue; }
+			Reach(Edge.To);
+		}
+	}
+#undef Reach
+
+	// Block boundaries. A block starts at the entry, at anything control can arrive at other than by falling through, and after anything that doesn't always fall through.
+	Cfg->Flags[0] |= CFG_BlockStart;
+	for (int Address = 0; Address < Kilobyte(4); Address++) {
+		if (!(Cfg->Flags[Address] & CFG_Reachable)) { continue; }
+		Cfg->ReachableCount++;
+		const uint16_t Opcode = Context->Program[Address] >> 12;
+		// Everything but input, output, halt, skipcond, jump and clear has a memory operand.
+		if (Opcode != 0x5 && Opcode != 0x6 && Opcode != 0x7 && Opcode != 0x8 && Opcode != 0x9 && Opcode != 0xA && Opcode != 0xF) {
+			Cfg->Flags[Context->Program[Address] & 0xFFF] |= CFG_Operand;
+		}
+		const int First = Cfg->EdgeStart[Address], Last = Cfg->EdgeStart[Address + 1];
+		const int FallsThrough = Last - First == 1 && Cfg->Edges[First].Kind == EDGE_Next;
+		for (int Index = First; Index < Last; Index++) {
+			if (Cfg->Edges[Index].Kind != EDGE_Next) { Cfg->Flags[Cfg->Edges[Index].To] |= CFG_BlockStart; }
+		}
+		if (!FallsThrough) { Cfg->Flags[(Address + 1) & 0xFFF] |= CFG_BlockStart; }
+	}
+
+	for (int Address = 0; Address < Kilobyte(4); Address++) {
+		Cfg->BlockOf[Address] = -1;
+		if (!(Cfg->Flags[Address] & CFG_Reachable)) {
+			Cfg->Flags[Address] &= ~CFG_BlockStart;
+			continue;
+		}
+		// A reachable word is either a block start or was fallen into from the word before it, so that word's block is still the last one.
+		if ((Cfg->Flags[Address] & CFG_BlockStart) || Cfg->BlockCount == 0) {
+			Cfg->Blocks[Cfg->BlockCount++] = (cfg_block){.Start = Address};
+		}
+		cfg_block *Block = &Cfg->Blocks[Cfg->BlockCount - 1];
+		Block->Length++;
+		Block->FirstEdge = Cfg->EdgeStart[Address];
+		Block->EdgeCount = Cfg->EdgeStart[Address + 1] - Cfg->EdgeStart[Address];
+		Cfg->BlockOf[Address] = Cfg->BlockCount - 1;
+	}
+
+	free(ReturnTaken);
+	free(Worklist);
+	free(NextCaller);
+	free(FirstCaller);
+	return Cfg;
+}
+
+// An assembled instruction that can never run, and isn't used as data by anything that can.
+translation_scope int IsDeadInstruction(const assembler_context *Context, const control_flow_graph *Cfg, int Address) {
+	return IsAssembledInstruction(Context, Address) && !(Cfg->Flags[Address] & (CFG_Reachable | CFG_Operand));
+}
+
+void FreeControlFlowGraph(control_flow_graph *Cfg) {
+	if (Cfg) {
+		free(Cfg->Edges);
+		free(Cfg);
+	}
+}
+
+// The .Ident naming Address, for labelling blocks. Returns FALSE if there isn't one.
+translation_scope int GetAddressName(const assembler_context *Context, int Address, const char **Name, int *Length) {
+	const int SourceIndex = Context->Symbols.AddressToSource[Address];
+	if (SourceIndex == -1) { return FALSE; }
+	*Name = Context->Symbols.Sources.Names[SourceIndex];
+	*Length = Context->Symbols.Sources.ByteCounts[SourceIndex];
+	return TRUE;
+}
+
+translation_scope void AppendDotString(string_builder *Output, const char *Text, int Length) {
+	for (int Index = 0; Index < Length; Index++) {
+		if (Text[Index] == '"' || Text[Index] == '\\') { AppendString(Output, "\\", 1); }
+		AppendString(Output, Text + Index, 1);
+	}
+}
+
+translation_scope int WriteControlFlowOutput(string_builder *Output, FILE *FileStream, const char *Name) {
+	int Success = fwrite(Output->Data, 1, Output->Length, FileStream) == Output->Length;
+	Success = (fclose(FileStream) == 0) && Success;
+	free(Output->Data);
+	if (!Success) {
+		printf("[Error %s] There was a error encountered while writing to the %s output file!\n", Name, Name);
+	}
+	return Success;
+}
+
+/* Writes one node per basic block, holding its instructions, and one edge per successor. Uses Context->Cfg if it is set, otherwise analyzes the program first.
+ */
+int OutputControlFlowDot(const assembler_context *Context, FILE *FileStream) {
+	control_flow_graph *Cfg = Context->Cfg ? Context->Cfg : AnalyzeControlFlow(Context);
+	string_builder Output = {0};
+	AppendFormat(&Output, "digraph MarieProgram {\n\tnode [shape=box fontname=\"monospace\"];\n");
+
+	for (int BlockIndex = 0; BlockIndex < Cfg->BlockCount; BlockIndex++) {
+		const cfg_block *Block = &Cfg->Blocks[BlockIndex];
+		AppendFormat(&Output, "\tb%d [label=\"", BlockIndex);
+		const char *Name = 0;
+		int NameLength = 0;
+		if (GetAddressName(Context, Block->Start, &Name, &NameLength)) {
+			AppendDotString(&Output, Name, NameLength);
+			AppendString(&Output, ":\\l", 3);
+		}
+		for (int Offset = 0; Offset < Block->Length; Offset++) {
+			const int Address = (Block->Start + Offset) & 0xFFF;
+			char Text[64];
+			FormatInstruction(Context, Context->Program[Address], Text, sizeof(Text));
+			AppendFormat(&Output, "0x%03X  ", Address);
+			AppendDotString(&Output, Text, strlen(Text));
+			AppendString(&Output, "\\l", 2);
+		}
+		AppendString(&Output, "\"];\n", 4);
+	}
+
+	for (int BlockIndex = 0; BlockIndex < Cfg->BlockCount; BlockIndex++) {
+		const cfg_block *Block = &Cfg->Blocks[BlockIndex];
+		for (int Index = Block->FirstEdge; Index < Block->FirstEdge + Block->EdgeCount; Index++) {
+			const cfg_edge Edge = Cfg->Edges[Index];
+			if (Cfg->BlockOf[Edge.To] == -1) { continue; } // A return to a jns that isn't reachable
+			AppendFormat(&Output, "\tb%d -> b%d", BlockIndex, Cfg->BlockOf[Edge.To]);
+			if (Edge.Kind != EDGE_Next) { AppendFormat(&Output, " [label=\"%s\"]", ControlFlowEdgeNames[Edge.Kind]); }
+			AppendString(&Output, ";\n", 2);
+		}
+	}
+	AppendString(&Output, "}\n", 2);
+
+	if (Cfg != Context->Cfg) { FreeControlFlowGraph(Cfg); }
+	return WriteControlFlowOutput(&Output, FileStream, "Control Flow Graph");
+}
+
+/* Writes the blocks, their successors and the assembled instructions nothing can reach, as one JSON object. Uses Context->Cfg if it is set, otherwise analyzes the program first.
+ */
+int OutputControlFlowJson(const assembler_context *Context, FILE *FileStream) {
+	control_flow_graph *Cfg = Context->Cfg ? Context->Cfg : AnalyzeControlFlow(Context);
+	string_builder Output = {0};
+	AppendFormat(&Output, "{\"entry\":0,\"reachable\":%d,\"blocks\":[", Cfg->ReachableCount);
+
+	for (int BlockIndex = 0; BlockIndex < Cfg->BlockCount; BlockIndex++) {
+		const cfg_block *Block = &Cfg->Blocks[BlockIndex];
+		AppendFormat(&Output, "%s\n{\"start\":%d,\"length\":%d,", BlockIndex ? "," : "", Block->Start, Block->Length);
+		const char *Name = 0;
+		int NameLength = 0;
+		if (GetAddressName(Context, Block->Start, &Name, &NameLength)) {
+			AppendString(&Output, "\"name\":", 7);
+			AppendJsonString(&Output, Name, NameLength);
+			AppendString(&Output, ",", 1);
+		}
+		AppendString(&Output, "\"successors\":[", 14);
+		int Written = 0;
+		for (int Index = Block->FirstEdge; Index < Block->FirstEdge + Block->EdgeCount; Index++) {
+			const cfg_edge Edge = Cfg->Edges[Index];
+			if (Cfg->BlockOf[Edge.To] == -1) { continue; }
+			AppendFormat(&Output, "%s{\"block\":%d,\"address\":%d,\"kind\":\"%s\"}", Written++ ? "," : "", Cfg->BlockOf[Edge.To], Edge.To, ControlFlowEdgeNames[Edge.Kind]);
+		}
+		AppendString(&Output, "]}", 2);
+	}
+
+	// Runs of assembled instructions that can never run, and that no reachable instruction uses as data either.
+	AppendFormat(&Output, "],\n\"unreachable\":[");
+	int Written = 0;
+	for (int Address = 0; Address < Kilobyte(4); Address++) {
+		if (!IsDeadInstruction(Context, Cfg, Address)) { continue; }
+		int End = Address;
+		while (End + 1 < Kilobyte(4) && IsDeadInstruction(Context, Cfg, End + 1)) { End++; }
+		AppendFormat(&Output, "%s{\"start\":%d,\"length\":%d}", Written++ ? "," : "", Address, End - Address + 1);
+		Address = End;
+	}
+	AppendString(&Output, "]}\n", 3);
+
+	if (Cfg != Context->Cfg) { FreeControlFlowGraph(Cfg); }
+	return WriteControlFlowOutput(&Output, FileStream, "Control Flow Graph");
+}
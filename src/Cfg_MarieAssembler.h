@@ -0,0 +1,57 @@
+/* File: Control flow analysis over an assembled program. Finds which words are reachable as code and splits them into basic blocks.
+ */
+
+#ifndef CFG_MARIEASSEMBLER_H
+#define CFG_MARIEASSEMBLER_H
+
+#include <stdint.h>
+
+typedef enum {
+	EDGE_Next, // Falls through to the next word
+	EDGE_Skip, // A skipcond skipping over the next word
+	EDGE_Jump,
+	EDGE_Call, // A jns into its subroutine
+	EDGE_Return, // A jumpi through a subroutine's return address, back to after one of its jns
+	EDGE_Indirect, // Any other jumpi, assuming the word it jumps through still holds its assembled value
+	EDGE_COUNT
+} cfg_edge_kind;
+
+global_var const char* const ControlFlowEdgeNames[EDGE_COUNT] = {
+	[EDGE_Next] = "next",
+	[EDGE_Skip] = "skip",
+	[EDGE_Jump] = "jump",
+	[EDGE_Call] = "call",
+	[EDGE_Return] = "return",
+	[EDGE_Indirect] = "indirect",
+};
+
+typedef struct {
+	uint16_t To;
+	uint8_t Kind; // cfg_edge_kind
+} cfg_edge;
+
+#define CFG_Reachable (0x1) // Execution starting from address 0 can get here
+#define CFG_BlockStart (0x2) // First word of a basic block. Only set on reachable words.
+#define CFG_ReturnSlot (0x4) // Some jns stores its return address here
+#define CFG_Operand (0x8) // A reachable instruction reads, writes or jumps through this word
+
+typedef struct {
+	uint16_t Start;
+	uint16_t Length; // In words
+	int FirstEdge, EdgeCount; // Successors of the block, into control_flow_graph.Edges
+} cfg_block;
+
+/* Built by AnalyzeControlFlow(). Every word gets successor edges whether or not it is reachable, so passes that rewrite code can ask about any word.
+ */
+typedef struct control_flow_graph {
+	uint8_t Flags[Kilobyte(4)]; // CFG_* flags for each word
+	int16_t BlockOf[Kilobyte(4)]; // Index into Blocks of the block holding each word, -1 for unreachable words
+	int EdgeStart[Kilobyte(4) + 1]; // The successors of word N are Edges[EdgeStart[N]] to Edges[EdgeStart[N + 1] - 1]
+	cfg_edge *Edges;
+	int EdgeCount;
+	cfg_block Blocks[Kilobyte(4)];
+	int BlockCount;
+	int ReachableCount;
+} control_flow_graph;
+
+#endif
@@ -0,0 +1,408 @@
+/* File: Reads program images written by --rawhex or --logisim, turns them back into MarieAsm source, and compares them.
+ *
+ * Words are decoded in one pass over the image through a 16 entry table built from Keywords. That pass also marks every address an instruction jumps to or reads and writes through, and each of those gets a label.
+ * A word is written as data instead of an instruction if an instruction reads, writes or stores a return address into it, or if it has bits the instruction's mnemonic can't express. Zero words that nothing points at are left out and skipped over with .SetAddr.
+ * Assembling the output gives back the same image, whichever way each word was written.
+ * Logisim images are decoded straight into the 4096 word program as they are read, a chunk at a time.
+ */
+
+#include "MarieAssembler.h"
+#include "Platform_MarieAssembler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Defined in MarieAssembler.c, after this file is included.
+int fprintfCheck(int *Success, FILE *File, char *FormatStr, ...);
+
+#define LOGISIM_IMAGE_HEADER "v2.0 raw"
+#define IMAGE_READ_CHUNK (Kilobyte(16))
+// Images are compared this many bytes at a time, which is one AVX2 register.
+#define IMAGE_DIFF_CHUNK (32)
+
+// How the 12 bit operand of each instruction is used.
+typedef enum {
+	OPERAND_None, // input, output, halt and clear ignore it
+	OPERAND_Condition, // skipcond
+	OPERAND_Memory, // Read from, written to or read through
+	OPERAND_Jump,
+	OPERAND_Call, // jns stores its return address there, and runs the word after it
+} operand_kind;
+
+global_var const uint8_t OperandKinds[KW_Storei + 1] = {
+	[KW_Jumpstore] = OPERAND_Call,
+	[KW_Load] = OPERAND_Memory,
+	[KW_Store] = OPERAND_Memory,
+	[KW_Add] = OPERAND_Memory,
+	[KW_Sub] = OPERAND_Memory,
+	[KW_Input] = OPERAND_None,
+	[KW_Output] = OPERAND_None,
+	[KW_Halt] = OPERAND_None,
+	[KW_Skipcond] = OPERAND_Condition,
+	[KW_Jump] = OPERAND_Jump,
+	[KW_Clear] = OPERAND_None,
+	[KW_Addi] = OPERAND_Memory,
+	[KW_Jumpi] = OPERAND_Memory,
+	[KW_Loadi] = OPERAND_Memory,
+	[KW_Storei] = OPERAND_Memory,
+};
+
+#define DIS_Instruction (0x1) // Written as its mnemonic, otherwise as data
+#define DIS_Emit (0x2) // Written at all
+#define DIS_CallTarget (0x4)
+#define DIS_MemoryTarget (0x8)
+#define DIS_JumpTarget (0x10)
+#define DIS_Target (DIS_CallTarget | DIS_MemoryTarget | DIS_JumpTarget)
+
+// Where a Logisim image's parser is between calls to LogisimParse(), so a word can be split across two chunks.
+typedef struct {
+	int InComment;
+	int Digits; // Hex digits read since the start of the word or its *, 0 between words
+	int IsDecimal; // Every digit so far was 0-9, so it can still be a count
+	int HasCount;
+	uint32_t Value, Decimal, Count;
+	int Address;
+	uint64_t Offset; // Byte of the file the parser is at
+} logisim_parser;
+
+translation_scope int LogisimFinishWord(logisim_parser *Parser, const char *Name, uint16_t *Program) {
+	if (Parser->Digits == 0 || Parser->Value > 0xFFFF) {
+		printf("[Error Disassemble] \"%s\" has something that isn't a 16 bit word before byte %llu of its Logisim image.\n", Name, (unsigned long long)Parser->Offset);
+		return FALSE;
+	}
+	const uint32_t Count = Parser->HasCount ? Parser->Count : 1;
+	if (Count > (uint32_t)(Kilobyte(4) - Parser->Address)) {
+		printf("[Error Disassemble] \"%s\" holds more than 4096 words, which doesn't fit in Marie's memory.\n", Name);
+		return FALSE;
+	}
+	for (uint32_t Repeat = 0; Repeat < Count; Repeat++) {
+		Program[Parser->Address++] = (uint16_t)Parser->Value;
+	}
+	*Parser = (logisim_parser){.Address = Parser->Address, .Offset = Parser->Offset};
+	return TRUE;
+}
+
+/* Decodes the next Size bytes of a Logisim image into Program. The words are either VALUE or COUNT*VALUE, where COUNT is decimal and VALUE is hex, and # starts a comment.
+ */
+translation_scope int LogisimParse(logisim_parser *Parser, const uint8_t *Data, int Size, const char *Name, uint16_t *Program) {
+	for (int Index = 0; Index < Size; Index++, Parser->Offset++) {
+		const uint8_t Char = Data[Index];
+		if (Parser->InComment) {
+			Parser->InComment = Char != '\n';
+			continue;
+		}
+
+		uint32_t Digit = 0;
+		if (Char >= '0' && Char <= '9') { Digit = Char - '0'; }
+		else if (Char >= 'A' && Char <= 'F') { Digit = Char - 'A' + 0xA; }
+		else if (Char >= 'a' && Char <= 'f') { Digit = Char - 'a' + 0xA; }
+		else if (Char == ' ' || Char == '\t' || Char == '\r' || Char == '\n') {
+			if ((Parser->Digits || Parser->HasCount) && !LogisimFinishWord(Parser, Name, Program)) { return FALSE; }
+			continue;
+		}
+		else if (Char == '#' && Parser->Digits == 0 && !Parser->HasCount) {
+			Parser->InComment = TRUE;
+			continue;
+		}
+		else if (Char == '*' && Parser->Digits && Parser->IsDecimal && !Parser->HasCount) {
+			Parser->HasCount = TRUE;
+			Parser->Count = Parser->Decimal;
+			Parser->Value = 0;
+			Parser->Digits = 0;
+			continue;
+		}
+		else {
+			printf("[Error Disassemble] \"%s\" has something that isn't a 16 bit word at byte %llu of its Logisim image.\n", Name, (unsigned long long)Parser->Offset);
+			return FALSE;
+		}
+
+		if (Parser->Digits == 0) { Parser->IsDecimal = TRUE; }
+		Parser->Digits++;
+		// Both are capped just past anything that fits, so long runs of digits don't wrap around into something that does.
+		Parser->Value = Min(Parser->Value * 0x10 + Digit, 0x10000);
+		Parser->IsDecimal = Parser->IsDecimal && Char <= '9';
+		Parser->Decimal = Min(Parser->Decimal * 10 + Digit, Kilobyte(4) + 1);
+	}
+	return TRUE;
+}
+
+/* Fills Program from an image in either format, Logisim if it starts with LOGISIM_IMAGE_HEADER and raw otherwise. Words a Logisim image leaves out are 0. Closes File.
+ * Returns FALSE and prints why if File isn't an image.
+ */
+translation_scope int LoadProgramImage(FILE *File, const char *Name, uint16_t *Program) {
+	int Success = TRUE;
+	memset(Program, 0, Kilobyte(4) * sizeof(uint16_t));
+
+	const int HeaderLength = strlen(LOGISIM_IMAGE_HEADER);
+	uint8_t *Header = (uint8_t*)Program;
+	const int HeaderRead = fread(Header, 1, HeaderLength, File);
+	if (HeaderRead == HeaderLength && memcmp(Header, LOGISIM_IMAGE_HEADER, HeaderLength) == 0) {
+		memset(Header, 0, HeaderLength);
+		logisim_parser Parser = {.Offset = HeaderLength};
+		uint8_t Chunk[IMAGE_READ_CHUNK];
+		for (size_t Size = 0; Success && (Size = fread(Chunk, 1, sizeof(Chunk), File)) != 0;) {
+			Success = LogisimParse(&Parser, Chunk, Size, Name, Program);
+		}
+		if (Success && (Parser.Digits || Parser.HasCount)) {
+			Success = LogisimFinishWord(&Parser, Name, Program);
+		}
+	}
+	else {
+		// Written by OutputRawHex(), which writes the words as they are in memory. The bytes that were read to look for the header are already in place.
+		const size_t Rest = Kilobyte(4) * sizeof(uint16_t) - HeaderRead;
+		if (HeaderRead != HeaderLength || fread(Header + HeaderRead, 1, Rest, File) != Rest || getc(File) != EOF) {
+			printf("[Error Disassemble] \"%s\" is neither a %d byte raw hex image nor a Logisim image starting with \"%s\".\n", Name, (int)(Kilobyte(4) * sizeof(uint16_t)), LOGISIM_IMAGE_HEADER);
+			Success = FALSE;
+		}
+	}
+	fclose(File);
+	return Success;
+}
+
+/* Reads the names of a symbol table written by OutputSymbolTable() into Names and NameLengths, which are indexed by address. The first name for an address wins.
+ * The names point into Table.
+ */
+translation_scope void ReadSymbolTableNames(const char *Table, const char **Names, int *NameLengths) {
+	const char *At = strchr(Table, '\n'); // The first line is the heading.
+	while (At && *At) {
+		At++;
+		if (At[0] == '|' && At[1] == ' ') {
+			const char *Name = At + 2;
+			int Length = 0;
+			while (Name[Length] && Name[Length] != ' ' && Name[Length] != '\n') { Length++; }
+			const char *Value = Name + Length;
+			while (*Value == ' ') { Value++; }
+			if (Length && Value[0] == '|') {
+				char *End = 0;
+				const long Address = strtol(Value + 1, &End, 16);
+				if (End != Value + 1 && Address >= 0 && Address < Kilobyte(4) && Names[Address] == 0) {
+					Names[Address] = Name;
+					NameLengths[Address] = Length;
+				}
+			}
+		}
+		At = strchr(At, '\n');
+	}
+}
+
+// Which keyword each opcode is, or -1 for an opcode no keyword has.
+translation_scope void BuildOpcodeTable(int *Opcodes) {
+	for (int Index = 0; Index < 16; Index++) { Opcodes[Index] = -1; }
+	for (int Index = 0; Index < KW_COUNT; Index++) {
+		if (Keywords[Index].Opcode != NO_OPCODE) { Opcodes[Keywords[Index].Opcode >> 12] = Index; }
+	}
+}
+
+// If Word's mnemonic says everything about it, so writing the mnemonic assembles back to the same word.
+translation_scope int DecodesExactly(const int *Opcodes, uint16_t Word) {
+	const int Keyword = Opcodes[Word >> 12];
+	const uint16_t X = Word & 0xFFF;
+	if (Keyword == -1) { return FALSE; }
+	switch (OperandKinds[Keyword]) {
+	case OPERAND_None: return X == 0;
+	case OPERAND_Condition: return X == 0x000 || X == 0x400 || X == 0xC00;
+	}
+	return TRUE;
+}
+
+/* Writes Word as an instruction, or as data if AsData is set or DecodesExactly() isn't. Operands are written as their name, or as a hex address if they don't have one.
+ * Returns how many bytes were written.
+ */
+translation_scope int WriteDisassembledWord(int *Success, FILE *Out, const int *Opcodes, uint16_t Word, int AsData, const char **Names, const int *NameLengths) {
+	const uint16_t X = Word & 0xFFF;
+	if (AsData || !DecodesExactly(Opcodes, Word)) {
+		return fprintfCheck(Success, Out, "%s 0x%04X", Keywords[KW_Data].String, Word);
+	}
+
+	const int Keyword = Opcodes[Word >> 12];
+	const char *Mnemonic = Keywords[Keyword].String;
+	switch (OperandKinds[Keyword]) {
+	case OPERAND_None: return fprintfCheck(Success, Out, "%s", Mnemonic);
+	case OPERAND_Condition: return fprintfCheck(Success, Out, "%s %s", Mnemonic, (X == 0x000) ? "lesser" : (X == 0x400) ? "equal" : "greater");
+	}
+	if (Names[X]) { return fprintfCheck(Success, Out, "%s %.*s", Mnemonic, NameLengths[X], Names[X]); }
+	return fprintfCheck(Success, Out, "%s 0x%03X", Mnemonic, X);
+}
+
+// Loads the symbol table for DisassembleMain() and DiffMain(), if there is one. The names point into the returned text, which should be freed.
+translation_scope char* LoadSymbolTableNames(FILE *SymbolFile, int SymbolFileSize, const char **Names, int *NameLengths, int *Success) {
+	char *SymbolTable = 0;
+	if (SymbolFile) {
+		// LoadFileIntoMemory() closes SymbolFile.
+		SymbolTable = LoadFileIntoMemory(SymbolFile, SymbolFileSize, Success);
+		if (*Success) { ReadSymbolTableNames(SymbolTable, Names, NameLengths); }
+	}
+	return SymbolTable;
+}
+
+int DisassembleMain(FILE *InFile, const char *InFileName, FILE *SymbolFile, int SymbolFileSize, FILE *Out) {
+	uint16_t Program[Kilobyte(4)];
+	int Success = LoadProgramImage(InFile, InFileName, Program);
+
+	const char *Names[Kilobyte(4)] = {0};
+	int NameLengths[Kilobyte(4)] = {0};
+	char *SymbolTable = LoadSymbolTableNames(SymbolFile, SymbolFileSize, Names, NameLengths, &Success);
+
+	if (Success) {
+		int Opcodes[16];
+		BuildOpcodeTable(Opcodes);
+
+		uint8_t Flags[Kilobyte(4)] = {0};
+		for (int Address = 0; Address < Kilobyte(4); Address++) {
+			const uint16_t Word = Program[Address];
+			const uint16_t X = Word & 0xFFF;
+			const int Keyword = Opcodes[Word >> 12];
+			if (Word == 0) { continue; } // Most likely memory nothing was put in, so it isn't read as a jns to 0x000.
+			Flags[Address] |= DIS_Emit;
+			if (!DecodesExactly(Opcodes, Word)) { continue; }
+
+			Flags[Address] |= DIS_Instruction;
+			switch (OperandKinds[Keyword]) {
+			case OPERAND_Memory: { Flags[X] |= DIS_MemoryTarget; } break;
+			case OPERAND_Jump: { Flags[X] |= DIS_JumpTarget; } break;
+			case OPERAND_Call: { Flags[X] |= DIS_CallTarget; } break;
+			}
+		}
+
+		// Every label gets defined somewhere, even if that means writing out a zero word, and memory that is read or written is data.
+		int NameWidth = 0;
+		char SynthesizedNames[Kilobyte(4)][16];
+		for (int Address = 0; Address < Kilobyte(4); Address++) {
+			if (Names[Address]) {
+				Flags[Address] |= DIS_Emit;
+			}
+			else if (Flags[Address] & DIS_Target) {
+				// Data words like 0x0001 decode as instructions too, so a word that is read or written is more likely data than a subroutine.
+				const char *Prefix = (Flags[Address] & DIS_MemoryTarget) ? "Data" : (Flags[Address] & DIS_CallTarget) ? "Sub" : "Label";
+				NameLengths[Address] = snprintf(SynthesizedNames[Address], sizeof(SynthesizedNames[Address]), "%s_%03X", Prefix, Address);
+				Names[Address] = SynthesizedNames[Address];
+				Flags[Address] |= DIS_Emit;
+			}
+			if (Flags[Address] & (DIS_CallTarget | DIS_MemoryTarget)) { Flags[Address] &= ~DIS_Instruction; }
+			NameWidth = Max(NameWidth, NameLengths[Address]);
+		}
+
+		// Wide enough for "skipcond greater" and "storei Name", so the .Idents line up.
+		const int InstructionWidth = Max(Keywords[KW_Skipcond].Length + 1 + (int)strlen("greater"), Keywords[KW_Storei].Length + 1 + NameWidth);
+		fprintfCheck(&Success, Out, "/ Disassembled from %s\n", InFileName);
+		int NextAddress = 0;
+		for (int Address = 0; Address < Kilobyte(4) && Success; Address++) {
+			if (!(Flags[Address] & DIS_Emit)) { continue; }
+			if (Address != NextAddress) {
+				fprintfCheck(&Success, Out, "\n.SetAddr 0x%03X\n", Address);
+			}
+			NextAddress = Address + 1;
+
+			const int Written = WriteDisassembledWord(&Success, Out, Opcodes, Program[Address], !(Flags[Address] & DIS_Instruction), Names, NameLengths);
+			if (Names[Address]) {
+				fprintfCheck(&Success, Out, "%*s %s %-*.*s / 0x%03X\n", InstructionWidth - Written, "", Keywords[KW_M_Ident].String, NameWidth, NameLengths[Address], Names[Address], Address);
+			}
+			else {
+				fprintfCheck(&Success, Out, "%*s %*s / 0x%03X\n", InstructionWidth - Written, "", Keywords[KW_M_Ident].Length + 1 + NameWidth, "", Address);
+			}
+		}
+
+		if (Success == FALSE) {
+			printf("[Error Disassemble] There was a error encountered while writing the disassembly!\n");
+		}
+	}
+
+	if (SymbolTable) { free(SymbolTable); }
+	fclose(Out);
+	return Success;
+}
+
+//-----
+//~ Diff
+
+// Sets Differs[Chunk] for every IMAGE_DIFF_CHUNK bytes of the programs that aren't the same.
+translation_scope void FindDifferentChunks(const uint16_t *A, const uint16_t *B, uint8_t *Differs) {
+	const int Words = IMAGE_DIFF_CHUNK / sizeof(uint16_t);
+	for (int Chunk = 0; Chunk < Kilobyte(4) / Words; Chunk++) {
+		uint64_t Different = 0;
+		for (int Index = 0; Index < IMAGE_DIFF_CHUNK / 8; Index++) {
+			uint64_t WordsA, WordsB;
+			memcpy(&WordsA, (const uint8_t*)(A + Chunk * Words) + Index * 8, 8);
+			memcpy(&WordsB, (const uint8_t*)(B + Chunk * Words) + Index * 8, 8);
+			Different |= WordsA ^ WordsB;
+		}
+		Differs[Chunk] = Different != 0;
+	}
+}
+
+#if MARIE_AVX2_SUPPORTED
+translation_scope AVX2_FUNCTION void FindDifferentChunksAvx2(const uint16_t *A, const uint16_t *B, uint8_t *Differs) {
+	const int Words = IMAGE_DIFF_CHUNK / sizeof(uint16_t);
+	for (int Chunk = 0; Chunk < Kilobyte(4) / Words; Chunk++) {
+		const __m256i Equal = _mm256_cmpeq_epi8(LoadLanes(A + Chunk * Words), LoadLanes(B + Chunk * Words));
+		Differs[Chunk] = (uint32_t)_mm256_movemask_epi8(Equal) != 0xFFFFFFFF;
+	}
+}
+#endif
+
+// Prints the words from Start up to End that differ between A and B, with both versions of each disassembled.
+translation_scope void PrintDiffRange(int *Success, int Start, int End, const uint16_t *A, const uint16_t *B, const int *Opcodes, const char **Names, const int *NameLengths) {
+	if (End - Start == 1) { fprintfCheck(Success, stdout, "0x%03X differs:\n", Start); }
+	else { fprintfCheck(Success, stdout, "0x%03X to 0x%03X differ:\n", Start, End - 1); }
+	for (int Address = Start; Address < End; Address++) {
+		fprintfCheck(Success, stdout, "  0x%03X", Address);
+		if (Names[Address]) { fprintfCheck(Success, stdout, " %.*s", NameLengths[Address], Names[Address]); }
+		fprintfCheck(Success, stdout, "\n    - 0x%04X ", A[Address]);
+		WriteDisassembledWord(Success, stdout, Opcodes, A[Address], FALSE, Names, NameLengths);
+		fprintfCheck(Success, stdout, "\n    + 0x%04X ", B[Address]);
+		WriteDisassembledWord(Success, stdout, Opcodes, B[Address], FALSE, Names, NameLengths);
+		fprintfCheck(Success, stdout, "\n");
+	}
+}
+
+int DiffMain(FILE *FileA, const char *NameA, FILE *FileB, const char *NameB, FILE *SymbolFile, int SymbolFileSize) {
+	uint16_t A[Kilobyte(4)], B[Kilobyte(4)];
+	int Success = LoadProgramImage(FileA, NameA, A);
+	Success = LoadProgramImage(FileB, NameB, B) && Success;
+
+	const char *Names[Kilobyte(4)] = {0};
+	int NameLengths[Kilobyte(4)] = {0};
+	char *SymbolTable = LoadSymbolTableNames(SymbolFile, SymbolFileSize, Names, NameLengths, &Success);
+	if (!Success) {
+		if (SymbolTable) { free(SymbolTable); }
+		return DIFF_Error;
+	}
+
+	const int Words = IMAGE_DIFF_CHUNK / sizeof(uint16_t);
+	uint8_t Differs[Kilobyte(4) / (IMAGE_DIFF_CHUNK / sizeof(uint16_t))];
+#if MARIE_AVX2_SUPPORTED
+	if (HostSupportsAvx2()) { FindDifferentChunksAvx2(A, B, Differs); }
+	else { FindDifferentChunks(A, B, Differs); }
+#else
+	FindDifferentChunks(A, B, Differs);
+#endif
+
+	int Opcodes[16];
+	BuildOpcodeTable(Opcodes);
+
+	// Only the chunks that differ are looked at word by word. A range can carry on from one chunk into the next.
+	int RangeCount = 0, RangeStart = -1;
+	for (int Chunk = 0; Chunk < Kilobyte(4) / Words && Success; Chunk++) {
+		for (int Address = Chunk * Words; Address < (Chunk + 1) * Words; Address++) {
+			const int Different = Differs[Chunk] && A[Address] != B[Address];
+			if (Different && RangeStart == -1) {
+				RangeStart = Address;
+			}
+			else if (!Different && RangeStart != -1) {
+				PrintDiffRange(&Success, RangeStart, Address, A, B, Opcodes, Names, NameLengths);
+				RangeStart = -1;
+				RangeCount++;
+			}
+			if (!Differs[Chunk]) { break; }
+		}
+	}
+	if (RangeStart != -1) {
+		PrintDiffRange(&Success, RangeStart, Kilobyte(4), A, B, Opcodes, Names, NameLengths);
+		RangeCount++;
+	}
+
+	if (SymbolTable) { free(SymbolTable); }
+	if (!Success) { return DIFF_Error; }
+	return RangeCount ? DIFF_Different : DIFF_Same;
+}
@@ -0,0 +1,133 @@
+/* File: The loop that runs a lockstep group. Lockstep_MarieAssembler.c includes this once for each set of lane operations, so the operations are inlined into the loop instead of being called through pointers.
+ * Before each include, LaneOp(Name) is defined to give the name of a lane operation in that set, and LOCKSTEP_FUNCTION to the attributes the operations need.
+ * The loop is named LaneOp(RunLockstepGroup).
+ */
+
+translation_scope LOCKSTEP_FUNCTION void LaneOp(RunLockstepGroup)(lockstep_group *Group) {
+	uint16_t (*Memory)[LOCKSTEP_LANES] = Group->Memory;
+	uint16_t *AC = Group->AC;
+	uint8_t *MayDiffer = Group->MayDiffer;
+	const uint64_t Budget = Group->InstructionBudget ? Group->InstructionBudget : UINT64_MAX;
+
+	while (Group->ActiveLanes) {
+		const uint16_t PC = Group->PC;
+		if (Group->InstructionCount >= Budget) {
+			LeaveLockstepAll(Group, PC, 0, SIM_BudgetExhausted);
+			break;
+		}
+		// A lane on its own runs faster in the interpreter.
+		if (Group->ActiveLaneCount == 1) {
+			LeaveLockstepAll(Group, PC, 0, SIM_Running);
+			break;
+		}
+
+		// A lane that stored over this instruction runs something else here. One compare across the lanes finds them.
+		uint16_t *Row = Memory[PC];
+		const uint16_t Instruction = Row[Group->Leader];
+		if (MayDiffer[PC]) {
+			for (uint32_t Stray = Group->ActiveLanes & ~LaneOp(LanesEqualMask)(Row, Instruction); Stray; Stray &= Stray - 1) {
+				LeaveLockstep(Group, CountTrailingZeros64(Stray), PC, 0, SIM_Running);
+			}
+		}
+
+		const uint16_t X = Instruction & 0xFFF;
+		uint16_t Next = (PC + 1) & 0xFFF;
+
+		switch (Instruction >> 12) {
+		case 0x0: { // jns
+			LaneOp(LanesFill)(Memory[X], Next);
+			MayDiffer[X] = FALSE;
+			Group->DirtyPages |= (uint64_t)1 << (X / MACHINE_PAGE_WORDS);
+			Next = (X + 1) & 0xFFF;
+		} break;
+		case 0x1: { LaneOp(LanesLoad)(AC, Memory[X]); } break; // load
+		case 0x2: { // store
+			LaneOp(LanesStore)(Memory[X], AC);
+			MayDiffer[X] = (LaneOp(LanesEqualMask)(AC, AC[Group->Leader]) & Group->ActiveLanes) != Group->ActiveLanes;
+			Group->DirtyPages |= (uint64_t)1 << (X / MACHINE_PAGE_WORDS);
+		} break;
+		case 0x3: { LaneOp(LanesAdd)(AC, Memory[X]); } break; // add
+		case 0x4: { LaneOp(LanesSubt)(AC, Memory[X]); } break; // subt
+		case 0x5: { // input
+			for (int Lane = 0; Lane < LOCKSTEP_LANES; Lane++) {
+				if ((Group->ActiveLanes & ((uint32_t)1 << Lane)) && !ReadMachineInput(Group->Lanes[Lane], &AC[Lane])) {
+					LeaveLockstep(Group, Lane, PC, 0, SIM_InputExhausted);
+				}
+			}
+		} break;
+		case 0x6: { // output
+			for (int Lane = 0; Lane < LOCKSTEP_LANES; Lane++) {
+				if (Group->ActiveLanes & ((uint32_t)1 << Lane)) {
+					WriteMachineOutput(Group->Lanes[Lane], AC[Lane]);
+				}
+			}
+		} break;
+		case 0x7: { LeaveLockstepAll(Group, PC, 1, SIM_Halted); } continue; // halt
+		case 0x8: { // skipcond
+			const uint32_t Skip = LaneOp(LanesSkipMask)(AC, (X >> 10) & 0x3) & Group->ActiveLanes;
+			if (Skip == Group->ActiveLanes) {
+				Next = (Next + 1) & 0xFFF;
+			}
+			else if (Skip) {
+				// The lanes went both ways. Whichever way fewer of them went leaves the group.
+				const int SkippersStay = PopCount64(Skip) * 2 > Group->ActiveLaneCount;
+				const uint16_t LeavingNext = SkippersStay ? Next : (Next + 1) & 0xFFF;
+				for (uint32_t Leaving = SkippersStay ? Group->ActiveLanes & ~Skip : Skip; Leaving; Leaving &= Leaving - 1) {
+					LeaveLockstep(Group, CountTrailingZeros64(Leaving), LeavingNext, 1, SIM_Running);
+				}
+				if (SkippersStay) { Next = (Next + 1) & 0xFFF; }
+			}
+		} break;
+		case 0x9: { Next = X; } break; // jump
+		case 0xA: { LaneOp(LanesFill)(AC, 0); } break; // clear
+		/* The indirect instructions go through the word at X. While every lane holds the same address there, they are as cheap as their direct versions.
+		 * Otherwise each lane goes its own way. Lanes that already left hold nothing that matters, so they get no special care.
+		 */
+		case 0xB: { // addi
+			if (!MayDiffer[X]) {
+				LaneOp(LanesAdd)(AC, Memory[Memory[X][Group->Leader] & 0xFFF]);
+			}
+			else {
+				for (int Lane = 0; Lane < LOCKSTEP_LANES; Lane++) { AC[Lane] += Memory[Memory[X][Lane] & 0xFFF][Lane]; }
+			}
+		} break;
+		case 0xC: { // jumpi
+			Next = Memory[X][Group->Leader] & 0xFFF;
+			if (MayDiffer[X]) {
+				for (uint32_t Stray = Group->ActiveLanes & ~LaneOp(LanesAddressEqualMask)(Memory[X], Next); Stray; Stray &= Stray - 1) {
+					const int Lane = CountTrailingZeros64(Stray);
+					LeaveLockstep(Group, Lane, Memory[X][Lane] & 0xFFF, 1, SIM_Running);
+				}
+			}
+		} break;
+		case 0xD: { // loadi
+			if (!MayDiffer[X]) {
+				LaneOp(LanesLoad)(AC, Memory[Memory[X][Group->Leader] & 0xFFF]);
+			}
+			else {
+				for (int Lane = 0; Lane < LOCKSTEP_LANES; Lane++) { AC[Lane] = Memory[Memory[X][Lane] & 0xFFF][Lane]; }
+			}
+		} break;
+		case 0xE: { // storei
+			if (!MayDiffer[X]) {
+				const uint16_t Address = Memory[X][Group->Leader] & 0xFFF;
+				LaneOp(LanesStore)(Memory[Address], AC);
+				MayDiffer[Address] = (LaneOp(LanesEqualMask)(AC, AC[Group->Leader]) & Group->ActiveLanes) != Group->ActiveLanes;
+				Group->DirtyPages |= (uint64_t)1 << (Address / MACHINE_PAGE_WORDS);
+			}
+			else {
+				for (int Lane = 0; Lane < LOCKSTEP_LANES; Lane++) {
+					const uint16_t Address = Memory[X][Lane] & 0xFFF;
+					Memory[Address][Lane] = AC[Lane];
+					MayDiffer[Address] = TRUE;
+					Group->DirtyPages |= (uint64_t)1 << (Address / MACHINE_PAGE_WORDS);
+				}
+			}
+		} break;
+		default: { LeaveLockstepAll(Group, PC, 0, SIM_IllegalInstruction); } continue;
+		}
+
+		Group->PC = Next;
+		Group->InstructionCount++;
+	}
+}
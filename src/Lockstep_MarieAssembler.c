@@ -0,0 +1,433 @@
+/* File: Runs many copies of one program at once, for fuzzing it with lots of different inputs.
+ * Every copy runs the same code and usually takes the same path through it, so the copies share one PC and their ACs and memories sit side by side in 16 bit lanes.
+ * load, store, add, subt and friends then run for every lane with a single AVX2 instruction. Lanes that go their own way leave the group and finish in the interpreter.
+ */
+
+#include "MarieAssembler.h"
+#include "Platform_MarieAssembler.h"
+#include "Simulator_MarieAssembler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+# define MARIE_AVX2_SUPPORTED 1
+# include <immintrin.h>
+#else
+# define MARIE_AVX2_SUPPORTED 0
+#endif
+
+// Lets one function use AVX2 while the rest of the program is built for plain x86-64. MSVC allows the intrinsics anywhere.
+#if defined(__GNUC__)
+# define AVX2_FUNCTION __attribute__((target("avx2")))
+#else
+# define AVX2_FUNCTION
+#endif
+
+//-----
+//~ Lane operations
+//
+// Each set is inlined into its own build of the group loop, see LockstepGroup_MarieAssembler.c. AC and Row always point at LOCKSTEP_LANES words.
+
+translation_scope force_inline void LanesFill(uint16_t *Row, uint16_t Value) {
+	for (int Lane = 0; Lane < LOCKSTEP_LANES; Lane++) { Row[Lane] = Value; }
+}
+
+translation_scope force_inline void LanesLoad(uint16_t *AC, const uint16_t *Row) {
+	for (int Lane = 0; Lane < LOCKSTEP_LANES; Lane++) { AC[Lane] = Row[Lane]; }
+}
+
+translation_scope force_inline void LanesStore(uint16_t *Row, const uint16_t *AC) {
+	for (int Lane = 0; Lane < LOCKSTEP_LANES; Lane++) { Row[Lane] = AC[Lane]; }
+}
+
+translation_scope force_inline void LanesAdd(uint16_t *AC, const uint16_t *Row) {
+	for (int Lane = 0; Lane < LOCKSTEP_LANES; Lane++) { AC[Lane] += Row[Lane]; }
+}
+
+translation_scope force_inline void LanesSubt(uint16_t *AC, const uint16_t *Row) {
+	for (int Lane = 0; Lane < LOCKSTEP_LANES; Lane++) { AC[Lane] -= Row[Lane]; }
+}
+
+translation_scope force_inline uint32_t LanesEqualMask(const uint16_t *Row, uint16_t Value) {
+	uint32_t Mask = 0;
+	for (int Lane = 0; Lane < LOCKSTEP_LANES; Lane++) { Mask |= (uint32_t)(Row[Lane] == Value) << Lane; }
+	return Mask;
+}
+
+// Which lanes hold an address equal to Target, in the low 12 bits the indirect instructions use.
+translation_scope force_inline uint32_t LanesAddressEqualMask(const uint16_t *Row, uint16_t Target) {
+	uint32_t Mask = 0;
+	for (int Lane = 0; Lane < LOCKSTEP_LANES; Lane++) { Mask |= (uint32_t)((Row[Lane] & 0xFFF) == Target) << Lane; }
+	return Mask;
+}
+
+// Same conditions as skipcond in StepInstruction().
+translation_scope force_inline uint32_t LanesSkipMask(const uint16_t *AC, int Condition) {
+	uint32_t Mask = 0;
+	for (int Lane = 0; Lane < LOCKSTEP_LANES; Lane++) {
+		const int16_t Value = (int16_t)AC[Lane];
+		const int Skip = (Condition == 0 && Value < 0) || (Condition == 1 && Value == 0) || (Condition >= 2 && Value > 0);
+		Mask |= (uint32_t)Skip << Lane;
+	}
+	return Mask;
+}
+
+#if MARIE_AVX2_SUPPORTED
+
+#define LoadLanes(Pointer) _mm256_loadu_si256((const __m256i*)(Pointer))
+#define StoreLanes(Pointer, Value) _mm256_storeu_si256((__m256i*)(Pointer), (Value))
+
+translation_scope force_inline AVX2_FUNCTION void LanesFillAvx2(uint16_t *Row, uint16_t Value) {
+	StoreLanes(Row, _mm256_set1_epi16((short)Value));
+}
+
+translation_scope force_inline AVX2_FUNCTION void LanesLoadAvx2(uint16_t *AC, const uint16_t *Row) {
+	StoreLanes(AC, LoadLanes(Row));
+}
+
+translation_scope force_inline AVX2_FUNCTION void LanesStoreAvx2(uint16_t *Row, const uint16_t *AC) {
+	StoreLanes(Row, LoadLanes(AC));
+}
+
+translation_scope force_inline AVX2_FUNCTION void LanesAddAvx2(uint16_t *AC, const uint16_t *Row) {
+	StoreLanes(AC, _mm256_add_epi16(LoadLanes(AC), LoadLanes(Row)));
+}
+
+translation_scope force_inline AVX2_FUNCTION void LanesSubtAvx2(uint16_t *AC, const uint16_t *Row) {
+	StoreLanes(AC, _mm256_sub_epi16(LoadLanes(AC), LoadLanes(Row)));
+}
+
+// Packs a 0x0000 or 0xFFFF per lane compare result down to one bit per lane.
+translation_scope force_inline AVX2_FUNCTION uint32_t LaneMaskAvx2(__m256i Compare) {
+	const __m128i Packed = _mm_packs_epi16(_mm256_castsi256_si128(Compare), _mm256_extracti128_si256(Compare, 1));
+	return (uint32_t)_mm_movemask_epi8(Packed);
+}
+
+translation_scope force_inline AVX2_FUNCTION uint32_t LanesEqualMaskAvx2(const uint16_t *Row, uint16_t Value) {
+	return LaneMaskAvx2(_mm256_cmpeq_epi16(LoadLanes(Row), _mm256_set1_epi16((short)Value)));
+}
+
+translation_scope force_inline AVX2_FUNCTION uint32_t LanesAddressEqualMaskAvx2(const uint16_t *Row, uint16_t Target) {
+	const __m256i Addresses = _mm256_and_si256(LoadLanes(Row), _mm256_set1_epi16(0xFFF));
+	return LaneMaskAvx2(_mm256_cmpeq_epi16(Addresses, _mm256_set1_epi16((short)Target)));
+}
+
+translation_scope force_inline AVX2_FUNCTION uint32_t LanesSkipMaskAvx2(const uint16_t *AC, int Condition) {
+	const __m256i Value = LoadLanes(AC);
+	const __m256i Zero = _mm256_setzero_si256();
+	if (Condition == 0) { return LaneMaskAvx2(_mm256_cmpgt_epi16(Zero, Value)); }
+	if (Condition == 1) { return LaneMaskAvx2(_mm256_cmpeq_epi16(Value, Zero)); }
+	return LaneMaskAvx2(_mm256_cmpgt_epi16(Value, Zero));
+}
+
+translation_scope int HostSupportsAvx2() {
+#if defined(_MSC_VER)
+	int Info[4];
+	__cpuid(Info, 0);
+	if (Info[0] < 7) { return FALSE; }
+	__cpuid(Info, 1);
+	if (!(Info[2] & (1 << 27))) { return FALSE; } // The OS has to use xsave...
+	if ((_xgetbv(0) & 0x6) != 0x6) { return FALSE; } // ...and save the upper halves of the ymm registers.
+	__cpuidex(Info, 7, 0);
+	return (Info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#else
+
+translation_scope int HostSupportsAvx2() {
+	return FALSE;
+}
+
+#endif
+
+//-----
+//~ Lockstep groups
+
+/* Hands Lane over to its own machine, with PC and Status as given and Executed more instructions than the group has run.
+ * A lane that is still running finishes in the interpreter right away.
+ */
+translation_scope void LeaveLockstep(lockstep_group *Group, int Lane, uint16_t PC, int Executed, simulation_status Status) {
+	marie_machine *Machine = Group->Lanes[Lane];
+	memcpy(Machine->Memory, Group->Program, sizeof(Machine->Memory));
+	for (int Page = 0; Page < 64; Page++) {
+		if (!(Group->DirtyPages & ((uint64_t)1 << Page))) { continue; }
+		for (int Address = Page * MACHINE_PAGE_WORDS; Address < (Page + 1) * MACHINE_PAGE_WORDS; Address++) {
+			Machine->Memory[Address] = Group->Memory[Address][Lane];
+		}
+	}
+	Machine->AC = Group->AC[Lane];
+	Machine->PC = PC;
+	Machine->Status = Status;
+	Machine->InstructionCount = Group->InstructionCount + Executed;
+	Machine->InstructionBudget = Group->InstructionBudget;
+	Machine->DirtyPages = Group->DirtyPages;
+	Group->LaneInstructions += Group->InstructionCount + Executed;
+
+	Group->ActiveLanes &= ~((uint32_t)1 << Lane);
+	Group->ActiveLaneCount--;
+	while (Group->ActiveLanes && !(Group->ActiveLanes & ((uint32_t)1 << Group->Leader))) {
+		Group->Leader++;
+	}
+
+	if (Status == SIM_Running) {
+		// The last lane leaving while it is still running is only handed over, nothing went another way.
+		if (Group->ActiveLanes) { Group->Divergences++; }
+		RunInterpreter(Machine);
+	}
+}
+
+translation_scope void LeaveLockstepAll(lockstep_group *Group, uint16_t PC, int Executed, simulation_status Status) {
+	for (uint32_t Leaving = Group->ActiveLanes; Leaving; Leaving &= Leaving - 1) {
+		LeaveLockstep(Group, CountTrailingZeros64(Leaving), PC, Executed, Status);
+	}
+}
+
+// The group loop, built on the plain C lane operations and then on the AVX2 ones.
+#define LaneOp(Name) Name
+#define LOCKSTEP_FUNCTION
+#include "LockstepGroup_MarieAssembler.c"
+#undef LaneOp
+#undef LOCKSTEP_FUNCTION
+
+global_var const lockstep_engine ScalarLockstep = {"scalar", RunLockstepGroup};
+
+#if MARIE_AVX2_SUPPORTED
+#define LaneOp(Name) Name##Avx2
+#define LOCKSTEP_FUNCTION AVX2_FUNCTION
+#include "LockstepGroup_MarieAssembler.c"
+#undef LaneOp
+#undef LOCKSTEP_FUNCTION
+
+global_var const lockstep_engine Avx2Lockstep = {"AVX2", RunLockstepGroupAvx2};
+#endif
+
+translation_scope lockstep_group* CreateLockstepGroup(int UseVector) {
+	lockstep_group *Group = calloc(1, sizeof(lockstep_group));
+	Group->Memory = calloc(Kilobyte(4), sizeof(*Group->Memory));
+	Group->Engine = &ScalarLockstep;
+#if MARIE_AVX2_SUPPORTED
+	if (UseVector && HostSupportsAvx2()) { Group->Engine = &Avx2Lockstep; }
+#endif
+	return Group;
+}
+
+translation_scope void FreeLockstepGroup(lockstep_group *Group) {
+	free(Group->Memory);
+	free(Group);
+}
+
+translation_scope void RunLockstep(lockstep_group *Group, const uint16_t *Program, marie_machine **Lanes, int LaneCount) {
+	// Only refill the pages the last run stored into, unless this is a different program.
+	uint64_t RefillPages = Group->DirtyPages;
+	if (memcmp(Group->Program, Program, sizeof(Group->Program)) != 0) {
+		memcpy(Group->Program, Program, sizeof(Group->Program));
+		RefillPages = ~(uint64_t)0;
+	}
+	for (int Page = 0; Page < 64; Page++) {
+		if (!(RefillPages & ((uint64_t)1 << Page))) { continue; }
+		for (int Address = Page * MACHINE_PAGE_WORDS; Address < (Page + 1) * MACHINE_PAGE_WORDS; Address++) {
+			LanesFill(Group->Memory[Address], Program[Address]);
+		}
+		memset(&Group->MayDiffer[Page * MACHINE_PAGE_WORDS], 0, MACHINE_PAGE_WORDS);
+	}
+	Group->DirtyPages = 0;
+	LanesFill(Group->AC, 0);
+	Group->PC = 0;
+	Group->InstructionCount = 0;
+	Group->ActiveLanes = ((uint32_t)1 << LaneCount) - 1;
+	Group->ActiveLaneCount = LaneCount;
+	Group->Leader = 0;
+	for (int Lane = 0; Lane < LaneCount; Lane++) {
+		Group->Lanes[Lane] = Lanes[Lane];
+		Lanes[Lane]->InputAt = 0;
+		Lanes[Lane]->OutputCount = 0;
+	}
+
+	Group->Engine->Run(Group);
+}
+
+//-----
+//~ Fuzzing
+
+// Each fuzzing run gets this many random input values. Reading past them ends the run.
+#define FUZZ_INPUTS_PER_RUN (16)
+#define FUZZ_BUDGET (100000)
+// How many runs that didn't halt are shown as examples.
+#define FUZZ_EXAMPLES (5)
+
+// What a run ended with, compared between engines.
+typedef struct {
+	simulation_status Status;
+	uint16_t AC, PC;
+	int InputsRead;
+	uint64_t InstructionCount;
+	uint64_t Hash; // Of memory and output
+} fuzz_result;
+
+translation_scope uint64_t NextFuzzRandom(uint64_t *State) {
+	// xorshift64
+	uint64_t Value = *State;
+	Value ^= Value << 13;
+	Value ^= Value >> 7;
+	Value ^= Value << 17;
+	*State = Value;
+	return Value;
+}
+
+translation_scope uint64_t HashWords(uint64_t Hash, const uint16_t *Words, int Count) {
+	// FNV-1a
+	for (int Index = 0; Index < Count; Index++) {
+		Hash = (Hash ^ Words[Index]) * 0x100000001B3ull;
+	}
+	return Hash;
+}
+
+translation_scope fuzz_result SummarizeRun(const marie_machine *Machine) {
+	fuzz_result Result = {
+		.Status = Machine->Status,
+		.AC = Machine->AC,
+		.PC = Machine->PC,
+		.InputsRead = Machine->InputAt,
+		.InstructionCount = Machine->InstructionCount,
+	};
+	Result.Hash = HashWords(0xCBF29CE484222325ull, Machine->Memory, Kilobyte(4));
+	Result.Hash = HashWords(Result.Hash, Machine->Output, Machine->OutputCount);
+	return Result;
+}
+
+/* Runs every set of Inputs through Program, LOCKSTEP_LANES runs at a time, and fills in Results.
+ * Group is 0 to run them one at a time in the interpreter instead. Returns how many seconds the runs themselves took.
+ */
+translation_scope double RunFuzzInputs(lockstep_group *Group, const uint16_t *Program, const uint16_t *Inputs, int RunCount, fuzz_result *Results) {
+	double Seconds = 0;
+	marie_machine *Machines[LOCKSTEP_LANES];
+	for (int Lane = 0; Lane < LOCKSTEP_LANES; Lane++) {
+		Machines[Lane] = calloc(1, sizeof(marie_machine));
+		Machines[Lane]->InputCount = FUZZ_INPUTS_PER_RUN;
+		Machines[Lane]->InstructionBudget = FUZZ_BUDGET;
+	}
+
+	for (int First = 0; First < RunCount; First += LOCKSTEP_LANES) {
+		const int LaneCount = Min(LOCKSTEP_LANES, RunCount - First);
+		for (int Lane = 0; Lane < LaneCount; Lane++) {
+			Machines[Lane]->Input = Inputs + (First + Lane) * FUZZ_INPUTS_PER_RUN;
+		}
+
+		const double Start = Platform_GetSeconds();
+		if (Group) {
+			Group->InstructionBudget = FUZZ_BUDGET;
+			RunLockstep(Group, Program, Machines, LaneCount);
+		}
+		else {
+			for (int Lane = 0; Lane < LaneCount; Lane++) {
+				ResetMachine(Machines[Lane], Program);
+				RunInterpreter(Machines[Lane]);
+			}
+		}
+		Seconds += Platform_GetSeconds() - Start;
+
+		for (int Lane = 0; Lane < LaneCount; Lane++) {
+			Results[First + Lane] = SummarizeRun(Machines[Lane]);
+		}
+	}
+
+	for (int Lane = 0; Lane < LOCKSTEP_LANES; Lane++) {
+		free(Machines[Lane]->Output);
+		free(Machines[Lane]);
+	}
+	return Seconds;
+}
+
+translation_scope int FuzzResultsMatch(const fuzz_result *A, const fuzz_result *B, int RunCount) {
+	for (int Index = 0; Index < RunCount; Index++) {
+		if (A[Index].Status != B[Index].Status || A[Index].AC != B[Index].AC || A[Index].PC != B[Index].PC ||
+		    A[Index].InputsRead != B[Index].InputsRead || A[Index].InstructionCount != B[Index].InstructionCount ||
+		    A[Index].Hash != B[Index].Hash) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+int FuzzMain(FILE *InFile, int InFileSize, const char *InFileName, int RunCount, int DiagnosticFormat) {
+	int Success = TRUE;
+	assembler_context *Context = CreateAssemblerContext();
+	Context->SourcePath = InFileName;
+	char *Source = LoadFileIntoMemory(InFile, InFileSize, &Success);
+	if (Success) {
+		Success = AssembleSource(Context, Source);
+		OutputDiagnostics(Context, InFileName, DiagnosticFormat, stdout);
+	}
+	else if (Source) { free(Source); }
+
+	if (Success) {
+		// A fixed seed, so a run that misbehaves shows up again next time.
+		uint64_t Random = 0x9E3779B97F4A7C15ull;
+		uint16_t *Inputs = malloc((size_t)RunCount * FUZZ_INPUTS_PER_RUN * sizeof(*Inputs));
+		for (int Index = 0; Index < RunCount * FUZZ_INPUTS_PER_RUN; Index++) {
+			// Mostly small numbers, which is what programs tend to branch on, with some from anywhere in the 16 bit range.
+			const uint64_t Value = NextFuzzRandom(&Random);
+			Inputs[Index] = (Value & 0x3) ? (uint16_t)((int)((Value >> 8) % 201) - 100) : (uint16_t)(Value >> 16);
+		}
+
+		fuzz_result *Interpreted = calloc(RunCount, sizeof(fuzz_result));
+		fuzz_result *Lockstep = calloc(RunCount, sizeof(fuzz_result));
+		const double InterpreterSeconds = RunFuzzInputs(0, Context->Program, Inputs, RunCount, Interpreted);
+
+		int Counts[SIM_IllegalInstruction + 1] = {0};
+		for (int Index = 0; Index < RunCount; Index++) {
+			Counts[Interpreted[Index].Status]++;
+		}
+		printf("[Fuzz] %d runs with %d random inputs each. %d halted, %d ran out of input, %d ran out of their %d instruction budget, %d hit an illegal instruction\n",
+		       RunCount, FUZZ_INPUTS_PER_RUN, Counts[SIM_Halted], Counts[SIM_InputExhausted], Counts[SIM_BudgetExhausted], FUZZ_BUDGET, Counts[SIM_IllegalInstruction]);
+
+		int Examples = 0;
+		for (int Index = 0; Index < RunCount && Examples < FUZZ_EXAMPLES; Index++) {
+			const fuzz_result *Result = &Interpreted[Index];
+			if (Result->Status == SIM_Halted || Result->Status == SIM_InputExhausted) { continue; }
+			printf("[Fuzz] %s at PC 0x%03X with inputs", SimulationStatusNames[Result->Status], Result->PC);
+			for (int Input = 0; Input < Result->InputsRead; Input++) {
+				printf(" %d", (int16_t)Inputs[Index * FUZZ_INPUTS_PER_RUN + Input]);
+			}
+			printf("\n");
+			Examples++;
+		}
+		printf("[Interpreter] %.3f seconds, %.0f runs per second\n", InterpreterSeconds, RunCount / InterpreterSeconds);
+
+		// The plain C lanes show what the lockstep bookkeeping costs by itself, the AVX2 lanes what vectorizing buys on top.
+		for (int UseVector = 0; UseVector <= 1 && Success; UseVector++) {
+			lockstep_group *Group = CreateLockstepGroup(UseVector);
+			if (UseVector && Group->Engine == &ScalarLockstep) {
+				printf("[Lockstep] This host doesn't support AVX2, only the plain C lanes were run.\n");
+				FreeLockstepGroup(Group);
+				break;
+			}
+
+			const double Seconds = RunFuzzInputs(Group, Context->Program, Inputs, RunCount, Lockstep);
+			uint64_t TotalInstructions = 0;
+			for (int Index = 0; Index < RunCount; Index++) { TotalInstructions += Lockstep[Index].InstructionCount; }
+			printf("[Lockstep %s] %.3f seconds, %.0f runs per second, %.1fx the interpreter. %.1f%% of instructions ran in lockstep, %llu lanes diverged\n",
+			       Group->Engine->Name, Seconds, RunCount / Seconds, InterpreterSeconds / Seconds,
+			       TotalInstructions ? 100.0 * Group->LaneInstructions / TotalInstructions : 100.0, (unsigned long long)Group->Divergences);
+
+			if (!FuzzResultsMatch(Interpreted, Lockstep, RunCount)) {
+				printf("[Lockstep %s] The interpreter and the lockstep engine disagree about how this program ran! Please report this as a bug.\n", Group->Engine->Name);
+				Success = FALSE;
+			}
+			FreeLockstepGroup(Group);
+		}
+
+		free(Lockstep);
+		free(Interpreted);
+		free(Inputs);
+	}
+
+	FreeAssemblerContext(Context);
+	return Success;
+}
@@ -0,0 +1,693 @@
+/* File: Language Server Protocol front end.
+ * Speaks JSON-RPC over a pair of streams, keeps every open document assembled, and answers editor queries from the symbol index built by Assemble().
+ */
+
+#include "MarieAssembler.h"
+#include "Platform_MarieAssembler.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Defined in MarieAssembler.c, after this file is included.
+translation_scope int SourceOffsetOf(const assembler_context *Context, const char *At);
+
+//-----
+//~ Minimal JSON reader
+
+enum json_kind {
+	JSON_Null,
+	JSON_False,
+	JSON_True,
+	JSON_Number,
+	JSON_String,
+	JSON_Array,
+	JSON_Object,
+};
+
+typedef struct json_value json_value;
+
+struct json_value {
+	int Kind;
+	// For strings this is the decoded text, for everything else it is the raw text of the value. Not null terminated.
+	char *Text;
+	int TextLength;
+	double Number;
+	// Set on members of an object.
+	char *Key;
+	int KeyLength;
+	json_value *FirstChild;
+	json_value *NextSibling;
+};
+
+typedef struct {
+	char *At;
+	char *End;
+	paged_list *Nodes;
+	int DidErrorOccur;
+} json_parser;
+
+translation_scope void JsonSkipWhitespace(json_parser *Parser) {
+	while (Parser->At < Parser->End &&
+	       (Parser->At[0] == ' ' || Parser->At[0] == '\t' || Parser->At[0] == '\r' || Parser->At[0] == '\n')) {
+		Parser->At++;
+	}
+}
+
+translation_scope int JsonHexDigit(char Digit) {
+	if (Digit >= '0' && Digit <= '9') { return Digit - '0'; }
+	if (Digit >= 'a' && Digit <= 'f') { return Digit - 'a' + 0xA; }
+	if (Digit >= 'A' && Digit <= 'F') { return Digit - 'A' + 0xA; }
+	return -1;
+}
+
+translation_scope uint32_t JsonReadHex4(json_parser *Parser) {
+	uint32_t Result = 0;
+	for (int Index = 0; Index < 4; Index++) {
+		int Digit = (Parser->At < Parser->End) ? JsonHexDigit(Parser->At[0]) : -1;
+		if (Digit == -1) { Parser->DidErrorOccur = TRUE; return 0; }
+		Result = (Result << 4) | Digit;
+		Parser->At++;
+	}
+	return Result;
+}
+
+/* Decodes the string starting at Parser->At (just past the opening quote) in place. Escapes never grow, so the decoded text fits where the encoded text was.
+ */
+translation_scope void JsonParseString(json_parser *Parser, char **Text, int *TextLength) {
+	char *Write = Parser->At;
+	*Text = Write;
+	while (Parser->At < Parser->End && Parser->At[0] != '"') {
+		if (Parser->At[0] != '\\') {
+			*Write++ = *Parser->At++;
+			continue;
+		}
+
+		Parser->At++;
+		if (Parser->At >= Parser->End) { break; }
+		char Escape = *Parser->At++;
+		switch (Escape) {
+		case('"'): *Write++ = '"'; break;
+		case('\\'): *Write++ = '\\'; break;
+		case('/'): *Write++ = '/'; break;
+		case('b'): *Write++ = '\b'; break;
+		case('f'): *Write++ = '\f'; break;
+		case('n'): *Write++ = '\n'; break;
+		case('r'): *Write++ = '\r'; break;
+		case('t'): *Write++ = '\t'; break;
+		case('u'): {
+			uint32_t CodePoint = JsonReadHex4(Parser);
+			if ((CodePoint & 0xFC00) == 0xD800 && Parser->End - Parser->At >= 6 && Parser->At[0] == '\\' && Parser->At[1] == 'u') {
+				Parser->At += 2;
+				uint32_t LowSurrogate = JsonReadHex4(Parser);
+				CodePoint = 0x10000 + ((CodePoint & 0x03FF) << 10) + (LowSurrogate & 0x03FF);
+			}
+
+			if (CodePoint <= 0x7F) {
+				*Write++ = (char)CodePoint;
+			}
+			else if (CodePoint <= 0x7FF) {
+				*Write++ = 0xC0 | ((CodePoint >> 6) & 0x1F);
+				*Write++ = 0x80 | (CodePoint & 0x3F);
+			}
+			else if (CodePoint <= 0xFFFF) {
+				*Write++ = 0xE0 | ((CodePoint >> 12) & 0xF);
+				*Write++ = 0x80 | ((CodePoint >> 6) & 0x3F);
+				*Write++ = 0x80 | (CodePoint & 0x3F);
+			}
+			else {
+				*Write++ = 0xF0 | ((CodePoint >> 18) & 0x7);
+				*Write++ = 0x80 | ((CodePoint >> 12) & 0x3F);
+				*Write++ = 0x80 | ((CodePoint >> 6) & 0x3F);
+				*Write++ = 0x80 | (CodePoint & 0x3F);
+			}
+		} break;
+		default: Parser->DidErrorOccur = TRUE; break;
+		}
+	}
+
+	if (Parser->At >= Parser->End) { Parser->DidErrorOccur = TRUE; }
+	else { Parser->At++; } // closing quote
+	*TextLength = Write - *Text;
+}
+
+translation_scope json_value* JsonParseValue(json_parser *Parser) {
+	json_value Value = {0};
+	JsonSkipWhitespace(Parser);
+	if (Parser->At >= Parser->End) {
+		Parser->DidErrorOccur = TRUE;
+		return 0;
+	}
+
+	char *Start = Parser->At;
+	json_value *Result = 0;
+	if (Parser->At[0] == '{' || Parser->At[0] == '[') {
+		const int IsObject = Parser->At[0] == '{';
+		const char Terminator = IsObject ? '}' : ']';
+		Value.Kind = IsObject ? JSON_Object : JSON_Array;
+		Result = AddToPagedList(Parser->Nodes, &Value);
+		Parser->At++;
+
+		json_value **LastChild = &Result->FirstChild;
+		JsonSkipWhitespace(Parser);
+		while (!Parser->DidErrorOccur && Parser->At < Parser->End && Parser->At[0] != Terminator) {
+			char *Key = 0;
+			int KeyLength = 0;
+			if (IsObject) {
+				JsonSkipWhitespace(Parser);
+				if (Parser->At >= Parser->End || Parser->At[0] != '"') { Parser->DidErrorOccur = TRUE; break; }
+				Parser->At++;
+				JsonParseString(Parser, &Key, &KeyLength);
+				JsonSkipWhitespace(Parser);
+				if (Parser->At >= Parser->End || Parser->At[0] != ':') { Parser->DidErrorOccur = TRUE; break; }
+				Parser->At++;
+			}
+
+			json_value *Child = JsonParseValue(Parser);
+			if (Child == 0) { break; }
+			Child->Key = Key;
+			Child->KeyLength = KeyLength;
+			*LastChild = Child;
+			LastChild = &Child->NextSibling;
+
+			JsonSkipWhitespace(Parser);
+			if (Parser->At < Parser->End && Parser->At[0] == ',') {
+				Parser->At++;
+				JsonSkipWhitespace(Parser);
+			}
+		}
+		if (Parser->At >= Parser->End) { Parser->DidErrorOccur = TRUE; }
+		else { Parser->At++; }
+	}
+	else if (Parser->At[0] == '"') {
+		Value.Kind = JSON_String;
+		Parser->At++;
+		JsonParseString(Parser, &Value.Text, &Value.TextLength);
+		Result = AddToPagedList(Parser->Nodes, &Value);
+		return Result;
+	}
+	else if (Parser->End - Parser->At >= 4 && strncmp(Parser->At, "null", 4) == 0) {
+		Value.Kind = JSON_Null;
+		Parser->At += 4;
+		Result = AddToPagedList(Parser->Nodes, &Value);
+	}
+	else if (Parser->End - Parser->At >= 4 && strncmp(Parser->At, "true", 4) == 0) {
+		Value.Kind = JSON_True;
+		Parser->At += 4;
+		Result = AddToPagedList(Parser->Nodes, &Value);
+	}
+	else if (Parser->End - Parser->At >= 5 && strncmp(Parser->At, "false", 5) == 0) {
+		Value.Kind = JSON_False;
+		Parser->At += 5;
+		Result = AddToPagedList(Parser->Nodes, &Value);
+	}
+	else {
+		Value.Kind = JSON_Number;
+		char *NumberEnd = 0;
+		Value.Number = strtod(Parser->At, &NumberEnd);
+		if (NumberEnd == Parser->At || NumberEnd > Parser->End) {
+			Parser->DidErrorOccur = TRUE;
+			return 0;
+		}
+		Parser->At = NumberEnd;
+		Result = AddToPagedList(Parser->Nodes, &Value);
+	}
+
+	Result->Text = Start;
+	Result->TextLength = Parser->At - Start;
+	return Result;
+}
+
+translation_scope json_value* JsonGet(json_value *Object, char *Key) {
+	if (Object == 0 || Object->Kind != JSON_Object) { return 0; }
+	const int KeyLength = strlen(Key);
+	for (json_value *Child = Object->FirstChild; Child; Child = Child->NextSibling) {
+		if (Child->KeyLength == KeyLength && memcmp(Child->Key, Key, KeyLength) == 0) {
+			return Child;
+		}
+	}
+	return 0;
+}
+
+translation_scope int JsonGetInt(json_value *Object, char *Key, int Default) {
+	json_value *Value = JsonGet(Object, Key);
+	return (Value && Value->Kind == JSON_Number) ? (int)Value->Number : Default;
+}
+
+//-----
+//~ Documents
+
+typedef struct {
+	int Line;
+	int Character; // In UTF-16 code units, as the protocol requires.
+} lsp_position;
+
+typedef struct {
+	char *Uri;
+	int UriLength;
+	char *Path; // Decoded from a file:// Uri so .Include can find files next to the document, otherwise 0
+	char *Text; // Owned by Context once assembled.
+	int TextLength;
+	int *LineStarts;
+	int LineCount;
+	assembler_context *Context;
+	string_builder Diagnostics; // Comma separated diagnostic objects from the last assembly.
+} lsp_document;
+
+typedef struct {
+	lsp_document **Documents;
+	int DocumentCount;
+	FILE *Out;
+	int ShutdownRequested;
+} lsp_server;
+
+translation_scope int Utf8SequenceLength(uint8_t Lead) {
+	if ((Lead & 0xF8) == 0xF0) { return 4; }
+	if ((Lead & 0xF0) == 0xE0) { return 3; }
+	if ((Lead & 0xE0) == 0xC0) { return 2; }
+	return 1;
+}
+
+translation_scope lsp_position LspPositionFromOffset(const lsp_document *Document, int Offset) {
+	lsp_position Result = {0};
+	int Low = 0, High = Document->LineCount - 1;
+	while (Low < High) { // Last line that starts at or before Offset.
+		int Middle = (Low + High + 1) / 2;
+		if (Document->LineStarts[Middle] <= Offset) { Low = Middle; }
+		else { High = Middle - 1; }
+	}
+	Result.Line = Low;
+	for (int At = Document->LineStarts[Low]; At < Offset && At < Document->TextLength;) {
+		int Length = Utf8SequenceLength(Document->Text[At]);
+		Result.Character += (Length == 4) ? 2 : 1;
+		At += Length;
+	}
+	return Result;
+}
+
+translation_scope int LspOffsetFromPosition(const lsp_document *Document, lsp_position Position) {
+	if (Position.Line < 0) { return 0; }
+	if (Position.Line >= Document->LineCount) { return Document->TextLength; }
+
+	int At = Document->LineStarts[Position.Line];
+	for (int Character = 0; Character < Position.Character && At < Document->TextLength && Document->Text[At] != '\n';) {
+		int Length = Utf8SequenceLength(Document->Text[At]);
+		Character += (Length == 4) ? 2 : 1;
+		At += Length;
+	}
+	return At;
+}
+
+translation_scope void LspAppendRange(string_builder *String, const lsp_document *Document, int StartOffset, int EndOffset) {
+	lsp_position Start = LspPositionFromOffset(Document, StartOffset);
+	lsp_position End = LspPositionFromOffset(Document, EndOffset);
+	AppendFormat(String, "{\"start\":{\"line\":%d,\"character\":%d},\"end\":{\"line\":%d,\"character\":%d}}", Start.Line, Start.Character, End.Line, End.Character);
+}
+
+translation_scope void LspAppendLocation(string_builder *String, const lsp_document *Document, int StartOffset, int EndOffset) {
+	AppendString(String, "{\"uri\":", 7);
+	AppendJsonString(String, Document->Uri, Document->UriLength);
+	AppendString(String, ",\"range\":", 9);
+	LspAppendRange(String, Document, StartOffset, EndOffset);
+	AppendString(String, "}", 1);
+}
+
+/* Turns the diagnostics from the document's last assembly into LSP diagnostic objects.
+ */
+translation_scope void LspCollectDiagnostics(lsp_document *Document) {
+	const assembler_context *Context = Document->Context;
+	Document->Diagnostics.Length = 0;
+	for (int Index = 0; Index < Context->DiagnosticCount; Index++) {
+		const diagnostic *Diagnostic = &Context->Diagnostics[Index];
+
+		// Underline from the reported offset to the end of the token there.
+		// The document is the assembled source, so a problem in an included file is shown at its .Include.
+		const int SourceOffset = (Diagnostic->File != -1) ? Diagnostic->IncludedAt : Diagnostic->Offset;
+		int StartOffset = Max(0, Min(SourceOffset, Document->TextLength));
+		int EndOffset = StartOffset;
+		while (EndOffset < Document->TextLength &&
+		       Document->Text[EndOffset] != ' ' && Document->Text[EndOffset] != '\t' &&
+		       Document->Text[EndOffset] != '\r' && Document->Text[EndOffset] != '\n') {
+			EndOffset++;
+		}
+
+		if (Document->Diagnostics.Length) { AppendString(&Document->Diagnostics, ",", 1); }
+		AppendString(&Document->Diagnostics, "{\"range\":", 9);
+		LspAppendRange(&Document->Diagnostics, Document, StartOffset, EndOffset);
+		AppendFormat(&Document->Diagnostics, ",\"severity\":%d,\"code\":\"%s\",\"source\":\"MarieAssembler\",\"message\":",
+		             Diagnostic->Severity == DS_Error ? 1 : 2, DiagnosticCodes[Diagnostic->Code].Name);
+		if (Diagnostic->Macro != -1) {
+			// The editor only shows the call, so the message says where in the macro the problem is.
+			const macro_definition *Macro = &Context->Macros[Diagnostic->Macro];
+			string_builder Message = {0};
+			AppendFormat(&Message, "%.*s\nIn macro \"%.*s\" at L:%d C:%d", Diagnostic->MessageLength, Context->DiagnosticText->Data + Diagnostic->MessageStart,
+			             Macro->NameLength, Macro->Name, Diagnostic->MacroLine, Diagnostic->MacroColumn);
+			AppendJsonString(&Document->Diagnostics, Message.Data, Message.Length);
+			free(Message.Data);
+		}
+		else {
+			AppendJsonString(&Document->Diagnostics, Context->DiagnosticText->Data + Diagnostic->MessageStart, Diagnostic->MessageLength);
+		}
+		AppendString(&Document->Diagnostics, "}", 1);
+	}
+}
+
+translation_scope void LspSend(lsp_server *Server, string_builder *Body) {
+	fprintf(Server->Out, "Content-Length: %d\r\n\r\n", Body->Length);
+	fwrite(Body->Data, 1, Body->Length, Server->Out);
+	fflush(Server->Out);
+}
+
+translation_scope void LspPublishDiagnostics(lsp_server *Server, lsp_document *Document, int Clear) {
+	string_builder Body = {0};
+	AppendFormat(&Body, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":");
+	AppendJsonString(&Body, Document->Uri, Document->UriLength);
+	AppendFormat(&Body, ",\"diagnostics\":[");
+	if (!Clear && Document->Diagnostics.Length) {
+		AppendString(&Body, Document->Diagnostics.Data, Document->Diagnostics.Length);
+	}
+	AppendFormat(&Body, "]}}");
+	LspSend(Server, &Body);
+	free(Body.Data);
+}
+
+/* Decodes a file:// URI into a path, undoing its percent escapes. Returns 0 for any other kind of URI. The result is malloc'd.
+ */
+translation_scope char* LspPathFromUri(const char *Uri, int UriLength) {
+	if (UriLength < 7 || memcmp(Uri, "file://", 7) != 0) { return 0; }
+	char *Result = malloc(UriLength - 7 + 1);
+	int Length = 0;
+	for (int Index = 7; Index < UriLength; Index++) {
+		int High = 0, Low = 0;
+		if (Uri[Index] == '%' && Index + 2 < UriLength && sscanf(Uri + Index + 1, "%1x%1x", &High, &Low) == 2) {
+			Result[Length++] = (char)(High * 16 + Low);
+			Index += 2;
+		}
+		else {
+			Result[Length++] = Uri[Index];
+		}
+	}
+	Result[Length] = 0;
+	// Windows paths come through as file:///C:/...
+	if (Length > 2 && Result[0] == '/' && Result[2] == ':') { memmove(Result, Result + 1, Length); }
+	return Result;
+}
+
+translation_scope lsp_document* LspFindDocument(lsp_server *Server, json_value *Params) {
+	json_value *Uri = JsonGet(JsonGet(Params, "textDocument"), "uri");
+	if (Uri == 0 || Uri->Kind != JSON_String) { return 0; }
+	for (int Index = 0; Index < Server->DocumentCount; Index++) {
+		lsp_document *Document = Server->Documents[Index];
+		if (Document->UriLength == Uri->TextLength && memcmp(Document->Uri, Uri->Text, Uri->TextLength) == 0) {
+			return Document;
+		}
+	}
+	return 0;
+}
+
+/* Replaces the document's text and reassembles it, reusing the document's context.
+ */
+translation_scope void LspUpdateDocument(lsp_server *Server, lsp_document *Document, json_value *Text) {
+	Document->Text = malloc(Text->TextLength + 1);
+	memcpy(Document->Text, Text->Text, Text->TextLength);
+	Document->Text[Text->TextLength] = 0;
+	Document->TextLength = Text->TextLength;
+
+	Document->LineCount = 1;
+	for (int Index = 0; Index < Document->TextLength; Index++) {
+		if (Document->Text[Index] == '\n') { Document->LineCount++; }
+	}
+	Document->LineStarts = realloc(Document->LineStarts, Document->LineCount * sizeof(int));
+	Document->LineStarts[0] = 0;
+	for (int Index = 0, Line = 1; Index < Document->TextLength; Index++) {
+		if (Document->Text[Index] == '\n') { Document->LineStarts[Line++] = Index + 1; }
+	}
+
+	AssembleSource(Document->Context, Document->Text);
+	LspCollectDiagnostics(Document);
+	LspPublishDiagnostics(Server, Document, FALSE);
+}
+
+translation_scope int LspIsInDocument(const lsp_document *Document, const char *At) {
+	return (uintptr_t)At >= (uintptr_t)Document->Text && (uintptr_t)At < (uintptr_t)(Document->Text + Document->TextLength);
+}
+
+/* Finds the identifier under Offset. Returns the index of the source it names, or -1.
+ * If the cursor is on a use of the identifier, *DestIndex is set to that use, otherwise it is -1.
+ */
+translation_scope int LspIdentifierAt(const lsp_document *Document, int Offset, int *DestIndex) {
+	const symbol_index *Symbols = &Document->Context->Symbols;
+	const char *Text = Document->Text;
+	*DestIndex = -1;
+
+	// Both lists are in source order, so they can be binary searched by where the name starts. Names from included files and macro expansions sort at their .Include or call, but are never under the cursor.
+	const assembler_context *Context = Document->Context;
+	int Low = 0, High = Symbols->DestCount - 1, Found = -1;
+	while (Low <= High) {
+		int Middle = (Low + High) / 2;
+		if (SourceOffsetOf(Context, Symbols->Dests.Names[Middle]) <= Offset) { Found = Middle; Low = Middle + 1; }
+		else { High = Middle - 1; }
+	}
+	if (Found != -1 && LspIsInDocument(Document, Symbols->Dests.Names[Found]) &&
+	    Offset <= (Symbols->Dests.Names[Found] - Text) + Symbols->Dests.ByteCounts[Found]) {
+		*DestIndex = Found;
+		return Symbols->DestToSource[Found];
+	}
+
+	Low = 0, High = Symbols->SourceCount - 1, Found = -1;
+	while (Low <= High) {
+		int Middle = (Low + High) / 2;
+		if (SourceOffsetOf(Context, Symbols->Sources.Names[Middle]) <= Offset) { Found = Middle; Low = Middle + 1; }
+		else { High = Middle - 1; }
+	}
+	if (Found != -1 && LspIsInDocument(Document, Symbols->Sources.Names[Found]) &&
+	    Offset <= (Symbols->Sources.Names[Found] - Text) + Symbols->Sources.ByteCounts[Found]) {
+		return Found;
+	}
+	return -1;
+}
+
+translation_scope int LspQueryOffset(lsp_document *Document, json_value *Params) {
+	json_value *Position = JsonGet(Params, "position");
+	lsp_position Result = {
+		.Line = JsonGetInt(Position, "line", 0),
+		.Character = JsonGetInt(Position, "character", 0),
+	};
+	return LspOffsetFromPosition(Document, Result);
+}
+
+translation_scope void LspAppendId(string_builder *Body, json_value *Id) {
+	if (Id == 0) { AppendString(Body, "null", 4); }
+	else if (Id->Kind == JSON_String) { AppendJsonString(Body, Id->Text, Id->TextLength); }
+	else { AppendString(Body, Id->Text, Id->TextLength); }
+}
+
+translation_scope void LspBeginResponse(string_builder *Body, json_value *Id) {
+	AppendFormat(Body, "{\"jsonrpc\":\"2.0\",\"id\":");
+	LspAppendId(Body, Id);
+	AppendFormat(Body, ",\"result\":");
+}
+
+translation_scope void LspHandleMessage(lsp_server *Server, json_value *Message) {
+	json_value *Method = JsonGet(Message, "method");
+	json_value *Id = JsonGet(Message, "id");
+	json_value *Params = JsonGet(Message, "params");
+	if (Method == 0 || Method->Kind != JSON_String) { return; } // A response to something we never send.
+
+	char MethodName[64] = {0};
+	memcpy(MethodName, Method->Text, Min(Method->TextLength, (int)sizeof(MethodName) - 1));
+
+	string_builder Body = {0};
+	if (strcmp(MethodName, "initialize") == 0) {
+		LspBeginResponse(&Body, Id);
+		AppendFormat(&Body, "{\"capabilities\":{\"textDocumentSync\":1,\"definitionProvider\":true,\"referencesProvider\":true,\"hoverProvider\":true},"
+		                  "\"serverInfo\":{\"name\":\"MarieAssembler\"}}}");
+	}
+	else if (strcmp(MethodName, "shutdown") == 0) {
+		Server->ShutdownRequested = TRUE;
+		LspBeginResponse(&Body, Id);
+		AppendFormat(&Body, "null}");
+	}
+	else if (strcmp(MethodName, "textDocument/didOpen") == 0) {
+		json_value *TextDocument = JsonGet(Params, "textDocument");
+		json_value *Uri = JsonGet(TextDocument, "uri");
+		json_value *Text = JsonGet(TextDocument, "text");
+		if (Uri && Uri->Kind == JSON_String && Text && Text->Kind == JSON_String) {
+			lsp_document *Document = LspFindDocument(Server, Params);
+			if (Document == 0) {
+				Document = calloc(1, sizeof(lsp_document));
+				Document->Uri = malloc(Uri->TextLength);
+				memcpy(Document->Uri, Uri->Text, Uri->TextLength);
+				Document->UriLength = Uri->TextLength;
+				Document->Context = CreateAssemblerContext();
+				Document->Path = LspPathFromUri(Uri->Text, Uri->TextLength);
+				Document->Context->SourcePath = Document->Path;
+
+				Server->Documents = realloc(Server->Documents, (Server->DocumentCount + 1) * sizeof(lsp_document*));
+				Server->Documents[Server->DocumentCount++] = Document;
+			}
+			LspUpdateDocument(Server, Document, Text);
+		}
+	}
+	else if (strcmp(MethodName, "textDocument/didChange") == 0) {
+		lsp_document *Document = LspFindDocument(Server, Params);
+		json_value *Changes = JsonGet(Params, "contentChanges");
+		json_value *LastChange = 0;
+		for (json_value *Change = Changes ? Changes->FirstChild : 0; Change; Change = Change->NextSibling) {
+			LastChange = Change;
+		}
+		json_value *Text = JsonGet(LastChange, "text");
+		// We only advertise full document sync, so the last change holds the whole document.
+		if (Document && Text && Text->Kind == JSON_String) {
+			LspUpdateDocument(Server, Document, Text);
+		}
+	}
+	else if (strcmp(MethodName, "textDocument/didClose") == 0) {
+		lsp_document *Document = LspFindDocument(Server, Params);
+		if (Document) {
+			LspPublishDiagnostics(Server, Document, TRUE);
+			for (int Index = 0; Index < Server->DocumentCount; Index++) {
+				if (Server->Documents[Index] == Document) {
+					Server->Documents[Index] = Server->Documents[--Server->DocumentCount];
+					break;
+				}
+			}
+			FreeAssemblerContext(Document->Context); // Also frees Document->Text
+			free(Document->LineStarts);
+			free(Document->Diagnostics.Data);
+			free(Document->Uri);
+			free(Document->Path);
+			free(Document);
+		}
+	}
+	else if (strcmp(MethodName, "textDocument/definition") == 0) {
+		lsp_document *Document = LspFindDocument(Server, Params);
+		LspBeginResponse(&Body, Id);
+		int DestIndex = -1;
+		int SourceIndex = Document ? LspIdentifierAt(Document, LspQueryOffset(Document, Params), &DestIndex) : -1;
+		if (SourceIndex != -1) {
+			const identifier_table *Sources = &Document->Context->Symbols.Sources;
+			// Something defined in an included file goes to the .Include that brought it in.
+			const int Offset = SourceOffsetOf(Document->Context, Sources->Names[SourceIndex]);
+			LspAppendLocation(&Body, Document, Offset, Offset + Sources->ByteCounts[SourceIndex]);
+			AppendString(&Body, "}", 1);
+		}
+		else {
+			AppendFormat(&Body, "null}");
+		}
+	}
+	else if (strcmp(MethodName, "textDocument/references") == 0) {
+		lsp_document *Document = LspFindDocument(Server, Params);
+		LspBeginResponse(&Body, Id);
+		AppendString(&Body, "[", 1);
+		int DestIndex = -1;
+		int SourceIndex = Document ? LspIdentifierAt(Document, LspQueryOffset(Document, Params), &DestIndex) : -1;
+		if (SourceIndex != -1) {
+			const symbol_index *Symbols = &Document->Context->Symbols;
+			int First = TRUE;
+			json_value *IncludeDeclaration = JsonGet(JsonGet(Params, "context"), "includeDeclaration");
+			if (IncludeDeclaration == 0 || IncludeDeclaration->Kind == JSON_True) {
+				const int Offset = SourceOffsetOf(Document->Context, Symbols->Sources.Names[SourceIndex]);
+				LspAppendLocation(&Body, Document, Offset, Offset + Symbols->Sources.ByteCounts[SourceIndex]);
+				First = FALSE;
+			}
+			for (int Reference = Symbols->FirstReference[SourceIndex]; Reference != -1; Reference = Symbols->NextReference[Reference]) {
+				const int Offset = SourceOffsetOf(Document->Context, Symbols->Dests.Names[Reference]);
+				if (!First) { AppendString(&Body, ",", 1); }
+				LspAppendLocation(&Body, Document, Offset, Offset + Symbols->Dests.ByteCounts[Reference]);
+				First = FALSE;
+			}
+		}
+		AppendString(&Body, "]}", 2);
+	}
+	else if (strcmp(MethodName, "textDocument/hover") == 0) {
+		lsp_document *Document = LspFindDocument(Server, Params);
+		LspBeginResponse(&Body, Id);
+		int DestIndex = -1;
+		int SourceIndex = Document ? LspIdentifierAt(Document, LspQueryOffset(Document, Params), &DestIndex) : -1;
+		if (SourceIndex != -1) {
+			const assembler_context *Context = Document->Context;
+			const identifier_table *Sources = &Context->Symbols.Sources;
+			const int ByteCount = Sources->ByteCounts[SourceIndex];
+			const int Address = Sources->Addresses[SourceIndex] & 0xFFF;
+			const uint16_t Word = Context->Program[Address];
+
+			char Hover[256];
+			snprintf(Hover, sizeof(Hover), "**%.*s**\n\nAddress: `0x%03X`\n\nValue: `0x%04X` (%d)",
+			         ByteCount, Sources->Names[SourceIndex], Address, Word, (int16_t)Word);
+			AppendFormat(&Body, "{\"contents\":{\"kind\":\"markdown\",\"value\":");
+			AppendJsonString(&Body, Hover, strlen(Hover));
+			AppendFormat(&Body, "},\"range\":");
+			const char *Start = (DestIndex != -1) ? Context->Symbols.Dests.Names[DestIndex] : Sources->Names[SourceIndex];
+			LspAppendRange(&Body, Document, Start - Document->Text, Start - Document->Text + ByteCount);
+			AppendString(&Body, "}}", 2);
+		}
+		else {
+			AppendFormat(&Body, "null}");
+		}
+	}
+	else if (Id) {
+		AppendFormat(&Body, "{\"jsonrpc\":\"2.0\",\"id\":");
+		LspAppendId(&Body, Id);
+		AppendFormat(&Body, ",\"error\":{\"code\":-32601,\"message\":\"Method not found\"}}");
+	}
+	// Any other notification, "initialized" and "$/..." included, needs no reply.
+
+	if (Body.Length) { LspSend(Server, &Body); }
+	free(Body.Data);
+}
+
+int LanguageServerMain(FILE *In, FILE *Out) {
+	lsp_server Server = {.Out = Out};
+	paged_list *Nodes = AllocatePagedList(sizeof(json_value), 256);
+	char *Message = 0;
+	int MessageCapacity = 0;
+	int Success = FALSE;
+
+	for (;;) {
+		// Header: lines terminated by \r\n, ended by an empty line. Only Content-Length matters.
+		char HeaderLine[256];
+		int ContentLength = -1;
+		int SawHeader = FALSE;
+		while (fgets(HeaderLine, sizeof(HeaderLine), In)) {
+			SawHeader = TRUE;
+			if (HeaderLine[0] == '\r' || HeaderLine[0] == '\n') { break; }
+			sscanf(HeaderLine, "Content-Length: %d", &ContentLength);
+		}
+		if (!SawHeader || ContentLength < 0) { break; } // Stream closed.
+
+		if (ContentLength + 1 > MessageCapacity) {
+			MessageCapacity = ContentLength + 1;
+			Message = realloc(Message, MessageCapacity);
+		}
+		if (fread(Message, 1, ContentLength, In) != (size_t)ContentLength) { break; }
+		Message[ContentLength] = 0;
+
+		ClearPagedList(Nodes);
+		json_parser Parser = {.At = Message, .End = Message + ContentLength, .Nodes = Nodes};
+		json_value *Root = JsonParseValue(&Parser);
+		if (Root == 0 || Parser.DidErrorOccur) { continue; }
+
+		json_value *Method = JsonGet(Root, "method");
+		if (Method && Method->Kind == JSON_String && Method->TextLength == 4 && memcmp(Method->Text, "exit", 4) == 0) {
+			Success = Server.ShutdownRequested;
+			break;
+		}
+		LspHandleMessage(&Server, Root);
+	}
+
+	for (int Index = 0; Index < Server.DocumentCount; Index++) {
+		lsp_document *Document = Server.Documents[Index];
+		FreeAssemblerContext(Document->Context);
+		free(Document->LineStarts);
+		free(Document->Diagnostics.Data);
+		free(Document->Uri);
+		free(Document->Path);
+		free(Document);
+	}
+	free(Server.Documents);
+	free(Message);
+	FreePagedList(Nodes);
+	return Success;
+}
@@ -12,15 +12,20 @@
 #include "Platform_MarieAssembler.h"
 
 #include "Memory_MarieAssembler.c"
+#include "Bits_MarieAssembler.c"
+#include "Lsp_MarieAssembler.c"
+#include "Simulator_MarieAssembler.c"
+#include "TestVectors_MarieAssembler.c"
+#include "Lockstep_MarieAssembler.c"
+#include "Trace_MarieAssembler.c"
+#include "Cfg_MarieAssembler.c"
+#include "Optimize_MarieAssembler.c"
+#include "Disassemble_MarieAssembler.c"
+#include "Archive_MarieAssembler.c"
 
 #include <stdio.h>
 #include <stdarg.h>
 
-// Contains the assembled Marie program
-global_var uint16_t Program[Kilobyte(4)] = {0};
-// Contains metadata regarding each Word of the program
-global_var uint8_t ProgramMetaData[Kilobyte(4)] = {0};
-
 /* Increases File->At pointer by Count characters.
  * This function also keeps File->Column and File->Line.
  * Returns the difference between the inital index and the new index in bytes.
@@ -92,6 +97,15 @@ void AdvancePastWhitespaceOnSameLine(file_state *File) {
 	}
 }
 
+/* Advances File->At to the end of the current line, leaving it on the newline. Used to skip the rest of a statement that had an error.
+ */
+void AdvanceToEndOfLine(file_state *File) {
+	while (File->At[0] != '\n' &&
+	       File->At[0] != '\0') {
+		IncrementFilePosition(File, 1);
+	}
+}
+
 /* if File->At does not point to the beginning of a number of the form `0d0000`, then this function returns false and Result is set to 0.
  * if File->At does point to the beginning of a number, then this function returns true and Result will have the value of that number.
  */
@@ -183,7 +197,10 @@ int ExtractIdentifier(file_state *File, int *CharCount, int *ByteCount) {
 	*CharCount = 0;
 	*ByteCount = 0;
 	
-	if (!(File->At[0] >= '0' && File->At[0] <= '9')) {
+	// An identifier never starts on the next line, so every statement stays on the line it started on.
+	if (!(File->At[0] >= '0' && File->At[0] <= '9') &&
+	    (File->At[0] != '\n') &&
+	    (File->At[0] != '\0')) {
 		Success = TRUE;
 		(*CharCount)++;
 		*ByteCount += IncrementFilePosition(File, 1);
@@ -258,394 +275,1626 @@ translation_scope inline int CompareStrToKeyword(char *Str, int FileKeywordLengt
 	}
 }
 
-/* If ConditionOfFailure is true, then DidErrorOccur is set to true, and vwprintf_s is called with the format string and the VarArg list passed to this function.
+/* Names made by expanding a macro aren't written anywhere, so they are traced back to the outermost call that expanded the macro. Anything else is returned as it is.
+ */
+translation_scope const char* UnexpandedAt(const assembler_context *Context, const char *At) {
+	for (int Index = Context->MacroTextCount - 1; Index >= 0; Index--) {
+		const macro_text *Text = &Context->MacroTexts[Index];
+		if ((uintptr_t)At >= (uintptr_t)Text->Text && (uintptr_t)At < (uintptr_t)(Text->Text + Text->Length)) {
+			return Text->CalledAt;
+		}
+	}
+	return At;
+}
+
+/* Finds the included file At points into. Returns its index into Context->Includes, or -1 if At isn't in one.
+ */
+translation_scope int FindSourceInclude(const assembler_context *Context, const char *At) {
+	At = UnexpandedAt(Context, At);
+	for (int Index = 0; Index < Context->IncludeCount; Index++) {
+		const include_file *File = Context->Includes[Index].File;
+		if ((uintptr_t)At >= (uintptr_t)File->Text && (uintptr_t)At <= (uintptr_t)(File->Text + File->TextLength)) {
+			return Index;
+		}
+	}
+	return -1;
+}
+
+/* Byte offset of At into Context->Source. Anything in an included file is at the outermost .Include that brought the file in.
+ * Returns -1 if At is in neither.
  */
-void ReportErrorConditionally(int ConditionOfFailure, int *DidErrorOccur, const char *FormatString, ...) {
+translation_scope int SourceOffsetOf(const assembler_context *Context, const char *At) {
+	At = UnexpandedAt(Context, At);
+	const int Include = FindSourceInclude(Context, At);
+	if (Include != -1) { At = Context->Includes[Include].IncludedAt.At; }
+	return (Context->Source && At >= Context->Source) ? (int)(At - Context->Source) : -1;
+}
+
+/* Byte offset of At into the file it is in, which is the included file FindSourceInclude() finds for it, or else Context->Source.
+ * Returns -1 if At is in neither.
+ */
+translation_scope int FileOffsetOf(const assembler_context *Context, const char *At) {
+	At = UnexpandedAt(Context, At);
+	const int Include = FindSourceInclude(Context, At);
+	if (Include != -1) { return (int)(At - Context->Includes[Include].File->Text); }
+	return (Context->Source && At >= Context->Source) ? (int)(At - Context->Source) : -1;
+}
+
+/* If ConditionOfFailure is true, the message built from the format string and the VarArg list passed to this function is recorded in Context->Diagnostics.
+ * DidErrorOccur is set to true if Code is an error. Warnings may pass 0 for DidErrorOccur.
+ * At points to where in the source the problem is, and is used to find the diagnostic's byte offset. While a macro is being expanded, the diagnostic is put at the call instead.
+ */
+void ReportErrorConditionally(assembler_context *Context, int ConditionOfFailure, int *DidErrorOccur, diagnostic_code Code, const char *At, int Line, int Column, const char *FormatString, ...) {
 	if (ConditionOfFailure) {
-		if (DidErrorOccur) {
-			*DidErrorOccur = TRUE;
+		const diagnostic_severity Severity = DiagnosticCodes[Code].Severity;
+		if (Severity == DS_Error) {
+			Context->ErrorCount++;
+			if (DidErrorOccur) {
+				*DidErrorOccur = TRUE;
+			}
 		}
+		else {
+			Context->WarningCount++;
+		}
+
+		if (Context->DiagnosticCount == DIAGNOSTIC_CAP) {
+			Context->DroppedDiagnosticCount++;
+			return;
+		}
+
+		diagnostic *Diagnostic = &Context->Diagnostics[Context->DiagnosticCount++];
+		Diagnostic->Code = Code;
+		Diagnostic->Severity = Severity;
+		Diagnostic->Macro = -1;
+		if (Context->ExpandedAt) {
+			Diagnostic->Macro = Context->ExpandingMacro;
+			Diagnostic->MacroLine = Line;
+			Diagnostic->MacroColumn = Column;
+			At = Context->ExpandedAt->At;
+			Line = Context->ExpandedAt->Line;
+			Column = Context->ExpandedAt->Column;
+		}
+		Diagnostic->Offset = FileOffsetOf(Context, At);
+		Diagnostic->File = FindSourceInclude(Context, At);
+		Diagnostic->IncludedAt = (Diagnostic->File != -1) ? SourceOffsetOf(Context, At) : -1;
+		Diagnostic->Line = Line;
+		Diagnostic->Column = Column;
+		Diagnostic->MessageStart = Context->DiagnosticText->Length;
+
 		va_list VarArgsList;
 		va_start(VarArgsList, FormatString);
-		vprintf(FormatString, VarArgsList);
+		AppendFormatVarArgs(Context->DiagnosticText, FormatString, VarArgsList);
 		va_end(VarArgsList);
+		Diagnostic->MessageLength = Context->DiagnosticText->Length - Diagnostic->MessageStart;
 	}
 }
 
-translation_scope inline int CheckIfIdentifierNameIsReserved(char *Start, int ByteCount, int CharCount, const file_state * const File) {
+translation_scope inline int CheckIfIdentifierNameIsReserved(assembler_context *Context, char *Start, int ByteCount, int CharCount, const file_state * const File) {
 	int DidErrorOccur = FALSE;
+	// Not reserved as such, but every name that gets past here is put in the symbol index, which only has room for names this long.
+	ReportErrorConditionally(Context, ByteCount > IDENTIFIER_MAX_BYTES, &DidErrorOccur, DC_IdentifierTooLong, Start, File->Line, File->Column - CharCount, "Identifier names can be at most %d bytes long, this one is %d bytes!", IDENTIFIER_MAX_BYTES, ByteCount);
+	if (DidErrorOccur) { return DidErrorOccur; }
 	for (int Index = 0; Index < KW_COUNT; Index++) {
-		ReportErrorConditionally((Keywords[Index].Length == ByteCount) && CompareStrCaseInsensitive(Start, Keywords[Index].String, ByteCount), &DidErrorOccur, "[Error L:%d C:%d] Identifier \"%.*s\" cannot the same name as a memonic! Please name thhe idnetifier something else.\n", File->Line, File->Column - CharCount, ByteCount, Start);
+		ReportErrorConditionally(Context, (Keywords[Index].Length == ByteCount) && CompareStrCaseInsensitive(Start, Keywords[Index].String, ByteCount), &DidErrorOccur, DC_ReservedMnemonic, Start, File->Line, File->Column - CharCount, "Identifier \"%.*s\" cannot the same name as a memonic! Please name thhe idnetifier something else.", ByteCount, Start);
 		if (DidErrorOccur == TRUE) { break; }
 	}
 			
-	for (int Index = 0; Index < ArraySize(ReservedNames); Index++) {
-		ReportErrorConditionally((strlen(ReservedNames[Index]) == ByteCount) && CompareStrCaseInsensitive(Start, ReservedNames[Index], ByteCount), &DidErrorOccur, "[Error L:%d C:%d] Identifier name \"%.*s\" is reserved! Please name the identifier something else.\n", File->Line, File->Column - CharCount, ByteCount, Start);
-		if (DidErrorOccur == TRUE) { break; }
+	for (int Index = 0; Index < ArraySize(ReservedNames) && !DidErrorOccur; Index++) {
+		ReportErrorConditionally(Context, (strlen(ReservedNames[Index]) == ByteCount) && CompareStrCaseInsensitive(Start, ReservedNames[Index], ByteCount), &DidErrorOccur, DC_ReservedName, Start, File->Line, File->Column - CharCount, "Identifier name \"%.*s\" is reserved! Please name the identifier something else.", ByteCount, Start);
 	}
 	
 	return DidErrorOccur;
 }
 
-translation_scope inline int WriteProgramData(file_state *File, uint16_t Data, int CurrentAddress, uint8_t ProgramMetaDataFlags) {
-	int Success = FALSE;
-	ReportErrorConditionally(ProgramMetaData[CurrentAddress] & PMD_IsOccupied, &Success, "[Error L:%d C:%d] An instruction overlapped another instruction! Pay mind to your usage of .SetAddr\n", File->Line, File->Column);
-	Program[CurrentAddress] = Data;
-	ProgramMetaData[CurrentAddress] |= ProgramMetaDataFlags;
-	
-	return Success;
+translation_scope uint32_t HashIdentifierName(const char *Start, int ByteCount) {
+	// 32 bit FNV-1a
+	uint32_t Result = 0x811c9dc5;
+	for (int Index = 0; Index < ByteCount; Index++) {
+		Result ^= (uint8_t)Start[Index];
+		Result *= 0x01000193;
+	}
+	return Result;
 }
 
-int Assemble(file_state *File, paged_list *IdentifierDestinationList, paged_list *IdentifierSourceList) {
-	int DidErrorOccur = FALSE;
-	int ToIncrementAddress = FALSE;
-	int LastLineOperationWasProcessed = -1;
+translation_scope int CountUtf8Characters(const char *Text, int ByteCount) {
+	int Count = 0;
+	for (int Index = 0; Index < ByteCount; Index++) {
+		if ((Text[Index] & 0xC0) != 0x80) { Count++; }
+	}
+	return Count;
+}
 
-	int CurrentAddress = 0;
-	
-	while(!DidErrorOccur) {
-		AdvancePastWhitespaceAndComments(File);
-		if (ToIncrementAddress == TRUE) {
-			CurrentAddress++;
-			ToIncrementAddress = FALSE;
-		}
-		if (File->At[0] == '\0') { break; } // we reached the end of the file, no more parsing to be done.
-		ReportErrorConditionally(CurrentAddress < 0 || CurrentAddress > 0xfff, &DidErrorOccur, "[Error] The CurrentAddress (%X) is less than 0 or greater than 0xfff. This was likely caused by a .SetAddress that was too high, or if there are more than 4095 instructions in this program. This program was at Line %d, Column %d when this error was caught.\nTerminateing Assembly...", CurrentAddress, File->Line, File->Column);
-		if (DidErrorOccur) { break; }
-
-		int KeywordIndex = 0;
-		int KeywordLength = 0;
-		ReportErrorConditionally(PeekKeyword(File, &KeywordLength) == FALSE, &DidErrorOccur, "[Error L:%d C:%d] Failed to find a keyword\n");
-		for (; KeywordIndex < KW_COUNT; KeywordIndex++) {
-			if (CompareStrToKeyword(File->At, KeywordLength, Keywords[KeywordIndex])) {
-				break;
-			}
-			else if (KeywordIndex + 1 == KW_COUNT) { KeywordIndex++; } // If we fail on the last keyword, take on a bogus value.
-		}
-
-		switch(KeywordIndex) {
-
-		case(KW_Jumpstore):
-		case(KW_Jump):
-		case(KW_Jumpi):
-		case(KW_Load):
-		case(KW_Loadi):
-		case(KW_Store):
-		case(KW_Storei):
-		case(KW_Add):
-		case(KW_Addi):
-		case(KW_Sub): {
-			// KEYWORD [Addr|Identifier]
-			
-			IncrementFilePosition(File, Keywords[KeywordIndex].Length);
-			AdvancePastWhitespaceOnSameLine(File);
-			ToIncrementAddress = TRUE;
-			LastLineOperationWasProcessed = File->Line;
-
-			// @TODO Allow 0d numbers as addresses
-			int Address = 0;
-			identifier_dest IdentifierDest = {.Start = File->At, .Address = CurrentAddress, .Line = File->Line, .Column = File->Column};
-			if (ExtractNumberHexadecimal(File, &Address)) {
-				ReportErrorConditionally(Address > 0xFFF || Address < 0, &DidErrorOccur, "[Error L:%d C:%d] The Address provided (0x%X) was not between 0x0 and 0xFFF.\n", File->Line, File->Column, Address);
-				WriteProgramData(File, Keywords[KeywordIndex].Opcode | Address, CurrentAddress, PMD_IsOccupied);
-			}
-			else if (ExtractIdentifier(File, &IdentifierDest.CharCount, &IdentifierDest.ByteCount)) {
-				DidErrorOccur = CheckIfIdentifierNameIsReserved(IdentifierDest.Start, IdentifierDest.ByteCount, IdentifierDest.CharCount, File);
-				if (!DidErrorOccur) {
-					AddToPagedList(IdentifierDestinationList, &IdentifierDest);
-					WriteProgramData(File, Keywords[KeywordIndex].Opcode, CurrentAddress, PMD_IsOccupied | PMD_UsedIdentifier);
-				}
-			}
-			else {
-				ReportErrorConditionally(TRUE, &DidErrorOccur, "[Error L:%d C:%d] Failed to read an argument for %s operation. Please provide a Hex Address or a Identifier.\n", File->Line, File->Column, Keywords[KeywordIndex].String);
-			}
+translation_scope void ResetSymbolIndex(symbol_index *Symbols) {
+	Symbols->SourceCount = 0;
+	Symbols->DestCount = 0;
+	if (Symbols->Slots) { memset(Symbols->Slots, 0, Symbols->SlotCount * sizeof(*Symbols->Slots)); }
+	memset(Symbols->AddressToSource, 0xFF, sizeof(Symbols->AddressToSource));
+	memset(Symbols->AddressToDest, 0xFF, sizeof(Symbols->AddressToDest));
+}
 
-			if (KeywordIndex == KW_Jumpstore) {
-				ReportErrorConditionally(Address == 0xFFF, 0, "[Warning L:%d C:%d] A jns instruction was provided 0xfff as a destination address. Make sure you know what you Marie Processor does when the Program Counter is > 0xFFF!\n", File->Line, File->Column);
-			}
-		} break;
-			
-		case(KW_Input):
-		case(KW_Output):
-		case(KW_Halt):
-		case(KW_Clear): {
-			// KEYWORD
+translation_scope void FreeIdentifierTable(identifier_table *Table) {
+	free(Table->Names);
+	free(Table->ByteCounts);
+	free(Table->Addresses);
+	free(Table->Lines);
+	free(Table->Columns);
+}
 
-			IncrementFilePosition(File, Keywords[KeywordIndex].Length);
-			AdvancePastWhitespaceOnSameLine(File);
-			ToIncrementAddress = TRUE;
-			LastLineOperationWasProcessed = File->Line;
+translation_scope void FreeSymbolIndex(symbol_index *Symbols) {
+	FreeIdentifierTable(&Symbols->Sources);
+	FreeIdentifierTable(&Symbols->Dests);
+	free(Symbols->Slots);
+	free(Symbols->FirstReference);
+	free(Symbols->NextReference);
+	free(Symbols->DestToSource);
+	memset(Symbols, 0, sizeof(*Symbols));
+}
 
-			WriteProgramData(File, Keywords[KeywordIndex].Opcode, CurrentAddress, PMD_IsOccupied);
-		} break;
+/* Returns the index into Symbols->Sources of the identifier with the given name, or -1 if it has not been defined.
+ */
+translation_scope int FindSymbol(const symbol_index *Symbols, const char *Start, int ByteCount) {
+	if (Symbols->SlotCount == 0) { return -1; }
+
+	const uint32_t Mask = Symbols->SlotCount - 1;
+	for (uint32_t Slot = HashIdentifierName(Start, ByteCount) & Mask; Symbols->Slots[Slot] != 0; Slot = (Slot + 1) & Mask) {
+		const int SourceIndex = Symbols->Slots[Slot] - 1;
+		if (Symbols->Sources.ByteCounts[SourceIndex] == ByteCount &&
+		    memcmp(Symbols->Sources.Names[SourceIndex], Start, ByteCount) == 0) {
+			return SourceIndex;
+		}
+	}
+	return -1;
+}
 
-		case(KW_Skipcond): {
-			// Skipcond [lesser|greater|equal|NUMBER]
+translation_scope void InsertSymbolSlot(symbol_index *Symbols, int SourceIndex) {
+	const uint32_t Mask = Symbols->SlotCount - 1;
+	uint32_t Slot = HashIdentifierName(Symbols->Sources.Names[SourceIndex], Symbols->Sources.ByteCounts[SourceIndex]) & Mask;
+	while (Symbols->Slots[Slot] != 0) { Slot = (Slot + 1) & Mask; }
+	Symbols->Slots[Slot] = SourceIndex + 1;
+}
 
-			IncrementFilePosition(File, Keywords[KW_Skipcond].Length);
-			AdvancePastWhitespaceOnSameLine(File);
-			ToIncrementAddress = TRUE;
-			LastLineOperationWasProcessed = File->Line;
-			
-			int RawOperation = 0;
-			if (CompareStr(File->At, "lesser", 6)) {
-				IncrementFilePosition(File, 6);
-				RawOperation = 0x000;
-			}
-			else if (CompareStr(File->At, "equal", 5)) {
-				IncrementFilePosition(File, 5);
-				RawOperation = 0x400;
-			}
-			else if (CompareStr(File->At, "greater", 7)) {
-				IncrementFilePosition(File, 7);
-				RawOperation = 0xC00;
-			}
-			else if (ExtractNumberHexadecimal(File, &RawOperation)) {
-			}
-			else {
-				ReportErrorConditionally(TRUE, &DidErrorOccur, "[Error L:%d C:%d] Failed to read an argument for Skipcond operation. Please provide either a named operation (\"lesser\", \"equal\", or \"greater\") or the raw operation value (0x000, 0x400, 0xC000 respectively).\n", File->Line, File->Column);
-			}
-			const int DidFail = RawOperation != 0x000 && RawOperation != 0x400 && RawOperation != 0xC00;
-			ReportErrorConditionally(DidFail, 0, "[Warning L:%d C:%d] The Operation provided (0x%0.3X) was not a known operation. We will continue to assemble this program but know that this skipcond instruction may have unintended behaivor!\nKnown operation constants are lesser (0x000), equal (0x400), or greater (0xC00)\n", File->Line, File->Column, RawOperation);
-			WriteProgramData(File, Keywords[KeywordIndex].Opcode | RawOperation, CurrentAddress, PMD_IsOccupied);
-		} break;
+translation_scope void GrowIdentifierTable(identifier_table *Table, int Capacity) {
+	Table->Names = realloc(Table->Names, Capacity * sizeof(*Table->Names));
+	Table->ByteCounts = realloc(Table->ByteCounts, Capacity * sizeof(*Table->ByteCounts));
+	Table->Addresses = realloc(Table->Addresses, Capacity * sizeof(*Table->Addresses));
+	Table->Lines = realloc(Table->Lines, Capacity * sizeof(*Table->Lines));
+	Table->Columns = realloc(Table->Columns, Capacity * sizeof(*Table->Columns));
+}
 
-		case(KW_M_SetAddr): {
-			// .SetAddr [Addr]
+// The caller has already checked that ByteCount is at most IDENTIFIER_MAX_BYTES.
+translation_scope void SetIdentifier(identifier_table *Table, int Index, const char *Name, int ByteCount, int Address, int Line, int Column) {
+	Table->Names[Index] = Name;
+	Table->ByteCounts[Index] = (uint16_t)ByteCount;
+	Table->Addresses[Index] = (int16_t)Address;
+	Table->Lines[Index] = (uint32_t)Line;
+	Table->Columns[Index] = (uint16_t)Min(Column, 0xFFFF);
+}
 
-			IncrementFilePosition(File, Keywords[KW_M_SetAddr].Length);
-			AdvancePastWhitespaceOnSameLine(File);
-			
-			ReportErrorConditionally(ExtractNumberHexadecimal(File, &CurrentAddress) == FALSE, &DidErrorOccur, "[Error L:%d C:%d] Unable to Extract a Hexadecimal Number for .SetAddr", File->Line, File->Column);
+translation_scope void CopyIdentifier(identifier_table *Table, int To, int From) {
+	Table->Names[To] = Table->Names[From];
+	Table->ByteCounts[To] = Table->ByteCounts[From];
+	Table->Addresses[To] = Table->Addresses[From];
+	Table->Lines[To] = Table->Lines[From];
+	Table->Columns[To] = Table->Columns[From];
+}
 
-			ReportErrorConditionally(CurrentAddress > 0xFFF || CurrentAddress < 0, &DidErrorOccur, "[Error L:%d C:%d] The Address provided (%x) was not between 0x0 and 0xfff.\n", File->Line, File->Column, CurrentAddress);
-		} break;
+translation_scope inline int IdentifierCharCount(const identifier_table *Table, int Index) {
+	return CountUtf8Characters(Table->Names[Index], Table->ByteCounts[Index]);
+}
 
-		case(KW_M_Ident): {
-			// .Ident [Identifier]
+/* Adds a definition of Name at Value to the index. The caller has already checked that the name isn't defined yet.
+ */
+translation_scope void AddSymbolSource(symbol_index *Symbols, const char *Name, int ByteCount, int Value, int Line, int Column) {
+	if (Symbols->SourceCount == Symbols->SourceCapacity) {
+		Symbols->SourceCapacity = Max(64, Symbols->SourceCapacity * 2);
+		GrowIdentifierTable(&Symbols->Sources, Symbols->SourceCapacity);
+		Symbols->FirstReference = realloc(Symbols->FirstReference, Symbols->SourceCapacity * sizeof(*Symbols->FirstReference));
+	}
+	const int SourceIndex = Symbols->SourceCount++;
+	SetIdentifier(&Symbols->Sources, SourceIndex, Name, ByteCount, Value, Line, Column);
+
+	// Keep the table at most half full, so probe chains stay short.
+	if (Symbols->SourceCount * 2 > Symbols->SlotCount) {
+		free(Symbols->Slots);
+		Symbols->SlotCount = Max(128, Symbols->SlotCount * 2);
+		Symbols->Slots = calloc(Symbols->SlotCount, sizeof(*Symbols->Slots));
+		for (int Index = 0; Index < Symbols->SourceCount; Index++) {
+			InsertSymbolSlot(Symbols, Index);
+		}
+	}
+	else {
+		InsertSymbolSlot(Symbols, SourceIndex);
+	}
 
-			IncrementFilePosition(File, Keywords[KW_M_Ident].Length);
-			AdvancePastWhitespaceOnSameLine(File);
-			
-			identifier_source Data = {.Start = File->At, .Value = CurrentAddress - 1, .Line = File->Line, .Column = File->Column};
+	if (Value >= 0 && Value < Kilobyte(4) && Symbols->AddressToSource[Value] == -1) {
+		Symbols->AddressToSource[Value] = SourceIndex;
+	}
+}
 
-			ReportErrorConditionally(LastLineOperationWasProcessed != File->Line, &DidErrorOccur, "[Error L:%d C:%d] Identifiers must follow right after a operation on the same line.\nEx: data 0d0 .Ident Foo\n", File->Line, File->Column); 
-			ReportErrorConditionally(ExtractIdentifier(File, &Data.CharCount, &Data.ByteCount) == FALSE, &DidErrorOccur, "[Error L:%d C:%d] Failed to find an Identifier Name after .Ident!\n", File->Line, File->Column);
-			
-			DidErrorOccur = CheckIfIdentifierNameIsReserved(Data.Start, Data.ByteCount, Data.CharCount, File);
+/* Adds a use of Name at Address to the index.
+ */
+translation_scope void AddSymbolDest(symbol_index *Symbols, const char *Name, int ByteCount, int Address, int Line, int Column) {
+	if (Symbols->DestCount == Symbols->DestCapacity) {
+		Symbols->DestCapacity = Max(64, Symbols->DestCapacity * 2);
+		GrowIdentifierTable(&Symbols->Dests, Symbols->DestCapacity);
+		Symbols->NextReference = realloc(Symbols->NextReference, Symbols->DestCapacity * sizeof(*Symbols->NextReference));
+		Symbols->DestToSource = realloc(Symbols->DestToSource, Symbols->DestCapacity * sizeof(*Symbols->DestToSource));
+	}
+	const int DestIndex = Symbols->DestCount++;
+	SetIdentifier(&Symbols->Dests, DestIndex, Name, ByteCount, Address, Line, Column);
+	Symbols->DestToSource[DestIndex] = -1;
 
-			for (int Index = 0; !DidErrorOccur; Index++) {
-				const identifier_source *IdentifierSource = GetFromPagedList(IdentifierSourceList, Index);
-				if (IdentifierSource == 0) { break; }
-		
-				if (Data.ByteCount == IdentifierSource->ByteCount &&
-				    CompareStr(Data.Start, IdentifierSource->Start, Data.ByteCount)) {
-					ReportErrorConditionally(TRUE, &DidErrorOccur, "[Error L:%d C:%d] Identifier \"%.*s\" was redefined!", Data.ByteCount, Data.Start);
-				}
-			}
-			
-			ProgramMetaData[CurrentAddress - 1] |= PMD_DefinedIdentifier;
-			// .Value is CurrentAddress - 1 because that was the address of the last instruction that was processed. Thanks to the following checks, we can be sure that we're refering to the instruction that was immeatly preceeded this .Ident.
-			
-			AddToPagedList(IdentifierSourceList, &Data);
-		} break;
+	if (Symbols->AddressToDest[Address] == -1) {
+		Symbols->AddressToDest[Address] = DestIndex;
+	}
+}
 
-		case(KW_Data): {
-			// Data [NUMBER]
+/* Builds the per identifier reference chains from DestToSource. Walking backwards and prepending keeps each chain in source order.
+ */
+translation_scope void LinkSymbolReferences(symbol_index *Symbols) {
+	for (int SourceIndex = 0; SourceIndex < Symbols->SourceCount; SourceIndex++) {
+		Symbols->FirstReference[SourceIndex] = -1;
+	}
+	for (int DestIndex = Symbols->DestCount - 1; DestIndex >= 0; DestIndex--) {
+		const int SourceIndex = Symbols->DestToSource[DestIndex];
+		Symbols->NextReference[DestIndex] = -1;
+		if (SourceIndex != -1) {
+			Symbols->NextReference[DestIndex] = Symbols->FirstReference[SourceIndex];
+			Symbols->FirstReference[SourceIndex] = DestIndex;
+		}
+	}
+}
 
-			IncrementFilePosition(File, Keywords[KW_Data].Length);
-			AdvancePastWhitespaceOnSameLine(File);
-			ToIncrementAddress = TRUE;
-			LastLineOperationWasProcessed = File->Line;
-			int Value = 0;
-			
-			if (ExtractNumberDecimal(File, &Value)) {
-			}
-			else if (ExtractNumberHexadecimal(File, &Value)) {
-			}
-			else {
-				ReportErrorConditionally(TRUE, &DidErrorOccur, "[Error L:%d C:%d] Failed to read an argument for the Data directive. Please provide a number constant within 0 - 65535 (0x0 - 0xffff).\n", File->Line, File->Column);
-			}
-			ReportErrorConditionally(Value < 0 || Value > 0xffff, &DidErrorOccur, "[Error L:%d C:%d] Invalid argument for the Data directive. Please provide a number constant within 0 - 65535 (0x0 - 0xffff).\n", File->Line, File->Column);
-			DidErrorOccur = WriteProgramData(File, Value, CurrentAddress, PMD_IsOccupied | PMD_IsData);
-		} break;
+/* Statement is where the statement writing Data started, which is what SourceMap points back to.
+ * While a .Section is open, CurrentAddress is into the section staging area instead of Program.
+ */
+translation_scope inline void WriteProgramData(assembler_context *Context, const file_state *File, const file_state *Statement, uint16_t Data, int CurrentAddress, uint8_t ProgramMetaDataFlags, int *DidErrorOccur) {
+	const int InSection = Context->OpenSection != -1;
+	uint8_t *MetaData = InSection ? Context->SectionMetaData : Context->ProgramMetaData;
+	ReportErrorConditionally(Context, MetaData[CurrentAddress] & PMD_IsOccupied, DidErrorOccur, DC_Overlap, File->At, File->Line, File->Column, "An instruction overlapped another instruction! Pay mind to your usage of .SetAddr");
+	(InSection ? Context->SectionProgram : Context->Program)[CurrentAddress] = Data;
+	MetaData[CurrentAddress] |= ProgramMetaDataFlags;
+	(InSection ? Context->SectionSourceMap : Context->SourceMap)[CurrentAddress] = (source_location){.Line = Statement->Line, .Column = Statement->Column, .Offset = Statement->At - Context->Source};
+}
 
-		default: {
-			ReportErrorConditionally(TRUE, &DidErrorOccur, "[Error L:%d C:%d] \"%.*s\" is not a valid keyword.\n", File->Line, File->Column, KeywordLength, File->At);
-		}
-			
-		}		         
+/* Starts a new section at Statement, which statements are assembled into until CloseSection().
+ * Returns the staging address of its first word. Sections are staged one after another, so this is where the last one ended.
+ */
+translation_scope int OpenSection(assembler_context *Context, const file_state *Statement) {
+	if (Context->SectionCount == Context->SectionCapacity) {
+		Context->SectionCapacity = Max(16, Context->SectionCapacity * 2);
+		Context->Sections = realloc(Context->Sections, Context->SectionCapacity * sizeof(*Context->Sections));
 	}
+	const program_section *Previous = Context->SectionCount ? &Context->Sections[Context->SectionCount - 1] : 0;
+	Context->OpenSection = Context->SectionCount++;
+	program_section *Section = &Context->Sections[Context->OpenSection];
+	*Section = (program_section){
+		.Start = Previous ? Previous->Start + Previous->Length : 0,
+		.Base = -1,
+		.FirstSource = Context->Symbols.SourceCount,
+		.FirstDest = Context->Symbols.DestCount,
+		.At = Statement->At,
+		.Line = Statement->Line,
+		.Column = Statement->Column,
+	};
+	return Section->Start;
+}
 
-	// resolve identifiers
+/* Ends the open .Section, if there is one. CurrentAddress is the staging address just past its last word.
+ */
+translation_scope void CloseSection(assembler_context *Context, int CurrentAddress) {
+	if (Context->OpenSection == -1) { return; }
+	program_section *Section = &Context->Sections[Context->OpenSection];
+	Section->Length = CurrentAddress - Section->Start;
+	Section->SourceCount = Context->Symbols.SourceCount - Section->FirstSource;
+	Section->DestCount = Context->Symbols.DestCount - Section->FirstDest;
+	Context->OpenSection = -1;
+}
 
-	if (!DidErrorOccur) {
-		for (int DestIndex = 0; ; DestIndex++) {
-			const identifier_dest *IdentifierDest = GetFromPagedList(IdentifierDestinationList, DestIndex);
-			if (IdentifierDest == 0) { break; }
+/* Finds a gap of Length free words in Program, first fit. Returns -1 if there isn't one.
+ */
+translation_scope int FindFreeGap(const assembler_context *Context, int Length) {
+	const program_bits *Occupied = &Context->ProgramBits[PMDB_IsOccupied];
+	for (int GapStart = FindNextClearBit(Occupied, 0); GapStart < Kilobyte(4);) {
+		const int GapEnd = FindNextSetBit(Occupied, GapStart);
+		if (GapEnd - GapStart >= Length) { return GapStart; }
+		GapStart = FindNextClearBit(Occupied, GapEnd);
+	}
+	return -1;
+}
 
-			DidErrorOccur = TRUE;
-			for (int SourceIndex = 0; ; SourceIndex++) {
-				const identifier_source *IdentifierSource = GetFromPagedList(IdentifierSourceList, SourceIndex);
-				if (IdentifierSource == 0) { break; }
-				
-				if (IdentifierDest->ByteCount == IdentifierSource->ByteCount) {
-					if (CompareStr(IdentifierDest->Start, IdentifierSource->Start, IdentifierDest->ByteCount)) {
-						Assert(IdentifierSource->Value <= 0xfff); // I'm pretty sure this should never be possible.
-						Program[IdentifierDest->Address] |= IdentifierSource->Value;
-						DidErrorOccur = FALSE;
-						break; // we can't match more than once.
-					}
-				}
-			}
-			if (DidErrorOccur) {
-				printf("[Error L:%d C:%d] Identifier \"%.*s\" was never defined!\n", IdentifierDest->Line, IdentifierDest->Column, IdentifierDest->ByteCount, IdentifierDest->Start);
-				break;
-			}
+/* Moves every .Section into a free gap of Program, largest first, each into the first gap it fits (first fit decreasing).
+ * The first section goes at address 0 if nothing was placed there with .SetAddr, since that is where the program starts running.
+ * The identifiers each section defines and uses are moved with it. Returns FALSE if a section didn't fit anywhere.
+ */
+translation_scope int PlaceSections(assembler_context *Context) {
+	int DidErrorOccur = FALSE;
+	symbol_index *Symbols = &Context->Symbols;
+	int *Order = malloc(sizeof(*Order) * Context->SectionCount);
+	int OrderCount = 0;
+	for (int SectionIndex = 0; SectionIndex < Context->SectionCount; SectionIndex++) {
+		if (Context->Sections[SectionIndex].Length == 0) { continue; }
+		// Insertion sort, largest first. Sections of the same size keep their source order.
+		int Index = OrderCount++;
+		while (Index > 0 && Context->Sections[Order[Index - 1]].Length < Context->Sections[SectionIndex].Length) {
+			Order[Index] = Order[Index - 1];
+			Index--;
 		}
+		Order[Index] = SectionIndex;
 	}
 
+	UpdateProgramBits(Context);
+	int EntrySection = -1;
+	for (int SectionIndex = 0; SectionIndex < Context->SectionCount && EntrySection == -1; SectionIndex++) {
+		if (Context->Sections[SectionIndex].Length) { EntrySection = SectionIndex; }
+	}
+	if (EntrySection != -1 && FindFreeGap(Context, Context->Sections[EntrySection].Length) != 0) { EntrySection = -1; }
+
+	for (int Index = -1; Index < OrderCount; Index++) {
+		const int SectionIndex = (Index == -1) ? EntrySection : Order[Index];
+		if (SectionIndex == -1 || (Index != -1 && SectionIndex == EntrySection)) { continue; }
+		program_section *Section = &Context->Sections[SectionIndex];
+		Section->Base = FindFreeGap(Context, Section->Length);
+		ReportErrorConditionally(Context, Section->Base == -1, &DidErrorOccur, DC_SectionDoesNotFit, Section->At, Section->Line, Section->Column, "There is no gap of %d free words left for this .Section. Make room with .SetAddr, or split the section into smaller ones.", Section->Length);
+		if (Section->Base == -1) { continue; }
+
+		for (int Offset = 0; Offset < Section->Length; Offset++) {
+			Context->Program[Section->Base + Offset] = Context->SectionProgram[Section->Start + Offset];
+			Context->ProgramMetaData[Section->Base + Offset] = Context->SectionMetaData[Section->Start + Offset];
+			Context->SourceMap[Section->Base + Offset] = Context->SectionSourceMap[Section->Start + Offset];
+		}
+		UpdateProgramBits(Context);
+		const int Moved = Section->Base - Section->Start;
+		for (int SourceIndex = Section->FirstSource; SourceIndex < Section->FirstSource + Section->SourceCount; SourceIndex++) {
+			Symbols->Sources.Addresses[SourceIndex] += Moved;
+		}
+		for (int DestIndex = Section->FirstDest; DestIndex < Section->FirstDest + Section->DestCount; DestIndex++) {
+			Symbols->Dests.Addresses[DestIndex] += Moved;
+		}
+	}
+	free(Order);
+
+	// The address indexes were filled in with staging addresses for the identifiers in sections.
+	memset(Symbols->AddressToSource, 0xFF, sizeof(Symbols->AddressToSource));
+	memset(Symbols->AddressToDest, 0xFF, sizeof(Symbols->AddressToDest));
+	for (int SourceIndex = 0; SourceIndex < Symbols->SourceCount; SourceIndex++) {
+		const int Value = Symbols->Sources.Addresses[SourceIndex];
+		if (Value >= 0 && Value < Kilobyte(4) && Symbols->AddressToSource[Value] == -1) { Symbols->AddressToSource[Value] = SourceIndex; }
+	}
+	for (int DestIndex = 0; DestIndex < Symbols->DestCount; DestIndex++) {
+		const int Address = Symbols->Dests.Addresses[DestIndex];
+		if (Symbols->AddressToDest[Address] == -1) { Symbols->AddressToDest[Address] = DestIndex; }
+	}
 	return !DidErrorOccur;
 }
 
-int fprintfCheck(int *Success, FILE *File, char *FormatStr, ...) {
-	va_list ArgList;
-	va_start(ArgList, FormatStr);
+/* Fills in the address of every identifier used, once every identifier has been defined and placed.
+ * Returns FALSE if any of them were never defined.
+ */
+translation_scope int ResolveIdentifiers(assembler_context *Context) {
+	int DidErrorOccur = FALSE;
+	symbol_index *Symbols = &Context->Symbols;
+	for (int DestIndex = 0; DestIndex < Symbols->DestCount; DestIndex++) {
+		const identifier_table *Dests = &Symbols->Dests;
+		const int SourceIndex = FindSymbol(Symbols, Dests->Names[DestIndex], Dests->ByteCounts[DestIndex]);
+		Symbols->DestToSource[DestIndex] = SourceIndex;
+
+		if (SourceIndex == -1) {
+			ReportErrorConditionally(Context, TRUE, &DidErrorOccur, DC_Undefined, Dests->Names[DestIndex], Dests->Lines[DestIndex], Dests->Columns[DestIndex], "Identifier \"%.*s\" was never defined!", Dests->ByteCounts[DestIndex], Dests->Names[DestIndex]);
+			continue;
+		}
 
-	int Result = vfprintf(File, FormatStr, ArgList);
-	if (Result < 0) { *Success = FALSE; }
-	
-	va_end(ArgList);
-	
-	if (!Success) {
-		return Result = 0;
+		const int Value = Symbols->Sources.Addresses[SourceIndex];
+		Assert(Value <= 0xfff); // I'm pretty sure this should never be possible.
+		Context->Program[Dests->Addresses[DestIndex]] |= Value;
 	}
-	return Result;
+	LinkSymbolReferences(Symbols);
+	return !DidErrorOccur;
 }
 
-int snprintfCheck(int *Success, char *Buffer, size_t Size, char *FormatStr, ...) {
-	va_list ArgList;
-	va_start(ArgList, FormatStr);
+/* Reads the statement at File->At into Statement, leaving File just past it. See statement for what is and isn't done here.
+ * A statement that doesn't start with a keyword can't be read any further, so File is left at the end of its line. If it is a macro call, the rest of the line is its arguments.
+ */
+translation_scope void ParseStatement(file_state *File, statement *Statement) {
+	*Statement = (statement){.Start = *File};
+	PeekKeyword(File, &Statement->KeywordLength);
+	int KeywordIndex = 0;
+	for (; KeywordIndex < KW_COUNT; KeywordIndex++) {
+		if (CompareStrToKeyword(File->At, Statement->KeywordLength, Keywords[KeywordIndex])) {
+			break;
+		}
+	}
+	Statement->Keyword = KeywordIndex;
+	if (KeywordIndex == KW_COUNT) {
+		if (Statement->KeywordLength) {
+			IncrementFilePosition(File, Statement->KeywordLength);
+			AdvancePastWhitespaceOnSameLine(File);
+		}
+		Statement->Argument = *File;
+		AdvanceToEndOfLine(File);
+		Statement->End = *File;
+		return;
+	}
 
-	int Result = vsnprintf(Buffer, Size, FormatStr, ArgList);
-	if (Result < 0) { *Success = FALSE; }
-	
-	va_end(ArgList);
+	IncrementFilePosition(File, Keywords[KeywordIndex].Length);
+	AdvancePastWhitespaceOnSameLine(File);
+	Statement->Argument = *File;
+
+	switch(KeywordIndex) {
+
+	case(KW_Jumpstore):
+	case(KW_Jump):
+	case(KW_Jumpi):
+	case(KW_Load):
+	case(KW_Loadi):
+	case(KW_Store):
+	case(KW_Storei):
+	case(KW_Add):
+	case(KW_Addi):
+	case(KW_Sub): {
+		// KEYWORD [Addr|Identifier]
+
+		// @TODO Allow 0d numbers as addresses
+		if (ExtractNumberHexadecimal(File, &Statement->Value)) {
+			Statement->ArgumentKind = ARG_Number;
+		}
+		else if (ExtractIdentifier(File, &Statement->CharCount, &Statement->ByteCount)) {
+			Statement->ArgumentKind = ARG_Identifier;
+		}
+	} break;
 
-	if (!Success) {
-		return Result = 0;
-	}
-	return Result;
-}
+	case(KW_Skipcond): {
+		// Skipcond [lesser|greater|equal|NUMBER]
 
-int OutputLogisimImage(FILE *FileStream) {
-	int Success = TRUE;
-	fprintfCheck(&Success, FileStream, "v2.0 raw\r\n");
+		Statement->ArgumentKind = ARG_Number;
+		if (CompareStr(File->At, "lesser", 6)) {
+			IncrementFilePosition(File, 6);
+			Statement->Value = 0x000;
+		}
+		else if (CompareStr(File->At, "equal", 5)) {
+			IncrementFilePosition(File, 5);
+			Statement->Value = 0x400;
+		}
+		else if (CompareStr(File->At, "greater", 7)) {
+			IncrementFilePosition(File, 7);
+			Statement->Value = 0xC00;
+		}
+		else if (!ExtractNumberHexadecimal(File, &Statement->Value)) {
+			Statement->ArgumentKind = ARG_None;
+			// Only a macro parameter can stand in for the operation, see ExpandMacro().
+			if (File->At == Statement->Argument.At && ExtractIdentifier(File, &Statement->CharCount, &Statement->ByteCount)) {
+				Statement->ArgumentKind = ARG_Identifier;
+			}
+		}
+	} break;
 
-	int Consectuive = 0;
-	int Prev = Program[0];
-	for (int Index = 0; Index <= Kilobyte(4) && Success; Index++) {
-		if (Prev == Program[Index] && Index != Kilobyte(4)) {
-			Consectuive++;
+	case(KW_M_SetAddr): {
+		// .SetAddr [Addr]
+
+		if (ExtractNumberHexadecimal(File, &Statement->Value)) {
+			Statement->ArgumentKind = ARG_Number;
 		}
-		else {
-			char Buffer[16] = {0};
-			if (Consectuive == 1) {
-				fprintfCheck(&Success, FileStream, "%X\n", Prev);
+	} break;
+
+	case(KW_M_Ident): {
+		// .Ident [Identifier]
+
+		if (ExtractIdentifier(File, &Statement->CharCount, &Statement->ByteCount)) {
+			Statement->ArgumentKind = ARG_Identifier;
+		}
+	} break;
+
+	case(KW_Data): {
+		// Data [NUMBER]
+
+		if (ExtractNumberDecimal(File, &Statement->Value)) {
+			Statement->ArgumentKind = ARG_Number;
+		}
+		else if (ExtractNumberHexadecimal(File, &Statement->Value)) {
+			Statement->ArgumentKind = ARG_Number;
+		}
+		else if (File->At == Statement->Argument.At && ExtractIdentifier(File, &Statement->CharCount, &Statement->ByteCount)) {
+			// Only a macro parameter can stand in for the number, see ExpandMacro().
+			Statement->ArgumentKind = ARG_Identifier;
+		}
+	} break;
+
+	case(KW_M_Include): {
+		// .Include "Path"
+
+		if (File->At[0] == '"') {
+			IncrementFilePosition(File, 1);
+			const file_state PathStart = *File;
+			while (File->At[0] != '"' &&
+			       File->At[0] != '\n' &&
+			       File->At[0] != '\0') {
+				Statement->CharCount++;
+				Statement->ByteCount += IncrementFilePosition(File, 1);
 			}
-			else {
-				fprintfCheck(&Success, FileStream, "%d*%X\n", Consectuive, Prev);
+			if (File->At[0] == '"' && Statement->ByteCount != 0) {
+				IncrementFilePosition(File, 1);
+				Statement->Argument = PathStart;
+				Statement->ArgumentKind = ARG_Path;
 			}
-			Consectuive = 1;
 		}
-		Prev = Program[Index];
-	}
+	} break;
 
-	fclose(FileStream);
+	case(KW_M_Macro): {
+		// .Macro Name [Parameter ...]
+
+		if (PeekKeyword(File, &Statement->ByteCount)) {
+			Statement->CharCount = Statement->ByteCount;
+			Statement->ArgumentKind = ARG_Identifier;
+		}
+		// The parameters are read when the macro is defined, see DefineMacro().
+		AdvanceToEndOfLine(File);
+	} break;
 
-	if (Success == FALSE) {
-		printf("[Error Logisim] There was a error encountered while writing to the Logisim output file!\n");
 	}
-	
-	return Success;
-}
 
-int OutputRawHex(FILE *FileStream) {
-	int Result = fwrite(Program, sizeof(Program), 1, FileStream);
-	int Success = Result == 1;
-	
-	fclose(FileStream);
+	Statement->End = *File;
+}
 
-	if (Success == FALSE) {
-		printf("[Error Raw Hex] There was a error encountered while writing to the hex output file!\n");
+translation_scope uint64_t HashText(const char *Text, int Length) {
+	// 64 bit FNV-1a
+	uint64_t Result = 0xcbf29ce484222325;
+	for (int Index = 0; Index < Length; Index++) {
+		Result ^= (uint8_t)Text[Index];
+		Result *= 0x100000001b3;
 	}
+	return Result;
+}
 
-	return Success;
+translation_scope void ReleaseIncludeFile(include_file *File) {
+	File->References--;
+	if (File->References == 0) {
+		free(File->Path);
+		free(File->Text);
+		free(File->Statements);
+		free(File);
+	}
 }
 
-int OutputSymbolTable(FILE *FileStream, paged_list *IdentifierDestinationList, paged_list *IdentifierSourceList) {
-	int IdentifierMaxCharLength = 0;
-	int Success = TRUE;
+/* Finds the file at Path in the context's include cache, reading and parsing it again only if it changed since it was cached.
+ * A file whose modified time changed but whose text didn't, say from a checkout touching it, costs a hash instead of a parse.
+ * The caller gets a reference to the result, to be let go with ReleaseIncludeFile(). Returns 0 if the file couldn't be read.
+ */
+translation_scope include_file* LoadIncludeFile(assembler_context *Context, const char *Path) {
+	uint64_t ModifiedTime = 0, FileId = 0;
+	if (!Platform_GetFileInfo(Path, &ModifiedTime, &FileId)) { return 0; }
 
-	for (int Index = 0; ; Index++) {
-		const identifier_source *IdentifierSource = GetFromPagedList(IdentifierSourceList, Index);
-		if (IdentifierSource == 0) { break; }
-		
-		if (IdentifierSource->CharCount > IdentifierMaxCharLength) {
-			IdentifierMaxCharLength = IdentifierSource->CharCount;
-		}
+	int CacheIndex = -1;
+	for (int Index = 0; Index < Context->IncludeCacheCount && CacheIndex == -1; Index++) {
+		if (strcmp(Context->IncludeCache[Index]->Path, Path) == 0) { CacheIndex = Index; }
+	}
+	include_file *Cached = (CacheIndex != -1) ? Context->IncludeCache[CacheIndex] : 0;
+	if (Cached && Cached->ModifiedTime == ModifiedTime && Cached->FileId == FileId) {
+		Cached->References++;
+		return Cached;
 	}
 
-	IdentifierMaxCharLength = Max(IdentifierMaxCharLength, 10);
+	FILE *FileStream = fopen(Path, "rb");
+	if (FileStream == 0) { return 0; }
+	fseek(FileStream, 0, SEEK_END);
+	const long FileSize = ftell(FileStream);
+	fseek(FileStream, 0, SEEK_SET);
+	int Success = TRUE;
+	char *Text = LoadFileIntoMemory(FileStream, (int)FileSize, &Success);
+	if (!Success) {
+		if (Text) { free(Text); }
+		return 0;
+	}
 
-	fprintfCheck(&Success, FileStream, "| %- *s | Identifier's Value | Addresses that use Identifier\n", IdentifierMaxCharLength, "Identifier");
-	for (int SourceIndex = 0; Success; SourceIndex++) {
-		const identifier_source *IdentifierSource = GetFromPagedList(IdentifierSourceList, SourceIndex);
-		if (IdentifierSource == 0) { break; }
+	const int TextLength = strlen(Text);
+	const uint64_t Hash = HashText(Text, TextLength);
+	if (Cached && Cached->Hash == Hash) {
+		free(Text);
+		Cached->ModifiedTime = ModifiedTime;
+		Cached->FileId = FileId;
+		Cached->References++;
+		return Cached;
+	}
 
-		int AdditionalPadding = (IdentifierSource->ByteCount - IdentifierSource->CharCount); // Extra padding based on the difference of the charcter count and byte count. This is because the printf family of functions calulated padding based on bytes writen.
-		fprintfCheck(&Success, FileStream, "| %- *.*s | 0x%-0*.3X | ", IdentifierMaxCharLength + AdditionalPadding, IdentifierSource->ByteCount, IdentifierSource->Start, 18 - 2, IdentifierSource->Value);
-		
-		for (int DestIndex = 0; Success; DestIndex++) {
-			const identifier_dest *IdentifierDest = GetFromPagedList(IdentifierDestinationList, DestIndex);
-			if (IdentifierDest == 0) { break; }
-			
-			if ((IdentifierSource->ByteCount == IdentifierDest->ByteCount) &&
-			    CompareStr(IdentifierSource->Start, IdentifierDest->Start, IdentifierSource->ByteCount)) {
-				fprintfCheck(&Success, FileStream, " 0x%-0.3X", IdentifierDest->Address);
-			}
+	include_file *File = calloc(1, sizeof(include_file));
+	const int PathLength = strlen(Path);
+	File->Path = malloc(PathLength + 1);
+	memcpy(File->Path, Path, PathLength + 1);
+	File->Text = Text;
+	File->TextLength = TextLength;
+	File->ModifiedTime = ModifiedTime;
+	File->FileId = FileId;
+	File->Hash = Hash;
+	File->References = 2; // The cache's, and the caller's
+
+	file_state FileState = {
+		.Line = 1,
+		.Column = 0,
+		.At = Text,
+	};
+	int StatementCapacity = 0;
+	while (TRUE) {
+		AdvancePastWhitespaceAndComments(&FileState);
+		if (FileState.At[0] == '\0') { break; }
+		if (File->StatementCount == StatementCapacity) {
+			StatementCapacity = Max(64, StatementCapacity * 2);
+			File->Statements = realloc(File->Statements, StatementCapacity * sizeof(statement));
 		}
-		fprintfCheck(&Success, FileStream, "\n");
+		ParseStatement(&FileState, &File->Statements[File->StatementCount++]);
 	}
-	fclose(FileStream);
 
-	if (Success == FALSE) {
-		printf("[Error Symbol Table] There was a error encountered while writing to the symbol table output file!\n");
+	if (Cached) {
+		// If an assembly still holds the old version, it lives until that assembly is reset.
+		Context->IncludeCache[CacheIndex] = File;
+		ReleaseIncludeFile(Cached);
 	}
+	else {
+		if (Context->IncludeCacheCount == Context->IncludeCacheCapacity) {
+			Context->IncludeCacheCapacity = Max(16, Context->IncludeCacheCapacity * 2);
+			Context->IncludeCache = realloc(Context->IncludeCache, Context->IncludeCacheCapacity * sizeof(include_file*));
+		}
+		Context->IncludeCache[Context->IncludeCacheCount++] = File;
+	}
+	return File;
+}
 
-	return Success;
+/* Drops "." segments, and ".." segments along with the directory before them, so one file is always named the same way and the include guard can recognise it.
+ * Separators all become '/'. Path is changed in place.
+ */
+translation_scope void NormalizePath(char *Path) {
+	const int IsAbsolute = (Path[0] == '/') || (Path[0] == '\\');
+	char *Base = Path + IsAbsolute; // Nothing before here can be dropped
+	char *Read = Base, *Write = Base;
+	while (Read[0] != 0) {
+		char *End = Read;
+		while (End[0] != 0 && End[0] != '/' && End[0] != '\\') { End++; }
+		const int Length = End - Read;
+
+		char *LastSegment = Write;
+		while (LastSegment > Base && LastSegment[-1] != '/') { LastSegment--; }
+		const int LastIsParent = (Write - LastSegment == 2) && LastSegment[0] == '.' && LastSegment[1] == '.';
+
+		if (Length == 0 || (Length == 1 && Read[0] == '.')) {
+		}
+		else if (Length == 2 && Read[0] == '.' && Read[1] == '.' && Write > Base && !LastIsParent) {
+			Write = (LastSegment > Base) ? LastSegment - 1 : Base;
+		}
+		else {
+			if (Write > Base) { *Write++ = '/'; }
+			memmove(Write, Read, Length);
+			Write += Length;
+		}
+		Read = (End[0] != 0) ? End + 1 : End;
+	}
+	Write[0] = 0;
 }
 
-int OutputListing(FILE *FileStream, paged_list *IdentifierDestinationList, paged_list *IdentifierSourceList) {
-	int Success = TRUE;
-	int InMemoryGap = FALSE;
+/* Joins an .Include path onto the directory of IncludingPath, the file the .Include is in. Absolute paths are used as they are.
+ * IncludingPath may be 0, then Path is relative to the working directory. The result is malloc'd and normalized.
+ */
+translation_scope char* ResolveIncludePath(const char *IncludingPath, const char *Path, int PathLength) {
+	const int IsAbsolute = (Path[0] == '/') || (Path[0] == '\\') || (PathLength > 1 && Path[1] == ':');
 
-	// @TODO make this growable!!! Someone someday will be really mad at me for limiting the size of this string.
-	char *ContentsOfAC = calloc(5000, sizeof(wchar_t));
-	int ContentsOfACSize = 5000;
+	int DirectoryLength = 0;
+	for (int Index = 0; IncludingPath && !IsAbsolute && IncludingPath[Index] != 0; Index++) {
+		if (IncludingPath[Index] == '/' || IncludingPath[Index] == '\\') { DirectoryLength = Index + 1; }
+	}
+
+	char *Result = malloc(DirectoryLength + PathLength + 1);
+	if (DirectoryLength) { memcpy(Result, IncludingPath, DirectoryLength); }
+	memcpy(Result + DirectoryLength, Path, PathLength);
+	Result[DirectoryLength + PathLength] = 0;
+	NormalizePath(Result);
+	return Result;
+}
+
+// Where assembly is up to, carried from one statement to the next and into included files.
+typedef struct {
+	int CurrentAddress;
+	int ToIncrementAddress; // The last statement took up a word, which CurrentAddress moves past before the next statement
+	int LastLineOperationWasProcessed; // A .Ident on this line names the operation before it, -1 if there is nothing it could name
+	int File; // Index into assembler_context.Includes of the file being assembled, or -1 for the source itself
+	int DefiningMacro; // Index into assembler_context.Macros of the .Macro whose body is being read, or -1
+	int Stop; // Assembly can't carry on past this point
+} assembly_state;
+
+translation_scope int IncludeFile(assembler_context *Context, assembly_state *State, const statement *Statement);
+translation_scope int DefineMacro(assembler_context *Context, assembly_state *State, const statement *Statement);
+translation_scope int FinishMacro(assembler_context *Context, assembly_state *State);
+translation_scope int FindMacro(const assembler_context *Context, const statement *Statement);
+translation_scope int CallMacro(assembler_context *Context, assembly_state *State, int Macro, const statement *Statement);
+
+/* Assembles one statement read by ParseStatement() at State->CurrentAddress, recording every error and warning it has in Context->Diagnostics.
+ * Returns FALSE if the statement had an error, the caller then skips the rest of its line.
+ */
+translation_scope int AssembleStatement(assembler_context *Context, assembly_state *State, const statement *Statement) {
+	int StatementError = FALSE;
+	const int KeywordIndex = Statement->Keyword;
+	const file_state *Start = &Statement->Start, *Argument = &Statement->Argument, *End = &Statement->End;
+	// Words from an included file map back to the .Include in the source that brought it in, and words from a macro to the call that expanded it.
+	const file_state *MapTo = (State->File != -1) ? &Context->Includes[State->File].IncludedAt : (Context->ExpandedAt ? Context->ExpandedAt : Start);
+
+	if (State->DefiningMacro != -1) {
+		// A macro's body is only kept here, it is assembled wherever the macro is called.
+		if (KeywordIndex == KW_M_EndMacro) { return FinishMacro(Context, State); }
+		const macro_definition *Macro = &Context->Macros[State->DefiningMacro];
+		ReportErrorConditionally(Context, KeywordIndex == KW_M_Macro, &StatementError, DC_BadMacro, Start->At, Start->Line, Start->Column, "A .Macro can't be defined inside another one. Please end \"%.*s\" with .EndMacro first.", Macro->NameLength, Macro->Name);
+		ReportErrorConditionally(Context, KeywordIndex == KW_M_Include, &StatementError, DC_BadMacro, Start->At, Start->Line, Start->Column, "An .Include can't be used inside a macro. Please include the file before the .Macro instead.");
+		if (!StatementError) {
+			if (Context->MacroStatementCount == Context->MacroStatementCapacity) {
+				Context->MacroStatementCapacity = Max(64, Context->MacroStatementCapacity * 2);
+				Context->MacroStatements = realloc(Context->MacroStatements, Context->MacroStatementCapacity * sizeof(macro_statement));
+			}
+			Context->MacroStatements[Context->MacroStatementCount++] = (macro_statement){.Statement = *Statement, .Parameter = -1, .Label = -1, .FirstArgument = -1};
+			Context->Macros[State->DefiningMacro].StatementCount++;
+		}
+		return !StatementError;
+	}
+
+	if (State->ToIncrementAddress == TRUE) {
+		State->CurrentAddress++;
+		State->ToIncrementAddress = FALSE;
+	}
+	if (State->CurrentAddress < 0 || State->CurrentAddress > 0xfff) {
+		// There is nowhere to put anything past the end of memory, so this is the one error we can't recover from.
+		ReportErrorConditionally(Context, TRUE, &StatementError, DC_AddressOverflow, Start->At, Start->Line, Start->Column, "The CurrentAddress (%X) is less than 0 or greater than 0xfff. This was likely caused by a .SetAddress that was too high, or if there are more than 4095 instructions in this program.\nTerminateing Assembly...", State->CurrentAddress);
+		State->Stop = TRUE;
+		return FALSE;
+	}
+
+	int CurrentAddress = State->CurrentAddress;
+	int ToIncrementAddress = FALSE;
+	int LastLineOperationWasProcessed = State->LastLineOperationWasProcessed;
+
+	ReportErrorConditionally(Context, Statement->KeywordLength == 0, &StatementError, DC_MissingKeyword, Start->At, Start->Line, Start->Column, "Failed to find a keyword");
+
+	switch(KeywordIndex) {
+
+	case(KW_Jumpstore):
+	case(KW_Jump):
+	case(KW_Jumpi):
+	case(KW_Load):
+	case(KW_Loadi):
+	case(KW_Store):
+	case(KW_Storei):
+	case(KW_Add):
+	case(KW_Addi):
+	case(KW_Sub): {
+		// KEYWORD [Addr|Identifier]
+
+		ToIncrementAddress = TRUE;
+		LastLineOperationWasProcessed = Start->Line;
+
+		int Address = 0;
+		if (Statement->ArgumentKind == ARG_Number) {
+			Address = Statement->Value;
+			ReportErrorConditionally(Context, Address > 0xFFF || Address < 0, &StatementError, DC_AddressOutOfRange, Argument->At, End->Line, End->Column, "The Address provided (0x%X) was not between 0x0 and 0xFFF.", Address);
+			WriteProgramData(Context, End, MapTo, Keywords[KeywordIndex].Opcode | Address, CurrentAddress, PMD_IsOccupied, &StatementError);
+		}
+		else if (Statement->ArgumentKind == ARG_Identifier) {
+			if (CheckIfIdentifierNameIsReserved(Context, Argument->At, Statement->ByteCount, Statement->CharCount, End)) {
+				StatementError = TRUE;
+			}
+			else {
+				AddSymbolDest(&Context->Symbols, Argument->At, Statement->ByteCount, CurrentAddress, Argument->Line, Argument->Column);
+				WriteProgramData(Context, End, MapTo, Keywords[KeywordIndex].Opcode, CurrentAddress, PMD_IsOccupied | PMD_UsedIdentifier, &StatementError);
+			}
+		}
+		else {
+			ReportErrorConditionally(Context, TRUE, &StatementError, DC_MissingArgument, End->At, End->Line, End->Column, "Failed to read an argument for %s operation. Please provide a Hex Address or a Identifier.", Keywords[KeywordIndex].String);
+		}
+
+		if (KeywordIndex == KW_Jumpstore) {
+			ReportErrorConditionally(Context, Address == 0xFFF, 0, DC_JnsToLastAddress, Argument->At, End->Line, End->Column, "A jns instruction was provided 0xfff as a destination address. Make sure you know what you Marie Processor does when the Program Counter is > 0xFFF!");
+		}
+	} break;
+
+	case(KW_Input):
+	case(KW_Output):
+	case(KW_Halt):
+	case(KW_Clear): {
+		// KEYWORD
+
+		ToIncrementAddress = TRUE;
+		LastLineOperationWasProcessed = Start->Line;
+
+		WriteProgramData(Context, End, MapTo, Keywords[KeywordIndex].Opcode, CurrentAddress, PMD_IsOccupied, &StatementError);
+	} break;
+
+	case(KW_Skipcond): {
+		// Skipcond [lesser|greater|equal|NUMBER]
+
+		ToIncrementAddress = TRUE;
+		LastLineOperationWasProcessed = Start->Line;
+
+		char *ArgumentStart = Argument->At;
+		const int RawOperation = Statement->Value;
+		if (Statement->ArgumentKind != ARG_Number) {
+			// Only a macro parameter can be an identifier here. One that wasn't replaced by a number is reported where it starts, as if nothing was read.
+			const file_state *Missing = (Statement->ArgumentKind == ARG_Identifier) ? Argument : End;
+			ReportErrorConditionally(Context, TRUE, &StatementError, DC_MissingArgument, Missing->At, Missing->Line, Missing->Column, "Failed to read an argument for Skipcond operation. Please provide either a named operation (\"lesser\", \"equal\", or \"greater\") or the raw operation value (0x000, 0x400, 0xC000 respectively).");
+		}
+		const int DidFail = RawOperation != 0x000 && RawOperation != 0x400 && RawOperation != 0xC00;
+		ReportErrorConditionally(Context, DidFail, 0, DC_UnknownSkipcond, ArgumentStart, End->Line, End->Column, "The Operation provided (0x%0.3X) was not a known operation. We will continue to assemble this program but know that this skipcond instruction may have unintended behaivor!\nKnown operation constants are lesser (0x000), equal (0x400), or greater (0xC00)", RawOperation);
+		WriteProgramData(Context, End, MapTo, Keywords[KeywordIndex].Opcode | RawOperation, CurrentAddress, PMD_IsOccupied, &StatementError);
+	} break;
+
+	case(KW_M_SetAddr): {
+		// .SetAddr [Addr]
+
+		const int PreviousAddress = CurrentAddress;
+		char *ArgumentStart = Argument->At;
+		CurrentAddress = Statement->Value;
+		ReportErrorConditionally(Context, Statement->ArgumentKind != ARG_Number, &StatementError, DC_MissingArgument, ArgumentStart, End->Line, End->Column, "Unable to Extract a Hexadecimal Number for .SetAddr");
+
+		ReportErrorConditionally(Context, CurrentAddress > 0xFFF || CurrentAddress < 0, &StatementError, DC_AddressOutOfRange, ArgumentStart, End->Line, End->Column, "The Address provided (%x) was not between 0x0 and 0xfff.", CurrentAddress);
+		if (StatementError) { CurrentAddress = PreviousAddress; } // Keep going from where we were, so the statements after this still land somewhere sensible.
+		else { CloseSection(Context, PreviousAddress); }
+	} break;
+
+	case(KW_M_Section): {
+		// .Section
+
+		LastLineOperationWasProcessed = -1; // A .Ident after this can't name the operation before it.
+
+		CloseSection(Context, CurrentAddress);
+		CurrentAddress = OpenSection(Context, Start);
+	} break;
+
+	case(KW_M_Include): {
+		// .Include "Path"
+
+		LastLineOperationWasProcessed = -1;
+
+		ReportErrorConditionally(Context, Statement->ArgumentKind != ARG_Path, &StatementError, DC_MissingArgument, End->At, End->Line, End->Column, "Failed to read a path for .Include. Please put the path in double quotes.\nEx: .Include \"Multiply.MarieAsm\"");
+		if (!StatementError) {
+			State->CurrentAddress = CurrentAddress;
+			StatementError = !IncludeFile(Context, State, Statement);
+			CurrentAddress = State->CurrentAddress;
+			ToIncrementAddress = State->ToIncrementAddress;
+		}
+	} break;
+
+	case(KW_M_Macro): {
+		// .Macro Name [Parameter ...]
+
+		LastLineOperationWasProcessed = -1;
+		StatementError = !DefineMacro(Context, State, Statement);
+	} break;
+
+	case(KW_M_EndMacro): {
+		// Only reached when no macro is being defined.
+		ReportErrorConditionally(Context, TRUE, &StatementError, DC_BadMacro, Start->At, Start->Line, Start->Column, "Found a .EndMacro without a .Macro before it.");
+	} break;
+
+	case(KW_M_Ident): {
+		// .Ident [Identifier]
+
+		// CurrentAddress is 0 if a .SetAddr 0x0 came between the operation and this .Ident, there is no instruction before it to name.
+		ReportErrorConditionally(Context, LastLineOperationWasProcessed != Argument->Line || CurrentAddress == 0, &StatementError, DC_IdentNotAfterOperation, Argument->At, Argument->Line, Argument->Column, "Identifiers must follow right after a operation on the same line.\nEx: data 0d0 .Ident Foo");
+		ReportErrorConditionally(Context, Statement->ArgumentKind != ARG_Identifier, &StatementError, DC_MissingIdentifierName, End->At, End->Line, End->Column, "Failed to find an Identifier Name after .Ident!");
+
+		if (!StatementError) {
+			StatementError = CheckIfIdentifierNameIsReserved(Context, Argument->At, Statement->ByteCount, Statement->CharCount, End);
+		}
+
+		if (!StatementError) {
+			ReportErrorConditionally(Context, FindSymbol(&Context->Symbols, Argument->At, Statement->ByteCount) != -1, &StatementError, DC_Redefined, Argument->At, End->Line, End->Column - Statement->CharCount, "Identifier \"%.*s\" was redefined!", Statement->ByteCount, Argument->At);
+		}
+
+		if (!StatementError) {
+			(Context->OpenSection != -1 ? Context->SectionMetaData : Context->ProgramMetaData)[CurrentAddress - 1] |= PMD_DefinedIdentifier;
+			// The value is CurrentAddress - 1 because that was the address of the last instruction that was processed. Thanks to the following checks, we can be sure that we're refering to the instruction that was immeatly preceeded this .Ident.
+
+			AddSymbolSource(&Context->Symbols, Argument->At, Statement->ByteCount, CurrentAddress - 1, Argument->Line, Argument->Column);
+		}
+	} break;
+
+	case(KW_Data): {
+		// Data [NUMBER]
+
+		ToIncrementAddress = TRUE;
+		LastLineOperationWasProcessed = Start->Line;
+
+		char *ArgumentStart = Argument->At;
+		const int Value = Statement->Value;
+		if (Statement->ArgumentKind != ARG_Number) {
+			const file_state *Missing = (Statement->ArgumentKind == ARG_Identifier) ? Argument : End;
+			ReportErrorConditionally(Context, TRUE, &StatementError, DC_MissingArgument, Missing->At, Missing->Line, Missing->Column, "Failed to read an argument for the Data directive. Please provide a number constant within 0 - 65535 (0x0 - 0xffff).");
+		}
+		ReportErrorConditionally(Context, Value < 0 || Value > 0xffff, &StatementError, DC_DataOutOfRange, ArgumentStart, End->Line, End->Column, "Invalid argument for the Data directive. Please provide a number constant within 0 - 65535 (0x0 - 0xffff).");
+		WriteProgramData(Context, End, MapTo, Value, CurrentAddress, PMD_IsOccupied | PMD_IsData, &StatementError);
+	} break;
+
+	default: {
+		const int Macro = FindMacro(Context, Statement);
+		if (Macro != -1) {
+			LastLineOperationWasProcessed = -1;
+			State->CurrentAddress = CurrentAddress;
+			StatementError = !CallMacro(Context, State, Macro, Statement);
+			CurrentAddress = State->CurrentAddress;
+			ToIncrementAddress = State->ToIncrementAddress;
+			break;
+		}
+		// KeywordLength is 0 if there was no keyword, which was already reported.
+		ReportErrorConditionally(Context, Statement->KeywordLength != 0, &StatementError, DC_UnknownKeyword, Start->At, Start->Line, Start->Column, "\"%.*s\" is not a valid keyword.", Statement->KeywordLength, Start->At);
+	}
+
+	}
+
+	State->CurrentAddress = CurrentAddress;
+	State->ToIncrementAddress = ToIncrementAddress;
+	State->LastLineOperationWasProcessed = LastLineOperationWasProcessed;
+	return !StatementError;
+}
+
+/* Assembles the file named by a .Include statement where the statement is. A file that was already included is skipped, whatever path it was reached by, which also keeps a file from including itself.
+ * Its statements come from the include cache, so including a library that hasn't changed since it was last read costs no parsing.
+ * Returns FALSE if the file couldn't be read or had errors.
+ */
+translation_scope int IncludeFile(assembler_context *Context, assembly_state *State, const statement *Statement) {
+	int DidErrorOccur = FALSE;
+	const char *IncludingPath = (State->File == -1) ? Context->SourcePath : Context->Includes[State->File].File->Path;
+	char *Path = ResolveIncludePath(IncludingPath, Statement->Argument.At, Statement->ByteCount);
+	include_file *File = LoadIncludeFile(Context, Path);
+	ReportErrorConditionally(Context, File == 0, &DidErrorOccur, DC_IncludeNotFound, Statement->Argument.At, Statement->Argument.Line, Statement->Argument.Column, "I could not read the included file \"%s\"!", Path);
+	free(Path);
+	if (File == 0) { return FALSE; }
+
+	uint64_t SourceModifiedTime = 0, SourceFileId = 0;
+	int AlreadyIncluded = Context->SourcePath && Platform_GetFileInfo(Context->SourcePath, &SourceModifiedTime, &SourceFileId) && SourceFileId == File->FileId;
+	for (int Index = 0; Index < Context->IncludeCount && !AlreadyIncluded; Index++) {
+		AlreadyIncluded = Context->Includes[Index].File->FileId == File->FileId;
+	}
+	if (AlreadyIncluded) {
+		ReleaseIncludeFile(File);
+		return TRUE;
+	}
+
+	if (Context->IncludeCount == Context->IncludeCapacity) {
+		Context->IncludeCapacity = Max(8, Context->IncludeCapacity * 2);
+		Context->Includes = realloc(Context->Includes, Context->IncludeCapacity * sizeof(source_include));
+	}
+	const int IncludingFile = State->File;
+	State->File = Context->IncludeCount++;
+	Context->Includes[State->File] = (source_include){
+		.File = File,
+		.IncludedAt = (IncludingFile == -1) ? Statement->Start : Context->Includes[IncludingFile].IncludedAt,
+	};
+
+	// A statement with an error skips the rest of its line, like it does in the source itself.
+	int SkipLine = 0;
+	for (int Index = 0; Index < File->StatementCount && !State->Stop; Index++) {
+		const statement *Included = &File->Statements[Index];
+		if (Included->Start.Line == SkipLine) { continue; }
+		if (!AssembleStatement(Context, State, Included)) {
+			DidErrorOccur = TRUE;
+			SkipLine = Included->End.Line;
+		}
+	}
+
+	if (State->DefiningMacro != -1 && Context->Macros[State->DefiningMacro].File == State->File) {
+		const macro_definition *Macro = &Context->Macros[State->DefiningMacro];
+		ReportErrorConditionally(Context, TRUE, &DidErrorOccur, DC_BadMacro, Macro->DefinedAt.At, Macro->DefinedAt.Line, Macro->DefinedAt.Column, "Macro \"%.*s\" has no .EndMacro! A macro has to end in the file it starts in.", Macro->NameLength, Macro->Name);
+		FinishMacro(Context, State);
+	}
+
+	State->File = IncludingFile;
+	State->LastLineOperationWasProcessed = -1;
+	return !DidErrorOccur;
+}
+
+/* Reads the parameter names of a .Macro, or the arguments of a macro call, from File to the end of its line. Each is a number or an identifier, and they are separated by whitespace.
+ * Returns FALSE with File at the first one it couldn't read, or at the one past MACRO_MAX_PARAMETERS.
+ */
+translation_scope int ParseMacroArguments(file_state *File, macro_argument *Arguments, int *Count) {
+	*Count = 0;
+	while (TRUE) {
+		AdvancePastWhitespaceOnSameLine(File);
+		if (File->At[0] == '\n' || File->At[0] == '\0' || File->At[0] == '/') { return TRUE; }
+		if (*Count == MACRO_MAX_PARAMETERS) { return FALSE; }
+
+		const file_state ArgumentStart = *File;
+		macro_argument *Argument = &Arguments[(*Count)++];
+		*Argument = (macro_argument){.Start = File->At, .Line = File->Line, .Column = File->Column, .Parameter = -1, .Label = -1};
+		if (ExtractNumberDecimal(File, &Argument->Value) || ExtractNumberHexadecimal(File, &Argument->Value)) {
+			Argument->Kind = ARG_Number;
+		}
+		else if (File->At == ArgumentStart.At && ExtractIdentifier(File, &Argument->CharCount, &Argument->ByteCount)) {
+			Argument->Kind = ARG_Identifier;
+		}
+		if (Argument->Kind == ARG_None ||
+		    (File->At[0] != ' ' && File->At[0] != '\t' && File->At[0] != '\r' && File->At[0] != '\n' && File->At[0] != '\0')) {
+			*File = ArgumentStart;
+			(*Count)--;
+			return FALSE;
+		}
+	}
+}
+
+/* Returns the index into Context->Macros of the macro Statement calls, or -1 if it isn't a macro call.
+ */
+translation_scope int FindMacro(const assembler_context *Context, const statement *Statement) {
+	const char *Name = Statement->Start.At;
+	const int Length = Statement->KeywordLength;
+	// Like an operation, the name has to be followed by whitespace.
+	if (Statement->Keyword != KW_COUNT || Length == 0 ||
+	    (Name[Length] != ' ' && Name[Length] != '\t' && Name[Length] != '\r' && Name[Length] != '\n' && Name[Length] != '\0' && Name[Length] != '/')) {
+		return -1;
+	}
+	for (int Index = 0; Index < Context->MacroCount; Index++) {
+		const macro_definition *Macro = &Context->Macros[Index];
+		if (Macro->NameLength == Length && memcmp(Macro->Name, Name, Length) == 0) { return Index; }
+	}
+	return -1;
+}
+
+translation_scope macro_argument* AddMacroArgument(assembler_context *Context, const macro_argument *Argument) {
+	if (Context->MacroArgumentCount == Context->MacroArgumentCapacity) {
+		Context->MacroArgumentCapacity = Max(64, Context->MacroArgumentCapacity * 2);
+		Context->MacroArguments = realloc(Context->MacroArguments, Context->MacroArgumentCapacity * sizeof(macro_argument));
+	}
+	Context->MacroArguments[Context->MacroArgumentCount] = *Argument;
+	return &Context->MacroArguments[Context->MacroArgumentCount++];
+}
+
+/* Starts the macro a .Macro statement defines. The statements after it, up to .EndMacro, become its body instead of being assembled.
+ * The body is read even if the .Macro line has errors, so they aren't reported again as errors in the statements after it.
+ */
+translation_scope int DefineMacro(assembler_context *Context, assembly_state *State, const statement *Statement) {
+	int DidErrorOccur = FALSE;
+	const file_state *Start = &Statement->Start, *Argument = &Statement->Argument;
+	char *Name = Argument->At;
+	const int NameLength = (Statement->ArgumentKind == ARG_Identifier) ? Statement->ByteCount : 0;
+
+	ReportErrorConditionally(Context, NameLength == 0, &DidErrorOccur, DC_BadMacro, Argument->At, Argument->Line, Argument->Column, "Failed to read a name for .Macro. Macro names are made of letters, like the operations they are used like.\nEx: .Macro Increment Counter");
+	for (int Index = 0; Index < KW_COUNT && !DidErrorOccur; Index++) {
+		ReportErrorConditionally(Context, CompareStrToKeyword(Name, NameLength, Keywords[Index]), &DidErrorOccur, DC_BadMacro, Argument->At, Argument->Line, Argument->Column, "Macro \"%.*s\" cannot have the same name as a keyword! Please name the macro something else.", NameLength, Name);
+	}
+	for (int Index = 0; Index < Context->MacroCount && !DidErrorOccur; Index++) {
+		const macro_definition *Other = &Context->Macros[Index];
+		ReportErrorConditionally(Context, Other->NameLength == NameLength && memcmp(Other->Name, Name, NameLength) == 0, &DidErrorOccur, DC_BadMacro, Argument->At, Argument->Line, Argument->Column, "Macro \"%.*s\" was already defined on line %d!", NameLength, Name, Other->DefinedAt.Line);
+	}
+
+	if (Context->MacroCount == Context->MacroCapacity) {
+		Context->MacroCapacity = Max(16, Context->MacroCapacity * 2);
+		Context->Macros = realloc(Context->Macros, Context->MacroCapacity * sizeof(macro_definition));
+	}
+	State->DefiningMacro = Context->MacroCount++;
+	macro_definition *Macro = &Context->Macros[State->DefiningMacro];
+	*Macro = (macro_definition){
+		.Name = Name,
+		// A macro with a bad name is still read, but can't be called.
+		.NameLength = DidErrorOccur ? 0 : NameLength,
+		.File = State->File,
+		.DefinedAt = *Start,
+		.FirstParameter = Context->MacroArgumentCount,
+		.FirstStatement = Context->MacroStatementCount,
+	};
+
+	macro_argument Parameters[MACRO_MAX_PARAMETERS];
+	int ParameterCount = 0;
+	file_state ParameterFile = *Argument;
+	if (NameLength) { IncrementFilePosition(&ParameterFile, NameLength); }
+	if (!ParseMacroArguments(&ParameterFile, Parameters, &ParameterCount)) {
+		ReportErrorConditionally(Context, TRUE, &DidErrorOccur, DC_BadMacro, ParameterFile.At, ParameterFile.Line, ParameterFile.Column, "Failed to read a parameter of .Macro. Parameters are identifiers separated by spaces, and there can be at most %d of them.", MACRO_MAX_PARAMETERS);
+	}
+	for (int Index = 0; Index < ParameterCount; Index++) {
+		const macro_argument *Parameter = &Parameters[Index];
+		int IsBad = FALSE;
+		ReportErrorConditionally(Context, Parameter->Kind != ARG_Identifier, &IsBad, DC_BadMacro, Parameter->Start, Parameter->Line, Parameter->Column, "Parameters of .Macro must be identifiers, not numbers.");
+		for (int Other = 0; Other < Index && !IsBad; Other++) {
+			ReportErrorConditionally(Context, Parameters[Other].ByteCount == Parameter->ByteCount && memcmp(Parameters[Other].Start, Parameter->Start, Parameter->ByteCount) == 0, &IsBad, DC_BadMacro, Parameter->Start, Parameter->Line, Parameter->Column, "Parameter \"%.*s\" of .Macro was named twice!", Parameter->ByteCount, Parameter->Start);
+		}
+		if (IsBad) { DidErrorOccur = TRUE; }
+		else {
+			AddMacroArgument(Context, Parameter);
+			Macro->ParameterCount++;
+		}
+	}
+	return !DidErrorOccur;
+}
+
+/* Finds what the identifier argument of a statement in a macro's body names, if it names a parameter or a label.
+ */
+translation_scope void FindMacroName(const assembler_context *Context, const macro_definition *Macro, const char *Start, int ByteCount, int *Parameter, int *Label) {
+	*Parameter = -1;
+	*Label = -1;
+	for (int Index = 0; Index < Macro->ParameterCount; Index++) {
+		const macro_argument *Other = &Context->MacroArguments[Macro->FirstParameter + Index];
+		if (Other->ByteCount == ByteCount && memcmp(Other->Start, Start, ByteCount) == 0) { *Parameter = Index; return; }
+	}
+	for (int Index = 0; Index < Macro->LabelCount; Index++) {
+		const macro_argument *Other = &Context->MacroArguments[Macro->FirstLabel + Index];
+		if (Other->ByteCount == ByteCount && memcmp(Other->Start, Start, ByteCount) == 0) { *Label = Index; return; }
+	}
+}
+
+/* Ends the body of the macro being defined at its .EndMacro. Every name in the body is looked up here, once, so expanding the macro never has to search for them.
+ */
+translation_scope int FinishMacro(assembler_context *Context, assembly_state *State) {
+	int DidErrorOccur = FALSE;
+	macro_definition *Macro = &Context->Macros[State->DefiningMacro];
+	State->DefiningMacro = -1;
+	macro_statement *Body = Context->MacroStatements + Macro->FirstStatement;
+
+	// Every identifier a .Ident in the body defines, other than a parameter, is a label of this macro.
+	Macro->FirstLabel = Context->MacroArgumentCount;
+	for (int Index = 0; Index < Macro->StatementCount; Index++) {
+		const statement *Statement = &Body[Index].Statement;
+		if (Statement->Keyword != KW_M_Ident || Statement->ArgumentKind != ARG_Identifier) { continue; }
+
+		int Parameter, Label;
+		FindMacroName(Context, Macro, Statement->Argument.At, Statement->ByteCount, &Parameter, &Label);
+		if (Parameter != -1) { continue; }
+		ReportErrorConditionally(Context, Label != -1, &DidErrorOccur, DC_Redefined, Statement->Argument.At, Statement->Argument.Line, Statement->Argument.Column, "Identifier \"%.*s\" was redefined!", Statement->ByteCount, Statement->Argument.At);
+		if (Label == -1 && CheckIfIdentifierNameIsReserved(Context, Statement->Argument.At, Statement->ByteCount, Statement->CharCount, &Statement->End)) {
+			DidErrorOccur = TRUE;
+		}
+		else if (Label == -1) {
+			AddMacroArgument(Context, &(macro_argument){.Kind = ARG_Identifier, .Value = Macro->LabelBytes, .Start = Statement->Argument.At, .CharCount = Statement->CharCount, .ByteCount = Statement->ByteCount, .Line = Statement->Argument.Line, .Column = Statement->Argument.Column, .Parameter = -1, .Label = -1});
+			Macro->LabelCount++;
+			Macro->LabelBytes += Statement->ByteCount;
+		}
+	}
+
+	for (int Index = 0; Index < Macro->StatementCount; Index++) {
+		macro_statement *Entry = &Body[Index];
+		const statement *Statement = &Entry->Statement;
+		if (Statement->ArgumentKind == ARG_Identifier && Statement->Keyword != KW_COUNT) {
+			FindMacroName(Context, Macro, Statement->Argument.At, Statement->ByteCount, &Entry->Parameter, &Entry->Label);
+		}
+		else if (Statement->Keyword == KW_COUNT && Statement->KeywordLength != 0) {
+			// Possibly a call to another macro, which doesn't need to be defined until this one is called. Its arguments are read now, so no expansion has to.
+			macro_argument Arguments[MACRO_MAX_PARAMETERS];
+			int ArgumentCount = 0;
+			file_state ArgumentFile = Statement->Argument;
+			if (!ParseMacroArguments(&ArgumentFile, Arguments, &ArgumentCount)) {
+				ReportErrorConditionally(Context, TRUE, &DidErrorOccur, DC_MacroArguments, ArgumentFile.At, ArgumentFile.Line, ArgumentFile.Column, "Failed to read an argument of the macro call. Arguments are numbers or identifiers separated by spaces, and there can be at most %d of them.", MACRO_MAX_PARAMETERS);
+				continue;
+			}
+			Entry->FirstArgument = Context->MacroArgumentCount;
+			Entry->ArgumentCount = ArgumentCount;
+			for (int ArgumentIndex = 0; ArgumentIndex < ArgumentCount; ArgumentIndex++) {
+				macro_argument *Argument = AddMacroArgument(Context, &Arguments[ArgumentIndex]);
+				if (Argument->Kind == ARG_Identifier) {
+					FindMacroName(Context, Macro, Argument->Start, Argument->ByteCount, &Argument->Parameter, &Argument->Label);
+				}
+			}
+		}
+	}
+	return !DidErrorOccur;
+}
+
+/* Gives Size bytes for the names made while expanding a macro called at CalledAt. They never move, and are freed with the rest of the assembly.
+ */
+translation_scope char* AllocateMacroText(assembler_context *Context, int Size, const char *CalledAt) {
+	if (Context->MacroTextBlockCount == 0 || Context->MacroTextBlockUsed + Size > Context->MacroTextBlockSize) {
+		if (Context->MacroTextBlockCount == Context->MacroTextBlockCapacity) {
+			Context->MacroTextBlockCapacity = Max(8, Context->MacroTextBlockCapacity * 2);
+			Context->MacroTextBlocks = realloc(Context->MacroTextBlocks, Context->MacroTextBlockCapacity * sizeof(char*));
+		}
+		Context->MacroTextBlockSize = Max(Kilobyte(64), Size);
+		Context->MacroTextBlocks[Context->MacroTextBlockCount++] = malloc(Context->MacroTextBlockSize);
+		Context->MacroTextBlockUsed = 0;
+	}
+	char *Result = Context->MacroTextBlocks[Context->MacroTextBlockCount - 1] + Context->MacroTextBlockUsed;
+	Context->MacroTextBlockUsed += Size;
+
+	// Names for one call usually follow each other in a block, and share a macro_text so tracing them back stays quick.
+	macro_text *Last = Context->MacroTextCount ? &Context->MacroTexts[Context->MacroTextCount - 1] : 0;
+	if (Last && Last->CalledAt == CalledAt && Last->Text + Last->Length == Result) {
+		Last->Length += Size;
+	}
+	else if (Size) {
+		if (Context->MacroTextCount == Context->MacroTextCapacity) {
+			Context->MacroTextCapacity = Max(64, Context->MacroTextCapacity * 2);
+			Context->MacroTexts = realloc(Context->MacroTexts, Context->MacroTextCapacity * sizeof(macro_text));
+		}
+		Context->MacroTexts[Context->MacroTextCount++] = (macro_text){.Text = Result, .Length = Size, .CalledAt = CalledAt};
+	}
+	return Result;
+}
+
+/* What an identifier in the body of a macro becomes in one expansion of it: the argument given for a parameter, the expansion's own name for a label, or itself.
+ * Every name is copied into the expansion's text, so that it sorts at the call like the rest of the expansion does.
+ */
+translation_scope macro_argument ExpandMacroName(assembler_context *Context, const macro_definition *Macro, const macro_argument *Arguments, const char *LabelNames, int SuffixLength, const macro_argument *Name) {
+	macro_argument Result = *Name;
+	Result.Parameter = Result.Label = -1;
+	if (Name->Parameter != -1) {
+		Result = Arguments[Name->Parameter];
+		if (Result.Kind == ARG_Number) { return Result; }
+	}
+	else if (Name->Label != -1) {
+		const macro_argument *Label = &Context->MacroArguments[Macro->FirstLabel + Name->Label];
+		Result.Start = (char*)LabelNames + Label->Value + Name->Label * SuffixLength;
+		Result.ByteCount = Label->ByteCount + SuffixLength;
+		Result.CharCount = Label->CharCount + SuffixLength;
+		return Result;
+	}
+	char *Copy = AllocateMacroText(Context, Result.ByteCount, Context->ExpandedAt->At);
+	memcpy(Copy, Result.Start, Result.ByteCount);
+	Result.Start = Copy;
+	return Result;
+}
+
+/* Assembles the body of Context->Macros[MacroIndex] where it is called, with Arguments in place of its parameters. Call is the statement calling it.
+ * Returns FALSE if the call or anything in the body had errors.
+ */
+translation_scope int ExpandMacro(assembler_context *Context, assembly_state *State, int MacroIndex, const statement *Call, const macro_argument *Arguments, int ArgumentCount) {
+	int DidErrorOccur = FALSE;
+	macro_definition *Macro = &Context->Macros[MacroIndex];
+	ReportErrorConditionally(Context, Macro->Expanding, &DidErrorOccur, DC_BadMacro, Call->Start.At, Call->Start.Line, Call->Start.Column, "Macro \"%.*s\" was called from inside itself! Macros can't be recursive, as the expansion would never end.", Macro->NameLength, Macro->Name);
+	ReportErrorConditionally(Context, ArgumentCount != Macro->ParameterCount, &DidErrorOccur, DC_MacroArguments, Call->Argument.At, Call->Argument.Line, Call->Argument.Column, "Macro \"%.*s\" takes %d arguments, but was given %d.", Macro->NameLength, Macro->Name, Macro->ParameterCount, ArgumentCount);
+	if (DidErrorOccur) { return FALSE; }
+
+	const int IsOutermost = (Context->ExpandedAt == 0);
+	const int FirstSource = Context->Symbols.SourceCount, FirstDest = Context->Symbols.DestCount;
+	const int CallingMacro = Context->ExpandingMacro;
+	if (IsOutermost) { Context->ExpandedAt = &Call->Start; }
+	Macro->Expanding = TRUE;
+
+	// Every label of this expansion is named at once: the name from the body, then @ and the number of the expansion.
+	char Suffix[16];
+	const int Expansion = ++Context->MacroExpansionCount;
+	const int SuffixLength = Macro->LabelCount ? snprintf(Suffix, sizeof(Suffix), "@%d", Expansion) : 0;
+	char *LabelNames = Macro->LabelCount ? AllocateMacroText(Context, Macro->LabelBytes + Macro->LabelCount * SuffixLength, Context->ExpandedAt->At) : 0;
+	for (int Index = 0; Index < Macro->LabelCount; Index++) {
+		const macro_argument *Label = &Context->MacroArguments[Macro->FirstLabel + Index];
+		char *LabelName = LabelNames + Label->Value + Index * SuffixLength;
+		memcpy(LabelName, Label->Start, Label->ByteCount);
+		memcpy(LabelName + Label->ByteCount, Suffix, SuffixLength);
+	}
+
+	// A .Ident in the body only names an operation from the body.
+	State->LastLineOperationWasProcessed = -1;
+	// A statement with an error skips the rest of its line, like it does outside of macros.
+	int SkipLine = 0;
+	for (int Index = 0; Index < Macro->StatementCount && !State->Stop; Index++) {
+		// Macros can't be defined while expanding one, so Context->MacroStatements stays put.
+		const macro_statement *Body = &Context->MacroStatements[Macro->FirstStatement + Index];
+		if (Body->Statement.Start.Line == SkipLine) { continue; }
+		statement Expanded = Body->Statement;
+		Context->ExpandingMacro = MacroIndex;
+
+		if (Body->FirstArgument != -1) {
+			const int Inner = FindMacro(Context, &Expanded);
+			if (Inner != -1) {
+				macro_argument InnerArguments[MACRO_MAX_PARAMETERS];
+				for (int ArgumentIndex = 0; ArgumentIndex < Body->ArgumentCount; ArgumentIndex++) {
+					const macro_argument *Argument = &Context->MacroArguments[Body->FirstArgument + ArgumentIndex];
+					InnerArguments[ArgumentIndex] = (Argument->Kind == ARG_Identifier) ? ExpandMacroName(Context, Macro, Arguments, LabelNames, SuffixLength, Argument) : *Argument;
+				}
+				if (!ExpandMacro(Context, State, Inner, &Expanded, InnerArguments, Body->ArgumentCount)) {
+					DidErrorOccur = TRUE;
+					SkipLine = Expanded.End.Line;
+				}
+				continue;
+			}
+		}
+		else if (Expanded.ArgumentKind == ARG_Identifier && Expanded.Keyword != KW_COUNT) {
+			const macro_argument Written = {.Kind = ARG_Identifier, .Start = Expanded.Argument.At, .CharCount = Expanded.CharCount, .ByteCount = Expanded.ByteCount, .Parameter = Body->Parameter, .Label = Body->Label};
+			const macro_argument Name = ExpandMacroName(Context, Macro, Arguments, LabelNames, SuffixLength, &Written);
+			if (Name.Kind == ARG_Number) {
+				Expanded.ArgumentKind = ARG_Number;
+				Expanded.Value = Name.Value;
+			}
+			else if (Expanded.Keyword == KW_Skipcond &&
+			         ((Name.ByteCount == 6 && CompareStr(Name.Start, "lesser", 6)) ||
+			          (Name.ByteCount == 5 && CompareStr(Name.Start, "equal", 5)) ||
+			          (Name.ByteCount == 7 && CompareStr(Name.Start, "greater", 7)))) {
+				// Named skipcond operations can be passed in like numbers.
+				Expanded.ArgumentKind = ARG_Number;
+				Expanded.Value = (Name.ByteCount == 6) ? 0x000 : (Name.ByteCount == 5) ? 0x400 : 0xC00;
+			}
+			else {
+				Expanded.Argument.At = Name.Start;
+				Expanded.ByteCount = Name.ByteCount;
+				Expanded.CharCount = Name.CharCount;
+			}
+		}
+
+		if (!AssembleStatement(Context, State, &Expanded)) {
+			DidErrorOccur = TRUE;
+			SkipLine = Expanded.End.Line;
+		}
+	}
+
+	Macro = &Context->Macros[MacroIndex];
+	Macro->Expanding = FALSE;
+	Context->ExpandingMacro = CallingMacro;
+	State->LastLineOperationWasProcessed = -1;
+	if (IsOutermost) {
+		// The names the expansion made are reported, and found by the LSP, at the call.
+		for (int Index = FirstSource; Index < Context->Symbols.SourceCount; Index++) {
+			Context->Symbols.Sources.Lines[Index] = Call->Start.Line;
+			Context->Symbols.Sources.Columns[Index] = (uint16_t)Min(Call->Start.Column, 0xFFFF);
+		}
+		for (int Index = FirstDest; Index < Context->Symbols.DestCount; Index++) {
+			Context->Symbols.Dests.Lines[Index] = Call->Start.Line;
+			Context->Symbols.Dests.Columns[Index] = (uint16_t)Min(Call->Start.Column, 0xFFFF);
+		}
+		Context->ExpandedAt = 0;
+	}
+	return !DidErrorOccur;
+}
+
+/* Expands a macro called from the source or an included file, after reading the arguments of the call.
+ */
+translation_scope int CallMacro(assembler_context *Context, assembly_state *State, int Macro, const statement *Statement) {
+	int DidErrorOccur = FALSE;
+	macro_argument Arguments[MACRO_MAX_PARAMETERS];
+	int ArgumentCount = 0;
+	file_state ArgumentFile = Statement->Argument;
+	const int Success = ParseMacroArguments(&ArgumentFile, Arguments, &ArgumentCount);
+	ReportErrorConditionally(Context, !Success, &DidErrorOccur, DC_MacroArguments, ArgumentFile.At, ArgumentFile.Line, ArgumentFile.Column, "Failed to read an argument of the macro call. Arguments are numbers or identifiers separated by spaces, and there can be at most %d of them.", MACRO_MAX_PARAMETERS);
+	if (DidErrorOccur) { return FALSE; }
+	return ExpandMacro(Context, State, Macro, Statement, Arguments, ArgumentCount);
+}
+
+/* Assembles File into Context. Every error and warning found is recorded in Context->Diagnostics.
+ * When a statement has an error the rest of its line is skipped and assembly carries on with the next line, so one run reports as many errors as it can.
+ * Returns TRUE if no errors were found.
+ */
+int Assemble(assembler_context *Context, file_state *File) {
+	int DidErrorOccur = FALSE;
+	assembly_state State = {.LastLineOperationWasProcessed = -1, .File = -1, .DefiningMacro = -1};
+	if (Context->Relocatable) {
+		// An object's code is placed by the linker, so everything before the first .SetAddr is a section too.
+		State.CurrentAddress = OpenSection(Context, File);
+	}
+
+	while (!State.Stop) {
+		AdvancePastWhitespaceAndComments(File);
+		if (File->At[0] == '\0') { break; } // we reached the end of the file, no more parsing to be done.
+
+		statement Statement;
+		ParseStatement(File, &Statement);
+		if (!AssembleStatement(Context, &State, &Statement)) {
+			DidErrorOccur = TRUE;
+			AdvanceToEndOfLine(File);
+		}
+	}
+	if (State.ToIncrementAddress) { State.CurrentAddress++; }
+	if (State.DefiningMacro != -1) {
+		const macro_definition *Macro = &Context->Macros[State.DefiningMacro];
+		ReportErrorConditionally(Context, TRUE, &DidErrorOccur, DC_BadMacro, Macro->DefinedAt.At, Macro->DefinedAt.Line, Macro->DefinedAt.Column, "Macro \"%.*s\" has no .EndMacro!", Macro->NameLength, Macro->Name);
+	}
+
+	CloseSection(Context, State.CurrentAddress);
+	// An object is left as it is for the linker, which knows where everything goes and what the other objects define.
+	if (!Context->Relocatable) {
+		if (Context->SectionCount && !PlaceSections(Context)) { DidErrorOccur = TRUE; }
+		if (!ResolveIdentifiers(Context)) { DidErrorOccur = TRUE; }
+	}
+	UpdateProgramBits(Context);
+
+	return !DidErrorOccur;
+}
+
+int fprintfCheck(int *Success, FILE *File, char *FormatStr, ...) {
+	va_list ArgList;
+	va_start(ArgList, FormatStr);
+
+	int Result = vfprintf(File, FormatStr, ArgList);
+	if (Result < 0) { *Success = FALSE; }
+	
+	va_end(ArgList);
+	
+	if (!Success) {
+		return Result = 0;
+	}
+	return Result;
+}
+
+int snprintfCheck(int *Success, char *Buffer, size_t Size, char *FormatStr, ...) {
+	va_list ArgList;
+	va_start(ArgList, FormatStr);
+
+	int Result = vsnprintf(Buffer, Size, FormatStr, ArgList);
+	if (Result < 0) { *Success = FALSE; }
+	
+	va_end(ArgList);
+
+	if (!Success) {
+		return Result = 0;
+	}
+	return Result;
+}
+
+int OutputLogisimImage(const assembler_context *Context, FILE *FileStream) {
+	int Success = TRUE;
+	fprintfCheck(&Success, FileStream, "v2.0 raw\r\n");
+
+	int Consectuive = 0;
+	int Prev = Context->Program[0];
+	for (int Index = 0; Index <= Kilobyte(4) && Success; Index++) {
+		// Index is checked first, there is no word at Kilobyte(4) to read.
+		if (Index != Kilobyte(4) && Prev == Context->Program[Index]) {
+			Consectuive++;
+		}
+		else {
+			char Buffer[16] = {0};
+			if (Consectuive == 1) {
+				fprintfCheck(&Success, FileStream, "%X\n", Prev);
+			}
+			else {
+				fprintfCheck(&Success, FileStream, "%d*%X\n", Consectuive, Prev);
+			}
+			Consectuive = 1;
+		}
+		if (Index != Kilobyte(4)) { Prev = Context->Program[Index]; }
+	}
+
+	fclose(FileStream);
+
+	if (Success == FALSE) {
+		printf("[Error Logisim] There was a error encountered while writing to the Logisim output file!\n");
+	}
+	
+	return Success;
+}
+
+int OutputRawHex(const assembler_context *Context, FILE *FileStream) {
+	int Result = fwrite(Context->Program, sizeof(Context->Program), 1, FileStream);
+	int Success = Result == 1;
+	
+	fclose(FileStream);
+
+	if (Success == FALSE) {
+		printf("[Error Raw Hex] There was a error encountered while writing to the hex output file!\n");
+	}
+
+	return Success;
+}
+
+int OutputSymbolTable(const assembler_context *Context, FILE *FileStream) {
+	int IdentifierMaxCharLength = 0;
+	int Success = TRUE;
+
+	const symbol_index *Symbols = &Context->Symbols;
+	for (int Index = 0; Index < Symbols->SourceCount; Index++) {
+		IdentifierMaxCharLength = Max(IdentifierMaxCharLength, IdentifierCharCount(&Symbols->Sources, Index));
+	}
+
+	IdentifierMaxCharLength = Max(IdentifierMaxCharLength, 10);
+
+	fprintfCheck(&Success, FileStream, "| %- *s | Identifier's Value | Addresses that use Identifier\n", IdentifierMaxCharLength, "Identifier");
+	for (int SourceIndex = 0; SourceIndex < Symbols->SourceCount && Success; SourceIndex++) {
+		const int ByteCount = Symbols->Sources.ByteCounts[SourceIndex];
+
+		int AdditionalPadding = (ByteCount - IdentifierCharCount(&Symbols->Sources, SourceIndex)); // Extra padding based on the difference of the charcter count and byte count. This is because the printf family of functions calulated padding based on bytes writen.
+		fprintfCheck(&Success, FileStream, "| %- *.*s | 0x%-0*.3X | ", IdentifierMaxCharLength + AdditionalPadding, ByteCount, Symbols->Sources.Names[SourceIndex], 18 - 2, Symbols->Sources.Addresses[SourceIndex]);
+		
+		for (int DestIndex = Symbols->FirstReference[SourceIndex]; DestIndex != -1 && Success; DestIndex = Symbols->NextReference[DestIndex]) {
+			fprintfCheck(&Success, FileStream, " 0x%-0.3X", Symbols->Dests.Addresses[DestIndex]);
+		}
+		fprintfCheck(&Success, FileStream, "\n");
+	}
+	fclose(FileStream);
+
+	if (Success == FALSE) {
+		printf("[Error Symbol Table] There was a error encountered while writing to the symbol table output file!\n");
+	}
+
+	return Success;
+}
+
+#define LISTING_PROFILE_WIDTH (10)
+// How many of the hottest blocks a profiled listing ends with.
+#define LISTING_HOT_BLOCKS (10)
+
+#define LISTING_FLOW_WIDTH (5)
+
+/* Prints the basic block starting at Address as a listing column, or "dead" if Address holds an instruction that can never run and isn't used as data.
+ * Prints nothing if the listing has no control flow graph, and a blank column if Address is -1.
+ */
+translation_scope void PrintListingFlowColumn(int *Success, FILE *FileStream, const assembler_context *Context, int Address) {
+	const control_flow_graph *Cfg = Context->Cfg;
+	if (Cfg == 0) { return; }
+
+	char Text[16] = "";
+	if (Address == -1) {
+	}
+	else if (Cfg->Flags[Address] & CFG_BlockStart) {
+		snprintf(Text, sizeof(Text), "B%d", Cfg->BlockOf[Address]);
+	}
+	else if (IsDeadInstruction(Context, Cfg, Address)) {
+		snprintf(Text, sizeof(Text), "dead");
+	}
+	fprintfCheck(Success, FileStream, "%-*s | ", LISTING_FLOW_WIDTH, Text);
+}
+
+/* Prints the profile's counts for Address as listing columns, or blank columns if Address is -1.
+ * Counts of zero are left blank too, so the lines that did run stand out.
+ */
+translation_scope void PrintListingProfileColumns(int *Success, FILE *FileStream, const machine_profile *Profile, int Address) {
+	if (Profile == 0) { return; }
+	const uint64_t *Counts[] = {Profile->Executions, Profile->SkipsTaken, Profile->Reads, Profile->Writes};
+	for (int Column = 0; Column < ArraySize(Counts); Column++) {
+		if (Address == -1 || Counts[Column][Address] == 0) {
+			fprintfCheck(Success, FileStream, "% *s | ", LISTING_PROFILE_WIDTH, "");
+		}
+		else {
+			fprintfCheck(Success, FileStream, "%*llu | ", LISTING_PROFILE_WIDTH, (unsigned long long)Counts[Column][Address]);
+		}
+	}
+}
+
+typedef struct {
+	int Address; // First instruction of the block
+	int SourceIndex; // The .Ident naming it, or -1
+	uint64_t Executions;
+} listing_hot_block;
+
+/* Splits the code into blocks that each start at an .Ident, or after a gap in memory, and prints the ones that executed the most.
+ */
+translation_scope void PrintListingHotBlocks(int *Success, FILE *FileStream, const assembler_context *Context) {
+	const symbol_index *Symbols = &Context->Symbols;
+	const machine_profile *Profile = Context->Profile;
+	listing_hot_block *Blocks = malloc(Kilobyte(4) * sizeof(listing_hot_block));
+	int BlockCount = 0;
+	uint64_t TotalExecutions = 0;
+	int NameMaxLength = strlen("Block");
+
+	const program_bits *Occupied = &Context->ProgramBits[PMDB_IsOccupied];
+	for (int Index = FindNextSetBit(Occupied, 0); Index < Kilobyte(4); Index = FindNextSetBit(Occupied, Index + 1)) {
+		const int StartsBlock = BlockCount == 0 || !TestProgramBit(Occupied, Index - 1) ||
+		                        ((Context->ProgramMetaData[Index] & PMD_DefinedIdentifier) && Symbols->AddressToSource[Index] != -1);
+		if (StartsBlock) {
+			listing_hot_block *Block = &Blocks[BlockCount++];
+			Block->Address = Index;
+			Block->SourceIndex = (Context->ProgramMetaData[Index] & PMD_DefinedIdentifier) ? Symbols->AddressToSource[Index] : -1;
+			Block->Executions = 0;
+			if (Block->SourceIndex != -1) {
+				NameMaxLength = Max(NameMaxLength, IdentifierCharCount(&Symbols->Sources, Block->SourceIndex));
+			}
+		}
+		Blocks[BlockCount - 1].Executions += Profile->Executions[Index];
+		TotalExecutions += Profile->Executions[Index];
+	}
+
+	fprintfCheck(Success, FileStream, "\nHottest blocks, out of %llu instructions executed\n", (unsigned long long)TotalExecutions);
+	fprintfCheck(Success, FileStream, "| %- *s | Address | Line  | %*s | Share\n", NameMaxLength, "Block", LISTING_PROFILE_WIDTH, "Executed");
+	for (int Rank = 0; Rank < LISTING_HOT_BLOCKS && *Success; Rank++) {
+		// Selection sort, only as far as we print.
+		int Hottest = -1;
+		for (int Index = Rank; Index < BlockCount; Index++) {
+			if (Hottest == -1 || Blocks[Index].Executions > Blocks[Hottest].Executions) { Hottest = Index; }
+		}
+		if (Hottest == -1 || Blocks[Hottest].Executions == 0) { break; }
+		const listing_hot_block Block = Blocks[Hottest];
+		Blocks[Hottest] = Blocks[Rank];
+		Blocks[Rank] = Block;
+
+		if (Block.SourceIndex != -1) {
+			const int ByteCount = Symbols->Sources.ByteCounts[Block.SourceIndex];
+			fprintfCheck(Success, FileStream, "| %- *.*s ", NameMaxLength + ByteCount - IdentifierCharCount(&Symbols->Sources, Block.SourceIndex), ByteCount, Symbols->Sources.Names[Block.SourceIndex]);
+		}
+		else {
+			fprintfCheck(Success, FileStream, "| %- *s ", NameMaxLength, "");
+		}
+		fprintfCheck(Success, FileStream, "| 0x%0.3X   | %-5d | %*llu | %.1f%%\n", Block.Address, Context->SourceMap[Block.Address].Line, LISTING_PROFILE_WIDTH, (unsigned long long)Block.Executions, 100.0 * Block.Executions / TotalExecutions);
+	}
+
+	free(Blocks);
+}
+
+int OutputListing(const assembler_context *Context, FILE *FileStream) {
+	int Success = TRUE;
+
+	// @TODO make this growable!!! Someone someday will be really mad at me for limiting the size of this string.
+	char *ContentsOfAC = calloc(5000, sizeof(wchar_t));
+	int ContentsOfACSize = 5000;
 	ContentsOfAC[0] = '0';
 	ContentsOfAC[1] = '\0';
 	int EmitCode = EMIT_No;
 	int EmitIndentNextLine = FALSE;
 
+	const symbol_index *Symbols = &Context->Symbols;
 	int OperandMaxLength = strlen("greater"); // "greater" is the longest literal operand, as a argument to skipcond.
-	for (int Index = 0; ; Index++) {
-		const identifier_source *IdentifierSource = GetFromPagedList(IdentifierSourceList, Index);
-		if (IdentifierSource == 0) { break; }
-		
-		if (IdentifierSource->CharCount > OperandMaxLength) {
-			OperandMaxLength = IdentifierSource->CharCount;
-		}
+	for (int Index = 0; Index < Symbols->SourceCount; Index++) {
+		OperandMaxLength = Max(OperandMaxLength, IdentifierCharCount(&Symbols->Sources, Index));
 	}
 
 	//  + 1 + is repersentive of spaces.
@@ -653,581 +1902,1283 @@ int OutputListing(FILE *FileStream, paged_list *IdentifierDestinationList, paged
 	// @TODO I think the max length of a listing is actually slightly shorter than this.
 	int ListingMaxLength = Keywords[KW_Skipcond].Length + 1 + OperandMaxLength + 1 + Keywords[KW_M_Ident].Length + 1 + OperandMaxLength;
 	
-	fprintfCheck(&Success, FileStream, "| Address | Opcode | %- *s | High Level Code\n", ListingMaxLength, "Listing");
+	fprintfCheck(&Success, FileStream, "| Address | Opcode | ");
+	if (Context->Cfg) {
+		fprintfCheck(&Success, FileStream, "%-*s | ", LISTING_FLOW_WIDTH, "Block");
+	}
+	if (Context->Profile) {
+		fprintfCheck(&Success, FileStream, "%*s | %*s | %*s | %*s | ", LISTING_PROFILE_WIDTH, "Executed", LISTING_PROFILE_WIDTH, "Skips", LISTING_PROFILE_WIDTH, "Reads", LISTING_PROFILE_WIDTH, "Writes");
+	}
+	fprintfCheck(&Success, FileStream, "%- *s | High Level Code\n", ListingMaxLength, "Listing");
 	
-	for (int Index = 0; Index < Kilobyte(4) && Success; Index++) {
+	const program_bits *Occupied = &Context->ProgramBits[PMDB_IsOccupied];
+	for (int Index = FindNextSetBit(Occupied, 0), Previous = -1; Index < Kilobyte(4) && Success; Previous = Index, Index = FindNextSetBit(Occupied, Index + 1)) {
 		int ListingCharacterCount = 0;
-		if (ProgramMetaData[Index] & PMD_IsOccupied) {
-			if (InMemoryGap) {
-				InMemoryGap = FALSE;
-				Assert(ListingMaxLength >= 14);
-				fprintfCheck(&Success, FileStream, "|         |        | .SetAddr 0x%0.3X% *s |\n", Index, ListingMaxLength - 14, "");
-			}
+		if (Index != Previous + 1) {
+			Assert(ListingMaxLength >= 14);
+			fprintfCheck(&Success, FileStream, "|         |        | ");
+			PrintListingFlowColumn(&Success, FileStream, Context, -1);
+			PrintListingProfileColumns(&Success, FileStream, Context->Profile, -1);
+			fprintfCheck(&Success, FileStream, ".SetAddr 0x%0.3X% *s |\n", Index, ListingMaxLength - 14, "");
+		}
 
-			fprintfCheck(&Success, FileStream, "| 0x%0.3X   | 0x%0.4X | ", Index, Program[Index]);
+		fprintfCheck(&Success, FileStream, "| 0x%0.3X   | 0x%0.4X | ", Index, Context->Program[Index]);
+		PrintListingFlowColumn(&Success, FileStream, Context, Index);
+		PrintListingProfileColumns(&Success, FileStream, Context->Profile, Index);
 
-			identifier_dest *IdentifierDestination = 0;
-			if (ProgramMetaData[Index] & PMD_UsedIdentifier) {
-				for (int IdentifierIndex = 0; ; IdentifierIndex++) {
-					IdentifierDestination = GetFromPagedList(IdentifierDestinationList, IdentifierIndex);
-							
-					if (IdentifierDestination == 0) {
-						printf("[Error Lising] Failed to resolve an Identifier used at  0x%0.3X\n", Index);
-						break;
-					}
-					if (IdentifierDestination->Address == Index) {
-						break;   
-					}
-				}
+		const char *IdentifierDestination = 0;
+		int IdentifierDestinationBytes = 0;
+		if (Context->ProgramMetaData[Index] & PMD_UsedIdentifier) {
+			if (Symbols->AddressToDest[Index] == -1) {
+				printf("[Error Lising] Failed to resolve an Identifier used at  0x%0.3X\n", Index);
+			}
+			else {
+				IdentifierDestination = Symbols->Dests.Names[Symbols->AddressToDest[Index]];
+				IdentifierDestinationBytes = Symbols->Dests.ByteCounts[Symbols->AddressToDest[Index]];
 			}
+		}
 
 
-			if (ProgramMetaData[Index] & PMD_IsData) {
-				ListingCharacterCount += fprintfCheck(&Success, FileStream, "data 0x%0.4X", Program[Index]);
+		if (Context->ProgramMetaData[Index] & PMD_IsData) {
+			ListingCharacterCount += fprintfCheck(&Success, FileStream, "data 0x%0.4X", Context->Program[Index]);
+		}
+		else {
+			char *OpcodeMemonic = 0;
+			const uint16_t Opcode = Context->Program[Index] & 0xF000;
+			if (Opcode == Keywords[KW_Jumpstore].Opcode) {
+				OpcodeMemonic = Keywords[KW_Jumpstore].String;
+				EmitCode = EMIT_Jumpstore;
 			}
-			else {
-				char *OpcodeMemonic = 0;
-				const uint16_t Opcode = Program[Index] & 0xF000;
-				if (Opcode == Keywords[KW_Jumpstore].Opcode) {
-					OpcodeMemonic = Keywords[KW_Jumpstore].String;
-					EmitCode = EMIT_Jumpstore;
+			else if (Opcode == Keywords[KW_Load].Opcode) {
+				OpcodeMemonic = Keywords[KW_Load].String;
+				EmitCode = EMIT_No;
+				if (IdentifierDestination) {
+					snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "%.*s", IdentifierDestinationBytes, IdentifierDestination);
 				}
-				else if (Opcode == Keywords[KW_Load].Opcode) {
-					OpcodeMemonic = Keywords[KW_Load].String;
-					EmitCode = EMIT_No;
+				else {
+					snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "RAM[0x%0.3X]", Context->Program[Index] & 0x0FFF);
+				}
+			}
+			else if (Opcode == Keywords[KW_Store].Opcode) {
+				OpcodeMemonic = Keywords[KW_Store].String;
+				EmitCode = EMIT_Store;
+			}
+			else if (Opcode == Keywords[KW_Add].Opcode) {
+				OpcodeMemonic = Keywords[KW_Add].String;
+				EmitCode = EMIT_No;
+				if (ContentsOfAC[0] == '0' && ContentsOfAC[1] == '\0') {
 					if (IdentifierDestination) {
-						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "%.*s", IdentifierDestination->ByteCount, IdentifierDestination->Start);
+						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "%.*s", IdentifierDestinationBytes, IdentifierDestination);
 					}
 					else {
-						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "RAM[0x%0.3X]", Program[Index] & 0x0FFF);
+						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "RAM[0x%0.3X]", Context->Program[Index] & 0x0FFF);
 					}
 				}
-				else if (Opcode == Keywords[KW_Store].Opcode) {
-					OpcodeMemonic = Keywords[KW_Store].String;
-					EmitCode = EMIT_Store;
-				}
-				else if (Opcode == Keywords[KW_Add].Opcode) {
-					OpcodeMemonic = Keywords[KW_Add].String;
-					EmitCode = EMIT_No;
-					if (ContentsOfAC[0] == '0' && ContentsOfAC[1] == '\0') {
-						if (IdentifierDestination) {
-							snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "%.*s", IdentifierDestination->ByteCount, IdentifierDestination->Start);
-						}
-						else {
-							snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "RAM[0x%0.3X]", Program[Index] & 0x0FFF);
-						}
+				else {
+					if (IdentifierDestination) {
+						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "%s + %.*s", ContentsOfAC, IdentifierDestinationBytes, IdentifierDestination);
 					}
 					else {
-						if (IdentifierDestination) {
-							snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "%s + %.*s", ContentsOfAC, IdentifierDestination->ByteCount, IdentifierDestination->Start);
-						}
-						else {
-							snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "%s + RAM[0x%0.3X]", ContentsOfAC, Program[Index] & 0x0FFF);
-						}
+						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "%s + RAM[0x%0.3X]", ContentsOfAC, Context->Program[Index] & 0x0FFF);
 					}
 				}
-				else if (Opcode == Keywords[KW_Sub].Opcode) {
-					OpcodeMemonic = Keywords[KW_Sub].String;
-					EmitCode = EMIT_No;
-					if (ContentsOfAC[0] == '0' && ContentsOfAC[1] == '\0') {
-						if (IdentifierDestination) {
-							snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "-%.*s", IdentifierDestination->ByteCount, IdentifierDestination->Start);
-						}
-						else {
-							snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "-RAM[0x%0.3X]", Program[Index] & 0x0FFF);
-						}
+			}
+			else if (Opcode == Keywords[KW_Sub].Opcode) {
+				OpcodeMemonic = Keywords[KW_Sub].String;
+				EmitCode = EMIT_No;
+				if (ContentsOfAC[0] == '0' && ContentsOfAC[1] == '\0') {
+					if (IdentifierDestination) {
+						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "-%.*s", IdentifierDestinationBytes, IdentifierDestination);
 					}
 					else {
-						if (IdentifierDestination) {
-							snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "%s - %.*s", ContentsOfAC, IdentifierDestination->ByteCount, IdentifierDestination->Start);
-						}
-						else {
-							snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "%s - RAM[0x%0.3X]", ContentsOfAC, Program[Index] & 0x0FFF);
-						}
+						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "-RAM[0x%0.3X]", Context->Program[Index] & 0x0FFF);
 					}
 				}
-				else if (Opcode == Keywords[KW_Input].Opcode) {
-					OpcodeMemonic = Keywords[KW_Input].String;
-					EmitCode = EMIT_No;
-					snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "Input");
-				}
-				else if (Opcode == Keywords[KW_Output].Opcode) {
-					OpcodeMemonic = Keywords[KW_Output].String;
-					EmitCode = EMIT_Output;
-				}
-				else if (Opcode == Keywords[KW_Halt].Opcode) {
-					OpcodeMemonic = Keywords[KW_Halt].String;
-					EmitCode = EMIT_Halt;
-				}
-				else if (Opcode == Keywords[KW_Skipcond].Opcode) {
-					OpcodeMemonic = Keywords[KW_Skipcond].String;
-					EmitCode = EMIT_Skipcond;
-				}
-				else if (Opcode == Keywords[KW_Jump].Opcode) {
-					OpcodeMemonic = Keywords[KW_Jump].String;
-					EmitCode = EMIT_Jump;
-				}
-				else if (Opcode == Keywords[KW_Clear].Opcode) {
-					OpcodeMemonic = Keywords[KW_Clear].String;
-					EmitCode = EMIT_Clear;
-					snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "0");
-				}
-				else if (Opcode == Keywords[KW_Jumpi].Opcode) {
-					OpcodeMemonic = Keywords[KW_Jumpi].String;
-					EmitCode = EMIT_Jumpi;
+				else {
+					if (IdentifierDestination) {
+						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "%s - %.*s", ContentsOfAC, IdentifierDestinationBytes, IdentifierDestination);
+					}
+					else {
+						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "%s - RAM[0x%0.3X]", ContentsOfAC, Context->Program[Index] & 0x0FFF);
+					}
 				}
-				else if (Opcode == Keywords[KW_Addi].Opcode) {
-					OpcodeMemonic = Keywords[KW_Addi].String;
-					EmitCode = EMIT_No;
-					if (ContentsOfAC[0] == '0' && ContentsOfAC[1] == '\0') {
-						if (IdentifierDestination) {
-							snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "RAM[%.*s]", IdentifierDestination->ByteCount, IdentifierDestination->Start);
-						}
-						else {
-							snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "RAM[RAM[0x%0.3X]]", Program[Index] & 0x0FFF);
-						}
+			}
+			else if (Opcode == Keywords[KW_Input].Opcode) {
+				OpcodeMemonic = Keywords[KW_Input].String;
+				EmitCode = EMIT_No;
+				snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "Input");
+			}
+			else if (Opcode == Keywords[KW_Output].Opcode) {
+				OpcodeMemonic = Keywords[KW_Output].String;
+				EmitCode = EMIT_Output;
+			}
+			else if (Opcode == Keywords[KW_Halt].Opcode) {
+				OpcodeMemonic = Keywords[KW_Halt].String;
+				EmitCode = EMIT_Halt;
+			}
+			else if (Opcode == Keywords[KW_Skipcond].Opcode) {
+				OpcodeMemonic = Keywords[KW_Skipcond].String;
+				EmitCode = EMIT_Skipcond;
+			}
+			else if (Opcode == Keywords[KW_Jump].Opcode) {
+				OpcodeMemonic = Keywords[KW_Jump].String;
+				EmitCode = EMIT_Jump;
+			}
+			else if (Opcode == Keywords[KW_Clear].Opcode) {
+				OpcodeMemonic = Keywords[KW_Clear].String;
+				EmitCode = EMIT_Clear;
+				snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "0");
+			}
+			else if (Opcode == Keywords[KW_Jumpi].Opcode) {
+				OpcodeMemonic = Keywords[KW_Jumpi].String;
+				EmitCode = EMIT_Jumpi;
+			}
+			else if (Opcode == Keywords[KW_Addi].Opcode) {
+				OpcodeMemonic = Keywords[KW_Addi].String;
+				EmitCode = EMIT_No;
+				if (ContentsOfAC[0] == '0' && ContentsOfAC[1] == '\0') {
+					if (IdentifierDestination) {
+						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "RAM[%.*s]", IdentifierDestinationBytes, IdentifierDestination);
 					}
 					else {
-						if (IdentifierDestination) {
-							snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "%s + RAM[%.*s]", ContentsOfAC, IdentifierDestination->ByteCount, IdentifierDestination->Start);
-						}
-						else {
-							snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "%s + RAM[RAM[0x%0.3X]]", ContentsOfAC, Program[Index] & 0x0FFF);
-						}
+						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "RAM[RAM[0x%0.3X]]", Context->Program[Index] & 0x0FFF);
 					}
 				}
-				else if (Opcode == Keywords[KW_Loadi].Opcode) {
-					OpcodeMemonic = Keywords[KW_Loadi].String;
-					EmitCode = EMIT_No;
+				else {
 					if (IdentifierDestination) {
-						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "RAM[%.*s]", IdentifierDestination->ByteCount, IdentifierDestination->Start);
+						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "%s + RAM[%.*s]", ContentsOfAC, IdentifierDestinationBytes, IdentifierDestination);
 					}
 					else {
-						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "RAM[RAM[0x%0.3X]]", Program[Index] & 0x0FFF);
+						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "%s + RAM[RAM[0x%0.3X]]", ContentsOfAC, Context->Program[Index] & 0x0FFF);
 					}
 				}
-				else if (Opcode == Keywords[KW_Storei].Opcode) {
-					OpcodeMemonic = Keywords[KW_Storei].String;
-					EmitCode = EMIT_Storei;
+			}
+			else if (Opcode == Keywords[KW_Loadi].Opcode) {
+				OpcodeMemonic = Keywords[KW_Loadi].String;
+				EmitCode = EMIT_No;
+				if (IdentifierDestination) {
+					snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "RAM[%.*s]", IdentifierDestinationBytes, IdentifierDestination);
 				}
-				
-				ListingCharacterCount += fprintfCheck(&Success, FileStream, "%s", OpcodeMemonic);
-
-				if (OpcodeMemonic != Keywords[KW_Halt].String &&
-				    OpcodeMemonic != Keywords[KW_Input].String &&
-				    OpcodeMemonic != Keywords[KW_Output].String &&
-				    OpcodeMemonic != Keywords[KW_Clear].String) {
-					if (ProgramMetaData[Index] & PMD_UsedIdentifier) {
-						Assert(IdentifierDestination != FALSE);
-						ListingCharacterCount += fprintfCheck(&Success, FileStream, " %.*s", IdentifierDestination->ByteCount, IdentifierDestination->Start);
-						ListingCharacterCount -= IdentifierDestination->ByteCount - IdentifierDestination->CharCount;
+				else {
+					snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "RAM[RAM[0x%0.3X]]", Context->Program[Index] & 0x0FFF);
+				}
+			}
+			else if (Opcode == Keywords[KW_Storei].Opcode) {
+				OpcodeMemonic = Keywords[KW_Storei].String;
+				EmitCode = EMIT_Storei;
+			}
+			
+			ListingCharacterCount += fprintfCheck(&Success, FileStream, "%s", OpcodeMemonic);
+
+			if (OpcodeMemonic != Keywords[KW_Halt].String &&
+			    OpcodeMemonic != Keywords[KW_Input].String &&
+			    OpcodeMemonic != Keywords[KW_Output].String &&
+			    OpcodeMemonic != Keywords[KW_Clear].String) {
+				if (Context->ProgramMetaData[Index] & PMD_UsedIdentifier) {
+					Assert(IdentifierDestination != FALSE);
+					ListingCharacterCount += fprintfCheck(&Success, FileStream, " %.*s", IdentifierDestinationBytes, IdentifierDestination);
+					ListingCharacterCount -= IdentifierDestinationBytes - CountUtf8Characters(IdentifierDestination, IdentifierDestinationBytes);
+				}
+				else {
+					if (OpcodeMemonic == Keywords[KW_Skipcond].String) {
+						switch(Context->Program[Index] & 0x0FFF) {
+						case(0x000): ListingCharacterCount += fprintfCheck(&Success, FileStream, " lesser"); break;
+						case(0x400): ListingCharacterCount += fprintfCheck(&Success, FileStream, " equal"); break;
+						case(0xC00): ListingCharacterCount += fprintfCheck(&Success, FileStream, " greater"); break;
+						default: ListingCharacterCount += fprintfCheck(&Success, FileStream, " 0x%0.3X", Context->Program[Index] & 0x0FFF); break;
+						}
 					}
 					else {
-						if (OpcodeMemonic == Keywords[KW_Skipcond].String) {
-							switch(Program[Index] & 0x0FFF) {
-							case(0x000): ListingCharacterCount += fprintfCheck(&Success, FileStream, " lesser"); break;
-							case(0x400): ListingCharacterCount += fprintfCheck(&Success, FileStream, " equal"); break;
-							case(0xC00): ListingCharacterCount += fprintfCheck(&Success, FileStream, " greater"); break;
-							default: ListingCharacterCount += fprintfCheck(&Success, FileStream, " 0x%0.3X", Program[Index] & 0x0FFF); break;
-							}
-						}
-						else {
-							ListingCharacterCount += fprintfCheck(&Success, FileStream, " 0x%0.3X", Program[Index] & 0x0FFF);
-						}
+						ListingCharacterCount += fprintfCheck(&Success, FileStream, " 0x%0.3X", Context->Program[Index] & 0x0FFF);
 					}
 				}
 			}
+		}
+	
+		if (Context->ProgramMetaData[Index] & PMD_DefinedIdentifier) {
+			if (Symbols->AddressToSource[Index] == -1) {
+				fprintfCheck(&Success, FileStream, " .Ident COULD NOT RESOLVE IDENTIFER DEFINITION");
+				printf("[Error Lising] Failed to resolve an Identifier defined at address 0x%0.3X\n", Index);
+				Success = FALSE;
+			}
+			else {
+				const int SourceIndex = Symbols->AddressToSource[Index];
+				ListingCharacterCount += fprintfCheck(&Success, FileStream, " .Ident %.*s", Symbols->Sources.ByteCounts[SourceIndex], Symbols->Sources.Names[SourceIndex]);
+				ListingCharacterCount -= Symbols->Sources.ByteCounts[SourceIndex] - IdentifierCharCount(&Symbols->Sources, SourceIndex);
+			}
+		}
 		
-			if (ProgramMetaData[Index] & PMD_DefinedIdentifier) {
-				for (int IdentifierIndex = 0; ; IdentifierIndex++) {
-					const identifier_source *IdentifierSource = GetFromPagedList(IdentifierSourceList, IdentifierIndex);
-					if (IdentifierSource == 0) {
-						fprintfCheck(&Success, FileStream, " .Ident COULD NOT RESOLVE IDENTIFER DEFINITION");
-						printf("[Error Lising] Failed to resolve an Identifier defined at address 0x%0.3X\n", Index);
-						Success = FALSE;
-						break;
-					}
-					if (IdentifierSource->Value == Index) {
-						ListingCharacterCount += fprintfCheck(&Success, FileStream, " .Ident %.*s", IdentifierSource->ByteCount, IdentifierSource->Start);
-						ListingCharacterCount -= IdentifierSource->ByteCount - IdentifierSource->CharCount;
-						break;
-					}
+		fprintfCheck(&Success, FileStream, "% *s | ", ListingMaxLength - ListingCharacterCount, "");
+
+		if (EmitIndentNextLine) {
+			EmitIndentNextLine = FALSE;
+			fprintfCheck(&Success, FileStream, "    ");
+		}
+		
+		{
+			switch (EmitCode) {
+
+			case(EMIT_No): {
+			} break;
+				
+			case(EMIT_Jump): {
+				if (IdentifierDestination) {
+					fprintfCheck(&Success, FileStream, "Goto %.*s // 0x%0.3X", IdentifierDestinationBytes, IdentifierDestination, Context->Program[Index] & 0xFFF);
+				}
+				else {
+					fprintfCheck(&Success, FileStream, "Goto 0x%0.3X", Context->Program[Index] & 0xFFF);
+				}
+			} break;
+
+			case(EMIT_Jumpi): {
+				if (IdentifierDestination) {
+					fprintfCheck(&Success, FileStream, "Goto RAM[%.*s]", IdentifierDestinationBytes, IdentifierDestination);
+				}
+				else {
+					fprintfCheck(&Success, FileStream, "Goto RAM[0x%0.3X]", Context->Program[Index] & 0xFFF);
+				}
+			} break;
+
+			case(EMIT_Jumpstore): {
+				if (IdentifierDestination) {
+					fprintfCheck(&Success, FileStream, "%.*s = PC\n", IdentifierDestinationBytes, IdentifierDestination);
+					fprintfCheck(&Success, FileStream, "|         |        | ");
+					PrintListingFlowColumn(&Success, FileStream, Context, -1);
+					PrintListingProfileColumns(&Success, FileStream, Context->Profile, -1);
+					fprintfCheck(&Success, FileStream, "%- *s | % *sGoto (%.*s + 0x1) // (0x%0.3X + 0x1)", ListingMaxLength, "", EmitIndentNextLine ? 0 : 4, "", IdentifierDestinationBytes, IdentifierDestination, Context->Program[Index] & 0xFFF);
+				}
+				else {
+					fprintfCheck(&Success, FileStream, "0x%0.3X = PC\n", Context->Program[Index] & 0x0FFF);
+					fprintfCheck(&Success, FileStream, "|         |        | ");
+					PrintListingFlowColumn(&Success, FileStream, Context, -1);
+					PrintListingProfileColumns(&Success, FileStream, Context->Profile, -1);
+					fprintfCheck(&Success, FileStream, "%- *s | Goto (0x%0.3X + 0x1)", ListingMaxLength, "", Context->Program[Index] & 0x0FFF);
+				}
+			} break;
+
+			case(EMIT_Skipcond): {
+				if ((Context->Program[Index] & 0x0FFF) == 0xC00) { // Greater
+					fprintfCheck(&Success, FileStream, "if ((%s) <= 0)", ContentsOfAC);
+				}
+				else if ((Context->Program[Index] & 0x0FFF) == 0x400) { // Equal
+					fprintfCheck(&Success, FileStream, "if ((%s) != 0)", ContentsOfAC);
+				}
+				else if ((Context->Program[Index] & 0x0FFF) == 0x000) { // Lesser
+					fprintfCheck(&Success, FileStream, "if ((%s) >= 0)", ContentsOfAC);
+				}
+				else { // Unknown
+					fprintfCheck(&Success, FileStream, "Skip next if (unknown operation)");
 				}
+				EmitIndentNextLine = TRUE;
+			} break;
+
+			case(EMIT_Store): {
+				if (IdentifierDestination) {
+					fprintfCheck(&Success, FileStream, "%.*s = %s", IdentifierDestinationBytes, IdentifierDestination, ContentsOfAC);
+					snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "%.*s", IdentifierDestinationBytes, IdentifierDestination);
+				}
+				else {
+					fprintfCheck(&Success, FileStream, "RAM[0x%0.3x] = %s", Context->Program[Index] & 0xFFF, ContentsOfAC);
+					snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "RAM[0x%0.3x]", Context->Program[Index] & 0xFFF);
+				}
+			} break;
+
+			case(EMIT_Storei): {
+				if (IdentifierDestination) {
+					fprintfCheck(&Success, FileStream, "RAM[%.*s] = %s", IdentifierDestinationBytes, IdentifierDestination, ContentsOfAC);
+					snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "RAM[%.*s]", IdentifierDestinationBytes, IdentifierDestination);
+				}
+				else {
+					fprintfCheck(&Success, FileStream, "RAM[RAM[0x%0.3X]] = %s", Context->Program[Index] & 0xFFF, ContentsOfAC);
+					snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "RAM[RAM[0x%0.3X]]", Context->Program[Index] & 0xFFF);
+				}
+				
+			} break;
+
+			case(EMIT_Clear): {
+				fprintfCheck(&Success, FileStream, "AC = 0");
+			} break;
+
+			case(EMIT_Output): {
+				fprintfCheck(&Success, FileStream, "Output = %s", ContentsOfAC);
+			} break;
+
+			case(EMIT_Halt): {
+				fprintfCheck(&Success, FileStream, "End execution");
+			} break;
+
+			default: {
+				printf("[Error Listing] We Tried to emit a invalid emit code! Something is wrong with the compiler\n");
+				Success = FALSE;
+			} break;
 			}
-			
-			fprintfCheck(&Success, FileStream, "% *s | ", ListingMaxLength - ListingCharacterCount, "");
+			EmitCode = EMIT_No;	
+		}
+		
+		fprintfCheck(&Success, FileStream, "\n");
+	}
+
+	if (Context->Cfg && Success) {
+		int DeadCount = 0;
+		for (int Index = 0; Index < Kilobyte(4); Index++) {
+			DeadCount += IsDeadInstruction(Context, Context->Cfg, Index);
+		}
+		fprintfCheck(&Success, FileStream, "\n%d words are reachable from address 0x000, in %d basic blocks. %d assembled instructions can never run.\n", Context->Cfg->ReachableCount, Context->Cfg->BlockCount, DeadCount);
+	}
+	if (Context->Profile && Success) {
+		PrintListingHotBlocks(&Success, FileStream, Context);
+	}
+
+	free(ContentsOfAC);
+	fclose(FileStream);
+
+	if (Success == FALSE) {
+		printf("[Error Listing] There was a error encountered while writing to the listing output file!\n");
+	}
+	
+	return Success;
+}
 
-			if (EmitIndentNextLine) {
-				EmitIndentNextLine = FALSE;
-				fprintfCheck(&Success, FileStream, "    ");
+/* The source map is text, so it diffs and greps like the other outputs. After a header line, each line is one run of consecutive occupied addresses:
+ *   0x018 33,0,812 1,0,24 1,0,20
+ * The run starts at address 0x018, whose statement starts at line 33, column 0, byte 812 of the source.
+ * Every word after the first is written as the change in line, column and byte offset from the word before it, which keeps straight line code to a few bytes per word.
+ */
+int OutputSourceMap(const assembler_context *Context, FILE *FileStream) {
+	int Success = TRUE;
+	fprintfCheck(&Success, FileStream, "MarieSourceMap v1\n");
+
+	source_location Previous = {0};
+	int At = 0, Start, End;
+	while (Success && NextSetRange(&Context->ProgramBits[PMDB_IsOccupied], &At, &Start, &End)) {
+		for (int Index = Start; Index < End; Index++) {
+			const source_location Location = Context->SourceMap[Index];
+			if (Index == Start) {
+				if (Previous.Line != 0) { fprintfCheck(&Success, FileStream, "\n"); }
+				fprintfCheck(&Success, FileStream, "0x%03X %d,%d,%d", Index, Location.Line, Location.Column, Location.Offset);
 			}
-			
-			{
-				switch (EmitCode) {
+			else {
+				fprintfCheck(&Success, FileStream, " %d,%d,%d", Location.Line - Previous.Line, Location.Column - Previous.Column, Location.Offset - Previous.Offset);
+			}
+			Previous = Location;
+		}
+	}
+	if (Previous.Line != 0) { fprintfCheck(&Success, FileStream, "\n"); }
+	fclose(FileStream);
 
-				case(EMIT_No): {
-				} break;
-					
-				case(EMIT_Jump): {
-					if (IdentifierDestination) {
-						fprintfCheck(&Success, FileStream, "Goto %.*s // 0x%0.3X", IdentifierDestination->ByteCount, IdentifierDestination->Start, Program[Index] & 0xFFF);
-					}
-					else {
-						fprintfCheck(&Success, FileStream, "Goto 0x%0.3X", Program[Index] & 0xFFF);
-					}
-				} break;
+	if (Success == FALSE) {
+		printf("[Error Source Map] There was a error encountered while writing to the source map output file!\n");
+	}
 
-				case(EMIT_Jumpi): {
-					if (IdentifierDestination) {
-						fprintfCheck(&Success, FileStream, "Goto RAM[%.*s]", IdentifierDestination->ByteCount, IdentifierDestination->Start);
-					}
-					else {
-						fprintfCheck(&Success, FileStream, "Goto RAM[0x%0.3X]", Program[Index] & 0xFFF);
-					}
-				} break;
+	return Success;
+}
 
-				case(EMIT_Jumpstore): {
-					if (IdentifierDestination) {
-						fprintfCheck(&Success, FileStream, "%.*s = PC\n", IdentifierDestination->ByteCount, IdentifierDestination->Start);
-						fprintfCheck(&Success, FileStream, "|         |        | %- *s | % *sGoto (%.*s + 0x1) // (0x%0.3X + 0x1)", ListingMaxLength, "", EmitIndentNextLine ? 0 : 4, "", IdentifierDestination->ByteCount, IdentifierDestination->Start, Program[Index] & 0xFFF);
-					}
-					else {
-						fprintfCheck(&Success, FileStream, "0x%0.3X = PC\n", Program [Index] & 0x0FFF);
-						fprintfCheck(&Success, FileStream, "|         |        | %- *s | Goto (0x%0.3X + 0x1)", ListingMaxLength, "", Program[Index] & 0x0FFF);
-					}
-				} break;
+const char* GetIncludedPath(const assembler_context *Context, int Index) {
+	return (Index >= 0 && Index < Context->IncludeCount) ? Context->Includes[Index].File->Path : 0;
+}
+
+int LookupSourceLocation(const assembler_context *Context, int Address, int *Line, int *Column, int *Offset) {
+	if (Address < 0 || Address > 0xFFF || Context->SourceMap[Address].Line == 0) { return FALSE; }
+	const source_location *Location = &Context->SourceMap[Address];
+	if (Line) { *Line = Location->Line; }
+	if (Column) { *Column = Location->Column; }
+	if (Offset) { *Offset = Location->Offset; }
+	return TRUE;
+}
+
+/* Objects are binary, with every number little endian:
+ *   "MARIEOBJ", u16 version
+ *   u16 chunk count, then for each chunk: u16 address (OBJECT_Relocatable if the linker places it), u16 length, its words as u16s, then one PMD_* byte per word
+ *   u16 symbol count, then for each .Ident: u16 chunk, u16 offset into the chunk, u32 line, u32 column, u16 name length, the name
+ *   u16 relocation count, then the same for every identifier used. The linker ORs the address of the symbol it names into that word.
+ * Everything before the first .SetAddr is assembled as a section, so a library doesn't have to say where it goes.
+ */
+#define OBJECT_MAGIC "MARIEOBJ"
+#define OBJECT_VERSION (1)
+#define OBJECT_Relocatable (0xFFFF)
+
+translation_scope void AppendU16(string_builder *Output, uint16_t Value) {
+	const char Bytes[2] = {Value & 0xFF, Value >> 8};
+	AppendString(Output, Bytes, 2);
+}
+
+translation_scope void AppendU32(string_builder *Output, uint32_t Value) {
+	AppendU16(Output, Value & 0xFFFF);
+	AppendU16(Output, Value >> 16);
+}
+
+translation_scope void AppendObjectChunk(string_builder *Output, int Address, const uint16_t *Words, const uint8_t *MetaData, int Length) {
+	AppendU16(Output, Address);
+	AppendU16(Output, Length);
+	for (int Index = 0; Index < Length; Index++) { AppendU16(Output, Words[Index]); }
+	AppendString(Output, (const char*)MetaData, Length);
+}
+
+translation_scope void AppendObjectReference(string_builder *Output, int Chunk, int Offset, int Line, int Column, const char *Name, int NameLength) {
+	AppendU16(Output, Chunk);
+	AppendU16(Output, Offset);
+	AppendU32(Output, Line);
+	AppendU32(Output, Column);
+	AppendU16(Output, NameLength);
+	AppendString(Output, Name, NameLength);
+}
+
+/* Which section each of Count identifiers was assembled in, or -1. First and Count pick the sources or the dests of each section.
+ */
+translation_scope int *FindIdentifierSections(const assembler_context *Context, int Count, int IsDest) {
+	int *Result = malloc(sizeof(*Result) * Max(1, Count));
+	for (int Index = 0; Index < Count; Index++) { Result[Index] = -1; }
+	for (int SectionIndex = 0; SectionIndex < Context->SectionCount; SectionIndex++) {
+		const program_section *Section = &Context->Sections[SectionIndex];
+		const int First = IsDest ? Section->FirstDest : Section->FirstSource;
+		const int SectionCount = IsDest ? Section->DestCount : Section->SourceCount;
+		for (int Index = First; Index < First + SectionCount; Index++) { Result[Index] = SectionIndex; }
+	}
+	return Result;
+}
+
+/* Writes the program held by Context as an object, which has to have been assembled with Context->Relocatable set.
+ */
+int OutputObject(const assembler_context *Context, FILE *FileStream) {
+	const symbol_index *Symbols = &Context->Symbols;
+
+	// Words placed with .SetAddr make one chunk per run of consecutive addresses, and each section with anything in it is one more.
+	int AddressChunk[Kilobyte(4)];
+	int *SectionChunk = malloc(sizeof(*SectionChunk) * Max(1, Context->SectionCount));
+	int *ChunkStart = malloc(sizeof(*ChunkStart) * (Kilobyte(4) + Context->SectionCount));
+	int *ChunkLength = malloc(sizeof(*ChunkLength) * Kilobyte(4));
+	int ChunkCount = 0;
+	memset(AddressChunk, 0xFF, sizeof(AddressChunk));
+	int At = 0, Start, End;
+	while (NextSetRange(&Context->ProgramBits[PMDB_IsOccupied], &At, &Start, &End)) {
+		for (int Address = Start; Address < End; Address++) { AddressChunk[Address] = ChunkCount; }
+		ChunkStart[ChunkCount] = Start;
+		ChunkLength[ChunkCount++] = End - Start;
+	}
+	const int AbsoluteChunkCount = ChunkCount;
+	for (int SectionIndex = 0; SectionIndex < Context->SectionCount; SectionIndex++) {
+		SectionChunk[SectionIndex] = -1;
+		if (Context->Sections[SectionIndex].Length) {
+			ChunkStart[ChunkCount] = Context->Sections[SectionIndex].Start;
+			SectionChunk[SectionIndex] = ChunkCount++;
+		}
+	}
+
+	string_builder Output = {0};
+	AppendString(&Output, OBJECT_MAGIC, 8);
+	AppendU16(&Output, OBJECT_VERSION);
+	AppendU16(&Output, ChunkCount);
+	for (int Chunk = 0; Chunk < AbsoluteChunkCount; Chunk++) {
+		const int Start = ChunkStart[Chunk];
+		AppendObjectChunk(&Output, Start, &Context->Program[Start], &Context->ProgramMetaData[Start], ChunkLength[Chunk]);
+	}
+	for (int SectionIndex = 0; SectionIndex < Context->SectionCount; SectionIndex++) {
+		const program_section *Section = &Context->Sections[SectionIndex];
+		if (Section->Length == 0) { continue; }
+		AppendObjectChunk(&Output, OBJECT_Relocatable, &Context->SectionProgram[Section->Start], &Context->SectionMetaData[Section->Start], Section->Length);
+	}
+
+	// Identifiers assembled in a section hold staging addresses, which become offsets into the section's chunk.
+	int *SourceSections = FindIdentifierSections(Context, Symbols->SourceCount, FALSE);
+	AppendU16(&Output, Symbols->SourceCount);
+	for (int SourceIndex = 0; SourceIndex < Symbols->SourceCount; SourceIndex++) {
+		const identifier_table *Sources = &Symbols->Sources;
+		const int Address = Sources->Addresses[SourceIndex];
+		const int Chunk = (SourceSections[SourceIndex] == -1) ? AddressChunk[Address] : SectionChunk[SourceSections[SourceIndex]];
+		AppendObjectReference(&Output, Chunk, Address - ChunkStart[Chunk], Sources->Lines[SourceIndex], Sources->Columns[SourceIndex], Sources->Names[SourceIndex], Sources->ByteCounts[SourceIndex]);
+	}
+	int *DestSections = FindIdentifierSections(Context, Symbols->DestCount, TRUE);
+	AppendU16(&Output, Symbols->DestCount);
+	for (int DestIndex = 0; DestIndex < Symbols->DestCount; DestIndex++) {
+		const identifier_table *Dests = &Symbols->Dests;
+		const int Address = Dests->Addresses[DestIndex];
+		const int Chunk = (DestSections[DestIndex] == -1) ? AddressChunk[Address] : SectionChunk[DestSections[DestIndex]];
+		AppendObjectReference(&Output, Chunk, Address - ChunkStart[Chunk], Dests->Lines[DestIndex], Dests->Columns[DestIndex], Dests->Names[DestIndex], Dests->ByteCounts[DestIndex]);
+	}
+
+	int Success = fwrite(Output.Data, 1, Output.Length, FileStream) == Output.Length;
+	Success = (fclose(FileStream) == 0) && Success;
+	if (Success == FALSE) {
+		printf("[Error Object] There was a error encountered while writing to the object output file!\n");
+	}
+
+	free(SourceSections);
+	free(DestSections);
+	free(SectionChunk);
+	free(ChunkStart);
+	free(ChunkLength);
+	free(Output.Data);
+	return Success;
+}
+
+/* Writes one line per call stack in the folded format flamegraph tools read, `Root;Caller;Callee Count`, and closes FileStream.
+ * Frames are named after the .Ident on the subroutine's return address. Returns TRUE on success.
+ */
+int OutputFoldedStacks(const assembler_context *Context, const call_stack_profile *CallStacks, const char *RootName, FILE *FileStream) {
+	int Success = TRUE;
+	const symbol_index *Symbols = &Context->Symbols;
+	int32_t Path[CALL_STACK_MAX_DEPTH];
+
+	for (int32_t Index = 0; Index < CallStacks->NodeCount && Success; Index++) {
+		if (CallStacks->Nodes[Index].Instructions == 0) { continue; }
+		int Depth = 0;
+		for (int32_t Node = Index; Node > 0; Node = CallStacks->Nodes[Node].Parent) {
+			Path[Depth++] = Node;
+		}
 
-				case(EMIT_Skipcond): {
-					if ((Program[Index] & 0x0FFF) == 0xC00) { // Greater
-						fprintfCheck(&Success, FileStream, "if ((%s) <= 0)", ContentsOfAC);
-					}
-					else if ((Program[Index] & 0x0FFF) == 0x400) { // Equal
-						fprintfCheck(&Success, FileStream, "if ((%s) != 0)", ContentsOfAC);
-					}
-					else if ((Program[Index] & 0x0FFF) == 0x000) { // Lesser
-						fprintfCheck(&Success, FileStream, "if ((%s) >= 0)", ContentsOfAC);
-					}
-					else { // Unknown
-						fprintfCheck(&Success, FileStream, "Skip next if (unknown operation)");
-					}
-					EmitIndentNextLine = TRUE;
-				} break;
+		fprintfCheck(&Success, FileStream, "%s", RootName);
+		while (Depth > 0) {
+			const uint16_t Subroutine = CallStacks->Nodes[Path[--Depth]].Subroutine;
+			const int SourceIndex = Symbols->AddressToSource[Subroutine];
+			if (SourceIndex != -1) {
+				fprintfCheck(&Success, FileStream, ";%.*s", Symbols->Sources.ByteCounts[SourceIndex], Symbols->Sources.Names[SourceIndex]);
+			}
+			else {
+				fprintfCheck(&Success, FileStream, ";0x%03X", Subroutine);
+			}
+		}
+		fprintfCheck(&Success, FileStream, " %llu\n", (unsigned long long)CallStacks->Nodes[Index].Instructions);
+	}
+	fclose(FileStream);
 
-				case(EMIT_Store): {
-					if (IdentifierDestination) {
-						fprintfCheck(&Success, FileStream, "%.*s = %s", IdentifierDestination->ByteCount, IdentifierDestination->Start, ContentsOfAC);
-						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "%.*s", IdentifierDestination->ByteCount, IdentifierDestination->Start);
-					}
-					else {
-						fprintfCheck(&Success, FileStream, "RAM[0x%0.3x] = %s", Program[Index] & 0xFFF, ContentsOfAC);
-						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "RAM[0x%0.3x]", Program[Index] & 0xFFF);
-					}
-				} break;
+	if (Success == FALSE) {
+		printf("[Error Folded Stacks] There was a error encountered while writing to the folded stacks output file!\n");
+	}
+	return Success;
+}
 
-				case(EMIT_Storei): {
-					if (IdentifierDestination) {
-						fprintfCheck(&Success, FileStream, "RAM[%.*s] = %s", IdentifierDestination->ByteCount, IdentifierDestination->Start, ContentsOfAC);
-						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "RAM[%.*s]", IdentifierDestination->ByteCount, IdentifierDestination->Start);
-					}
-					else {
-						fprintfCheck(&Success, FileStream, "RAM[RAM[0x%0.3X]] = %s", Program[Index] & 0xFFF, ContentsOfAC);
-						snprintfCheck(&Success, ContentsOfAC, ContentsOfACSize, "RAM[RAM[0x%0.3X]]", Program[Index] & 0xFFF);
-					}
-					
-				} break;
+#define TEXT_CHUNK_SIZE (Kilobyte(64))
+
+enum {
+	TEXT_Unknown, // Not enough bytes have arrived to tell which byte order mark the file starts with.
+	TEXT_Utf8,
+	TEXT_Utf16LE,
+	TEXT_Utf16BE,
+	TEXT_Unsupported,
+};
 
-				case(EMIT_Clear): {
-					fprintfCheck(&Success, FileStream, "AC = 0");
-				} break;
+/* Transcodes a file to UTF-8 as its bytes arrive, so it can be read in chunks from a pipe without knowing its size.
+ * A chunk can end anywhere, even between the bytes of a UTF-16 code unit or the halves of a surrogate pair. What is left over waits here for the next chunk.
+ */
+typedef struct {
+	int Encoding;
+	int HasByteOrderMark;
+	uint8_t Pending[4];
+	int PendingCount;
+	uint16_t HighSurrogate; // The first half of a surrogate pair whose second half hasn't arrived, or 0.
+	string_builder Text;
+	int Success;
+} text_decoder;
+
+translation_scope void AppendCodePoint(string_builder *Text, uint32_t CodePoint) {
+	ReserveString(Text, 4);
+	uint8_t *At = (uint8_t*)Text->Data + Text->Length;
+	if (CodePoint <= 0x7F) { // One Byte
+		At[0] = (uint8_t)CodePoint;
+		Text->Length += 1;
+	}
+	else if (CodePoint <= 0x7FF) { // Two Byte
+		At[0] = 0xC0 | ((uint8_t)( (CodePoint >> 6) & 0x1F ));
+		At[1] = 0x80 | ((uint8_t)( (CodePoint) & 0x3F ));
+		Text->Length += 2;
+	}
+	else if (CodePoint <= 0xFFFF) { // Three Byte
+		At[0] = 0xE0 | ((uint8_t)( (CodePoint >> (6*2)) & 0xF ));
+		At[1] = 0x80 | ((uint8_t)( (CodePoint >> (6)) & 0x3F ));
+		At[2] = 0x80 | ((uint8_t)( (CodePoint) & 0x3F ));
+		Text->Length += 3;
+	}
+	else if (CodePoint <= 0x10FFFF) { // Four Byte
+		At[0] = 0xF0 | ((uint8_t)( (CodePoint >> (6*3)) & 0x7 ));
+		At[1] = 0x80 | ((uint8_t)( (CodePoint >> (6*2)) & 0x3F ));
+		At[2] = 0x80 | ((uint8_t)( (CodePoint >> (6*1)) & 0x3F ));
+		At[3] = 0x80 | ((uint8_t)( (CodePoint) & 0x3F ));
+		Text->Length += 4;
+	}
+	else {
+		printf("[Error File Handling] A invalid codepoint was encountered!\n");
+	}
+	Text->Data[Text->Length] = 0;
+}
 
-				case(EMIT_Output): {
-					fprintfCheck(&Success, FileStream, "Output = %s", ContentsOfAC);
-				} break;
+translation_scope void DecodeUtf16Unit(text_decoder *Decoder, uint16_t Unit) {
+	const char *EncodingName = (Decoder->Encoding == TEXT_Utf16LE) ? "UTF-16-LE" : "UTF-16-BE";
+	if (Decoder->HighSurrogate) {
+		const uint16_t HighSurrogate = Decoder->HighSurrogate;
+		Decoder->HighSurrogate = 0;
+		if ((Unit & 0xFC00) == 0xDC00) {
+			AppendCodePoint(&Decoder->Text, 0x10000 + ((HighSurrogate & 0x03FF) << 10) + (Unit & 0x03FF));
+			return;
+		}
+		printf("[Error File Handling] A high surrogate was not followed by a low surrogate, This file is not valid %s\n", EncodingName);
+		Decoder->Success = FALSE;
+	}
 
-				case(EMIT_Halt): {
-					fprintfCheck(&Success, FileStream, "End execution");
-				} break;
+	if ((Unit & 0xFC00) == 0xD800) {
+		Decoder->HighSurrogate = Unit;
+	}
+	else if ((Unit & 0xFC00) == 0xDC00) {
+		printf("[Error File Handling] A low surrogate was not followed by a high surrogate, This file is not valid %s\n", EncodingName);
+		Decoder->Success = FALSE;
+	}
+	else {
+		AppendCodePoint(&Decoder->Text, Unit);
+	}
+}
 
-				default: {
-					printf("[Error Listing] We Tried to emit a invalid emit code! Something is wrong with the compiler\n");
-					Success = FALSE;
-				} break;
-				}
-				EmitCode = EMIT_No;	
-			}
-			
-			fprintfCheck(&Success, FileStream, "\n");
+translation_scope void DecodeTextBytes(text_decoder *Decoder, const uint8_t *Bytes, int Count) {
+	if (Decoder->Encoding == TEXT_Utf8) {
+		AppendString(&Decoder->Text, (const char*)Bytes, Count);
+	}
+	else if (Decoder->Encoding == TEXT_Utf16LE || Decoder->Encoding == TEXT_Utf16BE) {
+		const int BigEndian = (Decoder->Encoding == TEXT_Utf16BE);
+		int Index = 0;
+		if (Decoder->PendingCount == 1 && Count > 0) { // The last chunk ended halfway through a code unit.
+			const uint8_t First = Decoder->Pending[0], Second = Bytes[Index++];
+			Decoder->PendingCount = 0;
+			DecodeUtf16Unit(Decoder, BigEndian ? ((First << 8) | Second) : (First | (Second << 8)));
 		}
-		else {
-			InMemoryGap = TRUE;
+		for (; Index + 1 < Count; Index += 2) {
+			DecodeUtf16Unit(Decoder, BigEndian ? ((Bytes[Index] << 8) | Bytes[Index + 1]) : (Bytes[Index] | (Bytes[Index + 1] << 8)));
+		}
+		if (Index < Count) {
+			Decoder->Pending[Decoder->PendingCount++] = Bytes[Index];
 		}
 	}
+}
 
-	free(ContentsOfAC);
-	fclose(FileStream);
+/* Picks the encoding from the byte order mark at the start of Bytes, which are the first four bytes of the file, or all of it if it is shorter.
+ * *MarkLength is set to how many bytes the mark takes up. UTF-32 is reported and gives TEXT_Unsupported.
+ */
+translation_scope int DetectByteOrderMark(const uint8_t *ByteOrderMark, int Count, int *MarkLength) {
+	int Result = TEXT_Utf8;
+	*MarkLength = 0;
+	if ((Count >= 4) &&
+	    (ByteOrderMark[0] == 0xFF) &&
+	    (ByteOrderMark[1] == 0xFE) &&
+	    (ByteOrderMark[2] == 0x00) &&
+	    (ByteOrderMark[3] == 0x00)) { // UTF-32-LE
+		printf("[Error File Handling] Little Endian UTF 32 encoding is not supported. Please use UTF 16 or UTF 8.\n");
+		Result = TEXT_Unsupported;
+	}
+	else if ((Count >= 4) &&
+	         (ByteOrderMark[0] == 0x00) &&
+	         (ByteOrderMark[1] == 0x00) &&
+	         (ByteOrderMark[2] == 0xFE) &&
+	         (ByteOrderMark[3] == 0xFF)) { // UTF-32-BE
+		printf("[Error File Handling] Big Endian UTF 32 encoding is not supported. Please use UTF 16 or UTF 8.\n");
+		Result = TEXT_Unsupported;
+	}
+	else if ((Count >= 2) && (ByteOrderMark[0] == 0xFF) && (ByteOrderMark[1] == 0xFE)) { // UTF-16-LE
+		Result = TEXT_Utf16LE;
+		*MarkLength = 2;
+	}
+	else if ((Count >= 2) && (ByteOrderMark[0] == 0xFE) && (ByteOrderMark[1] == 0xFF)) { // UTF-16-BE
+		Result = TEXT_Utf16BE;
+		*MarkLength = 2;
+	}
+	else if ((Count >= 3) && (ByteOrderMark[0] == 0xEF) && (ByteOrderMark[1] == 0xBB) && (ByteOrderMark[2] == 0xBF)) { // remove UFT-8 Header if present.
+		*MarkLength = 3;
+	}
+	// Otherwise assuming UTF-8/Ascii
+	return Result;
+}
 
-	if (Success == FALSE) {
-		printf("[Error Listing] There was a error encountered while writing to the listing output file!\n");
+// Called once four bytes have arrived, or at the end of the file if it is shorter than that.
+translation_scope void DetectTextEncoding(text_decoder *Decoder) {
+	int MarkLength = 0;
+	Decoder->Encoding = DetectByteOrderMark(Decoder->Pending, Decoder->PendingCount, &MarkLength);
+	if (Decoder->Encoding == TEXT_Unsupported) {
+		Decoder->Success = FALSE;
+		return;
+	}
+	Decoder->HasByteOrderMark = (MarkLength != 0);
+	uint8_t Rest[4];
+	const int RestCount = Decoder->PendingCount - MarkLength;
+	memcpy(Rest, Decoder->Pending + MarkLength, RestCount);
+	Decoder->PendingCount = 0;
+	DecodeTextBytes(Decoder, Rest, RestCount);
+}
+
+translation_scope void DecodeTextChunk(text_decoder *Decoder, const uint8_t *Bytes, int Count) {
+	while (Decoder->Encoding == TEXT_Unknown && Count > 0) {
+		Decoder->Pending[Decoder->PendingCount++] = *Bytes++;
+		Count--;
+		if (Decoder->PendingCount == 4) { DetectTextEncoding(Decoder); }
+	}
+	if (Count > 0) { DecodeTextBytes(Decoder, Bytes, Count); }
+}
+
+translation_scope void FinishDecodingText(text_decoder *Decoder) {
+	if (Decoder->Encoding == TEXT_Unknown) { DetectTextEncoding(Decoder); }
+	if (Decoder->Encoding == TEXT_Unsupported) { return; }
+
+	const char *EncodingName = (Decoder->Encoding == TEXT_Utf16LE) ? "UTF-16-LE" : "UTF-16-BE";
+	if (Decoder->HighSurrogate) {
+		printf("[Error File Handling] A high surrogate was not followed by a low surrogate, This file is not valid %s\n", EncodingName);
+		Decoder->Success = FALSE;
+	}
+	if (Decoder->PendingCount) {
+		printf("[Error File Handling] The file ends partway through a character, This file is not valid %s\n", EncodingName);
+		Decoder->Success = FALSE;
+	}
+	if (Decoder->HasByteOrderMark && Decoder->Text.Length == 0 && Decoder->Success) {
+		printf("[Error File Handling] This file contains no textual content!\n");
+		Decoder->Success = FALSE;
 	}
-	
-	return Success;
 }
 
 char *LoadFileIntoMemory(FILE* FileStream, int FileSize, int *Success) {
 	char *Result = 0;
 
 	if (*Success) {
-		uint8_t ByteOrderMark[4];
-		fread(&ByteOrderMark, sizeof(uint8_t), Min(4, FileSize), FileStream);
-		fseek(FileStream, 0, SEEK_SET);
-
-		if ((FileSize >= 4) &&
-		    (ByteOrderMark[0] == 0xFF) &&
-		    (ByteOrderMark[1] == 0xFE) &&
-		    (ByteOrderMark[2] == 0x00) &&
-		    (ByteOrderMark[3] == 0x00)) { // UTF-32-LE
-			printf("[Error File Handling] Little Endian UTF 32 encoding is not supported. Please use UTF 16 or UTF 8.\n");
-			*Success = FALSE;       
+		// FileSize is only a hint, the file is read until it ends. Pipes and stdin report a size of 0.
+		text_decoder Decoder = {.Success = TRUE};
+		ReserveString(&Decoder.Text, FileSize);
+		Decoder.Text.Data[0] = 0;
+
+		uint8_t *Chunk = malloc(TEXT_CHUNK_SIZE);
+		size_t ChunkSize;
+		while ((ChunkSize = fread(Chunk, 1, TEXT_CHUNK_SIZE, FileStream)) > 0) {
+			DecodeTextChunk(&Decoder, Chunk, (int)ChunkSize);
 		}
-		
-		else if ((FileSize >= 4) &&
-		         (ByteOrderMark[0] == 0x00) &&
-		         (ByteOrderMark[1] == 0x00) &&
-		         (ByteOrderMark[2] == 0xFE) &&
-		         (ByteOrderMark[3] == 0xFF)) { // UTF-32-BE
-			printf("[Error File Handling] Big Endian UTF 32 encoding is not supported. Please use UTF 16 or UTF 8.\n");
+		if (ferror(FileStream)) {
+			printf("[Error File Handling] There was a error encountered while reading the file!\n");
+			Decoder.Success = FALSE;
+		}
+		FinishDecodingText(&Decoder);
+		free(Chunk);
+		fclose(FileStream);
+
+		if (Decoder.Success) {
+			Result = Decoder.Text.Data;
+		}
+		else {
+			free(Decoder.Text.Data);
 			*Success = FALSE;
 		}
-		
-		else if ((FileSize >= 2) &&
-		         (ByteOrderMark[0] == 0xFF) &&
-		         (ByteOrderMark[1] == 0xFE)) { // UTF-16-LE
-			FileSize -= 2;
-			if (FileSize == 0) {
+	}
+	
+	return Result;
+}
+
+char *DecodeTextInPlace(char *Bytes, size_t Size, int *Copied, int *Success) {
+	char *Result = 0;
+	*Copied = FALSE;
+
+	if (*Success) {
+		int MarkLength = 0;
+		const int Encoding = DetectByteOrderMark((const uint8_t*)Bytes, (int)Min(4, Size), &MarkLength);
+		if (Encoding == TEXT_Utf8) {
+			if (MarkLength && Size == MarkLength) {
 				printf("[Error File Handling] This file contains no textual content!\n");
-				*Success = 0;
+				*Success = FALSE;
 			}
 			else {
-				fseek(FileStream, 2, SEEK_SET);
-				Result = malloc(0);
-				int ResultSize = 0;
-				
-				Assert((FileSize%2) == 0);
-				while (FileSize != 0) {
-					uint16_t LowByte = 0, HighByte = 0;
-					uint32_t CodePoint = 0;
-					fread(&HighByte, sizeof(uint16_t), 1, FileStream);
-					FileSize -= 2;
-					if ((HighByte & 0xFC00) == 0xD800) {
-						fread(&LowByte, sizeof(uint16_t), 1, FileStream);
-						FileSize -= 2;
-						if ((LowByte & 0xFC00) != 0xDC00) {
-							printf("[Error File Handling] A high surrogate was not followed by a low surrogate, This file is not valid UTF-16-LE\n");
-							*Success = FALSE;       
-						}
-						CodePoint = 0x10000 + ((HighByte & 0x03FF) << 10) + (LowByte & 0x03FF);
-					}
-					else if ((HighByte & 0xFC00) == 0xDC00) {
-						printf("[Error File Handling] A low surrogate was not followed by a high surrogate, This file is not valid UTF-16-LE\n");
-						*Success = FALSE;
-					}
-					else {
-						CodePoint = HighByte;
-					}
-
-					if ((CodePoint >= 0x0) && (CodePoint <= 0x7F)) { // One Byte
-						ResultSize += 1;
-						Result = realloc(Result, ResultSize);
-						Result[ResultSize-1] = (uint8_t)CodePoint;
-					}
-					else if ((CodePoint >= 0x80) && (CodePoint <= 0x7FF)) { // Two Byte
-						ResultSize += 2;
-						Result = realloc(Result, ResultSize);
-						Result[ResultSize-2] = 0xC0 | ((uint8_t)( (CodePoint >> 6) & 0x1F ));
-						Result[ResultSize-1] = 0x80 | ((uint8_t)( (CodePoint) & 0x3F ));
-					}
-					else if ((CodePoint >= 0x800) && (CodePoint <= 0xFFFF)) { // Three Byte
-						ResultSize += 3;
-						Result = realloc(Result, ResultSize);
-						Result[ResultSize-3] = 0xE0 | ((uint8_t)( (CodePoint >> (6*2)) & 0xF ));
-						Result[ResultSize-2] = 0x80 | ((uint8_t)( (CodePoint >> (6)) & 0x3F ));
-						Result[ResultSize-1] = 0x80 | ((uint8_t)( (CodePoint) & 0x3F ));
-					}
-					else if ((CodePoint >= 0x10000) && (CodePoint <= 0x10FFFF)) { // Four Byte
-						ResultSize += 4;
-						Result = realloc(Result, ResultSize);
-						Result[ResultSize-4] = 0xF0 | ((uint8_t)( (CodePoint >> (6*3)) & 0x7 ));
-						Result[ResultSize-3] = 0x80 | ((uint8_t)( (CodePoint >> (6*2)) & 0x3F ));
-						Result[ResultSize-2] = 0x80 | ((uint8_t)( (CodePoint >> (6*1)) & 0x3F ));
-						Result[ResultSize-1] = 0x80 | ((uint8_t)( (CodePoint) & 0x3F ));
-					}
-					else {
-						printf("[Error File Handling] A invalid codepoint was encountered!\n");
-					}
-				}
-
-				Result = realloc(Result, ResultSize + 1);
-				Result[ResultSize] = 0;
+				Bytes[Size] = 0;
+				Result = Bytes + MarkLength;
 			}
 		}
-		
-		else if ((FileSize >= 2) &&
-		         (ByteOrderMark[0] == 0xFE) &&
-		         (ByteOrderMark[1] == 0xFF)) { // UTF-16-BE
-			FileSize -= 2;
-			if (FileSize == 0) {
-				printf("[Error File Handling] This file contains no textual content!\n");
-				*Success = 0;
+		else if (Encoding != TEXT_Unsupported) {
+			text_decoder Decoder = {.Encoding = Encoding, .HasByteOrderMark = TRUE, .Success = TRUE};
+			ReserveString(&Decoder.Text, (int)Size);
+			Decoder.Text.Data[0] = 0;
+			DecodeTextBytes(&Decoder, (const uint8_t*)Bytes + MarkLength, (int)(Size - MarkLength));
+			FinishDecodingText(&Decoder);
+			if (Decoder.Success) {
+				Result = Decoder.Text.Data;
+				*Copied = TRUE;
 			}
 			else {
-				fseek(FileStream, 2, SEEK_SET);
-				Result = malloc(0);
-				int ResultSize = 0;
-				
-				Assert((FileSize%2) == 0);
-				while (FileSize != 0) {
-					uint16_t LowByte = 0, HighByte = 0;
-					uint32_t CodePoint = 0;
-					fread(&HighByte, sizeof(uint16_t), 1, FileStream);
-					{ // Swap
-						uint8_t Temp = HighByte & 0xff;
-						HighByte = ((HighByte & 0xff00) >> 8) | (HighByte & 0xff00);
-						HighByte = (HighByte & 0x00FF) | (Temp << 8);
-					}
-					
-					FileSize -= 2;
-					if ((HighByte & 0xFC00) == 0xD800) {
-						fread(&LowByte, sizeof(uint16_t), 1, FileStream);
-						{ // Swap
-							uint8_t Temp = LowByte & 0xff;
-							LowByte = ((LowByte & 0xff00) >> 8) | (LowByte & 0xff00);
-							LowByte = (LowByte & 0x00FF) | (Temp << 8);
-						}
-						FileSize -= 2;
-						if ((LowByte & 0xFC00) != 0xDC00) {
-							printf("[Error File Handling] A high surrogate was not followed by a low surrogate, This file is not valid UTF-16-BE\n");
-							*Success = FALSE;       
-						}
-						CodePoint = 0x10000 + ((HighByte & 0x03FF) << 10) + (LowByte & 0x03FF);
-					}
-					else if ((HighByte & 0xFC00) == 0xDC00) {
-						printf("[Error File Handling] A low surrogate was not followed by a high surrogate, This file is not valid UTF-16-BE\n");
-						*Success = FALSE;
-					}
-					else {
-						CodePoint = HighByte;
-					}
+				free(Decoder.Text.Data);
+				*Success = FALSE;
+			}
+		}
+		else {
+			*Success = FALSE;
+		}
+	}
 
-					if ((CodePoint >= 0x0) && (CodePoint <= 0x7F)) { // One Byte
-						ResultSize += 1;
-						Result = realloc(Result, ResultSize);
-						Result[ResultSize-1] = (uint8_t)CodePoint;
-					}
-					else if ((CodePoint >= 0x80) && (CodePoint <= 0x7FF)) { // Two Byte
-						ResultSize += 2;
-						Result = realloc(Result, ResultSize);
-						Result[ResultSize-2] = 0xC0 | ((uint8_t)( (CodePoint >> 6) & 0x1F ));
-						Result[ResultSize-1] = 0x80 | ((uint8_t)( (CodePoint) & 0x3F ));
-					}
-					else if ((CodePoint >= 0x800) && (CodePoint <= 0xFFFF)) { // Three Byte
-						ResultSize += 3;
-						Result = realloc(Result, ResultSize);
-						Result[ResultSize-3] = 0xE0 | ((uint8_t)( (CodePoint >> (6*2)) & 0xF ));
-						Result[ResultSize-2] = 0x80 | ((uint8_t)( (CodePoint >> (6)) & 0x3F ));
-						Result[ResultSize-1] = 0x80 | ((uint8_t)( (CodePoint) & 0x3F ));
-					}
-					else if ((CodePoint >= 0x10000) && (CodePoint <= 0x10FFFF)) { // Four Byte
-						ResultSize += 4;
-						Result = realloc(Result, ResultSize);
-						Result[ResultSize-4] = 0xF0 | ((uint8_t)( (CodePoint >> (6*3)) & 0x7 ));
-						Result[ResultSize-3] = 0x80 | ((uint8_t)( (CodePoint >> (6*2)) & 0x3F ));
-						Result[ResultSize-2] = 0x80 | ((uint8_t)( (CodePoint >> (6*1)) & 0x3F ));
-						Result[ResultSize-1] = 0x80 | ((uint8_t)( (CodePoint) & 0x3F ));
-					}
-					else {
-						printf("[Error File Handling] A invalid codepoint was encountered!\n");
-					}
-				}
+	return Result;
+}
+
+assembler_context* CreateAssemblerContext() {
+	assembler_context *Result = calloc(1, sizeof(assembler_context));
+	Result->DiagnosticText = calloc(1, sizeof(string_builder));
+	return Result;
+}
+
+void FreeAssemblerContext(assembler_context *Context) {
+	if (Context->Source && Context->OwnsSource) { free(Context->Source); }
+	FreeSymbolIndex(&Context->Symbols);
+	free(Context->Sections);
+	for (int Index = 0; Index < Context->IncludeCount; Index++) {
+		ReleaseIncludeFile(Context->Includes[Index].File);
+	}
+	free(Context->Includes);
+	for (int Index = 0; Index < Context->IncludeCacheCount; Index++) {
+		ReleaseIncludeFile(Context->IncludeCache[Index]);
+	}
+	free(Context->IncludeCache);
+	free(Context->Macros);
+	free(Context->MacroStatements);
+	free(Context->MacroArguments);
+	free(Context->MacroTexts);
+	for (int Index = 0; Index < Context->MacroTextBlockCount; Index++) {
+		free(Context->MacroTextBlocks[Index]);
+	}
+	free(Context->MacroTextBlocks);
+	free(Context->DiagnosticText->Data);
+	free(Context->DiagnosticText);
+	free(Context);
+}
+
+/* Throws away the results of the last assembly, and makes Source the text identifiers point into. The context takes ownership of Source.
+ */
+translation_scope void ResetAssembly(assembler_context *Context, char *Source) {
+	// Ensure that Program is actually zero.
+	// This will be needed if this program is used as a DLL, or if the context is being reused!
+	memset(Context->Program, 0, sizeof(Context->Program));
+	memset(Context->ProgramMetaData, 0, sizeof(Context->ProgramMetaData));
+	memset(Context->ProgramBits, 0, sizeof(Context->ProgramBits));
+	memset(Context->SourceMap, 0, sizeof(Context->SourceMap));
+	memset(Context->SectionMetaData, 0, sizeof(Context->SectionMetaData));
+	Context->SectionCount = 0;
+	Context->OpenSection = -1;
+	ResetSymbolIndex(&Context->Symbols);
+	Context->DiagnosticCount = 0;
+	Context->DroppedDiagnosticCount = 0;
+	Context->ErrorCount = 0;
+	Context->WarningCount = 0;
+	Context->DiagnosticText->Length = 0;
+	for (int Index = 0; Index < Context->IncludeCount; Index++) {
+		ReleaseIncludeFile(Context->Includes[Index].File);
+	}
+	Context->IncludeCount = 0;
+	Context->MacroCount = 0;
+	Context->MacroStatementCount = 0;
+	Context->MacroArgumentCount = 0;
+	Context->MacroTextCount = 0;
+	for (int Index = 0; Index < Context->MacroTextBlockCount; Index++) {
+		free(Context->MacroTextBlocks[Index]);
+	}
+	Context->MacroTextBlockCount = 0;
+	Context->MacroExpansionCount = 0;
+	Context->ExpandedAt = 0;
+	Context->ExpandingMacro = -1;
+
+	if (Context->Source && Context->OwnsSource && Context->Source != Source) { free(Context->Source); }
+	Context->Source = Source;
+	Context->OwnsSource = TRUE;
+}
+
+int AssembleSource(assembler_context *Context, char *Source) {
+	ResetAssembly(Context, Source);
+	file_state FileState = {
+		.Line = 1,
+		.Column = 0,
+		.At = Source,
+	};
+	return Assemble(Context, &FileState);
+}
 
-				Result = realloc(Result, ResultSize + 1);
-				Result[ResultSize] = 0;
+int AssembleSourceInPlace(assembler_context *Context, char *Source) {
+	ResetAssembly(Context, Source);
+	Context->OwnsSource = FALSE;
+	file_state FileState = {
+		.Line = 1,
+		.Column = 0,
+		.At = Source,
+	};
+	return Assemble(Context, &FileState);
+}
+
+void OutputDiagnostics(const assembler_context *Context, const char *FileName, int DiagnosticFormat, FILE *FileStream) {
+	// Everything is built up front so it goes out in one write, instead of locking FileStream once per diagnostic.
+	string_builder Output = {0};
+	for (int Index = 0; Index < Context->DiagnosticCount; Index++) {
+		const diagnostic *Diagnostic = &Context->Diagnostics[Index];
+		const char *Message = Context->DiagnosticText->Data + Diagnostic->MessageStart;
+		const char *IncludedFileName = (Diagnostic->File != -1) ? Context->Includes[Diagnostic->File].File->Path : 0;
+		// Where in a macro's definition the problem is, when the diagnostic is at a call of the macro.
+		const macro_definition *Macro = (Diagnostic->Macro != -1) ? &Context->Macros[Diagnostic->Macro] : 0;
+		const char *MacroFileName = (Macro && Macro->File != -1) ? Context->Includes[Macro->File].File->Path : 0;
+
+		if (DiagnosticFormat == DF_JsonLines) {
+			AppendString(&Output, "{", 1);
+			if (IncludedFileName || FileName) {
+				AppendString(&Output, "\"file\":", 7);
+				AppendJsonString(&Output, IncludedFileName ? IncludedFileName : FileName, strlen(IncludedFileName ? IncludedFileName : FileName));
+				AppendString(&Output, ",", 1);
 			}
-		}
-		
-		else { // Assuming UTF-8/Ascii
-			if ((FileSize >= 3) &&
-			    (ByteOrderMark[0] == 0xEF) &&
-			    (ByteOrderMark[1] == 0xBB) &&
-			    (ByteOrderMark[2] == 0xBF)) { // remove UFT-8 Header if present.
-				FileSize -= 3;
-				if (FileSize == 0) {
-					printf("[Error File Handling] This file contains no textual content!\n");
-					*Success = FALSE;
+			AppendFormat(&Output, "\"severity\":\"%s\",\"code\":\"%s\",\"offset\":%d,\"line\":%d,\"column\":%d,",
+			             Diagnostic->Severity == DS_Error ? "error" : "warning", DiagnosticCodes[Diagnostic->Code].Name,
+			             Diagnostic->Offset, Diagnostic->Line, Diagnostic->Column);
+			if (Diagnostic->IncludedAt != -1) {
+				AppendFormat(&Output, "\"includedAt\":%d,", Diagnostic->IncludedAt);
+			}
+			if (Macro) {
+				AppendString(&Output, "\"macro\":{\"name\":", 16);
+				AppendJsonString(&Output, Macro->Name, Macro->NameLength);
+				if (MacroFileName) {
+					AppendString(&Output, ",\"file\":", 8);
+					AppendJsonString(&Output, MacroFileName, strlen(MacroFileName));
 				}
+				AppendFormat(&Output, ",\"line\":%d,\"column\":%d},", Diagnostic->MacroLine, Diagnostic->MacroColumn);
+			}
+			AppendString(&Output, "\"message\":", 10);
+			AppendJsonString(&Output, Message, Diagnostic->MessageLength);
+			AppendString(&Output, "}\n", 2);
+		}
+		else {
+			if (IncludedFileName) {
+				AppendFormat(&Output, "[%s %s L:%d C:%d] %.*s\n", Diagnostic->Severity == DS_Error ? "Error" : "Warning", IncludedFileName,
+				             Diagnostic->Line, Diagnostic->Column, Diagnostic->MessageLength, Message);
 			}
-			if (*Success) {
-				Result = malloc((FileSize + 1) * sizeof(*Result));
-				fread(Result, sizeof(char), FileSize, FileStream);
-				Result[FileSize] = '\0';
+			else {
+				AppendFormat(&Output, "[%s L:%d C:%d] %.*s\n", Diagnostic->Severity == DS_Error ? "Error" : "Warning",
+				             Diagnostic->Line, Diagnostic->Column, Diagnostic->MessageLength, Message);
+			}
+			if (Macro) {
+				AppendFormat(&Output, "    In macro \"%.*s\" at %s%sL:%d C:%d\n", Macro->NameLength, Macro->Name,
+				             MacroFileName ? MacroFileName : "", MacroFileName ? " " : "", Diagnostic->MacroLine, Diagnostic->MacroColumn);
 			}
 		}
-		fclose(FileStream);
 	}
-	
-	return Result;
+
+	if (Context->DroppedDiagnosticCount) {
+		if (DiagnosticFormat == DF_JsonLines) {
+			AppendString(&Output, "{", 1);
+			if (FileName) {
+				AppendString(&Output, "\"file\":", 7);
+				AppendJsonString(&Output, FileName, strlen(FileName));
+				AppendString(&Output, ",", 1);
+			}
+			AppendFormat(&Output, "\"severity\":\"note\",\"code\":\"diagnostics-dropped\",\"count\":%d}\n", Context->DroppedDiagnosticCount);
+		}
+		else {
+			AppendFormat(&Output, "%d more errors and warnings were found but not shown. Fix the ones above first!\n", Context->DroppedDiagnosticCount);
+		}
+	}
+
+	if (Output.Length) {
+		fwrite(Output.Data, 1, Output.Length, FileStream);
+		fflush(FileStream);
+	}
+	free(Output.Data);
+}
+
+// Each writer gets its own stdio buffer this big, so most outputs go out in a handful of writes.
+#define OUTPUT_BUFFER_SIZE (Kilobyte(64))
+
+typedef struct {
+	int (*Writer)(const assembler_context *Context, FILE *FileStream);
+	const assembler_context *Context;
+	FILE *FileStream;
+	int Success;
+} output_job;
+
+translation_scope void OutputJobThread(void *Data) {
+	output_job *Job = Data;
+	setvbuf(Job->FileStream, 0, _IOFBF, OUTPUT_BUFFER_SIZE);
+	Job->Success = Job->Writer(Job->Context, Job->FileStream);
+}
+
+/* Closes every output that isn't 0 without writing anything to it, for when the program couldn't be assembled. The caller removes the files.
+ */
+translation_scope void DiscardRequestedOutputs(FILE *OutLogisim, FILE *OutRawHex, FILE *OutSymbolTable, FILE *OutListing, FILE *OutSourceMap, FILE *OutCfgDot, FILE *OutCfgJson) {
+	FILE *Outputs[] = {OutLogisim, OutRawHex, OutSymbolTable, OutListing, OutSourceMap, OutCfgDot, OutCfgJson};
+	for (int Index = 0; Index < ArraySize(Outputs); Index++) {
+		if (Outputs[Index]) { fclose(Outputs[Index]); }
+	}
+}
+
+/* Runs the passes AssemblerFlags asks for over the assembled program in Context, then writes every output that isn't 0.
+ * Nothing changes Context once the passes are done, so each output is written on its own thread, and every output is closed whether or not it was written.
+ * Returns FALSE if nothing was asked for or any output failed, in which case the caller should remove all of them.
+ */
+translation_scope int WriteRequestedOutputs(assembler_context *Context, FILE *OutLogisim, FILE *OutRawHex, FILE *OutSymbolTable, FILE *OutListing, FILE *OutSourceMap, FILE *OutCfgDot, FILE *OutCfgJson, int AssemblerFlags) {
+	int Success = TRUE;
+	if (AssemblerFlags & ASSEMBLE_Optimize) {
+		OptimizeProgram(Context);
+	}
+	if (AssemblerFlags & ASSEMBLE_PackData) {
+		PackLiteralPool(Context);
+	}
+
+	if ((OutLogisim == 0) && (OutRawHex == 0) && (OutSymbolTable == 0) && (OutListing == 0) && (OutSourceMap == 0) && (OutCfgDot == 0) && (OutCfgJson == 0)) {
+		Success = FALSE;
+		printf("Warning: No outputs were were requested. No output files are being generated.\n");
+	}
+	if (OutCfgDot || OutCfgJson) {
+		// Analyzed once for every output, and the listing shows the blocks too.
+		Context->Cfg = AnalyzeControlFlow(Context);
+	}
+
+	output_job Jobs[7];
+	int JobCount = 0;
+	// The listing is usually the slowest, so it goes first and gets the calling thread.
+	if (OutListing) { Jobs[JobCount++] = (output_job){OutputListing, Context, OutListing}; }
+	if (OutRawHex) { Jobs[JobCount++] = (output_job){OutputRawHex, Context, OutRawHex}; }
+	if (OutLogisim) { Jobs[JobCount++] = (output_job){OutputLogisimImage, Context, OutLogisim}; }
+	if (OutSymbolTable) { Jobs[JobCount++] = (output_job){OutputSymbolTable, Context, OutSymbolTable}; }
+	if (OutSourceMap) { Jobs[JobCount++] = (output_job){OutputSourceMap, Context, OutSourceMap}; }
+	if (OutCfgDot) { Jobs[JobCount++] = (output_job){OutputControlFlowDot, Context, OutCfgDot}; }
+	if (OutCfgJson) { Jobs[JobCount++] = (output_job){OutputControlFlowJson, Context, OutCfgJson}; }
+
+	// With one processor the threads would only take turns, so everything is written on this one.
+	void *Threads[ArraySize(Jobs)] = {0};
+	const int UseThreads = Platform_GetProcessorCount() > 1;
+	for (int Index = 1; Index < JobCount && UseThreads; Index++) {
+		Threads[Index] = Platform_CreateThread(OutputJobThread, &Jobs[Index]);
+	}
+	for (int Index = 0; Index < JobCount; Index++) {
+		if (Threads[Index]) { Platform_JoinThread(Threads[Index]); }
+		else { OutputJobThread(&Jobs[Index]); }
+		Success = Success && Jobs[Index].Success;
+	}
+
+	FreeControlFlowGraph(Context->Cfg);
+	Context->Cfg = 0;
+	return Success;
 }
 
-int ApplicationMain(FILE *InFile, int InFileSize, FILE *OutLogisim, FILE *OutRawHex, FILE *OutSymbolTable, FILE *OutListing) {
+int ApplicationMain(FILE *InFile, int InFileSize, FILE *OutLogisim, FILE *OutRawHex, FILE *OutSymbolTable, FILE *OutListing, FILE *OutSourceMap, FILE *OutCfgDot, FILE *OutCfgJson, FILE *OutObject, const char *InFileName, int DiagnosticFormat, int AssemblerFlags) {
 	int Success = TRUE;
 	if (InFile == 0) {
 		Success = FALSE;
 		printf("A input file was not provided!\n");
 	}
-
-	// Ensure that Program is actually zero.
-	// This will be needed if this program is used as a DLL!
-	memset(Program, 0, sizeof(Program));
-	memset(ProgramMetaData, 0, sizeof(ProgramMetaData));
+	if (OutObject && (OutLogisim || OutRawHex || OutSymbolTable || OutListing || OutSourceMap || OutCfgDot || OutCfgJson)) {
+		Success = FALSE;
+		printf("An object can't be written along with other outputs, since nothing in it has an address yet. Link the object to get them.\n");
+	}
 
 	if (Success) {
-		file_state FileState = {
-			.Line = 1,
-			.Column = 0,
-		};
+		assembler_context *Context = CreateAssemblerContext();
+		Context->Relocatable = (OutObject != 0);
+		Context->SourcePath = InFileName;
 		char *StartOfFile = LoadFileIntoMemory(InFile, InFileSize, &Success);
-		FileState.At = StartOfFile;
 
-		paged_list *IdentifierDestinationList = AllocatePagedList(sizeof(identifier_dest), 10);
-		paged_list *IdentifierSourceList = AllocatePagedList(sizeof(identifier_source), 10);
-		
-		Success = Assemble(&FileState, IdentifierDestinationList, IdentifierSourceList);
-		
 		if (Success) {
-			if ((OutLogisim == 0) && (OutRawHex == 0) && (OutSymbolTable == 0) && (OutListing == 0)) {
-				Success = FALSE;
-				printf("Warning: No outputs were were requested. No output files are being generated.\n");
-			}
+			Success = AssembleSource(Context, StartOfFile);
+			OutputDiagnostics(Context, InFileName, DiagnosticFormat, stdout);
+		}
+		else if (StartOfFile) { free(StartOfFile); }
 
-			if ((OutRawHex != 0) && (Success)) {
-				Success = OutputRawHex(OutRawHex);
-			}
-			if ((OutLogisim != 0) && (Success)) {
-				Success = OutputLogisimImage(OutLogisim);
-			}
-			if ((OutSymbolTable != 0) && (Success)) {
-				Success = OutputSymbolTable(OutSymbolTable, IdentifierDestinationList, IdentifierSourceList);
-			}
-			if ((OutListing != 0) && (Success)) {
-				Success = OutputListing(OutListing, IdentifierDestinationList, IdentifierSourceList);
+		if (Success && OutObject) {
+			Success = OutputObject(Context, OutObject);
+		}
+		else if (Success) {
+			Success = WriteRequestedOutputs(Context, OutLogisim, OutRawHex, OutSymbolTable, OutListing, OutSourceMap, OutCfgDot, OutCfgJson, AssemblerFlags);
+		}
+		else {
+			DiscardRequestedOutputs(OutLogisim, OutRawHex, OutSymbolTable, OutListing, OutSourceMap, OutCfgDot, OutCfgJson);
+			if (OutObject) { fclose(OutObject); }
+		}
+
+		FreeAssemblerContext(Context);
+	}
+	else {
+		DiscardRequestedOutputs(OutLogisim, OutRawHex, OutSymbolTable, OutListing, OutSourceMap, OutCfgDot, OutCfgJson);
+		if (OutObject) { fclose(OutObject); }
+	}
+
+	return Success;
+}
+
+typedef struct {
+	const uint8_t *At, *End;
+	int Ok; // Cleared once anything is read past End
+} object_reader;
+
+translation_scope uint32_t ReadObjectNumber(object_reader *Reader, int Size) {
+	uint32_t Value = 0;
+	if (Reader->End - Reader->At < Size) {
+		Reader->Ok = FALSE;
+		return 0;
+	}
+	for (int Index = 0; Index < Size; Index++) {
+		Value |= (uint32_t)Reader->At[Index] << (8 * Index);
+	}
+	Reader->At += Size;
+	return Value;
+}
+
+translation_scope const uint8_t *ReadObjectBytes(object_reader *Reader, int Size) {
+	const uint8_t *Result = Reader->At;
+	if (Reader->End - Reader->At < Size) {
+		Reader->Ok = FALSE;
+		return Reader->End;
+	}
+	Reader->At += Size;
+	return Result;
+}
+
+typedef struct {
+	int Chunk, Offset;
+	int Line, Column;
+	char *Name;
+	int NameLength;
+} object_reference;
+
+translation_scope void ReadObjectReferences(object_reader *Reader, object_reference **References, int *Count) {
+	*Count = ReadObjectNumber(Reader, 2);
+	*References = malloc(sizeof(**References) * Max(1, *Count));
+	for (int Index = 0; Index < *Count && Reader->Ok; Index++) {
+		object_reference *Reference = &(*References)[Index];
+		Reference->Chunk = ReadObjectNumber(Reader, 2);
+		Reference->Offset = ReadObjectNumber(Reader, 2);
+		Reference->Line = ReadObjectNumber(Reader, 4);
+		Reference->Column = ReadObjectNumber(Reader, 4);
+		Reference->NameLength = ReadObjectNumber(Reader, 2);
+		Reference->Name = (char*)ReadObjectBytes(Reader, Reference->NameLength);
+	}
+}
+
+/* Adds one object to the program being linked in Context. Words it placed with .SetAddr go straight into Program, everything else becomes a section for PlaceSections().
+ * Returns FALSE if the object is damaged or clashes with the objects added before it.
+ */
+translation_scope int LinkObject(assembler_context *Context, const uint8_t *Data, int Size, const char *ObjectName) {
+	symbol_index *Symbols = &Context->Symbols;
+	object_reader Reader = {.At = Data, .End = Data + Size, .Ok = TRUE};
+	int DidErrorOccur = FALSE;
+	Reader.Ok = memcmp(ReadObjectBytes(&Reader, 8), OBJECT_MAGIC, 8) == 0 && Reader.Ok;
+	Reader.Ok = ReadObjectNumber(&Reader, 2) == OBJECT_VERSION && Reader.Ok;
+
+	// Where each chunk starts, in Program or in the section staging area, and how long it is.
+	const int ChunkCount = Reader.Ok ? ReadObjectNumber(&Reader, 2) : 0;
+	int *ChunkStart = malloc(sizeof(*ChunkStart) * Max(1, ChunkCount));
+	int *ChunkLength = malloc(sizeof(*ChunkLength) * Max(1, ChunkCount));
+	int *ChunkSection = malloc(sizeof(*ChunkSection) * Max(1, ChunkCount));
+	for (int Chunk = 0; Chunk < ChunkCount && Reader.Ok; Chunk++) {
+		const int Address = ReadObjectNumber(&Reader, 2);
+		const int Length = ReadObjectNumber(&Reader, 2);
+		const uint8_t *Words = ReadObjectBytes(&Reader, Length * 2);
+		const uint8_t *MetaData = ReadObjectBytes(&Reader, Length);
+		ChunkLength[Chunk] = Length;
+		ChunkSection[Chunk] = -1;
+		if (!Reader.Ok) { break; }
+
+		uint16_t *Program = Context->Program;
+		uint8_t *ProgramMetaData = Context->ProgramMetaData;
+		if (Address == OBJECT_Relocatable) {
+			const file_state Statement = {0};
+			ChunkSection[Chunk] = Context->SectionCount;
+			ChunkStart[Chunk] = OpenSection(Context, &Statement);
+			Context->Sections[ChunkSection[Chunk]].Length = Length;
+			Context->OpenSection = -1;
+			Program = Context->SectionProgram;
+			ProgramMetaData = Context->SectionMetaData;
+		}
+		else {
+			ChunkStart[Chunk] = Address;
+		}
+		if (ChunkStart[Chunk] + Length > Kilobyte(4)) {
+			printf("[Error Link] \"%s\" doesn't fit in memory along with the objects before it!\n", ObjectName);
+			DidErrorOccur = TRUE;
+			break;
+		}
+
+		for (int Index = 0; Index < Length; Index++) {
+			const int To = ChunkStart[Chunk] + Index;
+			ReportErrorConditionally(Context, ProgramMetaData[To] & PMD_IsOccupied, &DidErrorOccur, DC_Overlap, 0, 0, 0, "\"%s\" puts a word at 0x%03X, where another object already put one! Pay mind to your usage of .SetAddr", ObjectName, To);
+			Program[To] = Words[Index * 2] | (Words[Index * 2 + 1] << 8);
+			ProgramMetaData[To] = MetaData[Index];
+		}
+	}
+
+	object_reference *Sources = 0, *Dests = 0;
+	int SourceCount = 0, DestCount = 0;
+	if (Reader.Ok && !DidErrorOccur) {
+		ReadObjectReferences(&Reader, &Sources, &SourceCount);
+		ReadObjectReferences(&Reader, &Dests, &DestCount);
+		for (int Index = 0; Index < SourceCount && Reader.Ok; Index++) {
+			Reader.Ok = Sources[Index].Chunk < ChunkCount && Sources[Index].Offset < ChunkLength[Sources[Index].Chunk];
+		}
+		for (int Index = 0; Index < DestCount && Reader.Ok; Index++) {
+			Reader.Ok = Dests[Index].Chunk < ChunkCount && Dests[Index].Offset < ChunkLength[Dests[Index].Chunk];
+		}
+	}
+
+	// Identifiers are added one chunk at a time, since PlaceSections() expects the ones in a section to be next to each other.
+	for (int Chunk = 0; Chunk < ChunkCount && Reader.Ok && !DidErrorOccur; Chunk++) {
+		program_section *Section = (ChunkSection[Chunk] == -1) ? 0 : &Context->Sections[ChunkSection[Chunk]];
+		if (Section) {
+			Section->FirstSource = Symbols->SourceCount;
+			Section->FirstDest = Symbols->DestCount;
+		}
+		for (int Index = 0; Index < SourceCount; Index++) {
+			const object_reference *Reference = &Sources[Index];
+			if (Reference->Chunk != Chunk) { continue; }
+			if (FindSymbol(Symbols, Reference->Name, Reference->NameLength) != -1) {
+				ReportErrorConditionally(Context, TRUE, &DidErrorOccur, DC_Redefined, 0, Reference->Line, Reference->Column, "Identifier \"%.*s\" in \"%s\" was already defined by another object!", Reference->NameLength, Reference->Name, ObjectName);
+				continue;
 			}
-			
+			AddSymbolSource(Symbols, Reference->Name, Reference->NameLength, ChunkStart[Chunk] + Reference->Offset, Reference->Line, Reference->Column);
+		}
+		for (int Index = 0; Index < DestCount; Index++) {
+			const object_reference *Reference = &Dests[Index];
+			if (Reference->Chunk != Chunk) { continue; }
+			AddSymbolDest(Symbols, Reference->Name, Reference->NameLength, ChunkStart[Chunk] + Reference->Offset, Reference->Line, Reference->Column);
+		}
+		if (Section) {
+			Section->SourceCount = Symbols->SourceCount - Section->FirstSource;
+			Section->DestCount = Symbols->DestCount - Section->FirstDest;
+		}
+	}
+
+	if (!Reader.Ok) {
+		printf("[Error Link] \"%s\" is not an object written by --object, or it is damaged!\n", ObjectName);
+		DidErrorOccur = TRUE;
+	}
+	free(ChunkStart);
+	free(ChunkLength);
+	free(ChunkSection);
+	free(Sources);
+	free(Dests);
+	return !DidErrorOccur;
+}
+
+int LinkMain(FILE **Objects, const char **ObjectNames, int ObjectCount, FILE *OutLogisim, FILE *OutRawHex, FILE *OutSymbolTable, FILE *OutListing, FILE *OutSourceMap, FILE *OutCfgDot, FILE *OutCfgJson, int DiagnosticFormat, int AssemblerFlags) {
+	int Success = TRUE;
+	// Every object is read into one buffer, which the context owns as its source so identifier names can point into it.
+	int *ObjectStart = malloc(sizeof(*ObjectStart) * (ObjectCount + 1));
+	string_builder Buffer = {0};
+	for (int Index = 0; Index < ObjectCount; Index++) {
+		ObjectStart[Index] = Buffer.Length;
+		char Chunk[4096];
+		size_t ReadCount;
+		while ((ReadCount = fread(Chunk, 1, sizeof(Chunk), Objects[Index])) > 0) {
+			AppendString(&Buffer, Chunk, ReadCount);
+		}
+		if (ferror(Objects[Index])) {
+			printf("[Error Link] I could not read the object \"%s\"!\n", ObjectNames[Index]);
+			Success = FALSE;
 		}
+		fclose(Objects[Index]);
+	}
+	ObjectStart[ObjectCount] = Buffer.Length;
 
-		if (StartOfFile) { free(StartOfFile); }
-		if (IdentifierDestinationList) { FreePagedList(IdentifierDestinationList); }
-		if (IdentifierSourceList) { FreePagedList(IdentifierSourceList); }
+	assembler_context *Context = CreateAssemblerContext();
+	ResetAssembly(Context, Buffer.Data);
+	for (int Index = 0; Index < ObjectCount && Success; Index++) {
+		Success = LinkObject(Context, (const uint8_t*)Buffer.Data + ObjectStart[Index], ObjectStart[Index + 1] - ObjectStart[Index], ObjectNames[Index]);
 	}
-	
+	if (Success) {
+		Success = PlaceSections(Context);
+		Success = ResolveIdentifiers(Context) && Success;
+	}
+	UpdateProgramBits(Context);
+	OutputDiagnostics(Context, 0, DiagnosticFormat, stdout);
 
+	if (Success) {
+		Success = WriteRequestedOutputs(Context, OutLogisim, OutRawHex, OutSymbolTable, OutListing, OutSourceMap, OutCfgDot, OutCfgJson, AssemblerFlags);
+	}
+	else {
+		DiscardRequestedOutputs(OutLogisim, OutRawHex, OutSymbolTable, OutListing, OutSourceMap, OutCfgDot, OutCfgJson);
+	}
+	FreeAssemblerContext(Context);
+	free(ObjectStart);
 	return Success;
 }
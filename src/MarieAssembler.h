@@ -107,6 +107,26 @@ global_var const keyword_entry Keywords[] = {
 		.Length = 4,
 		.Opcode = NO_OPCODE,
 	},
+	{
+		.String = ".Section",
+		.Length = 8,
+		.Opcode = NO_OPCODE,
+	},
+	{
+		.String = ".Include",
+		.Length = 8,
+		.Opcode = NO_OPCODE,
+	},
+	{
+		.String = ".Macro",
+		.Length = 6,
+		.Opcode = NO_OPCODE,
+	},
+	{
+		.String = ".EndMacro",
+		.Length = 9,
+		.Opcode = NO_OPCODE,
+	},
 };
 
 // keyword_index should be able to index correctly into Keywords table.
@@ -129,6 +149,10 @@ enum keyword_index {
 	KW_M_SetAddr,
 	KW_M_Ident,
 	KW_Data,
+	KW_M_Section,
+	KW_M_Include,
+	KW_M_Macro,
+	KW_M_EndMacro,
 	// Keep this at the end, used for iterating though all keywords.
 	KW_COUNT,
 };
@@ -151,28 +175,305 @@ typedef struct {
 	char *At;
 } file_state;
 
-typedef struct {
-	char *Start;
-	int CharCount;
-	int ByteCount;
-	int Address;
-	int Line;
-	int Column;
-} identifier_dest;
+typedef enum {
+	ARG_None, // The statement takes no argument, or one couldn't be read
+	ARG_Number, // Statement.Value, including the named skipcond operations
+	ARG_Identifier,
+	ARG_Path, // The quoted path of a .Include, starting just after the opening quote
+} argument_kind;
 
+/* One statement as ParseStatement() read it from the source. Reading a statement only depends on its own text, so the statements of an included file are read once and kept in the include cache.
+ * Everything that depends on the statements before it, including reporting what is wrong with it, is left to AssembleStatement().
+ */
 typedef struct {
-	char *Start;
-	int CharCount;
-	int ByteCount;
+	int Keyword; // keyword_index, or KW_COUNT if the statement didn't start with a known keyword, which may be a macro call
+	int KeywordLength; // 0 if it didn't start with a keyword at all
+	file_state Start;
+	file_state Argument; // Where the argument starts, after the whitespace following the keyword. A macro call's arguments run from here to End.
+	file_state End; // Just past the argument, or past whatever was read while looking for one
+	argument_kind ArgumentKind;
 	int Value;
+	int CharCount, ByteCount; // Of an identifier or path argument
+} statement;
+
+/* A file pulled in with .Include, as kept in a context's include cache. Statements and the identifiers of every assembly that included the file point into Text,
+ * so an entry replaced by a newer version of the file lives until the last assembly holding it is reset.
+ */
+typedef struct include_file {
+	char *Path;
+	char *Text;
+	int TextLength;
+	uint64_t ModifiedTime, FileId; // From Platform_GetFileInfo()
+	uint64_t Hash; // Of Text
+	statement *Statements;
+	int StatementCount;
+	int References; // One for the cache, and one for each assembly it is included in
+} include_file;
+
+typedef struct {
+	include_file *File;
+	// The outermost .Include in the assembled source that brought this file in. Diagnostics and the source map point here for anything in the file.
+	file_state IncludedAt;
+} source_include;
+
+// Most arguments a macro can take.
+#define MACRO_MAX_PARAMETERS (16)
+
+// One argument of a macro call, or one parameter name of a .Macro.
+typedef struct {
+	argument_kind Kind; // ARG_Number or ARG_Identifier
+	int Value; // For a macro's label, where its name starts among the names of every label an expansion makes
+	char *Start; // The identifier's name
+	int CharCount, ByteCount;
+	int Line, Column;
+	// Inside a macro's body, the identifier may name one of the macro's parameters or labels, which each expansion replaces. -1 if it doesn't.
+	int Parameter, Label;
+} macro_argument;
+
+/* A statement in the body of a .Macro. The body is read once, when the macro is defined, and every expansion assembles these statements directly with the arguments of the call substituted in.
+ */
+typedef struct {
+	statement Statement;
+	int Parameter, Label; // What the statement's identifier argument names, see macro_argument
+	int FirstArgument, ArgumentCount; // A call to another macro keeps its arguments in assembler_context.MacroArguments
+} macro_statement;
+
+typedef struct {
+	char *Name;
+	int NameLength;
+	int File; // Index into assembler_context.Includes of the file it is defined in, or -1 for the assembled source
+	file_state DefinedAt;
+	int FirstParameter, ParameterCount; // In assembler_context.MacroArguments
+	int FirstStatement, StatementCount; // In assembler_context.MacroStatements
+	// Names defined with .Ident in the body. Each expansion gives them a name of their own, see ExpandMacro().
+	int FirstLabel, LabelCount; // In assembler_context.MacroArguments
+	int LabelBytes;
+	int Expanding; // Set while the macro is being expanded, so it can't call itself
+} macro_definition;
+
+/* The names an expansion of a macro gave to the identifiers in its body. Labels get the expansion's number appended, Loop becomes Loop@3, so every expansion's labels are its own.
+ * Names from a macro have no place of their own in the source, so diagnostics, the LSP and the source map put them at the call that expanded it.
+ */
+typedef struct {
+	const char *Text;
+	int Length;
+	const char *CalledAt; // The outermost macro call, in the assembled source or an included file
+} macro_text;
+
+// Where the statement that wrote one word of the program starts in the source.
+typedef struct {
+	int Line; // 0 if nothing was written to the word
+	int Column; // Counted the same way as diagnostic.Column
+	int Offset; // Bytes from the start of the source
+} source_location;
+
+/* The statements following a .Section, up to the next .Section or .SetAddr. They are assembled into assembler_context.SectionProgram at addresses relative to each other,
+ * then PlaceSections() moves each one into a free gap of Program once everything placed with .SetAddr is known.
+ */
+typedef struct {
+	int Start, Length; // The section's words in SectionProgram
+	int Base; // Where it was placed in Program, -1 until it has been
+	int FirstSource, SourceCount; // The identifiers it defines, in Symbols.Sources
+	int FirstDest, DestCount; // The identifiers it uses, in Symbols.Dests
+	const char *At; // Where the .Section is, for diagnostics
+	int Line, Column;
+} program_section;
+
+// Index of each PMD_* flag's bitset in assembler_context.ProgramBits.
+enum program_metadata_bit {
+	PMDB_IsOccupied = 0,
+	PMDB_UsedIdentifier,
+	PMDB_DefinedIdentifier,
+	PMDB_IsData,
+	// Keep this at the end, used for iterating though all flags.
+	PMDB_COUNT,
+};
+
+#define PMD_IsOccupied (1 << PMDB_IsOccupied)
+#define PMD_UsedIdentifier (1 << PMDB_UsedIdentifier)
+#define PMD_DefinedIdentifier (1 << PMDB_DefinedIdentifier)
+#define PMD_IsData (1 << PMDB_IsData)
+
+/* One bit per word of Program, set where the word has one PMD_* flag. Bit N is in Words[N / 64], counting up from the least significant bit.
+ * See Bits_MarieAssembler.c for the scans over it.
+ */
+typedef struct {
+	uint64_t Words[Kilobyte(4) / 64];
+} program_bits;
+
+// Longest identifier name, in bytes, that fits in identifier_table.ByteCounts.
+#define IDENTIFIER_MAX_BYTES (0xFFFF)
+
+/* Every identifier defined with .Ident, or every use of one, with one array per field so a pass only pulls the fields it reads through the cache. Entry N of each array is the same identifier.
+ * Names stay pointers rather than offsets, since they point into whichever text they came from: the source, an included file, a macro's text or an object being linked.
+ * An identifier takes 18 bytes across the arrays. How many characters its name is, for lining up columns, is counted from the name when it is needed.
+ */
+typedef struct {
+	const char **Names;
+	uint16_t *ByteCounts;
+	// Where a definition names, or where a use is. Every address fits, and -1 marks a use the optimizer dropped.
+	int16_t *Addresses;
+	uint32_t *Lines;
+	uint16_t *Columns; // Columns past 0xFFFF are stored as 0xFFFF
+} identifier_table;
+
+/* Indexed view over the identifiers, so that resolution, the outputs and editor queries never have to scan for them.
+ * Built while assembling, and valid for as long as the assembly it was built from.
+ */
+typedef struct {
+	// Every identifier, in the order they appear in the source.
+	identifier_table Sources;
+	identifier_table Dests;
+	int SourceCount, SourceCapacity;
+	int DestCount, DestCapacity;
+	// Open addressing hash table from an identifier's name to its index in Sources + 1. 0 marks an empty slot. SlotCount is a power of 2.
+	int *Slots;
+	int SlotCount;
+	// Each Source's references, as a chain through NextReference in source order. -1 terminates a chain.
+	int *FirstReference;
+	int *NextReference;
+	// Index of the Source each Dest resolved to, or -1.
+	int *DestToSource;
+	// Index of the first identifier defined at / used by each address, or -1.
+	int AddressToSource[Kilobyte(4)];
+	int AddressToDest[Kilobyte(4)];
+} symbol_index;
+
+typedef enum {
+	DS_Error,
+	DS_Warning,
+} diagnostic_severity;
+
+typedef enum {
+	DC_ReservedMnemonic,
+	DC_ReservedName,
+	DC_Overlap,
+	DC_AddressOverflow,
+	DC_MissingKeyword,
+	DC_UnknownKeyword,
+	DC_AddressOutOfRange,
+	DC_MissingArgument,
+	DC_JnsToLastAddress,
+	DC_UnknownSkipcond,
+	DC_IdentNotAfterOperation,
+	DC_MissingIdentifierName,
+	DC_Redefined,
+	DC_DataOutOfRange,
+	DC_Undefined,
+	DC_SectionDoesNotFit,
+	DC_IncludeNotFound,
+	DC_BadMacro,
+	DC_MacroArguments,
+	DC_IdentifierTooLong,
+	DC_COUNT
+} diagnostic_code;
+
+typedef struct {
+	char *Name; // Stable name for tools to match on, this never changes between versions.
+	diagnostic_severity Severity;
+} diagnostic_code_entry;
+
+global_var const diagnostic_code_entry DiagnosticCodes[DC_COUNT] = {
+	[DC_ReservedMnemonic] = {"reserved-mnemonic", DS_Error},
+	[DC_ReservedName] = {"reserved-name", DS_Error},
+	[DC_Overlap] = {"overlap", DS_Error},
+	[DC_AddressOverflow] = {"address-overflow", DS_Error},
+	[DC_MissingKeyword] = {"missing-keyword", DS_Error},
+	[DC_UnknownKeyword] = {"unknown-keyword", DS_Error},
+	[DC_AddressOutOfRange] = {"address-out-of-range", DS_Error},
+	[DC_MissingArgument] = {"missing-argument", DS_Error},
+	[DC_JnsToLastAddress] = {"jns-to-last-address", DS_Warning},
+	[DC_UnknownSkipcond] = {"unknown-skipcond", DS_Warning},
+	[DC_IdentNotAfterOperation] = {"ident-not-after-operation", DS_Error},
+	[DC_MissingIdentifierName] = {"missing-identifier-name", DS_Error},
+	[DC_Redefined] = {"redefined", DS_Error},
+	[DC_DataOutOfRange] = {"data-out-of-range", DS_Error},
+	[DC_Undefined] = {"undefined", DS_Error},
+	[DC_SectionDoesNotFit] = {"section-does-not-fit", DS_Error},
+	[DC_IncludeNotFound] = {"include-not-found", DS_Error},
+	[DC_BadMacro] = {"bad-macro", DS_Error},
+	[DC_MacroArguments] = {"macro-arguments", DS_Error},
+	[DC_IdentifierTooLong] = {"identifier-too-long", DS_Error},
+};
+
+typedef struct {
+	diagnostic_code Code;
+	diagnostic_severity Severity;
+	int Offset; // Byte offset into the file Line and Column are in, or -1 if the diagnostic isn't tied to the source
+	int File; // Index into assembler_context.Includes of the file Line and Column are in, or -1 for the assembled source
+	int IncludedAt; // For a diagnostic in an included file, byte offset into the assembled source of the outermost .Include that brought it in. -1 otherwise.
 	int Line;
 	int Column;
-} identifier_source;
+	// For a problem in the body of a macro, Line and Column are at the macro call in the source and these are where in the macro's definition it is. Macro is -1 otherwise.
+	int Macro; // Index into assembler_context.Macros
+	int MacroLine, MacroColumn;
+	int MessageStart; // Into assembler_context.DiagnosticText
+	int MessageLength;
+} diagnostic;
 
-#define PMD_IsOccupied (0x1)
-#define PMD_UsedIdentifier (0x2)
-#define PMD_DefinedIdentifier (0x4)
-#define PMD_IsData (0x8)
+// Past this many diagnostics we only count them. A file this broken has more pressing problems than the 201st error.
+#define DIAGNOSTIC_CAP (200)
+
+/* Everything the assembler produces for one source file.
+ * A context can be reused for many assemblies; AssembleSource() resets it before assembling.
+ */
+typedef struct assembler_context {
+	// Contains the assembled Marie program
+	uint16_t Program[Kilobyte(4)];
+	// Contains metadata regarding each Word of the program
+	uint8_t ProgramMetaData[Kilobyte(4)];
+	// The same flags as ProgramMetaData, one bitset per flag. Rebuilt by UpdateProgramBits() whenever a pass is done changing ProgramMetaData, so it is valid once assembly, linking, optimizing or packing finishes.
+	program_bits ProgramBits[PMDB_COUNT];
+	// Where each Word of the program came from. See OutputSourceMap() for the file form of this.
+	source_location SourceMap[Kilobyte(4)];
+	// Words of every .Section, one section after another, until PlaceSections() moves them into Program.
+	uint16_t SectionProgram[Kilobyte(4)];
+	uint8_t SectionMetaData[Kilobyte(4)];
+	source_location SectionSourceMap[Kilobyte(4)];
+	program_section *Sections;
+	int SectionCount, SectionCapacity;
+	int Relocatable; // Set before AssembleSource() to assemble an object for the linker, see OutputObject()
+	int OpenSection; // Index into Sections of the .Section statements are being assembled into, or -1 while they go straight into Program
+	// The text that was assembled. Identifiers point into this buffer, so it lives as long as the context does.
+	char *Source;
+	int OwnsSource; // FALSE if Source was assembled with AssembleSourceInPlace(), and belongs to the caller.
+	// Where Source was read from, set before AssembleSource(). .Include paths are relative to it, or to the working directory if it is 0.
+	const char *SourcePath;
+	// Every file pulled in with .Include, each only once. Identifiers from them point into the include cache, which is held on to until the next assembly.
+	source_include *Includes;
+	int IncludeCount, IncludeCapacity;
+	// Every file any assembly in this context has included, kept across ResetAssembly() so that reassembling only reads and parses a library again when it changes.
+	include_file **IncludeCache;
+	int IncludeCacheCount, IncludeCacheCapacity;
+	// Every .Macro defined so far, and the pieces they are made of.
+	macro_definition *Macros;
+	int MacroCount, MacroCapacity;
+	macro_statement *MacroStatements;
+	int MacroStatementCount, MacroStatementCapacity;
+	macro_argument *MacroArguments;
+	int MacroArgumentCount, MacroArgumentCapacity;
+	// One for each expansion of a macro, so the names it made can be traced back to where it was called. The text is in MacroTextBlocks.
+	macro_text *MacroTexts;
+	int MacroTextCount, MacroTextCapacity;
+	char **MacroTextBlocks;
+	int MacroTextBlockCount, MacroTextBlockCapacity, MacroTextBlockUsed, MacroTextBlockSize;
+	int MacroExpansionCount;
+	// While a macro is being expanded, the outermost call in the source and the macro the statement being assembled is from. Diagnostics go at the call, see diagnostic.Macro.
+	const file_state *ExpandedAt;
+	int ExpandingMacro;
+	symbol_index Symbols;
+	// Errors and warnings from the last assembly, in the order they were found. Nothing is printed while assembling, see OutputDiagnostics().
+	diagnostic Diagnostics[DIAGNOSTIC_CAP];
+	int DiagnosticCount;
+	int DroppedDiagnosticCount;
+	int ErrorCount;
+	int WarningCount;
+	struct string_builder *DiagnosticText;
+	// Counts from a profiled run of Program. While set, OutputListing() adds them as columns and ends with the hottest blocks.
+	const struct machine_profile *Profile;
+	// Control flow of Program, from AnalyzeControlFlow(). While set, OutputListing() marks where each basic block starts and which instructions can never run.
+	struct control_flow_graph *Cfg;
+} assembler_context;
 
 #define ArraySize(Array) (sizeof(Array)/sizeof(*Array))
 
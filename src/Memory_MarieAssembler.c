@@ -6,6 +6,8 @@
 #include "Memory_MarieAssembler.h"
 #include <malloc.h>
 #include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
 
 translation_scope inline paged_list* AllocatePagedList(uint32_t SizeOfElement, uint32_t Length) {
 	paged_list *Result = 0;
@@ -20,7 +22,8 @@ translation_scope inline paged_list* AllocatePagedList(uint32_t SizeOfElement, u
 	return Result;
 }
 
-translation_scope inline void AddToPagedList(paged_list *List, void *Data) {
+// Returns the list's copy of Data. Pages never move, so the pointer stays valid until the list is cleared or freed.
+translation_scope inline void* AddToPagedList(paged_list *List, void *Data) {
 	while (List->NextFreeIndex == List->Length) {
 		if (List->NextPage) {
 			List = List->NextPage;
@@ -34,6 +37,7 @@ translation_scope inline void AddToPagedList(paged_list *List, void *Data) {
 	void *Slot = (void*) ((uint8_t*)List->Memory + List->SizeOfElement * List->NextFreeIndex);
 	memcpy(Slot, Data, List->SizeOfElement);
 	List->NextFreeIndex++;
+	return Slot;
 }
 
 translation_scope inline void* GetFromPagedList(paged_list *List, uint32_t Index) {
@@ -53,23 +57,67 @@ translation_scope inline void* GetFromPagedList(paged_list *List, uint32_t Index
 	return 0;
 }
 
+// Empties the list while keeping every page around, so refilling it does not allocate.
+translation_scope inline void ClearPagedList(paged_list *List) {
+	for (; List; List = List->NextPage) {
+		List->NextFreeIndex = 0;
+	}
+}
+
 translation_scope inline void FreePagedList(paged_list *List) {
-	paged_list *Last = 0;
-	paged_list *Temp = List;
-	
 	while (List) {
-		if (Temp->NextPage) {
-			Last = Temp;
-			Temp = Temp->NextPage;
-		}
-		else {
-			free(Temp->Memory);
-			free(Temp);
+		paged_list *NextPage = List->NextPage;
+		free(List->Memory);
+		free(List);
+		List = NextPage;
+	}
+}
+
+translation_scope inline void ReserveString(string_builder *String, int Extra) {
+	if (String->Length + Extra + 1 > String->Capacity) {
+		String->Capacity = Max(String->Capacity * 2, String->Length + Extra + 1);
+		String->Data = realloc(String->Data, String->Capacity);
+	}
+}
 
-			if (Last) { Last->NextPage = 0; }
+translation_scope inline void AppendString(string_builder *String, const char *Text, int Length) {
+	ReserveString(String, Length);
+	memcpy(String->Data + String->Length, Text, Length);
+	String->Length += Length;
+	String->Data[String->Length] = 0;
+}
 
-			if (Temp == List) { List = 0; }
-			else { Temp = List; }
-		}
+translation_scope void AppendFormatVarArgs(string_builder *String, const char *FormatStr, va_list ArgList) {
+	va_list Copy;
+	va_copy(Copy, ArgList);
+	int Length = vsnprintf(0, 0, FormatStr, Copy);
+	va_end(Copy);
+	if (Length > 0) {
+		ReserveString(String, Length);
+		vsnprintf(String->Data + String->Length, Length + 1, FormatStr, ArgList);
+		String->Length += Length;
+	}
+}
+
+translation_scope void AppendFormat(string_builder *String, const char *FormatStr, ...) {
+	va_list ArgList;
+	va_start(ArgList, FormatStr);
+	AppendFormatVarArgs(String, FormatStr, ArgList);
+	va_end(ArgList);
+}
+
+// Appends Text as a quoted JSON string, escaping what JSON requires.
+translation_scope void AppendJsonString(string_builder *String, const char *Text, int Length) {
+	AppendString(String, "\"", 1);
+	for (int Index = 0; Index < Length; Index++) {
+		const uint8_t Char = Text[Index];
+		if (Char == '"') { AppendString(String, "\\\"", 2); }
+		else if (Char == '\\') { AppendString(String, "\\\\", 2); }
+		else if (Char == '\n') { AppendString(String, "\\n", 2); }
+		else if (Char == '\r') { AppendString(String, "\\r", 2); }
+		else if (Char == '\t') { AppendString(String, "\\t", 2); }
+		else if (Char < 0x20) { AppendFormat(String, "\\u%04x", Char); }
+		else { AppendString(String, (char*)&Char, 1); }
 	}
+	AppendString(String, "\"", 1);
 }
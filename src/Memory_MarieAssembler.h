@@ -7,6 +7,7 @@
 #define MEMORY_MARIEASSEMBLER_H
 
 #include <stdint.h>
+#include <stdarg.h>
 
 typedef struct paged_list paged_list;
 
@@ -19,6 +20,20 @@ struct paged_list {
 };
 
 translation_scope paged_list* AllocatePagedList(uint32_t SizeOfElement, uint32_t Length);
-translation_scope void AddToPagedList(paged_list *List, void *Data);
+translation_scope void* AddToPagedList(paged_list *List, void *Data);
+translation_scope void ClearPagedList(paged_list *List);
 translation_scope void FreePagedList(paged_list *List);
+
+// Growable, null terminated string. A zeroed string_builder is empty and ready to use.
+typedef struct string_builder {
+	char *Data;
+	int Length;
+	int Capacity;
+} string_builder;
+
+translation_scope void ReserveString(string_builder *String, int Extra);
+translation_scope void AppendString(string_builder *String, const char *Text, int Length);
+translation_scope void AppendFormat(string_builder *String, const char *FormatStr, ...);
+translation_scope void AppendFormatVarArgs(string_builder *String, const char *FormatStr, va_list ArgList);
+translation_scope void AppendJsonString(string_builder *String, const char *Text, int Length);
 #endif
@@ -0,0 +1,446 @@
+/* File: Peephole optimizer for assembled programs. Runs between AssembleSource() and the output writers when --optimize is given.
+ * Rewrites are confined to a basic block, and never touch a word that is labelled with .Ident, starts a block, or is read or written as data by reachable code.
+ * A removed word is packed out by sliding the rest of its block up, when the block ends in a jump, jumpi or halt so nothing falls into the freed word at its end.
+ * Otherwise the word is filled with a jump to the next word, which still saves cycles over what it replaced.
+ * Nothing is rewritten if an addi, jumpi, loadi or storei goes through a word the program stores into, since it could then land on or touch any word.
+ * PackLiteralPool() runs when --pack-data is given, merging data words that hold the same constant.
+ */
+
+#include "MarieAssembler.h"
+#include "Platform_MarieAssembler.h"
+#include "Cfg_MarieAssembler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Defined in MarieAssembler.c, after this file is included.
+translation_scope void LinkSymbolReferences(symbol_index *Symbols);
+translation_scope void CopyIdentifier(identifier_table *Table, int To, int From);
+
+// Estimated clock cycles per instruction on the textbook MARIE datapath: the fetch, plus one cycle per register transfer of the execute step.
+#define MARIE_FETCH_CYCLES (3)
+global_var const uint8_t MarieExecuteCycles[16] = {
+	7, // jns
+	3, 3, 3, 3, // load, store, add, subt
+	1, 1, 1, 1, 1, 1, // input, output, halt, skipcond, jump, clear
+	5, // addi
+	3, // jumpi
+	5, 5, // loadi, storei
+	0, // Not an instruction
+};
+
+translation_scope int InstructionCycles(uint16_t Word) {
+	return MARIE_FETCH_CYCLES + MarieExecuteCycles[Word >> 12];
+}
+
+// How many jumps in a row a chain is followed through, so a loop of jumps doesn't loop the optimizer.
+#define OPTIMIZE_MAX_CHAIN (16)
+
+typedef struct {
+	int StoreLoads; // store X, load X became store X
+	int ClearAdds; // clear, add X became load X
+	int JumpChains; // jump L, where L is jump M, became jump M
+	int WordsFreed;
+	int WordsFilled; // Replaced with a jump to the next word, because they couldn't be packed out
+	int CyclesSaved; // Summed over every rewrite, as if each rewritten spot ran once
+} optimize_report;
+
+// Words the optimizer must leave where they are, holding what they hold.
+translation_scope int IsPinnedWord(const assembler_context *Context, const control_flow_graph *Cfg, int Address) {
+	return (Context->ProgramMetaData[Address] & PMD_DefinedIdentifier) || (Cfg->Flags[Address] & (CFG_BlockStart | CFG_Operand));
+}
+
+translation_scope int IsRewritableInstruction(const assembler_context *Context, const control_flow_graph *Cfg, int Address) {
+	return (Cfg->Flags[Address] & CFG_Reachable) && IsAssembledInstruction(Context, Address) && !(Cfg->Flags[Address] & CFG_Operand);
+}
+
+/* Forgets the identifier used by the word at Address, if any. The Dest is only unlinked here, CompactSymbolDests() drops it from the index.
+ */
+translation_scope void DropSymbolDest(assembler_context *Context, int Address) {
+	symbol_index *Symbols = &Context->Symbols;
+	const int DestIndex = Symbols->AddressToDest[Address];
+	if (DestIndex != -1) {
+		Symbols->Dests.Addresses[DestIndex] = -1;
+		Symbols->AddressToDest[Address] = -1;
+	}
+	Context->ProgramMetaData[Address] &= ~PMD_UsedIdentifier;
+}
+
+/* Rebuilds the parts of the symbol index that point at Dests, after words have been dropped or moved.
+ */
+translation_scope void CompactSymbolDests(symbol_index *Symbols) {
+	int Kept = 0;
+	for (int DestIndex = 0; DestIndex < Symbols->DestCount; DestIndex++) {
+		if (Symbols->Dests.Addresses[DestIndex] == -1) { continue; }
+		CopyIdentifier(&Symbols->Dests, Kept, DestIndex);
+		Symbols->DestToSource[Kept] = Symbols->DestToSource[DestIndex];
+		Kept++;
+	}
+	Symbols->DestCount = Kept;
+
+	memset(Symbols->AddressToDest, 0xFF, sizeof(Symbols->AddressToDest));
+	for (int DestIndex = 0; DestIndex < Symbols->DestCount; DestIndex++) {
+		const int Address = Symbols->Dests.Addresses[DestIndex];
+		if (Symbols->AddressToDest[Address] == -1) { Symbols->AddressToDest[Address] = DestIndex; }
+	}
+	LinkSymbolReferences(Symbols);
+}
+
+/* Returns TRUE if the word at Address can be packed out of its block. The block has to end in a halt, jump or jumpi, so nothing falls through into the word freed at its end, and none of the words after Address may be pinned.
+ */
+translation_scope int CanPackWord(const assembler_context *Context, const control_flow_graph *Cfg, int Address) {
+	const cfg_block *Block = &Cfg->Blocks[Cfg->BlockOf[Address]];
+	const int End = Block->Start + Block->Length - 1;
+	const uint16_t LastOpcode = Context->Program[End] >> 12;
+	if (LastOpcode != 0x7 && LastOpcode != 0x9 && LastOpcode != 0xC) { return FALSE; }
+	for (int Index = Address + 1; Index <= End; Index++) {
+		if (IsPinnedWord(Context, Cfg, Index)) { return FALSE; }
+	}
+	return TRUE;
+}
+
+/* Removes the word at Address from its block. Returns TRUE if the block could be packed, or FALSE if the word was filled with a jump to the next word instead.
+ */
+translation_scope int RemoveWord(assembler_context *Context, const control_flow_graph *Cfg, int Address) {
+	symbol_index *Symbols = &Context->Symbols;
+	const cfg_block *Block = &Cfg->Blocks[Cfg->BlockOf[Address]];
+	const int End = Block->Start + Block->Length - 1;
+
+	DropSymbolDest(Context, Address);
+	if (!CanPackWord(Context, Cfg, Address)) {
+		Context->Program[Address] = 0x9000 | ((Address + 1) & 0xFFF);
+		return FALSE;
+	}
+
+	for (int Index = Address + 1; Index <= End; Index++) {
+		Context->Program[Index - 1] = Context->Program[Index];
+		Context->ProgramMetaData[Index - 1] = Context->ProgramMetaData[Index];
+		Context->SourceMap[Index - 1] = Context->SourceMap[Index];
+		const int DestIndex = Symbols->AddressToDest[Index];
+		if (DestIndex != -1) { Symbols->Dests.Addresses[DestIndex] = Index - 1; }
+		Symbols->AddressToDest[Index - 1] = DestIndex;
+	}
+	Context->Program[End] = 0;
+	Context->ProgramMetaData[End] = 0;
+	Context->SourceMap[End] = (source_location){0};
+	Symbols->AddressToDest[End] = -1;
+	return TRUE;
+}
+
+/* Points the jump at Address to Target, naming Target after its .Ident if it has one.
+ */
+translation_scope void RetargetJump(assembler_context *Context, int Address, int Target) {
+	symbol_index *Symbols = &Context->Symbols;
+	Context->Program[Address] = (Context->Program[Address] & 0xF000) | Target;
+	const int DestIndex = Symbols->AddressToDest[Address];
+	const int SourceIndex = Symbols->AddressToSource[Target];
+	if (DestIndex != -1 && SourceIndex != -1) {
+		Symbols->Dests.Names[DestIndex] = Symbols->Sources.Names[SourceIndex];
+		Symbols->Dests.ByteCounts[DestIndex] = Symbols->Sources.ByteCounts[SourceIndex];
+		Symbols->DestToSource[DestIndex] = SourceIndex;
+	}
+	else {
+		DropSymbolDest(Context, Address);
+	}
+}
+
+/* Makes one pass of rewrites over the program. Returns how many were made.
+ */
+translation_scope int OptimizePass(assembler_context *Context, optimize_report *Report) {
+	control_flow_graph *Cfg = AnalyzeControlFlow(Context);
+	uint16_t *Program = Context->Program;
+	int Changes = 0;
+
+	for (int Address = 0; Address < Kilobyte(4) && Changes == 0; Address++) {
+		if (!IsRewritableInstruction(Context, Cfg, Address)) { continue; }
+		const uint16_t Opcode = Program[Address] >> 12;
+		const uint16_t X = Program[Address] & 0xFFF;
+
+		if (Opcode == 0x9) {
+			// Jump chains. Every jump followed has to stay put for the chain to mean the same thing later.
+			int Target = X;
+			for (int Step = 0; Step < OPTIMIZE_MAX_CHAIN; Step++) {
+				if (Target == Address || !IsRewritableInstruction(Context, Cfg, Target) || (Program[Target] >> 12) != 0x9) { break; }
+				Target = Program[Target] & 0xFFF;
+				Report->CyclesSaved += InstructionCycles(0x9000);
+			}
+			if (Target != X) {
+				RetargetJump(Context, Address, Target);
+				Report->JumpChains++;
+				Changes++;
+			}
+			continue;
+		}
+
+		const int Next = Address + 1;
+		if (Next > 0xFFF || Cfg->BlockOf[Next] != Cfg->BlockOf[Address] || IsPinnedWord(Context, Cfg, Next) || !IsRewritableInstruction(Context, Cfg, Next)) { continue; }
+		const uint16_t NextOpcode = Program[Next] >> 12;
+		const uint16_t NextX = Program[Next] & 0xFFF;
+		if (NextX == Address || NextX == Next || X == Next) { continue; } // Code that reads or writes itself here
+
+		if (Opcode == 0x2 && NextOpcode == 0x1 && X == NextX) {
+			// store X, load X: the accumulator already holds X.
+			const uint16_t Removed = Program[Next];
+			if (RemoveWord(Context, Cfg, Next)) {
+				Report->WordsFreed++;
+				Report->CyclesSaved += InstructionCycles(Removed);
+			}
+			else {
+				Report->WordsFilled++;
+				Report->CyclesSaved += InstructionCycles(Removed) - InstructionCycles(0x9000);
+			}
+			Report->StoreLoads++;
+			Changes++;
+		}
+		else if (Opcode == 0xA && NextOpcode == 0x3 && NextX != Address) {
+			// clear, add X: the same as load X. Only worth it if the add can be packed out, filling it with a jump costs as much as it saved.
+			if (!CanPackWord(Context, Cfg, Next)) { continue; }
+
+			// The add's identifier, if any, moves to the new load.
+			symbol_index *Symbols = &Context->Symbols;
+			const int DestIndex = Symbols->AddressToDest[Next];
+			Report->CyclesSaved += InstructionCycles(Program[Address]) + InstructionCycles(Program[Next]) - InstructionCycles(0x1000);
+			Program[Address] = 0x1000 | NextX;
+			if (DestIndex != -1) {
+				Symbols->Dests.Addresses[DestIndex] = Address;
+				Symbols->AddressToDest[Address] = DestIndex;
+				Symbols->AddressToDest[Next] = -1;
+				Context->ProgramMetaData[Address] |= PMD_UsedIdentifier;
+				Context->ProgramMetaData[Next] &= ~PMD_UsedIdentifier;
+			}
+			RemoveWord(Context, Cfg, Next);
+			Report->WordsFreed++;
+			Report->ClearAdds++;
+			Changes++;
+		}
+	}
+
+	FreeControlFlowGraph(Cfg);
+	CompactSymbolDests(&Context->Symbols);
+	return Changes;
+}
+
+/* addi, jumpi, loadi and storei go through an address held in another word. The control flow graph follows them as if that word always holds its assembled value, which is only true if nothing reachable stores into it.
+ * Returns TRUE if a reachable one goes through a word that is stored into, or reads or writes reachable code through it. Then it could land on, read or write any word, and removing or moving words would change what the program does.
+ * A jumpi through a return address that only jns stores into is fine, the graph follows those back to after each jns.
+ */
+translation_scope int HasUnprovenIndirect(const assembler_context *Context, const control_flow_graph *Cfg) {
+	const uint16_t *Program = Context->Program;
+	uint8_t StoredInto[Kilobyte(4)] = {0}; // 1 if only jns stores into it, 2 if anything else does
+	for (int Address = 0; Address < Kilobyte(4); Address++) {
+		if (!IsRewritableInstruction(Context, Cfg, Address)) { continue; }
+		const uint16_t X = Program[Address] & 0xFFF;
+		switch (Program[Address] >> 12) {
+		case 0x0: { StoredInto[X] = Max(StoredInto[X], 1); } break; // jns
+		case 0x2: { StoredInto[X] = 2; } break; // store
+		case 0xE: { StoredInto[Program[X] & 0xFFF] = 2; } break; // storei
+		}
+	}
+
+	for (int Address = 0; Address < Kilobyte(4); Address++) {
+		if (!IsRewritableInstruction(Context, Cfg, Address)) { continue; }
+		const uint16_t Opcode = Program[Address] >> 12;
+		const uint16_t X = Program[Address] & 0xFFF;
+		if (Opcode < 0xB || Opcode > 0xE) { continue; }
+		if (Opcode == 0xC) {
+			if (StoredInto[X] == 2 || (StoredInto[X] == 1 && !(Cfg->Flags[X] & CFG_ReturnSlot))) { return TRUE; }
+		}
+		else if (StoredInto[X] || (Cfg->Flags[Program[X] & 0xFFF] & CFG_Reachable)) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+int OptimizeProgram(assembler_context *Context) {
+	optimize_report Report = {0};
+	control_flow_graph *Cfg = AnalyzeControlFlow(Context);
+	const int Unproven = HasUnprovenIndirect(Context, Cfg);
+	FreeControlFlowGraph(Cfg);
+	if (Unproven) {
+		printf("[Optimize] The program uses addi, jumpi, loadi or storei through a word it stores into or on its own code, so nothing was rewritten.\n");
+		return 0;
+	}
+
+	// One rewrite per pass keeps every rewrite working from an up to date control flow graph. Every rewrite removes a word or a jump from a chain, so this runs out.
+	for (int Pass = 0; Pass < Kilobyte(4) * OPTIMIZE_MAX_CHAIN; Pass++) {
+		if (OptimizePass(Context, &Report) == 0) { break; }
+	}
+	UpdateProgramBits(Context);
+
+	const int Rewrites = Report.StoreLoads + Report.ClearAdds + Report.JumpChains;
+	if (Rewrites == 0) {
+		printf("[Optimize] Nothing to optimize.\n");
+	}
+	else {
+		printf("[Optimize] %d store/load pairs, %d clear/add pairs and %d jump chains rewritten.\n", Report.StoreLoads, Report.ClearAdds, Report.JumpChains);
+		printf("[Optimize] %d instructions removed, %d words freed and %d filled with a jump to the next word. About %d fewer cycles if every rewritten spot runs once.\n",
+		       Report.StoreLoads + Report.ClearAdds - Report.WordsFilled, Report.WordsFreed, Report.WordsFilled, Report.CyclesSaved);
+	}
+	return Rewrites;
+}
+
+// Opcodes whose low 12 bits are an address, and so have to follow the word they point at when it moves.
+translation_scope int HasAddressOperand(uint16_t Word) {
+	switch (Word >> 12) {
+		case 0x5: case 0x6: case 0x7: case 0x8: case 0xA: case 0xF: return FALSE;
+		default: return TRUE;
+	}
+}
+
+translation_scope int HighestUsedAddress(const assembler_context *Context) {
+	return FindLastSetBit(&Context->ProgramBits[PMDB_IsOccupied]);
+}
+
+int PackLiteralPool(assembler_context *Context) {
+	symbol_index *Symbols = &Context->Symbols;
+	uint16_t *Program = Context->Program;
+	uint8_t *MetaData = Context->ProgramMetaData;
+	const int OldHighest = HighestUsedAddress(Context);
+
+	// A data word can be shared if it is only ever read by load, add and subt, since then nothing can tell it apart from another word holding the same value.
+	control_flow_graph *Cfg = AnalyzeControlFlow(Context);
+	uint8_t IsConstant[Kilobyte(4)];
+	int ReadCount[Kilobyte(4)] = {0};
+	for (int Address = 0; Address < Kilobyte(4); Address++) {
+		IsConstant[Address] = (MetaData[Address] & PMD_IsOccupied) && (MetaData[Address] & PMD_IsData) && !(Cfg->Flags[Address] & CFG_Reachable);
+	}
+
+	/* addi, jumpi, loadi and storei go through an address held in another word, which can't be followed here.
+	 * If the program has any of them, a word whose address is held by a word that isn't run might be read or written through it, so it isn't merged.
+	 * Nothing is slid either, since the words holding addresses would still point where the data used to be.
+	 */
+	int HasIndirect = FALSE;
+	for (int Address = 0; Address < Kilobyte(4); Address++) {
+		const uint16_t Opcode = Program[Address] >> 12;
+		if (IsAssembledInstruction(Context, Address) && Opcode >= 0xB && Opcode <= 0xE) { HasIndirect = TRUE; }
+	}
+	if (HasIndirect) {
+		for (int Address = 0; Address < Kilobyte(4); Address++) {
+			if ((MetaData[Address] & PMD_IsOccupied) && !(Cfg->Flags[Address] & CFG_Reachable)) { IsConstant[Program[Address] & 0xFFF] = FALSE; }
+		}
+	}
+	FreeControlFlowGraph(Cfg);
+	for (int Address = 0; Address < Kilobyte(4); Address++) {
+		if (IsAssembledInstruction(Context, Address) && HasAddressOperand(Program[Address])) {
+			const uint16_t Opcode = Program[Address] >> 12;
+			const uint16_t X = Program[Address] & 0xFFF;
+			if (Opcode == 0x1 || Opcode == 0x3 || Opcode == 0x4) { ReadCount[X]++; }
+			else { IsConstant[X] = FALSE; }
+		}
+	}
+
+	// The first constant holding each value becomes its pool entry.
+	int16_t MergedInto[Kilobyte(4)];
+	int16_t *PoolEntry = malloc(sizeof(*PoolEntry) * 0x10000);
+	memset(MergedInto, 0xFF, sizeof(MergedInto));
+	memset(PoolEntry, 0xFF, sizeof(*PoolEntry) * 0x10000);
+	int MergedCount = 0;
+	for (int Address = 0; Address < Kilobyte(4); Address++) {
+		if (!IsConstant[Address] || ReadCount[Address] == 0) { continue; }
+		if (PoolEntry[Program[Address]] == -1) {
+			PoolEntry[Program[Address]] = Address;
+		}
+		else {
+			MergedInto[Address] = PoolEntry[Program[Address]];
+			MergedCount++;
+		}
+	}
+	free(PoolEntry);
+
+	if (MergedCount == 0) {
+		printf("[PackData] No duplicate constants to merge.\n");
+		return 0;
+	}
+
+	// Point every reader at the pool entry. The pool entry keeps its own .Ident, or takes one from a word merged into it.
+	for (int Address = 0; Address < Kilobyte(4); Address++) {
+		const int Entry = MergedInto[Address];
+		if (Entry != -1 && Symbols->AddressToSource[Entry] == -1 && Symbols->AddressToSource[Address] != -1) {
+			Symbols->AddressToSource[Entry] = Symbols->AddressToSource[Address];
+			MetaData[Entry] |= PMD_DefinedIdentifier;
+		}
+	}
+	for (int Address = 0; Address < Kilobyte(4); Address++) {
+		if (IsAssembledInstruction(Context, Address) && HasAddressOperand(Program[Address]) && MergedInto[Program[Address] & 0xFFF] != -1) {
+			Program[Address] = (Program[Address] & 0xF000) | MergedInto[Program[Address] & 0xFFF];
+		}
+	}
+	for (int DestIndex = 0; DestIndex < Symbols->DestCount; DestIndex++) {
+		const int SourceIndex = Symbols->DestToSource[DestIndex];
+		if (SourceIndex == -1) { continue; }
+		const int Value = Symbols->Sources.Addresses[SourceIndex];
+		if (Value < 0 || Value >= Kilobyte(4) || MergedInto[Value] == -1) { continue; }
+		// Renamed after the pool entry, so the listing still assembles to the same program.
+		const int EntrySource = Symbols->AddressToSource[MergedInto[Value]];
+		Symbols->Dests.Names[DestIndex] = Symbols->Sources.Names[EntrySource];
+		Symbols->Dests.ByteCounts[DestIndex] = Symbols->Sources.ByteCounts[EntrySource];
+		Symbols->DestToSource[DestIndex] = EntrySource;
+	}
+	for (int SourceIndex = 0; SourceIndex < Symbols->SourceCount; SourceIndex++) {
+		const int Value = Symbols->Sources.Addresses[SourceIndex];
+		if (Value >= 0 && Value < Kilobyte(4) && MergedInto[Value] != -1) {
+			Symbols->Sources.Addresses[SourceIndex] = MergedInto[Value];
+		}
+	}
+
+	// Close the gaps the merged words left. Words only slide within their run of occupied words, so anything placed with .SetAddr stays where it was put.
+	// With indirect instructions the merged words are only freed, and everything else stays where it is.
+	int16_t Relocated[Kilobyte(4)];
+	int RemovedInRun = 0;
+	for (int Address = 0; Address < Kilobyte(4); Address++) {
+		if (!(MetaData[Address] & PMD_IsOccupied)) {
+			RemovedInRun = 0;
+			Relocated[Address] = Address;
+		}
+		else if (MergedInto[Address] != -1) {
+			if (!HasIndirect) { RemovedInRun++; }
+			Relocated[Address] = -1;
+		}
+		else {
+			Relocated[Address] = Address - RemovedInRun;
+		}
+	}
+
+	uint16_t NewProgram[Kilobyte(4)] = {0};
+	uint8_t NewMetaData[Kilobyte(4)] = {0};
+	int NewAddressToSource[Kilobyte(4)];
+	source_location *NewSourceMap = calloc(Kilobyte(4), sizeof(*NewSourceMap));
+	memset(NewAddressToSource, 0xFF, sizeof(NewAddressToSource));
+	for (int Address = 0; Address < Kilobyte(4); Address++) {
+		if (!(MetaData[Address] & PMD_IsOccupied) || Relocated[Address] == -1) { continue; }
+		const int To = Relocated[Address];
+		uint16_t Word = Program[Address];
+		if (IsAssembledInstruction(Context, Address) && HasAddressOperand(Word) && Relocated[Word & 0xFFF] != -1) {
+			Word = (Word & 0xF000) | Relocated[Word & 0xFFF];
+		}
+		NewProgram[To] = Word;
+		NewMetaData[To] = MetaData[Address];
+		NewSourceMap[To] = Context->SourceMap[Address];
+		NewAddressToSource[To] = Symbols->AddressToSource[Address];
+	}
+	memcpy(Program, NewProgram, sizeof(NewProgram));
+	memcpy(MetaData, NewMetaData, sizeof(NewMetaData));
+	memcpy(Context->SourceMap, NewSourceMap, sizeof(Context->SourceMap));
+	memcpy(Symbols->AddressToSource, NewAddressToSource, sizeof(NewAddressToSource));
+	free(NewSourceMap);
+
+	for (int SourceIndex = 0; SourceIndex < Symbols->SourceCount; SourceIndex++) {
+		const int Value = Symbols->Sources.Addresses[SourceIndex];
+		if (Value >= 0 && Value < Kilobyte(4)) { Symbols->Sources.Addresses[SourceIndex] = Relocated[Value]; }
+	}
+	for (int DestIndex = 0; DestIndex < Symbols->DestCount; DestIndex++) {
+		Symbols->Dests.Addresses[DestIndex] = Relocated[Symbols->Dests.Addresses[DestIndex]];
+	}
+	CompactSymbolDests(Symbols);
+	UpdateProgramBits(Context);
+
+	const int NewHighest = HighestUsedAddress(Context);
+	printf("[PackData] %d duplicate constants merged into the first word holding the same value, %d words (%d bytes) reclaimed. The highest used address went from 0x%03X to 0x%03X.\n",
+	       MergedCount, MergedCount, MergedCount * 2, OldHighest, NewHighest);
+	if (HasIndirect) {
+		printf("[PackData] The program uses addi, jumpi, loadi or storei, so the merged words were left free instead of sliding the words after them up.\n");
+	}
+	return MergedCount;
+}
@@ -43,12 +43,51 @@
 #define Max(A, B) ((A) > (B) ? (A) : (B))
 
 #define Kilobyte(A) ((A) * 1024)
-#define Megabyte(A) ((Kilobyte(A) * 1024)
+#define Megabyte(A) (Kilobyte(A) * 1024)
 
 #define global_var static
 #define local_persist static
 #define translation_scope static
 
+// For the few small functions in the simulators' inner loops, which have to be inlined even in unoptimized builds.
+#if defined(_MSC_VER)
+# define force_inline __forceinline
+#else
+# define force_inline inline __attribute__((always_inline))
+#endif
+
+// Atomic operations on values shared between threads. AtomicFetchAdd32 returns the value from before the add.
+// A load with acquire sees everything written before the store with release that it reads from.
+#ifdef _MSC_VER
+# include <intrin.h>
+# define AtomicFetchAdd32(Pointer, Value) _InterlockedExchangeAdd((volatile long*)(Pointer), (Value))
+// MSVC gives volatile accesses acquire and release semantics on x86 and x64.
+# define AtomicLoadAcquire64(Pointer) (*(volatile uint64_t*)(Pointer))
+# define AtomicStoreRelease64(Pointer, Value) (*(volatile uint64_t*)(Pointer) = (Value))
+#else
+# define AtomicFetchAdd32(Pointer, Value) __atomic_fetch_add((Pointer), (Value), __ATOMIC_SEQ_CST)
+# define AtomicLoadAcquire64(Pointer) __atomic_load_n((Pointer), __ATOMIC_ACQUIRE)
+# define AtomicStoreRelease64(Pointer, Value) __atomic_store_n((Pointer), (Value), __ATOMIC_RELEASE)
+#endif
+
+// Bit scans over 64 bit words. CountTrailingZeros64 and CountLeadingZeros64 are undefined when Value is 0.
+#ifdef _MSC_VER
+# include <stdint.h>
+translation_scope inline int CountTrailingZeros64(uint64_t Value) { unsigned long Index; _BitScanForward64(&Index, Value); return (int)Index; }
+translation_scope inline int CountLeadingZeros64(uint64_t Value) { unsigned long Index; _BitScanReverse64(&Index, Value); return 63 - (int)Index; }
+// __popcnt64 needs a processor with the popcnt instruction, which MSVC doesn't check for.
+translation_scope inline int PopCount64(uint64_t Value) {
+	Value = Value - ((Value >> 1) & 0x5555555555555555ull);
+	Value = (Value & 0x3333333333333333ull) + ((Value >> 2) & 0x3333333333333333ull);
+	Value = (Value + (Value >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+	return (int)((Value * 0x0101010101010101ull) >> 56);
+}
+#else
+# define CountTrailingZeros64(Value) __builtin_ctzll(Value)
+# define CountLeadingZeros64(Value) __builtin_clzll(Value)
+# define PopCount64(Value) __builtin_popcountll(Value)
+#endif
+
 #include <stdio.h>
 #include "MarieAssembler.h"
 
@@ -57,9 +96,51 @@
 
 void Platform_Breakpoint();
 
+/* Allocates Size bytes of zeroed memory that can be written to and executed, for the simulator's JIT.
+ * Returns 0 if the platform won't hand out executable memory, in which case the simulator falls back to its interpreter.
+ */
+void* Platform_AllocateExecutableMemory(size_t Size);
+void Platform_FreeExecutableMemory(void *Memory, size_t Size);
+
+// Seconds since some fixed point in the past, for timing benchmarks.
+double Platform_GetSeconds();
+
+typedef void (*platform_thread_proc)(void *Data);
+
+/* Starts a thread running Proc(Data). Returns 0 if the thread could not be started.
+ * Every thread must be waited on with Platform_JoinThread(), which also frees the handle.
+ */
+void* Platform_CreateThread(platform_thread_proc Proc, void *Data);
+void Platform_JoinThread(void *Thread);
+// How many threads the machine can run at once.
+int Platform_GetProcessorCount();
+/* An event lets one thread sleep until another has something for it. Signalling sets the event and wakes a thread waiting on it, and a wait returns once the event is set and clears it again.
+ * Signals while the event is already set are not counted, so the waiting thread has to check for everything that may have happened since its last wait.
+ * Returns 0 if the event could not be created.
+ */
+void* Platform_CreateEvent();
+void Platform_SignalEvent(void *Event);
+void Platform_WaitEvent(void *Event);
+void Platform_FreeEvent(void *Event);
+/* Looks up the file at Path. ModifiedTime is when it was last written, in some unit that changes whenever the file does.
+ * FileId is the same for every path that leads to the same file. Returns FALSE if there is no such file.
+ */
+int Platform_GetFileInfo(const char *Path, uint64_t *ModifiedTime, uint64_t *FileId);
+
 //-----
 //~ Functions defined in the application layer
 
+typedef enum {
+	ASSEMBLE_Optimize = 1 << 0, // Run the peephole optimizer over the program before writing any outputs
+	ASSEMBLE_PackData = 1 << 1, // Merge duplicate constants before writing any outputs
+} assembler_flags;
+
+// How diagnostics are written out once assembly finishes.
+typedef enum {
+	DF_Text, // "[Error L:1 C:4] message", for people
+	DF_JsonLines, // One JSON object per line, for graders and other tools
+} diagnostic_format;
+
 /* "Main" function for the application
  * While the application's actual entry point is in the platform spefic file, ApplicationMain() actually runs the application.
  * @Params InFile  Handle to the input file
@@ -68,7 +149,173 @@ void Platform_Breakpoint();
  * @Params RawHexOut  Handle where file containing a raw hex output should be writen to
  * @Params SymbolTableOut  Handle where a symbol table should be writen to
  * @Params ListingOut  Handle where a assembly listing should be writen to
+ * @Params SourceMapOut  Handle where the address to source line map should be writen to
+ * @Params CfgDotOut  Handle where the control flow graph should be writen to as Graphviz DOT
+ * @Params CfgJsonOut  Handle where the control flow graph should be writen to as JSON
+ * @Params ObjectOut  Handle where a relocatable object should be writen to for LinkMain(). Can't be combined with the other outputs
+ * @Params InFileName  Name diagnostics are attributed to, may be 0
+ * @Params DiagnosticFormat  How errors and warnings are printed to stdout, one of diagnostic_format
+ * @Params AssemblerFlags  Any combination of assembler_flags
+ * Every output handle is closed. Returns FALSE if the program didn't assemble or any output failed, and then none of the outputs should be kept.
+ */
+int ApplicationMain(FILE *InFile, int InFileSize, FILE *OutLogisim, FILE *OutRawHex, FILE *OutSymbolTable, FILE *OutListing, FILE *OutSourceMap, FILE *OutCfgDot, FILE *OutCfgJson, FILE *OutObject, const char *InFileName, int DiagnosticFormat, int AssemblerFlags);
+
+/* Lower level interface for platform layers that assemble more than once per run, such as a watch mode.
+ * A context keeps its allocations between calls to AssembleSource(), so reuse one instead of creating a new one per assembly.
+ */
+struct assembler_context* CreateAssemblerContext();
+void FreeAssemblerContext(struct assembler_context *Context);
+
+/* Reads the whole file into a null terminated UTF-8 buffer, transcoding from UTF-16 if needed. FileStream is closed.
+ * The file is read in chunks until it ends, so it can be a pipe or stdin. FileSize is only used to size the buffer up front, and can be 0 when it isn't known.
+ * Returns 0 and sets *Success to FALSE on failure.
+ */
+char *LoadFileIntoMemory(FILE* FileStream, int FileSize, int *Success);
+
+/* Returns the Size bytes at Bytes as null terminated UTF-8 text, detecting the encoding from the byte order mark like LoadFileIntoMemory().
+ * UTF-8 text is returned in place, just past its byte order mark, and Bytes[Size] is overwritten with the terminator, so it has to be writable. Anything else is transcoded into a new buffer and *Copied is set.
+ * Returns 0 and sets *Success to FALSE on failure.
+ */
+char *DecodeTextInPlace(char *Bytes, size_t Size, int *Copied, int *Success);
+
+/* Assembles Source into Context, throwing away the results of any previous assembly.
+ * The context takes ownership of Source and frees it when it is reset or freed.
+ * Returns TRUE if the source assembled without errors.
+ */
+int AssembleSource(struct assembler_context *Context, char *Source);
+
+/* Like AssembleSource(), but Source stays the caller's. It has to outlive everything read from the context, until the next assembly or the context is freed.
+ */
+int AssembleSourceInPlace(struct assembler_context *Context, char *Source);
+
+/* Writes every diagnostic from the last assembly to FileStream with a single write. FileStream is left open.
+ * FileName is included in each diagnostic if it isn't 0.
+ */
+void OutputDiagnostics(const struct assembler_context *Context, const char *FileName, int DiagnosticFormat, FILE *FileStream);
+
+/* Finds where the statement that assembled to Address starts in the source. Any of Line, Column and Offset may be 0.
+ * Returns FALSE if nothing was assembled to Address.
+ */
+int LookupSourceLocation(const struct assembler_context *Context, int Address, int *Line, int *Column, int *Offset);
+
+/* The path of the Index'th file the last assembly pulled in with .Include, or 0 once Index is past the last of them.
+ * The path stays valid until the next assembly or the context is freed.
+ */
+const char* GetIncludedPath(const struct assembler_context *Context, int Index);
+
+/* Finds the reachable words and basic blocks of the program held by Context, following execution from address 0. Free the result with FreeControlFlowGraph().
+ */
+struct control_flow_graph* AnalyzeControlFlow(const struct assembler_context *Context);
+void FreeControlFlowGraph(struct control_flow_graph *Cfg);
+
+/* Rewrites the program held by Context to run in fewer cycles without changing what it does, then prints what changed and roughly how many cycles it saves.
+ * Only reachable code is touched. Symbols, the source map and the listing follow the words that moved.
+ * Returns how many rewrites were made.
+ */
+int OptimizeProgram(struct assembler_context *Context);
+
+/* Merges data words that hold the same value and are only ever read by load, add and subt into the first of them, then slides the rest of each run of words up over the gaps.
+ * Every instruction, identifier and source map entry that pointed at a moved word is updated. Prints how many words were reclaimed.
+ * Returns how many words were merged away.
+ */
+int PackLiteralPool(struct assembler_context *Context);
+
+/* Output writers. Each one writes the assembled program held by Context into FileStream, and closes FileStream.
+ * Returns TRUE on success.
+ */
+int OutputLogisimImage(const struct assembler_context *Context, FILE *FileStream);
+int OutputRawHex(const struct assembler_context *Context, FILE *FileStream);
+int OutputSymbolTable(const struct assembler_context *Context, FILE *FileStream);
+int OutputListing(const struct assembler_context *Context, FILE *FileStream);
+int OutputSourceMap(const struct assembler_context *Context, FILE *FileStream);
+int OutputControlFlowDot(const struct assembler_context *Context, FILE *FileStream);
+int OutputControlFlowJson(const struct assembler_context *Context, FILE *FileStream);
+int OutputObject(const struct assembler_context *Context, FILE *FileStream);
+struct call_stack_profile;
+int OutputFoldedStacks(const struct assembler_context *Context, const struct call_stack_profile *CallStacks, const char *RootName, FILE *FileStream);
+
+typedef enum {
+	SIMULATE_Interpret = 1 << 0, // Don't use the JIT even if this host supports it
+	SIMULATE_Benchmark = 1 << 1, // Run with both the interpreter and the JIT, and compare them
+	SIMULATE_Optimize = 1 << 2, // Run the program as OptimizeProgram() rewrote it
+	SIMULATE_PackData = 1 << 3, // Run the program as PackLiteralPool() rewrote it
+} simulator_flags;
+
+/* Combines objects written by --object into one program, then runs the passes in AssemblerFlags and writes the outputs like ApplicationMain().
+ * Each object's .Idents can be used by every other object, so an identifier may only be defined once across all of them.
+ * Sections from every object are placed together, so the first object's code starts at address 0 unless something was placed there with .SetAddr. Closes every object.
+ * Returns TRUE if the objects linked and every output was written. Like ApplicationMain(), every output handle is closed either way.
+ */
+int LinkMain(FILE **Objects, const char **ObjectNames, int ObjectCount, FILE *OutLogisim, FILE *OutRawHex, FILE *OutSymbolTable, FILE *OutListing, FILE *OutSourceMap, FILE *OutCfgDot, FILE *OutCfgJson, int DiagnosticFormat, int AssemblerFlags);
+
+/* Assembles InFile and runs the program until it halts. Output instructions print to stdout.
+ * @Params InputValues  Where input instructions read their values from, written like `12 -3 0x1F 0d7`
+ * @Params OutProfile  If set, the run is profiled in the interpreter and a listing with the counts for each address is written here, then closed.
+ * @Params OutFoldedStacks  If set, the run tracks subroutine calls in the interpreter and the instructions run under each call stack are written here in flamegraph folded format, then closed.
+ * @Params OutTrace  If set, every instruction the interpreter executes is recorded here, then it is closed. See TraceDecodeMain().
+ * @Params SimulatorFlags  Any combination of simulator_flags
+ * Returns TRUE if the program assembled and halted.
+ */
+int SimulatorMain(FILE *InFile, int InFileSize, const char *InFileName, FILE *InputValues, FILE *OutProfile, FILE *OutFoldedStacks, FILE *OutTrace, int SimulatorFlags, int DiagnosticFormat);
+
+/* Assembles InFile, then prints the trace in TraceFile one instruction per line, naming addresses after the program's identifiers. Closes TraceFile.
+ * Returns TRUE if the program assembled and TraceFile was a trace.
+ */
+int TraceDecodeMain(FILE *InFile, int InFileSize, const char *InFileName, FILE *TraceFile, int DiagnosticFormat);
+
+/* Reads the program image in InFile, written by --rawhex or --logisim, and writes it to Out as MarieAsm source that assembles back to the same image.
+ * Every address that is jumped to, called, or read and written through gets a label. If SymbolFile is set, it is a symbol table written by --symboltable, and its names are used instead wherever it has one.
+ * Closes InFile, SymbolFile and Out. Returns TRUE if InFile was an image and the source was written.
+ */
+int DisassembleMain(FILE *InFile, const char *InFileName, FILE *SymbolFile, int SymbolFileSize, FILE *Out);
+
+typedef enum {
+	DIFF_Same = 0,
+	DIFF_Different = 1,
+	DIFF_Error = 2, // Same as diff and cmp, so scripts can tell a failure from a difference
+} diff_result;
+
+/* Compares the program images in FileA and FileB, which may each be either format, and prints every range of addresses where they differ with both versions of each word disassembled.
+ * Images that only differ in how their Logisim runs were written are the same. If SymbolFile is set, its names are used for the addresses and operands. Closes FileA, FileB and SymbolFile.
+ * Returns one of diff_result.
+ */
+int DiffMain(FILE *FileA, const char *NameA, FILE *FileB, const char *NameB, FILE *SymbolFile, int SymbolFileSize);
+
+/* Assembles InFile and runs the program once for each test case in the spec, spreading the cases over ThreadCount threads.
+ * A spec has one case per line, `Name: inputs -> expected outputs`, and `budget N` lines that set the instruction budget for the cases after them.
+ * SimulatorFlags may hold SIMULATE_Optimize and SIMULATE_PackData, to test the program as those passes rewrote it.
+ * Prints PASS or FAIL and the instructions executed for each case. Returns TRUE if every case passed.
+ */
+int TestVectorMain(FILE *InFile, int InFileSize, const char *InFileName, FILE *SpecFile, int SpecFileSize, int ThreadCount, int SimulatorFlags, int DiagnosticFormat);
+
+/* Assembles InFile and runs it RunCount times with random inputs, in the interpreter and in lockstep groups, and checks that every run ended the same way in both.
+ * Prints how the runs ended, a few inputs that made the program loop or misbehave, and how many runs per second each engine managed.
+ * Returns TRUE if the program assembled and both engines agreed.
+ */
+int FuzzMain(FILE *InFile, int InFileSize, const char *InFileName, int RunCount, int DiagnosticFormat);
+
+/* Runs a Language Server Protocol server over In and Out until the client asks it to exit.
+ * Returns TRUE if the client shut the server down properly.
+ */
+int LanguageServerMain(FILE *In, FILE *Out);
+
+// One regular file in a tar archive. Data points into the archive, and Name is malloc'd.
+typedef struct {
+	char *Name;
+	char *Data;
+	size_t Size;
+} archive_member;
+
+/* Lists the regular files in the uncompressed tar archive held in Archive, without copying any of them. Free the list with FreeArchiveMembers().
+ * Returns FALSE, with an empty list, if a header is damaged or the archive ends partway through a member.
+ */
+int ReadTarArchive(char *Archive, size_t Size, archive_member **Members, int *MemberCount);
+void FreeArchiveMembers(archive_member *Members, int MemberCount);
+
+/* Appends a regular file to the tar archive being written to Out. FinishTarArchive() writes the end of archive marker after the last one.
+ * Returns FALSE if writing failed.
  */
-int ApplicationMain(FILE *InFile, int InFileSize, FILE *OutLogisim, FILE *OutRawHex, FILE *OutSymbolTable, FILE *OutListing);
+int WriteTarMember(FILE *Out, const char *Name, const char *Data, size_t Size);
+int FinishTarArchive(FILE *Out);
 
 #endif
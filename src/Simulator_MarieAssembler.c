@@ -0,0 +1,886 @@
+/* File: Runs assembled Marie programs.
+ * RunInterpreter() executes one instruction at a time and works everywhere. On x86-64 hosts RunJit() translates basic blocks of the program into machine code and runs those instead.
+ */
+
+#include "MarieAssembler.h"
+#include "Platform_MarieAssembler.h"
+#include "Simulator_MarieAssembler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+global_var const char* const SimulationStatusNames[] = {
+	[SIM_Running] = "Running",
+	[SIM_Halted] = "Halted",
+	[SIM_BudgetExhausted] = "Instruction budget exhausted",
+	[SIM_InputExhausted] = "Ran out of input",
+	[SIM_IllegalInstruction] = "Illegal instruction",
+};
+
+//-----
+//~ Interpreter
+
+translation_scope void ResetMachine(marie_machine *Machine, const uint16_t *Program) {
+	memcpy(Machine->Memory, Program, sizeof(Machine->Memory));
+	Machine->AC = 0;
+	Machine->PC = 0;
+	Machine->Status = SIM_Running;
+	Machine->InstructionCount = 0;
+	Machine->DirtyPages = 0;
+	Machine->InputAt = 0;
+	Machine->OutputCount = 0;
+}
+
+/* Same as ResetMachine(), for a machine that was last reset with the same Program. Only the pages the last run stored into are copied.
+ */
+translation_scope void RestoreMachine(marie_machine *Machine, const uint16_t *Program) {
+	for (int Page = 0; Page < 64; Page++) {
+		if (Machine->DirtyPages & ((uint64_t)1 << Page)) {
+			memcpy(&Machine->Memory[Page * MACHINE_PAGE_WORDS], &Program[Page * MACHINE_PAGE_WORDS], MACHINE_PAGE_WORDS * sizeof(*Program));
+		}
+	}
+	Machine->AC = 0;
+	Machine->PC = 0;
+	Machine->Status = SIM_Running;
+	Machine->InstructionCount = 0;
+	Machine->DirtyPages = 0;
+	Machine->InputAt = 0;
+	Machine->OutputCount = 0;
+}
+
+// Every store in the interpreter goes through this, so DirtyPages stays accurate.
+#define MachineStore(Machine, Address, Value) do { \
+	const uint16_t StoreAddress = (Address); \
+	(Machine)->Memory[StoreAddress] = (Value); \
+	(Machine)->DirtyPages |= (uint64_t)1 << (StoreAddress / MACHINE_PAGE_WORDS); \
+} while (0)
+
+/* Parses a whole token of the form `12`, `-12`, `0d12` or `0xC` into a 16 bit word.
+ * Returns FALSE if the token is anything else.
+ */
+translation_scope int ParseMachineValue(const char *Text, int Length, uint16_t *Value) {
+	int At = 0;
+	int Sign = 1;
+	if (At < Length && (Text[At] == '-' || Text[At] == '+')) {
+		if (Text[At] == '-') { Sign = -1; }
+		At++;
+	}
+
+	int Base = 10;
+	if (At + 1 < Length && Text[At] == '0' && (Text[At + 1] == 'x' || Text[At + 1] == 'X')) { Base = 16; At += 2; }
+	else if (At + 1 < Length && Text[At] == '0' && (Text[At + 1] == 'd' || Text[At + 1] == 'D')) { Base = 10; At += 2; }
+
+	if (At == Length) { return FALSE; }
+	int Result = 0;
+	for (; At < Length; At++) {
+		int Digit = -1;
+		if (Text[At] >= '0' && Text[At] <= '9') { Digit = Text[At] - '0'; }
+		else if (Base == 16 && Text[At] >= 'a' && Text[At] <= 'f') { Digit = Text[At] - 'a' + 0xA; }
+		else if (Base == 16 && Text[At] >= 'A' && Text[At] <= 'F') { Digit = Text[At] - 'A' + 0xA; }
+		if (Digit == -1) { return FALSE; }
+		Result = (Result * Base + Digit) & 0xFFFF;
+	}
+
+	*Value = (uint16_t)(Result * Sign);
+	return TRUE;
+}
+
+/* Reads the next value from FileStream, skipping whitespace and commas before it. See ParseMachineValue() for what a value looks like.
+ * Returns FALSE at the end of the stream, or if the next thing in the stream isn't a value.
+ */
+translation_scope int ReadInputValue(FILE *FileStream, uint16_t *Value) {
+	int Char = fgetc(FileStream);
+	while (Char == ' ' || Char == '\t' || Char == '\r' || Char == '\n' || Char == ',') { Char = fgetc(FileStream); }
+
+	char Token[32];
+	int Length = 0;
+	for (; Char != EOF && Char != ' ' && Char != '\t' && Char != '\r' && Char != '\n' && Char != ','; Char = fgetc(FileStream)) {
+		if (Length == sizeof(Token)) { return FALSE; }
+		Token[Length++] = (char)Char;
+	}
+	if (Char != EOF) { ungetc(Char, FileStream); }
+
+	return ParseMachineValue(Token, Length, Value);
+}
+
+translation_scope int ReadMachineInput(marie_machine *Machine, uint16_t *Value) {
+	if (Machine->InputAt < Machine->InputCount) {
+		*Value = Machine->Input[Machine->InputAt++];
+		return TRUE;
+	}
+	if (Machine->InputStream) {
+		if (Machine->OutputStream) { fflush(Machine->OutputStream); } // Let a person see what the program printed before it asks them for something.
+		return ReadInputValue(Machine->InputStream, Value);
+	}
+	return FALSE;
+}
+
+translation_scope void WriteMachineOutput(marie_machine *Machine, uint16_t Value) {
+	if (Machine->OutputCount == Machine->OutputCapacity) {
+		Machine->OutputCapacity = Max(64, Machine->OutputCapacity * 2);
+		Machine->Output = realloc(Machine->Output, Machine->OutputCapacity * sizeof(*Machine->Output));
+	}
+	Machine->Output[Machine->OutputCount++] = Value;
+	if (Machine->OutputStream) {
+		fprintf(Machine->OutputStream, "%d\n", (int16_t)Value);
+	}
+}
+
+/* Returns the address the instruction at Machine->PC is about to store to, or -1 if it doesn't store.
+ */
+translation_scope int MachineStoreAddress(const marie_machine *Machine) {
+	const uint16_t Instruction = Machine->Memory[Machine->PC];
+	const uint16_t X = Instruction & 0xFFF;
+	switch (Instruction >> 12) {
+	case 0x0: case 0x2: { return X; }
+	case 0xE: { return Machine->Memory[X] & 0xFFF; }
+	default: { return -1; }
+	}
+}
+
+//-----
+//~ Profiling
+
+translation_scope call_stack_profile* CreateCallStackProfile() {
+	call_stack_profile *CallStacks = calloc(1, sizeof(call_stack_profile));
+	CallStacks->NodeCapacity = 256;
+	CallStacks->Nodes = malloc(CallStacks->NodeCapacity * sizeof(*CallStacks->Nodes));
+	CallStacks->SlotCapacity = 512;
+	CallStacks->Slots = malloc(CallStacks->SlotCapacity * sizeof(*CallStacks->Slots));
+	memset(CallStacks->Slots, -1, CallStacks->SlotCapacity * sizeof(*CallStacks->Slots));
+
+	// The root, for code outside of any subroutine.
+	CallStacks->Nodes[0] = (call_stack_node){.Parent = -1};
+	CallStacks->NodeCount = 1;
+	CallStacks->Stack[0] = 0;
+	CallStacks->Depth = 1;
+	return CallStacks;
+}
+
+translation_scope void FreeCallStackProfile(call_stack_profile *CallStacks) {
+	free(CallStacks->Nodes);
+	free(CallStacks->Slots);
+	free(CallStacks);
+}
+
+translation_scope uint32_t HashCallStackSlot(int32_t Parent, uint16_t Subroutine, int SlotCapacity) {
+	return (((uint32_t)Parent * 4096 + Subroutine) * 2654435761u) & (SlotCapacity - 1);
+}
+
+/* Returns the node for Parent's stack plus a call to Subroutine, adding it if this is the first such call. Returns -1 if there is no room for it.
+ */
+translation_scope int32_t FindCallStackChild(call_stack_profile *CallStacks, int32_t Parent, uint16_t Subroutine) {
+	uint32_t Slot = HashCallStackSlot(Parent, Subroutine, CallStacks->SlotCapacity);
+	for (; CallStacks->Slots[Slot] != -1; Slot = (Slot + 1) & (CallStacks->SlotCapacity - 1)) {
+		const call_stack_node *Node = &CallStacks->Nodes[CallStacks->Slots[Slot]];
+		if (Node->Parent == Parent && Node->Subroutine == Subroutine) { return CallStacks->Slots[Slot]; }
+	}
+	if (CallStacks->NodeCount == CALL_STACK_MAX_NODES) { return -1; }
+
+	if (CallStacks->NodeCount == CallStacks->NodeCapacity) {
+		CallStacks->NodeCapacity *= 2;
+		CallStacks->Nodes = realloc(CallStacks->Nodes, CallStacks->NodeCapacity * sizeof(*CallStacks->Nodes));
+	}
+	const int32_t Result = CallStacks->NodeCount++;
+	CallStacks->Nodes[Result] = (call_stack_node){.Parent = Parent, .Subroutine = Subroutine};
+	CallStacks->Slots[Slot] = Result;
+
+	// Keep the table at most half full.
+	if (CallStacks->NodeCount * 2 > CallStacks->SlotCapacity) {
+		free(CallStacks->Slots);
+		CallStacks->SlotCapacity *= 2;
+		CallStacks->Slots = malloc(CallStacks->SlotCapacity * sizeof(*CallStacks->Slots));
+		memset(CallStacks->Slots, -1, CallStacks->SlotCapacity * sizeof(*CallStacks->Slots));
+		for (int32_t Index = 1; Index < CallStacks->NodeCount; Index++) {
+			const call_stack_node *Node = &CallStacks->Nodes[Index];
+			uint32_t NewSlot = HashCallStackSlot(Node->Parent, Node->Subroutine, CallStacks->SlotCapacity);
+			while (CallStacks->Slots[NewSlot] != -1) { NewSlot = (NewSlot + 1) & (CallStacks->SlotCapacity - 1); }
+			CallStacks->Slots[NewSlot] = Index;
+		}
+	}
+	return Result;
+}
+
+translation_scope void TrackCall(call_stack_profile *CallStacks, uint16_t Subroutine) {
+	const int32_t Child = CallStacks->Depth < CALL_STACK_MAX_DEPTH ? FindCallStackChild(CallStacks, CallStacks->Stack[CallStacks->Depth - 1], Subroutine) : -1;
+	if (Child == -1) {
+		CallStacks->DroppedCalls++;
+		return;
+	}
+	CallStacks->Stack[CallStacks->Depth++] = Child;
+}
+
+// A jumpi through a frame's return address returns from that frame, and from anything it called that never returned.
+translation_scope void TrackJumpi(call_stack_profile *CallStacks, uint16_t Through) {
+	for (int Depth = CallStacks->Depth - 1; Depth > 0; Depth--) {
+		if (CallStacks->Nodes[CallStacks->Stack[Depth]].Subroutine == Through) {
+			CallStacks->Depth = Depth;
+			return;
+		}
+	}
+}
+
+//-----
+//~ Stepping
+
+/* Executes the instruction at *PC. PC, AC and the instruction count are Machine's, passed apart from it so that a loop can keep them in locals.
+ * Profile, CallStacks and Trace are hooks, each skipped if it is 0: Profile counts executions, skips taken, reads and writes, CallStacks counts each instruction toward the call stack it ran in and follows jns calls and jumpi returns, and Trace records each instruction.
+ * Callers pass a constant 0 for the hooks they don't use, so those are compiled out of their loops.
+ * Only instructions that ran go through the hooks. One that ran out of input or was illegal sets Machine->Status and changes nothing else.
+ * jns leaves AC alone, it only stores the return address and jumps.
+ * skipcond looks at bits 11 and 10 of its argument: 00 skips if AC < 0, 01 if AC == 0, and 10 or 11 if AC > 0.
+ */
+translation_scope force_inline void StepInstruction(marie_machine *Machine, machine_profile *Profile, call_stack_profile *CallStacks, trace_recorder *Trace, uint16_t *PC, uint16_t *AC, uint64_t *InstructionCount) {
+	uint16_t *Memory = Machine->Memory;
+	const uint16_t Instruction = Memory[*PC];
+	const uint16_t X = Instruction & 0xFFF;
+	uint16_t Next = (*PC + 1) & 0xFFF;
+	int StoredAt = -1; // Named apart from the variable inside MachineStore()
+	uint16_t StoredValue = *AC;
+
+	switch (Instruction >> 12) {
+	case 0x0: { // jns
+		MachineStore(Machine, X, Next);
+		StoredAt = X;
+		StoredValue = Next;
+		if (Profile) { Profile->Writes[X]++; }
+		Next = (X + 1) & 0xFFF;
+	} break;
+	case 0x1: { *AC = Memory[X]; if (Profile) { Profile->Reads[X]++; } } break; // load
+	case 0x2: { MachineStore(Machine, X, *AC); StoredAt = X; if (Profile) { Profile->Writes[X]++; } } break; // store
+	case 0x3: { *AC += Memory[X]; if (Profile) { Profile->Reads[X]++; } } break; // add
+	case 0x4: { *AC -= Memory[X]; if (Profile) { Profile->Reads[X]++; } } break; // subt
+	case 0x5: { // input
+		uint16_t Value;
+		if (!ReadMachineInput(Machine, &Value)) {
+			Machine->Status = SIM_InputExhausted;
+			return;
+		}
+		*AC = Value;
+	} break;
+	case 0x6: { WriteMachineOutput(Machine, *AC); } break; // output
+	case 0x7: { Machine->Status = SIM_Halted; Next = *PC; } break; // halt
+	case 0x8: { // skipcond
+		const int16_t SignedAC = (int16_t)*AC;
+		const int Condition = (X >> 10) & 0x3;
+		if ((Condition == 0 && SignedAC < 0) || (Condition == 1 && SignedAC == 0) || (Condition >= 2 && SignedAC > 0)) {
+			Next = (Next + 1) & 0xFFF;
+			if (Profile) { Profile->SkipsTaken[*PC]++; }
+		}
+	} break;
+	case 0x9: { Next = X; } break; // jump
+	case 0xA: { *AC = 0; } break; // clear
+	case 0xB: { // addi
+		const uint16_t Pointer = Memory[X] & 0xFFF;
+		*AC += Memory[Pointer];
+		if (Profile) { Profile->Reads[X]++; Profile->Reads[Pointer]++; }
+	} break;
+	case 0xC: { Next = Memory[X] & 0xFFF; if (Profile) { Profile->Reads[X]++; } } break; // jumpi
+	case 0xD: { // loadi
+		const uint16_t Pointer = Memory[X] & 0xFFF;
+		*AC = Memory[Pointer];
+		if (Profile) { Profile->Reads[X]++; Profile->Reads[Pointer]++; }
+	} break;
+	case 0xE: { // storei
+		StoredAt = Memory[X] & 0xFFF;
+		MachineStore(Machine, StoredAt, *AC);
+		if (Profile) { Profile->Reads[X]++; Profile->Writes[StoredAt]++; }
+	} break;
+	default: {
+		Machine->Status = SIM_IllegalInstruction;
+		return;
+	}
+	}
+
+	if (Profile) { Profile->Executions[*PC]++; }
+	if (CallStacks) {
+		// The call or return itself counts toward the stack it ran in.
+		CallStacks->Nodes[CallStacks->Stack[CallStacks->Depth - 1]].Instructions++;
+		if ((Instruction >> 12) == 0x0) { TrackCall(CallStacks, X); }
+		else if ((Instruction >> 12) == 0xC) { TrackJumpi(CallStacks, X); }
+	}
+	if (Trace) {
+		RecordTraceStep(Trace, *PC, Instruction, *AC, StoredAt, StoredValue);
+	}
+
+	*PC = Next;
+	(*InstructionCount)++;
+}
+
+// Executes the instruction at Machine->PC, see StepInstruction(). Nothing is profiled or traced.
+translation_scope void StepMachine(marie_machine *Machine) {
+	uint16_t PC = Machine->PC;
+	uint16_t AC = Machine->AC;
+	uint64_t InstructionCount = Machine->InstructionCount;
+	StepInstruction(Machine, 0, 0, 0, &PC, &AC, &InstructionCount);
+	Machine->PC = PC;
+	Machine->AC = AC;
+	Machine->InstructionCount = InstructionCount;
+}
+
+/* Runs the machine until it stops or spends its budget, with the hooks of StepInstruction(). PC, AC and the instruction count stay in locals for the whole run.
+ */
+translation_scope force_inline void RunInterpreterLoop(marie_machine *Machine, machine_profile *Profile, call_stack_profile *CallStacks, trace_recorder *Trace) {
+	uint16_t PC = Machine->PC;
+	uint16_t AC = Machine->AC;
+	uint64_t InstructionCount = Machine->InstructionCount;
+	const uint64_t Budget = Machine->InstructionBudget ? Machine->InstructionBudget : UINT64_MAX;
+
+	while (Machine->Status == SIM_Running) {
+		if (InstructionCount >= Budget) {
+			Machine->Status = SIM_BudgetExhausted;
+			break;
+		}
+		StepInstruction(Machine, Profile, CallStacks, Trace, &PC, &AC, &InstructionCount);
+	}
+
+	Machine->PC = PC;
+	Machine->AC = AC;
+	Machine->InstructionCount = InstructionCount;
+}
+
+/* Runs the machine in the interpreter, counting into Machine->Profile and Machine->CallStacks and recording into Machine->Trace if they are set.
+ * Plain runs and runs with only --profile or only --trace each get a loop built for them. Anything else shares one loop that checks every hook.
+ */
+translation_scope void RunInterpreter(marie_machine *Machine) {
+	machine_profile *Profile = Machine->Profile;
+	call_stack_profile *CallStacks = Machine->CallStacks;
+	trace_recorder *Trace = Machine->Trace;
+	if (!Profile && !CallStacks && !Trace) { RunInterpreterLoop(Machine, 0, 0, 0); }
+	else if (!CallStacks && !Trace) { RunInterpreterLoop(Machine, Profile, 0, 0); }
+	else if (!Profile && !CallStacks) { RunInterpreterLoop(Machine, 0, 0, Trace); }
+	else { RunInterpreterLoop(Machine, Profile, CallStacks, Trace); }
+}
+
+//-----
+//~ JIT
+//
+// Register use inside generated code:
+//   r10w  AC
+//   r8    Machine->Memory
+//   r9    &Jit->State
+//   eax   PC of the next block when leaving a block
+//   ecx, edx, r11  scratch
+// These are all volatile in both the System V and Windows x64 calling conventions, so generated code never saves anything or touches the stack.
+//
+// A block runs straight line Marie code and ends at jump, jumpi, jns or skipcond, right before input, output, halt or an illegal instruction, or after JIT_MAX_BLOCK_INSTRUCTIONS.
+// Each block ends by jumping to the dispatch stub with the next PC in eax, which looks the next block up in State.BlockCode and jumps straight into it.
+// When there is no block there, or the instruction budget is nearly spent, the dispatch stub returns to RunJit() instead, which compiles the block or runs the instruction in the interpreter.
+//
+// Every store checks State.CodeMap, and leaves the block if it wrote into code we have compiled. RunJit() then throws the stale blocks away.
+
+#define JIT_MAX_BLOCK_BYTES ((JIT_MAX_BLOCK_INSTRUCTIONS + 1) * JIT_MAX_INSTRUCTION_BYTES)
+#define JIT_OFFSET(Field) ((uint32_t)offsetof(jit_state, Field))
+
+#if MARIE_JIT_SUPPORTED
+
+translation_scope inline void JitEmitBytes(marie_jit *Jit, const uint8_t *Bytes, int Count) {
+	memcpy(Jit->Code + Jit->CodeUsed, Bytes, Count);
+	Jit->CodeUsed += Count;
+}
+
+#define JitEmit(Jit, ...) do { const uint8_t JitBytes[] = {__VA_ARGS__}; JitEmitBytes(Jit, JitBytes, sizeof(JitBytes)); } while (0)
+
+translation_scope inline void JitEmit32(marie_jit *Jit, uint32_t Value) {
+	memcpy(Jit->Code + Jit->CodeUsed, &Value, 4);
+	Jit->CodeUsed += 4;
+}
+
+translation_scope inline void JitEmit16(marie_jit *Jit, uint16_t Value) {
+	memcpy(Jit->Code + Jit->CodeUsed, &Value, 2);
+	Jit->CodeUsed += 2;
+}
+
+// Emits a rel32 jump to Target. Opcode is E9 for jmp, or 0F 8x for a conditional jump.
+translation_scope void JitEmitJump(marie_jit *Jit, const uint8_t *Opcode, int OpcodeLength, uint8_t *Target) {
+	JitEmitBytes(Jit, Opcode, OpcodeLength);
+	JitEmit32(Jit, (uint32_t)(Target - (Jit->Code + Jit->CodeUsed + 4)));
+}
+
+translation_scope void JitEmitJmp(marie_jit *Jit, uint8_t *Target) {
+	const uint8_t Jmp[] = {0xE9};
+	JitEmitJump(Jit, Jmp, sizeof(Jmp), Target);
+}
+
+// add qword [r9 + InstructionCount], Executed
+translation_scope void JitEmitCountInstructions(marie_jit *Jit, int Executed) {
+	JitEmit(Jit, 0x49, 0x81, 0x81); JitEmit32(Jit, JIT_OFFSET(InstructionCount)); JitEmit32(Jit, Executed);
+}
+
+// Leaves the block for the block at NextPC.
+translation_scope void JitEmitBlockExit(marie_jit *Jit, uint16_t NextPC, int Executed) {
+	JitEmit(Jit, 0xB8); JitEmit32(Jit, NextPC); // mov eax, NextPC
+	JitEmitCountInstructions(Jit, Executed);
+	JitEmitJmp(Jit, Jit->DispatchStub);
+}
+
+/* Emits what follows every store: marking its page dirty, and the check for a store into compiled code. If it hit compiled code, the block stops right here and goes back to RunJit().
+ * Address is the address stored to, or -1 if it is in eax.
+ */
+translation_scope void JitEmitStoreCheck(marie_jit *Jit, int Address, uint16_t ResumePC, int Executed) {
+	if (Address == -1) {
+		JitEmit(Jit, 0x89, 0xC1); // mov ecx, eax
+		JitEmit(Jit, 0xC1, 0xE9, 0x06); // shr ecx, 6
+		JitEmit(Jit, 0x49, 0x0F, 0xAB, 0x89); JitEmit32(Jit, JIT_OFFSET(DirtyPages)); // bts [r9 + DirtyPages], rcx
+	}
+	else {
+		JitEmit(Jit, 0x49, 0x0F, 0xBA, 0xA9); JitEmit32(Jit, JIT_OFFSET(DirtyPages)); JitEmit(Jit, Address / MACHINE_PAGE_WORDS); // bts qword [r9 + DirtyPages], Page
+	}
+
+	if (Address == -1) {
+		JitEmit(Jit, 0x41, 0x80, 0xBC, 0x01); JitEmit32(Jit, JIT_OFFSET(CodeMap)); JitEmit(Jit, 0x00); // cmp byte [r9 + rax + CodeMap], 0
+	}
+	else {
+		JitEmit(Jit, 0x41, 0x80, 0xB9); JitEmit32(Jit, JIT_OFFSET(CodeMap) + Address); JitEmit(Jit, 0x00); // cmp byte [r9 + CodeMap + Address], 0
+	}
+	JitEmit(Jit, 0x74, 0x00); // je past the slow path, patched below
+	const size_t PatchAt = Jit->CodeUsed - 1;
+
+	if (Address == -1) {
+		JitEmit(Jit, 0x41, 0x89, 0x81); JitEmit32(Jit, JIT_OFFSET(InvalidateAddress)); // mov [r9 + InvalidateAddress], eax
+	}
+	else {
+		JitEmit(Jit, 0x41, 0xC7, 0x81); JitEmit32(Jit, JIT_OFFSET(InvalidateAddress)); JitEmit32(Jit, Address); // mov dword [r9 + InvalidateAddress], Address
+	}
+	JitEmit(Jit, 0xB8); JitEmit32(Jit, ResumePC); // mov eax, ResumePC
+	JitEmitCountInstructions(Jit, Executed);
+	JitEmitJmp(Jit, Jit->ExitStub);
+
+	Jit->Code[PatchAt] = (uint8_t)(Jit->CodeUsed - (PatchAt + 1));
+}
+
+// movzx eax, word [r8 + X*2] ; and eax, 0xFFF
+translation_scope void JitEmitLoadPointer(marie_jit *Jit, uint16_t X) {
+	JitEmit(Jit, 0x41, 0x0F, 0xB7, 0x80); JitEmit32(Jit, X * 2);
+	JitEmit(Jit, 0x25); JitEmit32(Jit, 0xFFF);
+}
+
+translation_scope void FlushJit(marie_jit *Jit) {
+	memset(Jit->State.BlockCode, 0, sizeof(Jit->State.BlockCode));
+	memset(Jit->State.CodeMap, 0, sizeof(Jit->State.CodeMap));
+	memset(Jit->BlockLength, 0, sizeof(Jit->BlockLength));
+	Jit->CodeUsed = Jit->StubsEnd;
+}
+
+translation_scope marie_jit* CreateJit() {
+	uint8_t *Code = Platform_AllocateExecutableMemory(JIT_CODE_SIZE);
+	if (Code == 0) { return 0; }
+
+	marie_jit *Jit = calloc(1, sizeof(marie_jit));
+	Jit->Code = Code;
+
+	// Entry: called as Enter(State, BlockCode)
+	Jit->Enter = (jit_enter_function)(Jit->Code + Jit->CodeUsed);
+#ifdef _WIN32
+	JitEmit(Jit, 0x49, 0x89, 0xC9); // mov r9, rcx
+#else
+	JitEmit(Jit, 0x49, 0x89, 0xF9); // mov r9, rdi
+#endif
+	JitEmit(Jit, 0x4D, 0x8B, 0x81); JitEmit32(Jit, JIT_OFFSET(Memory)); // mov r8, [r9 + Memory]
+	JitEmit(Jit, 0x45, 0x0F, 0xB7, 0x91); JitEmit32(Jit, JIT_OFFSET(AC)); // movzx r10d, word [r9 + AC]
+#ifdef _WIN32
+	JitEmit(Jit, 0xFF, 0xE2); // jmp rdx
+#else
+	JitEmit(Jit, 0xFF, 0xE6); // jmp rsi
+#endif
+
+	// Dispatch: eax holds the next PC
+	Jit->DispatchStub = Jit->Code + Jit->CodeUsed;
+	JitEmit(Jit, 0x49, 0x8B, 0x89); JitEmit32(Jit, JIT_OFFSET(InstructionCount)); // mov rcx, [r9 + InstructionCount]
+	JitEmit(Jit, 0x49, 0x3B, 0x89); JitEmit32(Jit, JIT_OFFSET(ChainLimit)); // cmp rcx, [r9 + ChainLimit]
+	JitEmit(Jit, 0x73, 0x00); // jae Exit, patched below
+	const size_t BudgetPatchAt = Jit->CodeUsed - 1;
+	JitEmit(Jit, 0x49, 0x8B, 0x8C, 0xC1); JitEmit32(Jit, JIT_OFFSET(BlockCode)); // mov rcx, [r9 + rax*8 + BlockCode]
+	JitEmit(Jit, 0x48, 0x85, 0xC9); // test rcx, rcx
+	JitEmit(Jit, 0x74, 0x00); // jz Exit, patched below
+	const size_t MissingPatchAt = Jit->CodeUsed - 1;
+	JitEmit(Jit, 0xFF, 0xE1); // jmp rcx
+
+	// Exit: return eax to RunJit()
+	Jit->ExitStub = Jit->Code + Jit->CodeUsed;
+	Jit->Code[BudgetPatchAt] = (uint8_t)(Jit->CodeUsed - (BudgetPatchAt + 1));
+	Jit->Code[MissingPatchAt] = (uint8_t)(Jit->CodeUsed - (MissingPatchAt + 1));
+	JitEmit(Jit, 0x66, 0x45, 0x89, 0x91); JitEmit32(Jit, JIT_OFFSET(AC)); // mov [r9 + AC], r10w
+	JitEmit(Jit, 0xC3); // ret
+
+	Jit->StubsEnd = Jit->CodeUsed;
+	return Jit;
+}
+
+translation_scope void FreeJit(marie_jit *Jit) {
+	Platform_FreeExecutableMemory(Jit->Code, JIT_CODE_SIZE);
+	free(Jit);
+}
+
+/* Translates the block starting at Start. The instruction at Start must not be one that RunJit() leaves to the interpreter.
+ */
+translation_scope void* CompileBlock(marie_jit *Jit, const uint16_t *Memory, uint16_t Start) {
+	if (Jit->CodeUsed + JIT_MAX_BLOCK_BYTES > JIT_CODE_SIZE) {
+		FlushJit(Jit);
+		Jit->Flushes++;
+	}
+
+	uint8_t *BlockCode = Jit->Code + Jit->CodeUsed;
+	uint16_t PC = Start;
+	int Length = 0;
+	for (int Ended = FALSE; !Ended;) {
+		const uint16_t Instruction = Memory[PC];
+		const uint16_t X = Instruction & 0xFFF;
+		const uint16_t Next = (PC + 1) & 0xFFF;
+		const int Opcode = Instruction >> 12;
+
+		if (Opcode == 0x5 || Opcode == 0x6 || Opcode == 0x7 || Opcode == 0xF) {
+			// input, output, halt and illegal instructions are left to the interpreter.
+			JitEmitBlockExit(Jit, PC, Length);
+			break;
+		}
+
+		Length++;
+		switch (Opcode) {
+		case 0x0: { // jns
+			JitEmit(Jit, 0x66, 0x41, 0xC7, 0x80); JitEmit32(Jit, X * 2); JitEmit16(Jit, Next); // mov word [r8 + X*2], Next
+			JitEmitStoreCheck(Jit, X, (X + 1) & 0xFFF, Length);
+			JitEmitBlockExit(Jit, (X + 1) & 0xFFF, Length);
+			Ended = TRUE;
+		} break;
+		case 0x1: { // load
+			JitEmit(Jit, 0x45, 0x0F, 0xB7, 0x90); JitEmit32(Jit, X * 2); // movzx r10d, word [r8 + X*2]
+		} break;
+		case 0x2: { // store
+			JitEmit(Jit, 0x66, 0x45, 0x89, 0x90); JitEmit32(Jit, X * 2); // mov [r8 + X*2], r10w
+			JitEmitStoreCheck(Jit, X, Next, Length);
+		} break;
+		case 0x3: { // add
+			JitEmit(Jit, 0x66, 0x45, 0x03, 0x90); JitEmit32(Jit, X * 2); // add r10w, [r8 + X*2]
+		} break;
+		case 0x4: { // subt
+			JitEmit(Jit, 0x66, 0x45, 0x2B, 0x90); JitEmit32(Jit, X * 2); // sub r10w, [r8 + X*2]
+		} break;
+		case 0x8: { // skipcond
+			const int Condition = (X >> 10) & 0x3;
+			const uint8_t CmovOpcode = (Condition == 0) ? 0x4C : (Condition == 1) ? 0x44 : 0x4F; // cmovl, cmove, cmovg
+			JitEmit(Jit, 0x41, 0x0F, 0xBF, 0xCA); // movsx ecx, r10w
+			JitEmit(Jit, 0x85, 0xC9); // test ecx, ecx
+			JitEmit(Jit, 0xB8); JitEmit32(Jit, Next); // mov eax, Next
+			JitEmit(Jit, 0xBA); JitEmit32(Jit, (Next + 1) & 0xFFF); // mov edx, Next + 1
+			JitEmit(Jit, 0x0F, CmovOpcode, 0xC2); // cmovCC eax, edx
+			JitEmitCountInstructions(Jit, Length);
+			JitEmitJmp(Jit, Jit->DispatchStub);
+			Ended = TRUE;
+		} break;
+		case 0x9: { // jump
+			JitEmitBlockExit(Jit, X, Length);
+			Ended = TRUE;
+		} break;
+		case 0xA: { // clear
+			JitEmit(Jit, 0x45, 0x31, 0xD2); // xor r10d, r10d
+		} break;
+		case 0xB: { // addi
+			JitEmitLoadPointer(Jit, X);
+			JitEmit(Jit, 0x66, 0x45, 0x03, 0x14, 0x40); // add r10w, [r8 + rax*2]
+		} break;
+		case 0xC: { // jumpi
+			JitEmitLoadPointer(Jit, X);
+			JitEmitCountInstructions(Jit, Length);
+			JitEmitJmp(Jit, Jit->DispatchStub);
+			Ended = TRUE;
+		} break;
+		case 0xD: { // loadi
+			JitEmitLoadPointer(Jit, X);
+			JitEmit(Jit, 0x45, 0x0F, 0xB7, 0x14, 0x40); // movzx r10d, word [r8 + rax*2]
+		} break;
+		case 0xE: { // storei
+			JitEmitLoadPointer(Jit, X);
+			JitEmit(Jit, 0x66, 0x45, 0x89, 0x14, 0x40); // mov [r8 + rax*2], r10w
+			JitEmitStoreCheck(Jit, -1, Next, Length);
+		} break;
+		}
+
+		// Blocks never wrap around the end of memory, so a block always covers Start to Start + Length - 1.
+		if (!Ended && (Length == JIT_MAX_BLOCK_INSTRUCTIONS || Next == 0)) {
+			JitEmitBlockExit(Jit, Next, Length);
+			Ended = TRUE;
+		}
+		PC = Next;
+	}
+	Assert(Length > 0);
+
+	Jit->State.BlockCode[Start] = BlockCode;
+	Jit->BlockLength[Start] = Length;
+	for (int Index = 0; Index < Length; Index++) {
+		Jit->State.CodeMap[Start + Index]++;
+	}
+	Jit->BlocksCompiled++;
+	return BlockCode;
+}
+
+/* Throws away every block that covers Address.
+ */
+translation_scope void InvalidateJitAddress(marie_jit *Jit, int Address) {
+	for (int Start = Max(0, Address - JIT_MAX_BLOCK_INSTRUCTIONS + 1); Start <= Address; Start++) {
+		if (Jit->State.BlockCode[Start] && Start + Jit->BlockLength[Start] > Address) {
+			for (int Index = 0; Index < Jit->BlockLength[Start]; Index++) {
+				Jit->State.CodeMap[Start + Index]--;
+			}
+			Jit->State.BlockCode[Start] = 0;
+			Jit->BlockLength[Start] = 0;
+		}
+	}
+	Jit->Invalidations++;
+}
+
+translation_scope void RunJit(marie_jit *Jit, marie_machine *Machine) {
+	jit_state *State = &Jit->State;
+	FlushJit(Jit); // Blocks from an earlier run were compiled from a different memory image.
+	State->Memory = Machine->Memory;
+
+	while (Machine->Status == SIM_Running) {
+		const uint64_t Budget = Machine->InstructionBudget;
+		if (Budget && Machine->InstructionCount >= Budget) {
+			Machine->Status = SIM_BudgetExhausted;
+			break;
+		}
+
+		const int Opcode = Machine->Memory[Machine->PC] >> 12;
+		const int NearBudget = Budget && Budget - Machine->InstructionCount < JIT_MAX_BLOCK_INSTRUCTIONS;
+		if (Opcode == 0x5 || Opcode == 0x6 || Opcode == 0x7 || Opcode == 0xF || NearBudget) {
+			// Single steps keep the budget exact, since a block could run past it.
+			const int StoreAddress = MachineStoreAddress(Machine);
+			StepMachine(Machine);
+			if (StoreAddress != -1 && State->CodeMap[StoreAddress]) {
+				InvalidateJitAddress(Jit, StoreAddress);
+			}
+			continue;
+		}
+
+		void *Block = State->BlockCode[Machine->PC];
+		if (Block == 0) {
+			Block = CompileBlock(Jit, Machine->Memory, Machine->PC);
+		}
+
+		State->AC = Machine->AC;
+		State->InstructionCount = Machine->InstructionCount;
+		State->DirtyPages = Machine->DirtyPages;
+		State->ChainLimit = Budget ? Budget - JIT_MAX_BLOCK_INSTRUCTIONS : UINT64_MAX;
+		State->InvalidateAddress = -1;
+		Machine->PC = Jit->Enter(State, Block);
+		Machine->AC = State->AC;
+		Machine->InstructionCount = State->InstructionCount;
+		Machine->DirtyPages = State->DirtyPages;
+
+		if (State->InvalidateAddress != -1) {
+			InvalidateJitAddress(Jit, State->InvalidateAddress);
+		}
+	}
+}
+
+#else
+
+translation_scope marie_jit* CreateJit() {
+	return 0;
+}
+
+translation_scope void FreeJit(marie_jit *Jit) {
+}
+
+translation_scope void RunJit(marie_jit *Jit, marie_machine *Machine) {
+	RunInterpreter(Machine);
+}
+
+#endif
+
+//-----
+//~ Front end
+
+/* Writes the instruction's mnemonic and operand into Text, naming the operand after its .Ident if it has one.
+ */
+translation_scope void FormatInstruction(const assembler_context *Context, uint16_t Instruction, char *Text, int TextSize) {
+	const symbol_index *Symbols = &Context->Symbols;
+	const uint16_t Opcode = Instruction & 0xF000;
+	const uint16_t X = Instruction & 0xFFF;
+	const char *Mnemonic = 0;
+	for (int Index = 0; Index < ArraySize(Keywords); Index++) {
+		if (Keywords[Index].Opcode == Opcode) {
+			Mnemonic = Keywords[Index].String;
+			break;
+		}
+	}
+
+	if (Mnemonic == 0) {
+		snprintf(Text, TextSize, "0x%04X", Instruction);
+	}
+	else if (Opcode == Keywords[KW_Input].Opcode || Opcode == Keywords[KW_Output].Opcode ||
+	         Opcode == Keywords[KW_Halt].Opcode || Opcode == Keywords[KW_Clear].Opcode) {
+		snprintf(Text, TextSize, "%s", Mnemonic);
+	}
+	else if (Opcode == Keywords[KW_Skipcond].Opcode) {
+		const char *Condition = (X == 0x000) ? "lesser" : (X == 0x400) ? "equal" : (X == 0xC00) ? "greater" : 0;
+		if (Condition) { snprintf(Text, TextSize, "%s %s", Mnemonic, Condition); }
+		else { snprintf(Text, TextSize, "%s 0x%03X", Mnemonic, X); }
+	}
+	else if (Symbols->AddressToSource[X] != -1) {
+		const int SourceIndex = Symbols->AddressToSource[X];
+		snprintf(Text, TextSize, "%s %.*s", Mnemonic, Symbols->Sources.ByteCounts[SourceIndex], Symbols->Sources.Names[SourceIndex]);
+	}
+	else {
+		snprintf(Text, TextSize, "%s 0x%03X", Mnemonic, X);
+	}
+}
+
+translation_scope void PrintMachineState(const marie_machine *Machine, const char *Name) {
+	printf("[%s] %s at PC 0x%03X after %llu instructions. AC = 0x%04X (%d)\n", Name, SimulationStatusNames[Machine->Status], Machine->PC, (unsigned long long)Machine->InstructionCount, Machine->AC, (int16_t)Machine->AC);
+}
+
+translation_scope int MachinesMatch(const marie_machine *A, const marie_machine *B) {
+	return A->Status == B->Status && A->PC == B->PC && A->AC == B->AC &&
+	       A->InstructionCount == B->InstructionCount &&
+	       memcmp(A->Memory, B->Memory, sizeof(A->Memory)) == 0 &&
+	       A->OutputCount == B->OutputCount &&
+	       memcmp(A->Output, B->Output, A->OutputCount * sizeof(*A->Output)) == 0;
+}
+
+/* Runs Program with both the interpreter and the JIT, checks that they agree, and reports how long each took.
+ */
+translation_scope int BenchmarkSimulators(const uint16_t *Program, FILE *InputValues) {
+	int Success = TRUE;
+
+	// Both runs need the same input, so read it all up front.
+	uint16_t *Input = 0;
+	int InputCount = 0, InputCapacity = 0;
+	uint16_t Value = 0;
+	while (InputValues && ReadInputValue(InputValues, &Value)) {
+		if (InputCount == InputCapacity) {
+			InputCapacity = Max(64, InputCapacity * 2);
+			Input = realloc(Input, InputCapacity * sizeof(*Input));
+		}
+		Input[InputCount++] = Value;
+	}
+
+	marie_machine *Interpreted = calloc(1, sizeof(marie_machine));
+	ResetMachine(Interpreted, Program);
+	Interpreted->Input = Input;
+	Interpreted->InputCount = InputCount;
+	double Start = Platform_GetSeconds();
+	RunInterpreter(Interpreted);
+	const double InterpreterSeconds = Platform_GetSeconds() - Start;
+	PrintMachineState(Interpreted, "Interpreter");
+	printf("[Interpreter] %.3f seconds, %.1f million instructions per second\n", InterpreterSeconds, Interpreted->InstructionCount / InterpreterSeconds / 1e6);
+
+	marie_jit *Jit = CreateJit();
+	if (Jit == 0) {
+		printf("[JIT] This host can't run the JIT, only the interpreter was benchmarked.\n");
+	}
+	else {
+		marie_machine *Compiled = calloc(1, sizeof(marie_machine));
+		ResetMachine(Compiled, Program);
+		Compiled->Input = Input;
+		Compiled->InputCount = InputCount;
+		Start = Platform_GetSeconds();
+		RunJit(Jit, Compiled);
+		const double JitSeconds = Platform_GetSeconds() - Start;
+		PrintMachineState(Compiled, "JIT");
+		printf("[JIT] %.3f seconds, %.1f million instructions per second. %llu blocks compiled, %llu invalidated by stores, %llu flushes\n", JitSeconds, Compiled->InstructionCount / JitSeconds / 1e6, (unsigned long long)Jit->BlocksCompiled, (unsigned long long)Jit->Invalidations, (unsigned long long)Jit->Flushes);
+
+		if (MachinesMatch(Interpreted, Compiled)) {
+			printf("[Benchmark] The JIT was %.1fx as fast as the interpreter.\n", InterpreterSeconds / JitSeconds);
+		}
+		else {
+			printf("[Benchmark] The interpreter and the JIT disagree about how this program ran! Please report this as a bug.\n");
+			Success = FALSE;
+		}
+		free(Compiled->Output);
+		free(Compiled);
+		FreeJit(Jit);
+	}
+
+	free(Interpreted->Output);
+	free(Interpreted);
+	free(Input);
+	return Success;
+}
+
+int SimulatorMain(FILE *InFile, int InFileSize, const char *InFileName, FILE *InputValues, FILE *OutProfile, FILE *OutFoldedStacks, FILE *OutTrace, int SimulatorFlags, int DiagnosticFormat) {
+	int Success = TRUE;
+	assembler_context *Context = CreateAssemblerContext();
+	Context->SourcePath = InFileName;
+	char *Source = LoadFileIntoMemory(InFile, InFileSize, &Success);
+	if (Success) {
+		Success = AssembleSource(Context, Source);
+		OutputDiagnostics(Context, InFileName, DiagnosticFormat, stdout);
+	}
+	else if (Source) { free(Source); }
+
+	if (Success && (SimulatorFlags & SIMULATE_Optimize)) {
+		OptimizeProgram(Context);
+	}
+	if (Success && (SimulatorFlags & SIMULATE_PackData)) {
+		PackLiteralPool(Context);
+	}
+
+	if (Success && (SimulatorFlags & SIMULATE_Benchmark)) {
+		Success = BenchmarkSimulators(Context->Program, InputValues);
+	}
+	else if (Success) {
+		marie_machine *Machine = calloc(1, sizeof(marie_machine));
+		ResetMachine(Machine, Context->Program);
+		Machine->InputStream = InputValues;
+		Machine->OutputStream = stdout;
+		// Only the interpreter can profile.
+		if (OutProfile) { Machine->Profile = calloc(1, sizeof(machine_profile)); }
+		if (OutFoldedStacks) { Machine->CallStacks = CreateCallStackProfile(); }
+		if (OutTrace) {
+			Machine->Trace = StartTrace(Context->Program, OutTrace);
+			Success = Machine->Trace != 0;
+		}
+
+		// If the trace couldn't start StartTrace() has said so, and the program isn't run at all.
+		if (Success) {
+			marie_jit *Jit = ((SimulatorFlags & SIMULATE_Interpret) || OutProfile || OutFoldedStacks || OutTrace) ? 0 : CreateJit();
+			if (Jit) {
+				RunJit(Jit, Machine);
+				FreeJit(Jit);
+			}
+			else {
+				RunInterpreter(Machine);
+			}
+			PrintMachineState(Machine, "Simulator");
+			Success = Machine->Status == SIM_Halted;
+		}
+		if (Machine->Trace) {
+			printf("[Simulator] Traced %llu instructions.\n", (unsigned long long)Machine->Trace->Records);
+			if (!FinishTrace(Machine->Trace, Machine->Status)) { Success = FALSE; }
+		}
+
+		if (OutProfile) {
+			Context->Profile = Machine->Profile;
+			if (!OutputListing(Context, OutProfile)) { Success = FALSE; }
+			Context->Profile = 0;
+			free(Machine->Profile);
+		}
+		if (OutFoldedStacks) {
+			// The root frame is the program's file name, without its directory or extension.
+			const char *RootName = InFileName;
+			for (const char *At = InFileName; *At; At++) {
+				if (*At == '/' || *At == '\\') { RootName = At + 1; }
+			}
+			const char *Dot = strrchr(RootName, '.');
+			char *Root = calloc(strlen(RootName) + 1, 1);
+			memcpy(Root, RootName, Dot && Dot != RootName ? (size_t)(Dot - RootName) : strlen(RootName));
+
+			if (Machine->CallStacks->DroppedCalls) {
+				printf("[Simulator] %llu calls went deeper than %d frames or past %d distinct call stacks, and were counted toward their caller.\n", (unsigned long long)Machine->CallStacks->DroppedCalls, CALL_STACK_MAX_DEPTH, CALL_STACK_MAX_NODES);
+			}
+			if (!OutputFoldedStacks(Context, Machine->CallStacks, Root, OutFoldedStacks)) { Success = FALSE; }
+			free(Root);
+			FreeCallStackProfile(Machine->CallStacks);
+		}
+
+		free(Machine->Output);
+		free(Machine);
+	}
+
+	FreeAssemblerContext(Context);
+	return Success;
+}
@@ -0,0 +1,221 @@
+/* File: Runs assembled Marie programs, either with a plain interpreter or by translating them to x86-64 machine code.
+ */
+
+#ifndef SIMULATOR_MARIEASSEMBLER_H
+#define SIMULATOR_MARIEASSEMBLER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+# define MARIE_JIT_SUPPORTED 1
+#else
+# define MARIE_JIT_SUPPORTED 0
+#endif
+
+typedef enum {
+	SIM_Running = 0,
+	SIM_Halted,
+	SIM_BudgetExhausted, // Ran InstructionBudget instructions without halting.
+	SIM_InputExhausted, // An input instruction ran out of input values.
+	SIM_IllegalInstruction, // Opcode 0xF, which no instruction uses.
+} simulation_status;
+
+/* Counts of what happened at each address during a profiled run. Each array is indexed by address.
+ * Reads and Writes count the data an instruction touched, not instruction fetches.
+ */
+typedef struct machine_profile {
+	uint64_t Executions[Kilobyte(4)];
+	uint64_t SkipsTaken[Kilobyte(4)]; // Times a skipcond here skipped the next instruction
+	uint64_t Reads[Kilobyte(4)];
+	uint64_t Writes[Kilobyte(4)];
+} machine_profile;
+
+// Deeper calls than this are counted as part of the deepest frame.
+#define CALL_STACK_MAX_DEPTH (256)
+// Distinct call stacks past this many are counted as part of their caller's stack.
+#define CALL_STACK_MAX_NODES (1 << 20)
+
+// One distinct call stack. It is its Parent's stack plus a call to Subroutine.
+typedef struct {
+	int32_t Parent; // -1 for the root, which is the code outside of any subroutine
+	uint16_t Subroutine; // The address jns stored the return address into
+	uint64_t Instructions; // Instructions executed with exactly this stack
+} call_stack_node;
+
+/* Counts instructions per call stack. A jns pushes a frame for the subroutine it calls, and a jumpi through the return address of a frame on the stack returns from it.
+ */
+typedef struct call_stack_profile {
+	call_stack_node *Nodes;
+	int NodeCount, NodeCapacity;
+	int32_t *Slots; // Hash table from a Parent and Subroutine to the node, -1 for empty slots
+	int SlotCapacity;
+	int32_t Stack[CALL_STACK_MAX_DEPTH]; // Stack[Depth - 1] is the node instructions are counted into
+	int Depth;
+	uint64_t DroppedCalls; // Calls that went past CALL_STACK_MAX_DEPTH or CALL_STACK_MAX_NODES
+} call_stack_profile;
+
+translation_scope call_stack_profile* CreateCallStackProfile();
+translation_scope void FreeCallStackProfile(call_stack_profile *CallStacks);
+
+// Bytes of trace the simulator can get ahead of the thread writing it out. Must be a power of 2.
+#define TRACE_RING_SIZE (Megabyte(16))
+
+/* Records every executed instruction into a ring buffer, which a background thread writes to a file. See Trace_MarieAssembler.c for the format.
+ * The simulator is the only writer of Head and the flushing thread the only writer of Tail, so neither needs a lock.
+ */
+typedef struct trace_recorder {
+	uint8_t *Ring;
+	uint64_t Head; // Bytes the simulator has made visible to the flushing thread
+	uint64_t Tail; // Bytes the flushing thread has written to File
+	uint64_t Finished; // Set once the simulator has written its last record
+	FILE *File;
+	void *Thread;
+	void *DataReady; // Signalled by the simulator whenever it publishes, and when it finishes
+	void *SpaceReady; // Signalled by the flushing thread whenever it writes
+	int WriteFailed;
+
+	// Only touched by the simulator
+	uint64_t LocalHead; // Bytes written, including ones not yet published through Head
+	uint64_t CachedTail;
+	uint64_t Limit; // Once LocalHead gets here, the simulator has to publish, and maybe wait for room, before it writes another record
+	uint16_t Program[Kilobyte(4)]; // Instruction words are only recorded when they differ from this
+	uint16_t PC, AC; // From the previous record
+	uint64_t Records;
+} trace_recorder;
+
+// Returns 0 and prints why if the trace couldn't be started.
+translation_scope trace_recorder* StartTrace(const uint16_t *Program, FILE *File);
+// Writes the end of the trace, waits for the flushing thread and closes the file. Returns FALSE if writing failed.
+translation_scope int FinishTrace(trace_recorder *Trace, simulation_status Status);
+// Records one executed instruction. StoreAddress is -1 if it didn't store anything.
+translation_scope force_inline void RecordTraceStep(trace_recorder *Trace, uint16_t PC, uint16_t Instruction, uint16_t AC, int StoreAddress, uint16_t StoreValue);
+
+typedef struct {
+	uint16_t Memory[Kilobyte(4)];
+	uint16_t AC;
+	uint16_t PC; // Always within 0x000 - 0xFFF
+	simulation_status Status;
+	uint64_t InstructionCount;
+	uint64_t InstructionBudget; // 0 for no limit
+	// Bit N is set once anything stores into words N*64 to N*64 + 63. RestoreMachine() only copies these pages back.
+	uint64_t DirtyPages;
+
+	// Values consumed by input instructions, in order. Once these run out, values are read from InputStream if it is set.
+	const uint16_t *Input;
+	int InputCount;
+	int InputAt;
+	FILE *InputStream;
+
+	// Values produced by output instructions, in order.
+	uint16_t *Output;
+	int OutputCount;
+	int OutputCapacity;
+	FILE *OutputStream; // If set, outputs are also printed here as they happen.
+
+	// If either is set, RunInterpreter() counts into it. The JIT and lockstep groups never profile.
+	machine_profile *Profile;
+	call_stack_profile *CallStacks;
+	trace_recorder *Trace;
+} marie_machine;
+
+// Words per page of DirtyPages
+#define MACHINE_PAGE_WORDS (64)
+
+translation_scope void ResetMachine(marie_machine *Machine, const uint16_t *Program);
+translation_scope void RestoreMachine(marie_machine *Machine, const uint16_t *Program);
+translation_scope void StepMachine(marie_machine *Machine);
+translation_scope void RunInterpreter(marie_machine *Machine);
+
+//-----
+//~ JIT
+
+// A block is at most this many Marie instructions, so at most this many blocks can cover any one address.
+#define JIT_MAX_BLOCK_INSTRUCTIONS (64)
+// Worst case bytes of machine code per Marie instruction, with room for the block's exit.
+#define JIT_MAX_INSTRUCTION_BYTES (96)
+#define JIT_CODE_SIZE (Megabyte(1))
+
+/* State shared between the dispatcher and the generated code. Generated code addresses every field relative to r9.
+ */
+typedef struct {
+	void *BlockCode[Kilobyte(4)]; // Machine code of the block starting at each address, or 0
+	uint8_t CodeMap[Kilobyte(4)]; // How many compiled blocks cover each address. Stores to a covered address leave the block.
+	uint16_t *Memory;
+	uint64_t InstructionCount;
+	uint64_t ChainLimit; // Blocks only jump straight to the next block while InstructionCount is below this.
+	uint64_t DirtyPages;
+	int32_t InvalidateAddress; // Set by generated code when it stored into a compiled block, otherwise -1.
+	uint16_t AC;
+} jit_state;
+
+typedef uint16_t (*jit_enter_function)(jit_state *State, void *BlockCode);
+
+typedef struct {
+	uint8_t *Code;
+	size_t CodeUsed;
+	size_t StubsEnd; // Code before this is the entry and dispatch stubs, which survive a flush.
+	jit_enter_function Enter;
+	uint8_t *DispatchStub;
+	uint8_t *ExitStub;
+	uint8_t BlockLength[Kilobyte(4)];
+	jit_state State;
+
+	uint64_t BlocksCompiled;
+	uint64_t Invalidations;
+	uint64_t Flushes; // Times the code buffer filled up and every block was thrown away
+} marie_jit;
+
+// Returns 0 if this host can't run generated code, callers should fall back to RunInterpreter().
+translation_scope marie_jit* CreateJit();
+translation_scope void FreeJit(marie_jit *Jit);
+translation_scope void RunJit(marie_jit *Jit, marie_machine *Machine);
+
+//-----
+//~ Lockstep
+
+// Runs this many copies of a program side by side, one per 16 bit lane of an AVX2 register.
+#define LOCKSTEP_LANES (16)
+
+struct lockstep_group;
+
+/* One build of the loop that runs a group. The loop is built once on AVX2 lane operations and once on plain C ones, with the operations inlined into it, so which one runs is picked once per group instead of once per instruction.
+ */
+typedef struct {
+	const char *Name;
+	void (*Run)(struct lockstep_group *Group);
+} lockstep_engine;
+
+/* Runs up to LOCKSTEP_LANES machines through the same program together, sharing one PC.
+ * Any lane that would go somewhere else, because a skipcond, jumpi or self modifying store sent it elsewhere, leaves the group and finishes in the interpreter.
+ */
+typedef struct lockstep_group {
+	const lockstep_engine *Engine;
+	uint16_t (*Memory)[LOCKSTEP_LANES]; // Memory[Address][Lane], so one address in every lane is one row.
+	uint16_t Program[Kilobyte(4)]; // What Memory was last filled with
+	// Bit N is set once any lane stores into words N*64 to N*64 + 63. Every other page still holds Program in every lane.
+	uint64_t DirtyPages;
+	// Set for each address a store may have left holding different values in different lanes. Only instructions fetched from these are checked for lanes that run something else.
+	uint8_t MayDiffer[Kilobyte(4)];
+	uint16_t AC[LOCKSTEP_LANES];
+	uint16_t PC;
+	uint64_t InstructionCount;
+	uint64_t InstructionBudget; // 0 for no limit
+	uint32_t ActiveLanes; // Bit N is set while lane N is still in the group
+	int ActiveLaneCount;
+	int Leader; // Lowest active lane
+	marie_machine *Lanes[LOCKSTEP_LANES]; // Where each lane's input comes from, and where its final state ends up.
+
+	uint64_t LaneInstructions; // Instructions run in the group, counted once per lane
+	uint64_t Divergences; // Lanes that left the group while still running
+} lockstep_group;
+
+// UseVector picks the AVX2 engine if this host supports it, otherwise the plain C one.
+translation_scope lockstep_group* CreateLockstepGroup(int UseVector);
+translation_scope void FreeLockstepGroup(lockstep_group *Group);
+/* Runs Program on Lanes[0] to Lanes[LaneCount - 1]. Each machine's Input should be set up beforehand.
+ * Afterwards every machine holds exactly the state RunInterpreter() would have left it in.
+ */
+translation_scope void RunLockstep(lockstep_group *Group, const uint16_t *Program, marie_machine **Lanes, int LaneCount);
+
+#endif
@@ -0,0 +1,254 @@
+/* File: Runs one assembled program against many test cases at once, for autograding.
+ * The program is assembled once. Worker threads then take cases off a shared counter, and run each one on their own machine whose memory starts as a copy of the assembled image.
+ * Between cases a worker only copies back the pages of memory the last case stored into, so a case that touches little memory costs little to reset.
+ */
+
+#include "MarieAssembler.h"
+#include "Platform_MarieAssembler.h"
+#include "Simulator_MarieAssembler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Budget for cases that come before any `budget` line in the spec.
+#define TEST_DEFAULT_BUDGET (1000000)
+
+typedef struct {
+	char *Name;
+	int NameLength;
+	int Line;
+	int InputStart, InputCount; // Into test_suite.Values
+	int ExpectedStart, ExpectedCount; // Into test_suite.Values
+	uint64_t Budget;
+
+	// Filled in by the worker that ran the case
+	simulation_status Status;
+	uint64_t InstructionCount;
+	uint16_t *Output;
+	int OutputCount;
+} test_case;
+
+typedef struct {
+	const uint16_t *Program;
+	uint16_t *Values;
+	int ValueCount, ValueCapacity;
+	test_case *Cases;
+	int CaseCount, CaseCapacity;
+	int32_t NextCase; // Workers claim cases with AtomicFetchAdd32()
+} test_suite;
+
+translation_scope void AddTestValue(test_suite *Suite, uint16_t Value) {
+	if (Suite->ValueCount == Suite->ValueCapacity) {
+		Suite->ValueCapacity = Max(256, Suite->ValueCapacity * 2);
+		Suite->Values = realloc(Suite->Values, Suite->ValueCapacity * sizeof(*Suite->Values));
+	}
+	Suite->Values[Suite->ValueCount++] = Value;
+}
+
+translation_scope int IsSpecWhitespace(char Char) {
+	return Char == ' ' || Char == '\t' || Char == '\r' || Char == ',';
+}
+
+/* Parses the values in Line up to End into Suite->Values. Returns the number of values, or -1 if something wasn't a value.
+ */
+translation_scope int ParseTestValues(test_suite *Suite, char *At, char *End, int LineNumber) {
+	int Count = 0;
+	while (At < End) {
+		while (At < End && IsSpecWhitespace(*At)) { At++; }
+		if (At == End) { break; }
+
+		char *TokenStart = At;
+		while (At < End && !IsSpecWhitespace(*At)) { At++; }
+		uint16_t Value = 0;
+		if (!ParseMachineValue(TokenStart, At - TokenStart, &Value)) {
+			printf("[Error L:%d] \"%.*s\" is not a value. Values look like 12, -12, 0d12 or 0xC.\n", LineNumber, (int)(At - TokenStart), TokenStart);
+			return -1;
+		}
+		AddTestValue(Suite, Value);
+		Count++;
+	}
+	return Count;
+}
+
+/* Parses a test spec. Comments start with '/' and last to the end of the line, like in a Marie program.
+ *   budget 5000
+ *   AddsTwoNumbers: 1 2 -> 3
+ * Returns FALSE and prints why if the spec is malformed.
+ */
+translation_scope int ParseTestSpec(test_suite *Suite, char *Spec) {
+	int Success = TRUE;
+	uint64_t Budget = TEST_DEFAULT_BUDGET;
+	int LineNumber = 0;
+
+	for (char *Line = Spec; Line && *Line && Success;) {
+		LineNumber++;
+		char *End = strchr(Line, '\n');
+		char *NextLine = End ? End + 1 : 0;
+		if (End == 0) { End = Line + strlen(Line); }
+		char *Comment = memchr(Line, '/', End - Line);
+		if (Comment) { End = Comment; }
+
+		while (Line < End && IsSpecWhitespace(*Line)) { Line++; }
+		while (End > Line && IsSpecWhitespace(End[-1])) { End--; }
+
+		if (Line == End) {
+			// Blank line
+		}
+		else if (End - Line > 7 && strncmp(Line, "budget", 6) == 0 && IsSpecWhitespace(Line[6])) {
+			char *Number = Line + 7;
+			char *NumberEnd = 0;
+			Budget = strtoull(Number, &NumberEnd, 10);
+			if (NumberEnd != End || Budget == 0) {
+				printf("[Error L:%d] A budget needs to be a whole number of instructions greater than 0.\n", LineNumber);
+				Success = FALSE;
+			}
+		}
+		else {
+			char *Colon = memchr(Line, ':', End - Line);
+			char *Arrow = Colon ? strstr(Colon, "->") : 0;
+			if (Colon == 0 || Arrow == 0 || Arrow >= End) {
+				printf("[Error L:%d] A test case looks like `Name: inputs -> expected outputs`.\n", LineNumber);
+				Success = FALSE;
+				break;
+			}
+
+			if (Suite->CaseCount == Suite->CaseCapacity) {
+				Suite->CaseCapacity = Max(16, Suite->CaseCapacity * 2);
+				Suite->Cases = realloc(Suite->Cases, Suite->CaseCapacity * sizeof(*Suite->Cases));
+			}
+			test_case *Case = &Suite->Cases[Suite->CaseCount++];
+			memset(Case, 0, sizeof(*Case));
+			Case->Name = Line;
+			Case->NameLength = Colon - Line;
+			while (Case->NameLength > 0 && IsSpecWhitespace(Case->Name[Case->NameLength - 1])) { Case->NameLength--; }
+			Case->Line = LineNumber;
+			Case->Budget = Budget;
+
+			Case->InputStart = Suite->ValueCount;
+			Case->InputCount = ParseTestValues(Suite, Colon + 1, Arrow, LineNumber);
+			Case->ExpectedStart = Suite->ValueCount;
+			Case->ExpectedCount = ParseTestValues(Suite, Arrow + 2, End, LineNumber);
+			Success = Case->InputCount != -1 && Case->ExpectedCount != -1;
+		}
+
+		Line = NextLine;
+	}
+
+	return Success;
+}
+
+translation_scope void TestVectorWorker(void *Data) {
+	test_suite *Suite = Data;
+	marie_machine *Machine = calloc(1, sizeof(marie_machine));
+	ResetMachine(Machine, Suite->Program);
+
+	for (;;) {
+		const int CaseIndex = AtomicFetchAdd32(&Suite->NextCase, 1);
+		if (CaseIndex >= Suite->CaseCount) { break; }
+		test_case *Case = &Suite->Cases[CaseIndex];
+
+		RestoreMachine(Machine, Suite->Program);
+		Machine->Input = Suite->Values + Case->InputStart;
+		Machine->InputCount = Case->InputCount;
+		Machine->InstructionBudget = Case->Budget;
+		RunInterpreter(Machine);
+
+		Case->Status = Machine->Status;
+		Case->InstructionCount = Machine->InstructionCount;
+		Case->OutputCount = Machine->OutputCount;
+		Case->Output = malloc(Max(1, Machine->OutputCount) * sizeof(*Case->Output));
+		memcpy(Case->Output, Machine->Output, Machine->OutputCount * sizeof(*Case->Output));
+	}
+
+	free(Machine->Output);
+	free(Machine);
+}
+
+translation_scope void PrintTestValues(const uint16_t *Values, int Count) {
+	if (Count == 0) { printf(" (nothing)"); }
+	for (int Index = 0; Index < Count; Index++) {
+		printf(" %d", (int16_t)Values[Index]);
+	}
+}
+
+int TestVectorMain(FILE *InFile, int InFileSize, const char *InFileName, FILE *SpecFile, int SpecFileSize, int ThreadCount, int SimulatorFlags, int DiagnosticFormat) {
+	int Success = TRUE;
+	assembler_context *Context = CreateAssemblerContext();
+	Context->SourcePath = InFileName;
+	char *Source = LoadFileIntoMemory(InFile, InFileSize, &Success);
+	if (Success) {
+		Success = AssembleSource(Context, Source);
+		OutputDiagnostics(Context, InFileName, DiagnosticFormat, stdout);
+	}
+	else if (Source) { free(Source); }
+
+	if (Success && (SimulatorFlags & SIMULATE_Optimize)) {
+		OptimizeProgram(Context);
+	}
+	if (Success && (SimulatorFlags & SIMULATE_PackData)) {
+		PackLiteralPool(Context);
+	}
+
+	test_suite Suite = {.Program = Context->Program};
+	char *Spec = 0;
+	if (Success) {
+		Spec = LoadFileIntoMemory(SpecFile, SpecFileSize, &Success);
+		Success = Success && ParseTestSpec(&Suite, Spec);
+	}
+	if (Success && Suite.CaseCount == 0) {
+		printf("The test spec doesn't have any test cases in it!\n");
+		Success = FALSE;
+	}
+
+	if (Success) {
+		ThreadCount = Max(1, Min(ThreadCount, Suite.CaseCount));
+		const double Start = Platform_GetSeconds();
+
+		// This thread is a worker too, so a thread that fails to start only slows things down.
+		void **Threads = calloc(ThreadCount, sizeof(void*));
+		for (int Index = 1; Index < ThreadCount; Index++) {
+			Threads[Index] = Platform_CreateThread(TestVectorWorker, &Suite);
+		}
+		TestVectorWorker(&Suite);
+		for (int Index = 1; Index < ThreadCount; Index++) {
+			if (Threads[Index]) { Platform_JoinThread(Threads[Index]); }
+		}
+		free(Threads);
+		const double Seconds = Platform_GetSeconds() - Start;
+
+		int PassCount = 0;
+		uint64_t TotalInstructions = 0;
+		for (int Index = 0; Index < Suite.CaseCount; Index++) {
+			const test_case *Case = &Suite.Cases[Index];
+			const uint16_t *Expected = Suite.Values + Case->ExpectedStart;
+			const int Passed = Case->Status == SIM_Halted && Case->OutputCount == Case->ExpectedCount &&
+			                   memcmp(Case->Output, Expected, Case->OutputCount * sizeof(*Expected)) == 0;
+			PassCount += Passed;
+			TotalInstructions += Case->InstructionCount;
+
+			printf("[%s] %.*s: %llu instructions", Passed ? "PASS" : "FAIL", Case->NameLength, Case->Name, (unsigned long long)Case->InstructionCount);
+			if (Case->Status != SIM_Halted) {
+				printf(". %s", SimulationStatusNames[Case->Status]);
+			}
+			if (!Passed) {
+				printf(". Expected");
+				PrintTestValues(Expected, Case->ExpectedCount);
+				printf(", got");
+				PrintTestValues(Case->Output, Case->OutputCount);
+			}
+			printf("\n");
+		}
+		printf("%d of %d cases passed. %llu instructions on %d thread%s in %.3f seconds.\n", PassCount, Suite.CaseCount, (unsigned long long)TotalInstructions, ThreadCount, ThreadCount == 1 ? "" : "s", Seconds);
+		Success = PassCount == Suite.CaseCount;
+	}
+
+	for (int Index = 0; Index < Suite.CaseCount; Index++) {
+		free(Suite.Cases[Index].Output);
+	}
+	free(Suite.Cases);
+	free(Suite.Values);
+	free(Spec);
+	FreeAssemblerContext(Context);
+	return Success;
+}
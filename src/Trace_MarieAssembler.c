@@ -0,0 +1,327 @@
+/* File: Records every instruction a simulated program executes to a file, and prints those recordings back out.
+ *
+ * A trace file starts with the 8 bytes "MARIETRC", then the 4096 words of the program as it was loaded, low byte first.
+ * Then there is one record per executed instruction, which is usually 1 or 2 bytes:
+ *   Header byte. The low 2 bits say where PC is: TRACE_PC_Next, TRACE_PC_Skip, TRACE_PC_Jump or TRACE_PC_End. The other bits are TRACE_Has* flags.
+ *   TRACE_PC_Jump: PC, 2 bytes low byte first.
+ *   TRACE_HasInstruction: The instruction word, 2 bytes low byte first. Only there when self modifying code changed it from the loaded program.
+ *   TRACE_HasAC: AC after the instruction, as a varint of the zigzagged difference from the last AC.
+ *   TRACE_HasStore: The address stored to as a varint, then the value stored as a varint of its zigzagged difference from AC.
+ * A TRACE_PC_End header ends the trace, followed by one byte of simulation_status.
+ * Varints are 7 bits at a time, lowest first, with the top bit set on every byte but the last.
+ */
+
+#include "MarieAssembler.h"
+#include "Platform_MarieAssembler.h"
+#include "Simulator_MarieAssembler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_MAGIC "MARIETRC"
+
+#define TRACE_PC_Next (0x0) // PC is the last record's PC + 1
+#define TRACE_PC_Skip (0x1) // PC is the last record's PC + 2
+#define TRACE_PC_Jump (0x2) // PC follows
+#define TRACE_PC_End (0x3) // Not an instruction, the trace is over
+#define TRACE_PC_Mask (0x3)
+#define TRACE_HasAC (0x4)
+#define TRACE_HasStore (0x8)
+#define TRACE_HasInstruction (0x10)
+
+// Header, PC, instruction, AC, store address and store value.
+#define TRACE_MAX_RECORD_BYTES (1 + 2 + 2 + 3 + 2 + 3)
+// The simulator only tells the flushing thread about new records this often, so it isn't touching shared memory on every instruction.
+#define TRACE_PUBLISH_BYTES (Kilobyte(64))
+
+translation_scope force_inline uint16_t ZigZag16(uint16_t Value) {
+	return (uint16_t)((Value << 1) ^ ((Value & 0x8000) ? 0xFFFF : 0x0000));
+}
+
+translation_scope inline uint16_t UnZigZag16(uint16_t Value) {
+	return (uint16_t)((Value >> 1) ^ ((Value & 1) ? 0xFFFF : 0x0000));
+}
+
+//-----
+//~ Recording
+
+translation_scope void TraceFlushThread(void *Data) {
+	trace_recorder *Trace = Data;
+	uint64_t Tail = Trace->Tail;
+
+	for (;;) {
+		// Finished has to be read before Head, or records published between the two reads could be missed.
+		const uint64_t Finished = AtomicLoadAcquire64(&Trace->Finished);
+		const uint64_t Head = AtomicLoadAcquire64(&Trace->Head);
+		if (Head == Tail) {
+			if (Finished) { break; }
+			Platform_WaitEvent(Trace->DataReady);
+			continue;
+		}
+
+		const uint64_t Start = Tail & (TRACE_RING_SIZE - 1);
+		const uint64_t Length = Min(Head - Tail, TRACE_RING_SIZE - Start);
+		if (!Trace->WriteFailed && fwrite(Trace->Ring + Start, 1, Length, Trace->File) != Length) {
+			// Keep draining the ring anyway, or the simulator would wait for space forever.
+			Trace->WriteFailed = TRUE;
+		}
+		Tail += Length;
+		AtomicStoreRelease64(&Trace->Tail, Tail);
+		Platform_SignalEvent(Trace->SpaceReady);
+	}
+}
+
+translation_scope trace_recorder* StartTrace(const uint16_t *Program, FILE *File) {
+	trace_recorder *Trace = calloc(1, sizeof(trace_recorder));
+	Trace->Ring = malloc(TRACE_RING_SIZE + TRACE_MAX_RECORD_BYTES); // Room for a record to run past the end, see RecordTraceStep()
+	Trace->File = File;
+	memcpy(Trace->Program, Program, sizeof(Trace->Program));
+	Trace->PC = 0xFFF; // So the first instruction, at 0x000, is TRACE_PC_Next.
+
+	int Success = fwrite(TRACE_MAGIC, 1, 8, File) == 8;
+	for (int Address = 0; Address < Kilobyte(4) && Success; Address++) {
+		const uint8_t Word[2] = {Program[Address] & 0xFF, Program[Address] >> 8};
+		Success = fwrite(Word, 1, 2, File) == 2;
+	}
+	if (Success) {
+		Trace->DataReady = Platform_CreateEvent();
+		Trace->SpaceReady = Platform_CreateEvent();
+		Success = Trace->DataReady && Trace->SpaceReady;
+	}
+	if (Success) {
+		Trace->Thread = Platform_CreateThread(TraceFlushThread, Trace);
+		Success = Trace->Thread != 0;
+	}
+
+	if (!Success) {
+		printf("[Error Trace] The trace couldn't be started!\n");
+		fclose(File);
+		if (Trace->DataReady) { Platform_FreeEvent(Trace->DataReady); }
+		if (Trace->SpaceReady) { Platform_FreeEvent(Trace->SpaceReady); }
+		free(Trace->Ring);
+		free(Trace);
+		return 0;
+	}
+	return Trace;
+}
+
+#define TracePut(Out, Byte) (*(Out)++ = (uint8_t)(Byte))
+
+translation_scope force_inline uint8_t* TracePutVarint(uint8_t *Out, uint32_t Value) {
+	while (Value >= 0x80) {
+		TracePut(Out, Value | 0x80);
+		Value >>= 7;
+	}
+	TracePut(Out, Value);
+	return Out;
+}
+
+/* Called once LocalHead reaches Limit. Hands the records written so far to the flushing thread, waits until the ring has room for another record, then moves Limit to the next point this has to happen.
+ */
+translation_scope void TraceMakeRoom(trace_recorder *Trace) {
+	// The flushing thread can't make room out of records it doesn't know about.
+	AtomicStoreRelease64(&Trace->Head, Trace->LocalHead);
+	Platform_SignalEvent(Trace->DataReady);
+
+	Trace->CachedTail = AtomicLoadAcquire64(&Trace->Tail);
+	while (Trace->LocalHead + TRACE_MAX_RECORD_BYTES - Trace->CachedTail > TRACE_RING_SIZE) {
+		Platform_WaitEvent(Trace->SpaceReady);
+		Trace->CachedTail = AtomicLoadAcquire64(&Trace->Tail);
+	}
+	Trace->Limit = Min(Trace->LocalHead + TRACE_PUBLISH_BYTES, Trace->CachedTail + TRACE_RING_SIZE - TRACE_MAX_RECORD_BYTES);
+}
+
+// Inlined into StepInstruction(), so recording an instruction costs no call.
+translation_scope force_inline void RecordTraceStep(trace_recorder *Trace, uint16_t PC, uint16_t Instruction, uint16_t AC, int StoreAddress, uint16_t StoreValue) {
+	if (Trace->LocalHead >= Trace->Limit) {
+		TraceMakeRoom(Trace);
+	}
+
+	const uint16_t LastPC = Trace->PC;
+	const uint16_t LastAC = Trace->AC;
+	uint8_t Header = TRACE_PC_Jump;
+	if (PC == ((LastPC + 1) & 0xFFF)) { Header = TRACE_PC_Next; }
+	else if (PC == ((LastPC + 2) & 0xFFF)) { Header = TRACE_PC_Skip; }
+	if (Instruction != Trace->Program[PC]) { Header |= TRACE_HasInstruction; }
+	if (AC != LastAC) { Header |= TRACE_HasAC; }
+	if (StoreAddress != -1) { Header |= TRACE_HasStore; }
+
+	// The record is written in one piece, and whatever ran past the end of the ring is copied around to the start afterwards.
+	uint8_t *const Start = Trace->Ring + (Trace->LocalHead & (TRACE_RING_SIZE - 1));
+	uint8_t *Out = Start;
+	TracePut(Out, Header);
+	if ((Header & TRACE_PC_Mask) == TRACE_PC_Jump) {
+		TracePut(Out, PC & 0xFF);
+		TracePut(Out, PC >> 8);
+	}
+	if (Header & TRACE_HasInstruction) {
+		TracePut(Out, Instruction & 0xFF);
+		TracePut(Out, Instruction >> 8);
+	}
+	if (Header & TRACE_HasAC) {
+		Out = TracePutVarint(Out, ZigZag16(AC - LastAC));
+	}
+	if (Header & TRACE_HasStore) {
+		Out = TracePutVarint(Out, StoreAddress);
+		Out = TracePutVarint(Out, ZigZag16(StoreValue - AC));
+	}
+	if (Out > Trace->Ring + TRACE_RING_SIZE) {
+		memcpy(Trace->Ring, Trace->Ring + TRACE_RING_SIZE, Out - (Trace->Ring + TRACE_RING_SIZE));
+	}
+
+	Trace->LocalHead += Out - Start;
+	Trace->PC = PC;
+	Trace->AC = AC;
+	Trace->Records++;
+}
+
+translation_scope int FinishTrace(trace_recorder *Trace, simulation_status Status) {
+	TraceMakeRoom(Trace);
+	Trace->Ring[Trace->LocalHead++ & (TRACE_RING_SIZE - 1)] = TRACE_PC_End;
+	Trace->Ring[Trace->LocalHead++ & (TRACE_RING_SIZE - 1)] = (uint8_t)Status;
+	AtomicStoreRelease64(&Trace->Head, Trace->LocalHead);
+	AtomicStoreRelease64(&Trace->Finished, 1);
+	Platform_SignalEvent(Trace->DataReady);
+	Platform_JoinThread(Trace->Thread);
+	Platform_FreeEvent(Trace->DataReady);
+	Platform_FreeEvent(Trace->SpaceReady);
+
+	int Success = !Trace->WriteFailed;
+	Success = (fclose(Trace->File) == 0) && Success;
+	if (!Success) {
+		printf("[Error Trace] There was a error encountered while writing to the trace file!\n");
+	}
+	free(Trace->Ring);
+	free(Trace);
+	return Success;
+}
+
+//-----
+//~ Decoding
+
+// Returns FALSE at the end of the file.
+translation_scope int TraceGetVarint(FILE *File, uint32_t *Value) {
+	*Value = 0;
+	for (int Shift = 0; Shift < 32; Shift += 7) {
+		const int Byte = getc(File);
+		if (Byte == EOF) { return FALSE; }
+		*Value |= (uint32_t)(Byte & 0x7F) << Shift;
+		if (!(Byte & 0x80)) { return TRUE; }
+	}
+	return FALSE;
+}
+
+translation_scope int TraceGetWord(FILE *File, uint16_t *Value) {
+	const int Low = getc(File);
+	const int High = getc(File);
+	*Value = (uint16_t)(Low | (High << 8));
+	return Low != EOF && High != EOF;
+}
+
+
+int TraceDecodeMain(FILE *InFile, int InFileSize, const char *InFileName, FILE *TraceFile, int DiagnosticFormat) {
+	int Success = TRUE;
+	assembler_context *Context = CreateAssemblerContext();
+	Context->SourcePath = InFileName;
+	char *Source = LoadFileIntoMemory(InFile, InFileSize, &Success);
+	if (Success) {
+		Success = AssembleSource(Context, Source);
+		OutputDiagnostics(Context, InFileName, DiagnosticFormat, stdout);
+	}
+	else if (Source) { free(Source); }
+
+	uint16_t Program[Kilobyte(4)];
+	if (Success) {
+		char Magic[8];
+		Success = fread(Magic, 1, 8, TraceFile) == 8 && memcmp(Magic, TRACE_MAGIC, 8) == 0;
+		for (int Address = 0; Address < Kilobyte(4) && Success; Address++) {
+			Success = TraceGetWord(TraceFile, &Program[Address]);
+		}
+		if (!Success) {
+			printf("[Error Trace] This isn't a trace file!\n");
+		}
+		else if (memcmp(Program, Context->Program, sizeof(Program)) != 0) {
+			printf("[Warning Trace] The trace was recorded from a different program than \"%s\", so the names shown may be wrong.\n", InFileName);
+		}
+	}
+
+	if (Success) {
+		// The closest .Ident at or before each address, so every PC can be shown as Name+Offset.
+		const symbol_index *Symbols = &Context->Symbols;
+		int Label[Kilobyte(4)];
+		for (int Address = 0, Current = -1; Address < Kilobyte(4); Address++) {
+			if (Symbols->AddressToSource[Address] != -1) { Current = Symbols->AddressToSource[Address]; }
+			Label[Address] = Current;
+		}
+
+		uint16_t PC = 0xFFF, AC = 0;
+		uint64_t Count = 0;
+		int Ended = FALSE;
+		for (;;) {
+			const int Header = getc(TraceFile);
+			if (Header == EOF) { break; }
+			if ((Header & TRACE_PC_Mask) == TRACE_PC_End) {
+				const int Status = getc(TraceFile);
+				if (Status >= SIM_Running && Status <= SIM_IllegalInstruction) {
+					printf("Trace ended: %s after %llu instructions.\n", SimulationStatusNames[Status], (unsigned long long)Count);
+					Ended = TRUE;
+				}
+				break;
+			}
+
+			uint16_t Instruction = 0, StoreValue = 0;
+			uint32_t Varint = 0, StoreAddress = 0;
+			int Complete = TRUE;
+			switch (Header & TRACE_PC_Mask) {
+			case TRACE_PC_Next: { PC = (PC + 1) & 0xFFF; } break;
+			case TRACE_PC_Skip: { PC = (PC + 2) & 0xFFF; } break;
+			case TRACE_PC_Jump: { Complete = TraceGetWord(TraceFile, &PC); PC &= 0xFFF; } break;
+			}
+			Instruction = Program[PC];
+			if (Header & TRACE_HasInstruction) { Complete = Complete && TraceGetWord(TraceFile, &Instruction); }
+			if (Header & TRACE_HasAC) {
+				Complete = Complete && TraceGetVarint(TraceFile, &Varint);
+				AC += UnZigZag16((uint16_t)Varint);
+			}
+			if (Header & TRACE_HasStore) {
+				Complete = Complete && TraceGetVarint(TraceFile, &StoreAddress) && TraceGetVarint(TraceFile, &Varint);
+				StoreValue = AC + UnZigZag16((uint16_t)Varint);
+			}
+			if (!Complete) { break; }
+
+			printf("%10llu  0x%03X  ", (unsigned long long)Count, PC);
+			char Text[64];
+			FormatInstruction(Context, Instruction, Text, sizeof(Text));
+			printf("%-24s", Text);
+			printf("  AC = 0x%04X %6d", AC, (int16_t)AC);
+			if (Header & TRACE_HasStore) {
+				printf("  RAM[0x%03X] = 0x%04X", StoreAddress & 0xFFF, StoreValue);
+			}
+			else {
+				printf("%*s", 22, "");
+			}
+			int Line = 0;
+			const int HasLine = LookupSourceLocation(Context, PC, &Line, 0, 0);
+			if (Label[PC] != -1 || HasLine) { printf("  ;"); }
+			if (Label[PC] != -1) {
+				const int LabelByteCount = Symbols->Sources.ByteCounts[Label[PC]];
+				const char *LabelName = Symbols->Sources.Names[Label[PC]];
+				const int Offset = PC - Symbols->Sources.Addresses[Label[PC]];
+				if (Offset) { printf(" %.*s+%d", LabelByteCount, LabelName, Offset); }
+				else { printf(" %.*s", LabelByteCount, LabelName); }
+			}
+			if (HasLine) { printf(" (L:%d)", Line); }
+			printf("\n");
+			Count++;
+		}
+
+		if (!Ended) {
+			printf("[Warning Trace] The trace stops after %llu instructions without an ending, the program was probably still running when it was cut off.\n", (unsigned long long)Count);
+		}
+	}
+
+	fclose(TraceFile);
+	FreeAssemblerContext(Context);
+	return Success;
+}
@@ -3,6 +3,7 @@
  * File: This file contains all platform specific code for Linux.
  */
 
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <errno.h>
@@ -10,6 +11,15 @@
 #include <string.h>
 #include <signal.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "Platform_MarieAssembler.h"
 
@@ -17,9 +27,120 @@ void Platform_Breakpoint() {
 	raise(SIGINT);
 }
 
+void* Platform_AllocateExecutableMemory(size_t Size) {
+	void *Result = mmap(0, Size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return (Result == MAP_FAILED) ? 0 : Result;
+}
+
+void Platform_FreeExecutableMemory(void *Memory, size_t Size) {
+	munmap(Memory, Size);
+}
+
+double Platform_GetSeconds() {
+	struct timespec Time;
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+	return Time.tv_sec + Time.tv_nsec / 1e9;
+}
+
+typedef struct {
+	pthread_t Handle;
+	platform_thread_proc Proc;
+	void *Data;
+} linux_thread;
+
+translation_scope void* LinuxThreadProc(void *Data) {
+	linux_thread *Thread = Data;
+	Thread->Proc(Thread->Data);
+	return 0;
+}
+
+void* Platform_CreateThread(platform_thread_proc Proc, void *Data) {
+	linux_thread *Thread = calloc(1, sizeof(linux_thread));
+	Thread->Proc = Proc;
+	Thread->Data = Data;
+	if (pthread_create(&Thread->Handle, 0, LinuxThreadProc, Thread) != 0) {
+		free(Thread);
+		return 0;
+	}
+	return Thread;
+}
+
+void Platform_JoinThread(void *Thread) {
+	pthread_join(((linux_thread*)Thread)->Handle, 0);
+	free(Thread);
+}
+
+int Platform_GetProcessorCount() {
+	long Count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (Count < 1) ? 1 : (int)Count;
+}
+
+typedef struct {
+	pthread_mutex_t Mutex;
+	pthread_cond_t Condition;
+	int Set;
+} linux_event;
+
+void* Platform_CreateEvent() {
+	linux_event *Event = calloc(1, sizeof(linux_event));
+	if (pthread_mutex_init(&Event->Mutex, 0) != 0) {
+		free(Event);
+		return 0;
+	}
+	if (pthread_cond_init(&Event->Condition, 0) != 0) {
+		pthread_mutex_destroy(&Event->Mutex);
+		free(Event);
+		return 0;
+	}
+	return Event;
+}
+
+void Platform_SignalEvent(void *Event) {
+	linux_event *LinuxEvent = Event;
+	pthread_mutex_lock(&LinuxEvent->Mutex);
+	LinuxEvent->Set = TRUE;
+	pthread_cond_signal(&LinuxEvent->Condition);
+	pthread_mutex_unlock(&LinuxEvent->Mutex);
+}
+
+void Platform_WaitEvent(void *Event) {
+	linux_event *LinuxEvent = Event;
+	pthread_mutex_lock(&LinuxEvent->Mutex);
+	while (!LinuxEvent->Set) { pthread_cond_wait(&LinuxEvent->Condition, &LinuxEvent->Mutex); }
+	LinuxEvent->Set = FALSE;
+	pthread_mutex_unlock(&LinuxEvent->Mutex);
+}
+
+void Platform_FreeEvent(void *Event) {
+	linux_event *LinuxEvent = Event;
+	pthread_cond_destroy(&LinuxEvent->Condition);
+	pthread_mutex_destroy(&LinuxEvent->Mutex);
+	free(LinuxEvent);
+}
+
+int Platform_GetFileInfo(const char *Path, uint64_t *ModifiedTime, uint64_t *FileId) {
+	struct stat Info;
+	if (stat(Path, &Info) == -1) { return FALSE; }
+	*ModifiedTime = (uint64_t)Info.st_mtim.tv_sec * 1000000000 + Info.st_mtim.tv_nsec;
+	*FileId = ((uint64_t)Info.st_dev << 48) ^ (uint64_t)Info.st_ino;
+	return TRUE;
+}
+
+// An input file named "-" is stdin, so a program can be piped straight into the assembler.
+int IsStdinPath(const char *FileName) {
+	return strcmp(FileName, "-") == 0;
+}
+
+FILE *OpenInputFile(char *FileName) {
+	return IsStdinPath(FileName) ? stdin : fopen(FileName, "rb");
+}
+
+// Returns 0 for stdin and pipes, whose size isn't known until they have been read.
 size_t GetFileSize(char *FileName, int *Success) {
 	struct stat fInfo;
 
+	if (IsStdinPath(FileName)) { return 0; }
+
 	if(stat(FileName, &fInfo) == -1) {
 		fprintf(stderr, "Error getting file info for file: %s\n%s\n", FileName, strerror(errno));
 		*Success = FALSE;
@@ -29,7 +150,8 @@ size_t GetFileSize(char *FileName, int *Success) {
 		fprintf(stderr, "Error opening file: %s\n%s\n", FileName, strerror(errno));
 		*Success = FALSE;
 	}
-	return (size_t)fInfo.st_size;
+	else { fclose(FileHandle); }
+	return S_ISREG(fInfo.st_mode) ? (size_t)fInfo.st_size : 0;
 }
 
 int IndexOfFromEnd(char *String, char Target) {
@@ -54,6 +176,7 @@ int StartsWith(char *String, char *Target) {
 }
 
 char* GenerateOutputPath(char *InFileName, char *PostFix) {
+	if (IsStdinPath(InFileName)) { InFileName = "stdin"; }
 	int DotIndex = IndexOfFromEnd(InFileName, '.');
 	int PathSeperatorIndex = IndexOfFromEnd(InFileName, '/');
 	if (DotIndex < PathSeperatorIndex || DotIndex == -1) {
@@ -70,22 +193,982 @@ char* GenerateOutputPath(char *InFileName, char *PostFix) {
 	return AutoFileName;
 }
 
+// Removes every output that was opened, after whatever was writing them failed. Only regular files are removed, so an output sent to something like /dev/stdout is left alone.
+translation_scope void RemoveOutputFiles(char **Paths, int Count) {
+	for (int Index = 0; Index < Count; Index++) {
+		struct stat Info;
+		if (Paths[Index] && stat(Paths[Index], &Info) == 0 && S_ISREG(Info.st_mode)) { remove(Paths[Index]); }
+	}
+}
+
 translation_scope inline void PrintHelp(char *ApplicationName) {
 	const char* HelpMessage =
 		"Usage: %s <InFileName> [Output Options]\n"
+		"<InFileName> may be - to read the program from stdin, then outputs left blank are named stdin.<extension>\n"
 		"Where [Output Options] can be any combination of:\n"
 		"  --logisim [FileName] ==> Outputs Logisim rom image at [FileName], or if blank <InFileName>.LogisimImage\n"
 		"  --rawhex [FileName] ==> Outputs a file containing the raw hex for the program at [FileName], or if blank <InFileName>.hex\n"
 		"  --symboltable [FileName] ==> Outputs a file containing a symbol table for the program at [FileName], or if blank <InFileName>.sym\n"
-		"  --listing [FileName] ==> Outputs a file containing a listing for the program at [FileName], or if blank <InFileName>.lst\n";
+		"  --listing [FileName] ==> Outputs a file containing a listing for the program at [FileName], or if blank <InFileName>.lst\n"
+		"  --cfg [FileName] ==> Outputs the program's control flow graph as Graphviz DOT at [FileName], or if blank <InFileName>.dot. The listing, if any, also marks where each basic block starts and which instructions can never run\n"
+		"  --cfg-json [FileName] ==> Outputs the program's control flow graph as JSON at [FileName], or if blank <InFileName>.cfg.json\n"
+		"  --sourcemap [FileName] ==> Outputs a file mapping each address of the program back to the line, column and byte of the source that produced it at [FileName], or if blank <InFileName>.srcmap\n"
+		"  --optimize ==> Rewrites store X/load X and clear/add X pairs and chains of jumps before writing outputs or simulating, and reports how many instructions and cycles that saved\n"
+		"  --pack-data ==> Merges data words holding the same constant that are only read by load, add and subt, closes the gaps they leave, and reports how many words were reclaimed\n"
+		"  --object [FileName] ==> Assembles the program into a relocatable object at [FileName], or if blank <InFileName>.mobj, instead of writing the other outputs. Everything before the first .SetAddr is placed by the linker\n"
+		"  --link ==> Every input file is an object written by --object. They are placed and linked together into one program, which the other output options are written from. Default output names come from the first object\n"
+		"  --lsp ==> Run as a Language Server Protocol server over stdin and stdout. Takes no input file\n"
+		"  --watch ==> Keep running, and reassemble whenever the input changes. <InFileName> may be a directory, in which case every .MarieAsm file in it is watched. Files pulled in with .Include are watched too, wherever they are\n"
+		"  --batch ==> Every input file is assembled on its own, and its outputs are written under auto-generated names. Output file names can't be given\n"
+		"  --archive [FileName] ==> <InFileName> is an uncompressed tar. Every .MarieAsm file in it is assembled on its own, and its outputs and diagnostics, named after it, are written into one tar at [FileName], or if blank <InFileName>.out.tar. Output file names can't be given\n"
+		"  --simulate [FileName] ==> Runs the program instead of writing outputs. Input instructions read numbers from [FileName], or if blank from stdin\n"
+		"  --interpret ==> Simulate with the interpreter instead of the JIT\n"
+		"  --benchmark ==> Simulate with both the interpreter and the JIT, check that they agree, and compare how fast they are. Input only comes from the --simulate file\n"
+		"  --testvectors <FileName> ==> Runs the program once for every test case in <FileName> and reports which ones passed. Each line of <FileName> looks like `Name: inputs -> expected outputs`, and `budget N` lines limit how many instructions the cases after them may run\n"
+		"  --threads <Count> ==> How many threads --testvectors uses. Defaults to one per processor\n"
+		"  --profile [FileName] ==> Simulates the program in the interpreter, then writes a listing with how often each address was executed, skipped from, read and written at [FileName], or if blank <InFileName>.profile.lst. It ends with the blocks that ran the most\n"
+		"  --flamegraph [FileName] ==> Simulates the program in the interpreter, following jns calls and jumpi returns, then writes how many instructions ran under each call stack at [FileName], or if blank <InFileName>.folded. This is the folded format flamegraph.pl and speedscope read\n"
+		"  --trace [FileName] ==> Simulates the program in the interpreter and records every instruction it executes at [FileName], or if blank <InFileName>.trace\n"
+		"  --decode-trace <FileName> ==> Prints the trace recorded at <FileName> one instruction per line, using <InFileName> to name addresses\n"
+		"  --disassemble [FileName] ==> <InFileName> is a program image written by --rawhex or --logisim. Writes it back out as MarieAsm source at [FileName], or if blank <InFileName>.dis.MarieAsm, with a label for every address that is jumped to or used as data\n"
+		"  --diff <FileName> ==> <InFileName> and <FileName> are program images written by --rawhex or --logisim, in either format. Prints each range of addresses where they differ, disassembled. Exits with 0 if they are the same, 1 if they differ and 2 if either can't be read\n"
+		"  --symbols <FileName> ==> Names the labels --disassemble writes, and the addresses --diff prints, after the identifiers in the symbol table at <FileName>, written by --symboltable\n"
+		"  --fuzz <Count> ==> Runs the program <Count> times with random inputs, both in the interpreter and 16 runs at a time in lockstep, and reports how the runs ended and how fast each way was\n"
+		"  --diagnostics [text|json] ==> How errors and warnings are printed. json prints one JSON object per line. Defaults to text\n";
 
 	printf(HelpMessage, ApplicationName);
 }
 
+//-----
+//~ Batched file output
+
+/* Writing each output with fopen/fwrite/fclose costs at least three syscalls a file, and with tens of thousands of small outputs that is what the time goes to.
+ * WriteFiles() takes outputs that are already rendered into memory and hands the opens, writes and closes for a whole batch of them to the kernel at once through io_uring.
+ * When io_uring isn't available, such as on older kernels or in a sandbox that blocks it, every file is written with open/pwrite/close instead.
+ */
+typedef struct {
+	const char *Path;
+	const void *Data;
+	size_t Size;
+	int Error; // Set by WriteFiles(), 0 if the file was written, otherwise an errno value.
+} file_write;
+
+// How many files are opened at once. Each one needs a write and a close in flight after it is opened.
+#define OUTPUT_RING_FILES (128)
+// Larger writes are split by the kernel anyway, so they go through pwrite().
+#define OUTPUT_RING_MAX_WRITE (Megabyte(512))
+
+#define OUTPUT_OPEN_FLAGS (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC)
+
+typedef struct {
+	int Fd;
+	unsigned *SqHead, *SqTail, *SqMask, *SqArray;
+	unsigned *CqHead, *CqTail, *CqMask;
+	struct io_uring_sqe *Sqes;
+	struct io_uring_cqe *Cqes;
+} output_ring;
+
+global_var output_ring OutputRing;
+global_var int OutputRingState; // 0 until we first try to set up the ring, then 1 if it is ready or -1 if it isn't available.
+
+translation_scope int WriteFilePortable(file_write *Write) {
+	int Fd = open(Write->Path, OUTPUT_OPEN_FLAGS, 0666);
+	if (Fd == -1) { return errno; }
+
+	int Error = 0;
+	const char *At = Write->Data;
+	size_t Offset = 0;
+	while (Offset < Write->Size) {
+		ssize_t Written = pwrite(Fd, At + Offset, Write->Size - Offset, Offset);
+		if (Written == -1 && errno == EINTR) { continue; }
+		if (Written <= 0) {
+			Error = (Written == -1) ? errno : EIO;
+			break;
+		}
+		Offset += Written;
+	}
+	if (close(Fd) == -1 && Error == 0) { Error = errno; }
+	return Error;
+}
+
+translation_scope int SetUpOutputRing(output_ring *Ring) {
+	struct io_uring_params Params = {0};
+	Ring->Fd = syscall(__NR_io_uring_setup, OUTPUT_RING_FILES * 2, &Params);
+	if (Ring->Fd < 0) { return FALSE; }
+
+	size_t SqRingSize = Params.sq_off.array + Params.sq_entries * sizeof(unsigned);
+	size_t CqRingSize = Params.cq_off.cqes + Params.cq_entries * sizeof(struct io_uring_cqe);
+	int SingleMap = (Params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (SingleMap) {
+		if (CqRingSize > SqRingSize) { SqRingSize = CqRingSize; }
+		CqRingSize = SqRingSize;
+	}
+
+	char *SqRing = mmap(0, SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Ring->Fd, IORING_OFF_SQ_RING);
+	char *CqRing = SingleMap ? SqRing : mmap(0, CqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Ring->Fd, IORING_OFF_CQ_RING);
+	void *Sqes = mmap(0, Params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Ring->Fd, IORING_OFF_SQES);
+	if (SqRing == MAP_FAILED || CqRing == MAP_FAILED || Sqes == MAP_FAILED) {
+		// The process is about to fall back to pwrite for good, so whatever did get mapped is left for exit to clean up.
+		close(Ring->Fd);
+		return FALSE;
+	}
+
+	Ring->SqHead = (unsigned*)(SqRing + Params.sq_off.head);
+	Ring->SqTail = (unsigned*)(SqRing + Params.sq_off.tail);
+	Ring->SqMask = (unsigned*)(SqRing + Params.sq_off.ring_mask);
+	Ring->SqArray = (unsigned*)(SqRing + Params.sq_off.array);
+	Ring->CqHead = (unsigned*)(CqRing + Params.cq_off.head);
+	Ring->CqTail = (unsigned*)(CqRing + Params.cq_off.tail);
+	Ring->CqMask = (unsigned*)(CqRing + Params.cq_off.ring_mask);
+	Ring->Cqes = (struct io_uring_cqe*)(CqRing + Params.cq_off.cqes);
+	Ring->Sqes = Sqes;
+	return TRUE;
+}
+
+// Returns the next free submission entry, cleared. It is handed to the kernel by SubmitOutputRing().
+translation_scope struct io_uring_sqe* GetOutputRingEntry(output_ring *Ring, unsigned *Tail) {
+	unsigned Index = *Tail & *Ring->SqMask;
+	(*Tail)++;
+	struct io_uring_sqe *Entry = &Ring->Sqes[Index];
+	memset(Entry, 0, sizeof(*Entry));
+	Ring->SqArray[Index] = Index;
+	return Entry;
+}
+
+/* Submits every entry up to Tail and waits for Count completions, storing each one's result at Results[user_data].
+ * Returns FALSE if the kernel refused to take the entries, in which case the ring shouldn't be used again.
+ */
+translation_scope int SubmitOutputRing(output_ring *Ring, unsigned Tail, unsigned Count, int *Results) {
+	unsigned ToSubmit = Tail - *Ring->SqTail;
+	__atomic_store_n(Ring->SqTail, Tail, __ATOMIC_RELEASE);
+
+	unsigned Completed = 0;
+	while (Completed < Count) {
+		int Result = syscall(__NR_io_uring_enter, Ring->Fd, ToSubmit, 1, IORING_ENTER_GETEVENTS, 0, 0);
+		if (Result == -1 && errno == EINTR) { continue; }
+		if (Result == -1) { return FALSE; }
+		ToSubmit -= ((unsigned)Result < ToSubmit) ? (unsigned)Result : ToSubmit;
+
+		unsigned Head = *Ring->CqHead;
+		unsigned CqTail = __atomic_load_n(Ring->CqTail, __ATOMIC_ACQUIRE);
+		for (; Head != CqTail; Head++) {
+			struct io_uring_cqe *Cqe = &Ring->Cqes[Head & *Ring->CqMask];
+			Results[Cqe->user_data] = Cqe->res;
+			Completed++;
+		}
+		__atomic_store_n(Ring->CqHead, Head, __ATOMIC_RELEASE);
+	}
+	return TRUE;
+}
+
+/* Writes up to OUTPUT_RING_FILES files through the ring, in two rounds of submissions: every open, then a write linked to a close for each file that opened.
+ * Linking the open to its write would need the kernel to hand the new descriptor straight to the write, which only direct descriptors do, so the opens are waited on first.
+ * Returns FALSE if the ring stopped working, in which case the caller writes the whole batch again without it.
+ */
+translation_scope int WriteFilesThroughRing(output_ring *Ring, file_write *Writes, int Count) {
+	int Fds[OUTPUT_RING_FILES];
+	int Results[OUTPUT_RING_FILES * 2];
+
+	unsigned Tail = *Ring->SqTail;
+	for (int Index = 0; Index < Count; Index++) {
+		struct io_uring_sqe *Entry = GetOutputRingEntry(Ring, &Tail);
+		Entry->opcode = IORING_OP_OPENAT;
+		Entry->fd = AT_FDCWD;
+		Entry->addr = (uint64_t)(uintptr_t)Writes[Index].Path;
+		Entry->len = 0666;
+		Entry->open_flags = OUTPUT_OPEN_FLAGS;
+		Entry->user_data = Index;
+	}
+	if (!SubmitOutputRing(Ring, Tail, Count, Fds)) { return FALSE; }
+
+	int OpenCount = 0;
+	for (int Index = 0; Index < Count; Index++) {
+		if (Fds[Index] == -EINVAL) {
+			// The kernel is too old to know IORING_OP_OPENAT.
+			for (int CloseIndex = 0; CloseIndex < Count; CloseIndex++) {
+				if (Fds[CloseIndex] >= 0) { close(Fds[CloseIndex]); }
+			}
+			return FALSE;
+		}
+	}
+	for (int Index = 0; Index < Count; Index++) {
+		if (Fds[Index] < 0) {
+			Writes[Index].Error = -Fds[Index];
+			continue;
+		}
+
+		struct io_uring_sqe *Entry = GetOutputRingEntry(Ring, &Tail);
+		Entry->opcode = IORING_OP_WRITE;
+		Entry->fd = Fds[Index];
+		Entry->addr = (uint64_t)(uintptr_t)Writes[Index].Data;
+		Entry->len = (uint32_t)Writes[Index].Size;
+		Entry->off = 0;
+		// A hard link closes the file even if the write fails.
+		Entry->flags = IOSQE_IO_HARDLINK;
+		Entry->user_data = Index * 2;
+
+		Entry = GetOutputRingEntry(Ring, &Tail);
+		Entry->opcode = IORING_OP_CLOSE;
+		Entry->fd = Fds[Index];
+		Entry->user_data = Index * 2 + 1;
+		OpenCount++;
+	}
+	if (OpenCount && !SubmitOutputRing(Ring, Tail, OpenCount * 2, Results)) { return FALSE; }
+
+	for (int Index = 0; Index < Count; Index++) {
+		if (Fds[Index] < 0) { continue; }
+		int Written = Results[Index * 2], Closed = Results[Index * 2 + 1];
+		if (Written >= 0 && (size_t)Written < Writes[Index].Size) {
+			// Short writes are rare enough on regular files to just start that file over.
+			Writes[Index].Error = WriteFilePortable(&Writes[Index]);
+		}
+		else if (Written < 0) { Writes[Index].Error = -Written; }
+		else if (Closed < 0) { Writes[Index].Error = -Closed; }
+		else { Writes[Index].Error = 0; }
+	}
+	return TRUE;
+}
+
+/* Creates or truncates each Writes[N].Path and writes its Data to it, setting Writes[N].Error.
+ * The Data must stay alive until this returns. Returns the number of files that could not be written.
+ */
+translation_scope int WriteFiles(file_write *Writes, int Count) {
+	if (OutputRingState == 0) {
+		OutputRingState = SetUpOutputRing(&OutputRing) ? 1 : -1;
+	}
+
+	int FailedCount = 0;
+	for (int First = 0; First < Count; First += OUTPUT_RING_FILES) {
+		int BatchCount = (Count - First < OUTPUT_RING_FILES) ? Count - First : OUTPUT_RING_FILES;
+		file_write *Batch = Writes + First;
+
+		int UseRing = (OutputRingState == 1);
+		for (int Index = 0; Index < BatchCount && UseRing; Index++) {
+			UseRing = Batch[Index].Size <= OUTPUT_RING_MAX_WRITE;
+		}
+		if (UseRing && !WriteFilesThroughRing(&OutputRing, Batch, BatchCount)) {
+			OutputRingState = -1;
+			UseRing = FALSE;
+		}
+		for (int Index = 0; Index < BatchCount; Index++) {
+			if (!UseRing) { Batch[Index].Error = WriteFilePortable(&Batch[Index]); }
+			if (Batch[Index].Error) { FailedCount++; }
+		}
+	}
+	return FailedCount;
+}
+
+//~ Watch mode
+
+enum output_kind {
+	OUT_Logisim = 0,
+	OUT_RawHex,
+	OUT_SymbolTable,
+	OUT_Listing,
+	OUT_SourceMap,
+	OUT_CfgDot,
+	OUT_CfgJson,
+	// Keep this at the end, used for iterating though all output kinds.
+	OUT_COUNT,
+};
+
+typedef int (*output_writer)(const struct assembler_context *Context, FILE *FileStream);
+
+typedef struct {
+	char *Name;
+	char *PostFix;
+	output_writer Writer;
+} output_kind_info;
+
+global_var const output_kind_info OutputKinds[OUT_COUNT] = {
+	[OUT_Logisim] = {.Name = "Logisim image", .PostFix = ".LogisimImage", .Writer = OutputLogisimImage},
+	[OUT_RawHex] = {.Name = "raw hex", .PostFix = ".hex", .Writer = OutputRawHex},
+	[OUT_SymbolTable] = {.Name = "symbol table", .PostFix = ".sym", .Writer = OutputSymbolTable},
+	[OUT_Listing] = {.Name = "listing", .PostFix = ".lst", .Writer = OutputListing},
+	[OUT_SourceMap] = {.Name = "source map", .PostFix = ".srcmap", .Writer = OutputSourceMap},
+	[OUT_CfgDot] = {.Name = "control flow graph", .PostFix = ".dot", .Writer = OutputControlFlowDot},
+	[OUT_CfgJson] = {.Name = "control flow graph", .PostFix = ".cfg.json", .Writer = OutputControlFlowJson},
+};
+
+// How long the input has to stay quiet before we reassemble. Editors tend to write a file in several bursts.
+#define WATCH_DEBOUNCE_MS (100)
+
+typedef struct {
+	char *SourcePath;
+	char *OutputPaths[OUT_COUNT];
+	uint64_t OutputHashes[OUT_COUNT];
+	int HasOutputHash[OUT_COUNT];
+	int Dirty;
+	// Every file the last assembly of SourcePath pulled in with .Include, so that a change to one of them reassembles it too.
+	char **IncludePaths;
+	int IncludeCount;
+} watched_source;
+
+// A directory watched because a watched source includes a file in it.
+typedef struct {
+	char *Path; // Up to and including the last '/', empty for the working directory
+	int Descriptor;
+} watched_directory;
+
+translation_scope uint64_t HashBytes(const void *Data, size_t Size) {
+	// 64 bit FNV-1a
+	const uint8_t *Bytes = Data;
+	uint64_t Result = 0xcbf29ce484222325ull;
+	for (size_t Index = 0; Index < Size; Index++) {
+		Result ^= Bytes[Index];
+		Result *= 0x100000001b3ull;
+	}
+	return Result;
+}
+
+/* Hashes the file at Path, so that the first reassembly in watch mode doesn't rewrite outputs that are already up to date.
+ * Returns FALSE if the file could not be read.
+ */
+translation_scope int HashExistingFile(char *Path, uint64_t *Hash) {
+	int Success = FALSE;
+	FILE *FileHandle = fopen(Path, "rb");
+	if (FileHandle) {
+		char *Buffer = 0;
+		size_t Size = 0;
+		FILE *Memory = open_memstream(&Buffer, &Size);
+		char Chunk[Kilobyte(16)];
+		size_t ReadCount = 0;
+		while ((ReadCount = fread(Chunk, 1, sizeof(Chunk), FileHandle)) != 0) {
+			fwrite(Chunk, 1, ReadCount, Memory);
+		}
+		Success = !ferror(FileHandle);
+		fclose(Memory);
+		fclose(FileHandle);
+		*Hash = HashBytes(Buffer, Size);
+		free(Buffer);
+	}
+	return Success;
+}
+
+translation_scope int HasExtension(char *FileName, char *Extension) {
+	int DotIndex = IndexOfFromEnd(FileName, '.');
+	return (DotIndex != -1) && (strcasecmp(FileName + DotIndex, Extension) == 0);
+}
+
+translation_scope void AddWatchedSource(watched_source **Sources, int *SourceCount, char *SourcePath, char *ExplicitOutputPaths[OUT_COUNT], int GenerateOutputs[OUT_COUNT]) {
+	*Sources = realloc(*Sources, (*SourceCount + 1) * sizeof(watched_source));
+	watched_source *Source = &(*Sources)[*SourceCount];
+	(*SourceCount)++;
+
+	memset(Source, 0, sizeof(*Source));
+	Source->SourcePath = strdup(SourcePath);
+	Source->Dirty = TRUE;
+	for (int Kind = 0; Kind < OUT_COUNT; Kind++) {
+		if (ExplicitOutputPaths && ExplicitOutputPaths[Kind]) {
+			Source->OutputPaths[Kind] = strdup(ExplicitOutputPaths[Kind]);
+		}
+		else if (GenerateOutputs[Kind]) {
+			Source->OutputPaths[Kind] = GenerateOutputPath(SourcePath, OutputKinds[Kind].PostFix);
+		}
+
+		if (Source->OutputPaths[Kind]) {
+			Source->HasOutputHash[Kind] = HashExistingFile(Source->OutputPaths[Kind], &Source->OutputHashes[Kind]);
+		}
+	}
+}
+
+/* Remembers the files the last assembly in Context included, replacing what was remembered for Source before.
+ */
+translation_scope void RememberIncludes(struct assembler_context *Context, watched_source *Source) {
+	for (int Index = 0; Index < Source->IncludeCount; Index++) {
+		free(Source->IncludePaths[Index]);
+	}
+	Source->IncludeCount = 0;
+	const char *Path = 0;
+	while ((Path = GetIncludedPath(Context, Source->IncludeCount)) != 0) {
+		Source->IncludePaths = realloc(Source->IncludePaths, (Source->IncludeCount + 1) * sizeof(char*));
+		Source->IncludePaths[Source->IncludeCount++] = strdup(Path);
+	}
+}
+
+/* Reassembles one source with the shared Context, and writes each output only if its contents changed since the last time it was written.
+ * Everything it has to say is left in stdout's buffer, see ReassembleWatchedSource().
+ */
+translation_scope void AssembleWatchedSource(struct assembler_context *Context, watched_source *Source, int DiagnosticFormat, int AssemblerFlags) {
+	int Success = TRUE;
+	FILE *InFile = fopen(Source->SourcePath, "rb");
+	if (InFile == 0) {
+		// The file may have been deleted or renamed away, just wait for the next change.
+		fprintf(stderr, "[Watch] I could not open \"%s\" for reading!\n", Source->SourcePath);
+		return;
+	}
+
+	size_t InFileSize = GetFileSize(Source->SourcePath, &Success);
+	char *Text = LoadFileIntoMemory(InFile, InFileSize, &Success);
+	if (Success) {
+		Context->SourcePath = Source->SourcePath;
+		Success = AssembleSource(Context, Text);
+		RememberIncludes(Context, Source);
+		OutputDiagnostics(Context, Source->SourcePath, DiagnosticFormat, stdout);
+	}
+	else if (Text) { free(Text); }
+
+	if (!Success) {
+		printf("[Watch] \"%s\" failed to assemble, outputs were left untouched.\n", Source->SourcePath);
+		return;
+	}
+	if (AssemblerFlags & ASSEMBLE_Optimize) {
+		OptimizeProgram(Context);
+	}
+	if (AssemblerFlags & ASSEMBLE_PackData) {
+		PackLiteralPool(Context);
+	}
+
+	char *Rendered[OUT_COUNT] = {0};
+	size_t RenderedSize[OUT_COUNT] = {0};
+	for (int Kind = 0; Kind < OUT_COUNT && Success; Kind++) {
+		if (Source->OutputPaths[Kind]) {
+			FILE *Memory = open_memstream(&Rendered[Kind], &RenderedSize[Kind]);
+			Success = (Memory != 0) && OutputKinds[Kind].Writer(Context, Memory);
+		}
+	}
+
+	file_write Writes[OUT_COUNT];
+	int WriteKinds[OUT_COUNT];
+	uint64_t Hashes[OUT_COUNT];
+	int WriteCount = 0, UnchangedCount = 0;
+	for (int Kind = 0; Kind < OUT_COUNT && Success; Kind++) {
+		if (Source->OutputPaths[Kind] == 0) { continue; }
+
+		Hashes[Kind] = HashBytes(Rendered[Kind], RenderedSize[Kind]);
+		if (Source->HasOutputHash[Kind] && Source->OutputHashes[Kind] == Hashes[Kind]) {
+			UnchangedCount++;
+			continue;
+		}
+		Writes[WriteCount] = (file_write){.Path = Source->OutputPaths[Kind], .Data = Rendered[Kind], .Size = RenderedSize[Kind]};
+		WriteKinds[WriteCount++] = Kind;
+	}
+
+	int WrittenCount = WriteCount - WriteFiles(Writes, WriteCount);
+	for (int Index = 0; Index < WriteCount; Index++) {
+		int Kind = WriteKinds[Index];
+		if (Writes[Index].Error == 0) {
+			Source->OutputHashes[Kind] = Hashes[Kind];
+			Source->HasOutputHash[Kind] = TRUE;
+		}
+		else {
+			// Forget the hash so the next reassembly tries again.
+			Source->HasOutputHash[Kind] = FALSE;
+			fprintf(stderr, "[Watch] I could not write the %s output file \"%s\"!\n%s\n", OutputKinds[Kind].Name, Source->OutputPaths[Kind], strerror(Writes[Index].Error));
+		}
+	}
+
+	for (int Kind = 0; Kind < OUT_COUNT; Kind++) {
+		if (Rendered[Kind]) { free(Rendered[Kind]); }
+	}
+
+	if (Success) {
+		printf("[Watch] Assembled \"%s\": %d output(s) written, %d unchanged.\n", Source->SourcePath, WrittenCount, UnchangedCount);
+	}
+}
+
+/* AssembleWatchedSource(), then flushes stdout however it went, so that whoever is watching the output sees each reassembly as it happens.
+ */
+translation_scope void ReassembleWatchedSource(struct assembler_context *Context, watched_source *Source, int DiagnosticFormat, int AssemblerFlags) {
+	AssembleWatchedSource(Context, Source, DiagnosticFormat, AssemblerFlags);
+	fflush(stdout);
+}
+
+/* Watches the directory of every file a watched source includes, and stops watching the directories nothing includes from any more.
+ * Called after every round of reassembly, since an edit can add or drop an .Include. SourceWatch is the watch on the sources' own directory, which is never removed.
+ */
+translation_scope void RefreshIncludeWatches(int Notify, int SourceWatch, watched_source *Sources, int SourceCount, watched_directory **Directories, int *DirectoryCount) {
+	watched_directory *Refreshed = 0;
+	int RefreshedCount = 0;
+	for (int SourceIndex = 0; SourceIndex < SourceCount; SourceIndex++) {
+		for (int IncludeIndex = 0; IncludeIndex < Sources[SourceIndex].IncludeCount; IncludeIndex++) {
+			char *IncludePath = Sources[SourceIndex].IncludePaths[IncludeIndex];
+			char *Path = strndup(IncludePath, IndexOfFromEnd(IncludePath, '/') + 1);
+			int Found = FALSE;
+			for (int Index = 0; Index < RefreshedCount && !Found; Index++) {
+				Found = strcmp(Refreshed[Index].Path, Path) == 0;
+			}
+			if (Found) {
+				free(Path);
+				continue;
+			}
+
+			int Descriptor = -1;
+			for (int Index = 0; Index < *DirectoryCount && Descriptor == -1; Index++) {
+				if (strcmp((*Directories)[Index].Path, Path) == 0) { Descriptor = (*Directories)[Index].Descriptor; }
+			}
+			if (Descriptor == -1) {
+				Descriptor = inotify_add_watch(Notify, (Path[0] != 0) ? Path : ".", IN_CLOSE_WRITE | IN_MOVED_TO);
+			}
+			if (Descriptor == -1) {
+				fprintf(stderr, "[Watch] I could not watch \"%s\" for changes to \"%s\"!\n%s\n", (Path[0] != 0) ? Path : ".", IncludePath, strerror(errno));
+				free(Path);
+				continue;
+			}
+			Refreshed = realloc(Refreshed, (RefreshedCount + 1) * sizeof(watched_directory));
+			Refreshed[RefreshedCount++] = (watched_directory){.Path = Path, .Descriptor = Descriptor};
+		}
+	}
+
+	for (int Index = 0; Index < *DirectoryCount; Index++) {
+		// Two paths to one directory share a descriptor, so it is only removed once neither is needed.
+		const int Descriptor = (*Directories)[Index].Descriptor;
+		int StillWatched = (Descriptor == SourceWatch);
+		for (int RefreshedIndex = 0; RefreshedIndex < RefreshedCount && !StillWatched; RefreshedIndex++) {
+			StillWatched = Refreshed[RefreshedIndex].Descriptor == Descriptor;
+		}
+		if (!StillWatched) { inotify_rm_watch(Notify, Descriptor); }
+		free((*Directories)[Index].Path);
+	}
+	free(*Directories);
+	*Directories = Refreshed;
+	*DirectoryCount = RefreshedCount;
+}
+
+/* Runs forever, reassembling InPath whenever it changes.
+ * InPath may name a single source file, or a directory in which case every .MarieAsm file in the directory is watched, and outputs are always given auto-generated names.
+ * Returns FALSE if watching could not be started.
+ */
+translation_scope int WatchMain(char *InPath, char *OutputPaths[OUT_COUNT], int GenerateOutputs[OUT_COUNT], int DiagnosticFormat, int AssemblerFlags) {
+	struct stat InInfo;
+	if (stat(InPath, &InInfo) == -1) {
+		fprintf(stderr, "Error getting file info for file: %s\n%s\n", InPath, strerror(errno));
+		return FALSE;
+	}
+	int IsDirectory = S_ISDIR(InInfo.st_mode);
+
+	int AnyOutputs = FALSE;
+	for (int Kind = 0; Kind < OUT_COUNT; Kind++) {
+		AnyOutputs |= (OutputPaths[Kind] != 0) || GenerateOutputs[Kind];
+		if (IsDirectory && OutputPaths[Kind]) {
+			fprintf(stderr, "Output file names cannot be given when watching a directory, leave the file name blank to auto-generate one per source.\n");
+			return FALSE;
+		}
+	}
+	if (!AnyOutputs) {
+		printf("Warning: No outputs were were requested. No output files are being generated.\n");
+		return FALSE;
+	}
+
+	char *WatchDirectory = 0;
+	char *WatchFileName = 0; // Only set when watching a single file.
+	if (IsDirectory) {
+		WatchDirectory = strdup(InPath);
+	}
+	else {
+		int PathSeperatorIndex = IndexOfFromEnd(InPath, '/');
+		if (PathSeperatorIndex == -1) {
+			WatchDirectory = strdup(".");
+			WatchFileName = InPath;
+		}
+		else {
+			WatchDirectory = strndup(InPath, PathSeperatorIndex + 1);
+			WatchFileName = InPath + PathSeperatorIndex + 1;
+		}
+	}
+
+	// We watch the directory even for a single file, since many editors save by writing a new file and renaming it over the old one.
+	int Notify = inotify_init1(IN_CLOEXEC);
+	int SourceWatch = (Notify == -1) ? -1 : inotify_add_watch(Notify, WatchDirectory, IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (SourceWatch == -1) {
+		fprintf(stderr, "I could not watch \"%s\" for changes!\n%s\n", WatchDirectory, strerror(errno));
+		free(WatchDirectory);
+		return FALSE;
+	}
+
+	watched_source *Sources = 0;
+	int SourceCount = 0;
+	if (IsDirectory) {
+		DIR *Directory = opendir(WatchDirectory);
+		struct dirent *Entry = 0;
+		while (Directory && (Entry = readdir(Directory))) {
+			if (HasExtension(Entry->d_name, ".MarieAsm")) {
+				char *SourcePath = 0;
+				asprintf(&SourcePath, "%s/%s", WatchDirectory, Entry->d_name);
+				AddWatchedSource(&Sources, &SourceCount, SourcePath, 0, GenerateOutputs);
+				free(SourcePath);
+			}
+		}
+		if (Directory) { closedir(Directory); }
+	}
+	else {
+		AddWatchedSource(&Sources, &SourceCount, InPath, OutputPaths, GenerateOutputs);
+	}
+
+	printf("[Watch] Watching \"%s\". Press Ctrl+C to stop.\n", InPath);
+
+	struct assembler_context *Context = CreateAssemblerContext();
+	// The directories of included files, which may lie outside WatchDirectory.
+	watched_directory *IncludeDirectories = 0;
+	int IncludeDirectoryCount = 0;
+	char EventBuffer[Kilobyte(4)] __attribute__((aligned(__alignof__(struct inotify_event))));
+	for (;;) {
+		int AnyReassembled = FALSE;
+		for (int Index = 0; Index < SourceCount; Index++) {
+			if (Sources[Index].Dirty) {
+				Sources[Index].Dirty = FALSE;
+				ReassembleWatchedSource(Context, &Sources[Index], DiagnosticFormat, AssemblerFlags);
+				AnyReassembled = TRUE;
+			}
+		}
+		if (AnyReassembled) {
+			RefreshIncludeWatches(Notify, SourceWatch, Sources, SourceCount, &IncludeDirectories, &IncludeDirectoryCount);
+		}
+
+		// Block until something happens, then keep draining events until the directory has been quiet for WATCH_DEBOUNCE_MS.
+		int Timeout = -1;
+		for (;;) {
+			struct pollfd PollInfo = {.fd = Notify, .events = POLLIN};
+			int Ready = poll(&PollInfo, 1, Timeout);
+			if (Ready == -1 && errno == EINTR) { continue; }
+			if (Ready <= 0) { break; }
+
+			ssize_t Length = read(Notify, EventBuffer, sizeof(EventBuffer));
+			if (Length <= 0) { break; }
+
+			for (char *At = EventBuffer; At < EventBuffer + Length;) {
+				struct inotify_event *Event = (struct inotify_event*)At;
+				At += sizeof(struct inotify_event) + Event->len;
+				if (Event->len == 0) { continue; }
+
+				for (int DirectoryIndex = 0; DirectoryIndex < IncludeDirectoryCount; DirectoryIndex++) {
+					if (IncludeDirectories[DirectoryIndex].Descriptor != Event->wd) { continue; }
+					char *ChangedPath = 0;
+					asprintf(&ChangedPath, "%s%s", IncludeDirectories[DirectoryIndex].Path, Event->name);
+					for (int Index = 0; Index < SourceCount; Index++) {
+						for (int IncludeIndex = 0; IncludeIndex < Sources[Index].IncludeCount; IncludeIndex++) {
+							if (strcmp(Sources[Index].IncludePaths[IncludeIndex], ChangedPath) == 0) { Sources[Index].Dirty = TRUE; }
+						}
+					}
+					free(ChangedPath);
+				}
+
+				if (Event->wd != SourceWatch) { continue; }
+				if (IsDirectory) {
+					if (!HasExtension(Event->name, ".MarieAsm")) { continue; }
+
+					char *SourcePath = 0;
+					asprintf(&SourcePath, "%s/%s", WatchDirectory, Event->name);
+					int Found = FALSE;
+					for (int Index = 0; Index < SourceCount; Index++) {
+						if (strcmp(Sources[Index].SourcePath, SourcePath) == 0) {
+							Sources[Index].Dirty = TRUE;
+							Found = TRUE;
+						}
+					}
+					if (!Found) {
+						AddWatchedSource(&Sources, &SourceCount, SourcePath, 0, GenerateOutputs);
+					}
+					free(SourcePath);
+				}
+				else if (strcmp(Event->name, WatchFileName) == 0) {
+					Sources[0].Dirty = TRUE;
+				}
+			}
+			Timeout = WATCH_DEBOUNCE_MS;
+		}
+	}
+
+	// We never get here, Ctrl+C ends the process.
+	for (int Index = 0; Index < IncludeDirectoryCount; Index++) {
+		free(IncludeDirectories[Index].Path);
+	}
+	free(IncludeDirectories);
+	FreeAssemblerContext(Context);
+	close(Notify);
+	free(WatchDirectory);
+	return TRUE;
+}
+
+/* Writes out, then frees, every output queued by BatchMain(). Returns the number of outputs that could not be written.
+ */
+translation_scope int FlushBatchOutputs(file_write *Pending, int *PendingCount) {
+	int FailedCount = WriteFiles(Pending, *PendingCount);
+	for (int Index = 0; Index < *PendingCount; Index++) {
+		if (Pending[Index].Error) {
+			fprintf(stderr, "[Batch] I could not write the output file \"%s\"!\n%s\n", Pending[Index].Path, strerror(Pending[Index].Error));
+		}
+		free((void*)Pending[Index].Path);
+		free((void*)Pending[Index].Data);
+	}
+	*PendingCount = 0;
+	return FailedCount;
+}
+
+/* Assembles each of InFileNames on its own, as if the assembler had been run once per file, and writes its outputs under auto-generated names.
+ * The outputs are rendered into memory and queued, then written OUTPUT_RING_FILES at a time by WriteFiles(), so assembling a whole folder of submissions isn't held back by opening and closing files one by one.
+ * A file that fails to assemble gets no outputs. Returns FALSE if any file failed to assemble or any output could not be written.
+ */
+translation_scope int BatchMain(char **InFileNames, int InFileCount, int GenerateOutputs[OUT_COUNT], int DiagnosticFormat, int AssemblerFlags) {
+	int AnyOutputs = FALSE;
+	for (int Kind = 0; Kind < OUT_COUNT; Kind++) { AnyOutputs |= GenerateOutputs[Kind]; }
+	if (!AnyOutputs) {
+		printf("Warning: No outputs were were requested. No output files are being generated.\n");
+		return FALSE;
+	}
+
+	struct assembler_context *Context = CreateAssemblerContext();
+	// A file's outputs are only queued once all of them rendered, so there is always room for one more file's worth.
+	file_write *Pending = calloc(OUTPUT_RING_FILES + OUT_COUNT, sizeof(file_write));
+	int PendingCount = 0;
+	int AssembledCount = 0, OutputCount = 0, FailedOutputCount = 0;
+
+	for (int FileIndex = 0; FileIndex < InFileCount; FileIndex++) {
+		char *InFileName = InFileNames[FileIndex];
+		FILE *InFile = OpenInputFile(InFileName);
+		if (InFile == 0) {
+			fprintf(stderr, "I could not open the input file \"%s\" for reading!\n", InFileName);
+			continue;
+		}
+
+		int Success = TRUE;
+		size_t InFileSize = GetFileSize(InFileName, &Success);
+		char *Text = LoadFileIntoMemory(InFile, InFileSize, &Success);
+		if (Success) {
+			Context->SourcePath = InFileName;
+			Success = AssembleSource(Context, Text);
+			OutputDiagnostics(Context, InFileName, DiagnosticFormat, stdout);
+		}
+		else if (Text) { free(Text); }
+		if (!Success) { continue; }
+
+		if (AssemblerFlags & ASSEMBLE_Optimize) {
+			OptimizeProgram(Context);
+		}
+		if (AssemblerFlags & ASSEMBLE_PackData) {
+			PackLiteralPool(Context);
+		}
+
+		if (GenerateOutputs[OUT_CfgDot] || GenerateOutputs[OUT_CfgJson]) {
+			// Analyzed once for every output, and the listing shows the blocks too.
+			Context->Cfg = AnalyzeControlFlow(Context);
+		}
+
+		file_write *Outputs = Pending + PendingCount;
+		int RenderedCount = 0;
+		for (int Kind = 0; Kind < OUT_COUNT && Success; Kind++) {
+			if (!GenerateOutputs[Kind]) { continue; }
+
+			char *Data = 0;
+			size_t Size = 0;
+			FILE *Memory = open_memstream(&Data, &Size);
+			Success = (Memory != 0) && OutputKinds[Kind].Writer(Context, Memory);
+			Outputs[RenderedCount++] = (file_write){.Path = GenerateOutputPath(InFileName, OutputKinds[Kind].PostFix), .Data = Data, .Size = Size};
+		}
+		FreeControlFlowGraph(Context->Cfg);
+		Context->Cfg = 0;
+		if (!Success) {
+			for (int Index = 0; Index < RenderedCount; Index++) {
+				free((void*)Outputs[Index].Path);
+				free((void*)Outputs[Index].Data);
+			}
+			continue;
+		}
+
+		AssembledCount++;
+		OutputCount += RenderedCount;
+		PendingCount += RenderedCount;
+		if (PendingCount >= OUTPUT_RING_FILES) {
+			FailedOutputCount += FlushBatchOutputs(Pending, &PendingCount);
+		}
+	}
+	FailedOutputCount += FlushBatchOutputs(Pending, &PendingCount);
+
+	printf("[Batch] Assembled %d of %d file(s), %d output(s) written.\n", AssembledCount, InFileCount, OutputCount - FailedOutputCount);
+	free(Pending);
+	FreeAssemblerContext(Context);
+	return (AssembledCount == InFileCount) && (FailedOutputCount == 0);
+}
+
+/* Maps the file at Path, or reads it if it can't be mapped, like a pipe. The byte after the end is always there, zero and writable, so text at the very end can be null terminated in place.
+ * Every page is private, so writing to it never reaches the file. Free it with FreeArchiveBytes(). Returns 0 if the file couldn't be read.
+ */
+translation_scope char *LoadArchiveBytes(char *Path, size_t *Size, size_t *MappedSize) {
+	char *Result = 0;
+	*Size = 0;
+	*MappedSize = 0;
+	const int File = IsStdinPath(Path) ? STDIN_FILENO : open(Path, O_RDONLY);
+	if (File == -1) { return 0; }
+
+	struct stat Info;
+	if (fstat(File, &Info) == 0 && S_ISREG(Info.st_mode) && Info.st_size > 0) {
+		// Reserve an extra page, then map the file over the front of it.
+		const size_t PageSize = sysconf(_SC_PAGESIZE);
+		const size_t Reserved = (Info.st_size / PageSize + 1) * PageSize;
+		void *Base = mmap(0, Reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (Base != MAP_FAILED && mmap(Base, Info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, File, 0) != MAP_FAILED) {
+			madvise(Base, Info.st_size, MADV_SEQUENTIAL);
+			Result = Base;
+			*Size = Info.st_size;
+			*MappedSize = Reserved;
+		}
+		else if (Base != MAP_FAILED) {
+			munmap(Base, Reserved);
+		}
+	}
+	if (Result == 0) {
+		size_t Length = 0, Capacity = Kilobyte(64);
+		char *Buffer = malloc(Capacity);
+		ssize_t ReadCount;
+		while ((ReadCount = read(File, Buffer + Length, Capacity - Length - 1)) > 0) {
+			Length += ReadCount;
+			if (Capacity - Length - 1 == 0) {
+				Capacity *= 2;
+				Buffer = realloc(Buffer, Capacity);
+			}
+		}
+		if (ReadCount == 0) {
+			Buffer[Length] = 0;
+			Result = Buffer;
+			*Size = Length;
+		}
+		else {
+			free(Buffer);
+		}
+	}
+	if (File != STDIN_FILENO) { close(File); }
+	return Result;
+}
+
+translation_scope void FreeArchiveBytes(char *Bytes, size_t MappedSize) {
+	if (MappedSize) { munmap(Bytes, MappedSize); }
+	else { free(Bytes); }
+}
+
+/* Assembles every .MarieAsm file in the uncompressed tar at ArchivePath on its own, like BatchMain(), and writes each one's requested outputs and its diagnostics, as <Name>.log, into one tar at OutPath.
+ * The archive is mapped rather than read, and UTF-8 members are assembled where they lie in it, so however many programs it holds there is one file to open for input and one for output.
+ * A member that fails to assemble only gets its log. Returns FALSE if the archive couldn't be read, any member failed to assemble, or the output couldn't be written, in which case OutPath is removed.
+ */
+translation_scope int ArchiveMain(char *ArchivePath, char *OutPath, int GenerateOutputs[OUT_COUNT], int DiagnosticFormat, int AssemblerFlags) {
+	size_t ArchiveSize = 0, MappedSize = 0;
+	char *Archive = LoadArchiveBytes(ArchivePath, &ArchiveSize, &MappedSize);
+	if (Archive == 0) {
+		fprintf(stderr, "I could not read the archive \"%s\"!\n%s\n", ArchivePath, strerror(errno));
+		return FALSE;
+	}
+	archive_member *Members = 0;
+	int MemberCount = 0;
+	if (!ReadTarArchive(Archive, ArchiveSize, &Members, &MemberCount)) {
+		FreeArchiveBytes(Archive, MappedSize);
+		return FALSE;
+	}
+
+	FILE *Out = fopen(OutPath, "wb");
+	if (Out == 0) {
+		fprintf(stderr, "I could not open the output archive \"%s\" for writing!\n", OutPath);
+		FreeArchiveMembers(Members, MemberCount);
+		FreeArchiveBytes(Archive, MappedSize);
+		return FALSE;
+	}
+	setvbuf(Out, 0, _IOFBF, Megabyte(1));
+
+	struct assembler_context *Context = CreateAssemblerContext();
+	int SourceCount = 0, AssembledCount = 0, OutputCount = 0;
+	int WriteSuccess = TRUE;
+	for (int MemberIndex = 0; MemberIndex < MemberCount && WriteSuccess; MemberIndex++) {
+		const archive_member *Member = &Members[MemberIndex];
+		if (!HasExtension(Member->Name, ".MarieAsm")) { continue; }
+		SourceCount++;
+
+		int Success = TRUE, Copied = FALSE;
+		char *Text = DecodeTextInPlace(Member->Data, Member->Size, &Copied, &Success);
+		char *Log = 0;
+		size_t LogSize = 0;
+		FILE *LogStream = open_memstream(&Log, &LogSize);
+		if (Success) {
+			Context->SourcePath = Member->Name;
+			Success = Copied ? AssembleSource(Context, Text) : AssembleSourceInPlace(Context, Text);
+			OutputDiagnostics(Context, Member->Name, DiagnosticFormat, LogStream);
+		}
+		else {
+			fprintf(LogStream, "[Error File Handling] \"%s\" could not be read as UTF-8 or UTF-16 text.\n", Member->Name);
+		}
+
+		if (Success) {
+			if (AssemblerFlags & ASSEMBLE_Optimize) {
+				OptimizeProgram(Context);
+			}
+			if (AssemblerFlags & ASSEMBLE_PackData) {
+				PackLiteralPool(Context);
+			}
+			if (GenerateOutputs[OUT_CfgDot] || GenerateOutputs[OUT_CfgJson]) {
+				// Analyzed once for every output, and the listing shows the blocks too.
+				Context->Cfg = AnalyzeControlFlow(Context);
+			}
+		}
+
+		// Every output is rendered before any is written, so a member whose output fails gets none of them, like in BatchMain().
+		file_write Outputs[OUT_COUNT];
+		int RenderedCount = 0;
+		for (int Kind = 0; Kind < OUT_COUNT && Success; Kind++) {
+			if (!GenerateOutputs[Kind]) { continue; }
+
+			char *Data = 0;
+			size_t Size = 0;
+			FILE *Memory = open_memstream(&Data, &Size);
+			Success = (Memory != 0) && OutputKinds[Kind].Writer(Context, Memory);
+			Outputs[RenderedCount++] = (file_write){.Path = GenerateOutputPath(Member->Name, OutputKinds[Kind].PostFix), .Data = Data, .Size = Size};
+		}
+		FreeControlFlowGraph(Context->Cfg);
+		Context->Cfg = 0;
+
+		for (int Index = 0; Index < RenderedCount; Index++) {
+			if (Success && WriteSuccess) {
+				WriteSuccess = WriteTarMember(Out, Outputs[Index].Path, Outputs[Index].Data, Outputs[Index].Size);
+				OutputCount++;
+			}
+			free((void*)Outputs[Index].Path);
+			free((void*)Outputs[Index].Data);
+		}
+		fclose(LogStream);
+		char *LogPath = GenerateOutputPath(Member->Name, ".log");
+		WriteSuccess = WriteSuccess && WriteTarMember(Out, LogPath, Log, LogSize);
+		free(LogPath);
+		free(Log);
+		AssembledCount += Success;
+	}
+	WriteSuccess = WriteSuccess && FinishTarArchive(Out);
+	WriteSuccess = (fclose(Out) == 0) && WriteSuccess;
+	if (!WriteSuccess) {
+		fprintf(stderr, "[Archive] I could not write the output archive \"%s\"!\n", OutPath);
+		remove(OutPath);
+	}
+	else {
+		printf("[Archive] Assembled %d of %d file(s) from \"%s\", %d output(s) written to \"%s\".\n", AssembledCount, SourceCount, ArchivePath, OutputCount, OutPath);
+	}
+
+	// Members assembled in place point into the archive, so the context goes first.
+	FreeAssemblerContext(Context);
+	FreeArchiveMembers(Members, MemberCount);
+	FreeArchiveBytes(Archive, MappedSize);
+	return (AssembledCount == SourceCount) && WriteSuccess;
+}
+
 int main(int argc, char *argv[], char *envp[]) {
-	FILE *InFile = 0, *OutLogisim = 0, *OutHex = 0, *OutSymbolTable = 0, *OutListing = 0;
-	char *InFileName = 0, *OutLogisimPath = 0, *OutHexPath = 0, *OutSymbolTablePath = 0, *OutListingPath = 0;
-	int GenLogisim = FALSE, GenHex = FALSE, GenSymbolTable = FALSE, GenListing = FALSE;
+	FILE *InFile = 0, *OutLogisim = 0, *OutHex = 0, *OutSymbolTable = 0, *OutListing = 0, *OutSourceMap = 0, *OutCfgDot = 0, *OutCfgJson = 0, *OutObject = 0;
+	char *InFileName = 0, *OutLogisimPath = 0, *OutHexPath = 0, *OutSymbolTablePath = 0, *OutListingPath = 0, *OutSourceMapPath = 0, *OutCfgDotPath = 0, *OutCfgJsonPath = 0, *OutObjectPath = 0;
+	int GenLogisim = FALSE, GenHex = FALSE, GenSymbolTable = FALSE, GenListing = FALSE, GenSourceMap = FALSE, GenCfgDot = FALSE, GenCfgJson = FALSE, GenObject = FALSE;
+	// With --link every input file is an object, otherwise there is only the one.
+	int Link = FALSE;
+	char **InFileNames = calloc(argc, sizeof(*InFileNames));
+	int InFileCount = 0;
+	int Watch = FALSE;
+	// With --batch every input file is assembled on its own.
+	int Batch = FALSE;
+	// With --archive the input file is a tar, and every .MarieAsm file in it is assembled on its own.
+	int Archive = FALSE;
+	char *ArchiveOutPath = 0;
+	int DiagnosticFormat = DF_Text;
+	int AssemblerFlags = 0;
+	int Simulate = FALSE, SimulateGiven = FALSE, SimulatorFlags = 0;
+	char *SimulateInputPath = 0;
+	char *ProfilePath = 0, *FlamegraphPath = 0, *TracePath = 0, *DecodeTracePath = 0;
+	int Disassemble = FALSE;
+	char *DisassemblyPath = 0, *SymbolsPath = 0, *DiffPath = 0;
+	int Profile = FALSE, Flamegraph = FALSE, Trace = FALSE;
+	char *TestVectorPath = 0;
+	int ThreadCount = 0;
+	int FuzzRunCount = 0;
 	uint64_t InFileSize = 0;
 	int Success = TRUE;
 
@@ -96,133 +1179,698 @@ int main(int argc, char *argv[], char *envp[]) {
 			if (Index + 1 >= argc) { Arg = ""; }
 			else { Arg = argv[Index + 1]; }
 
-			if (OutLogisim == 0 && GenLogisim == FALSE) {
-				if (!((StartsWith(Arg, "--")) || (Arg[0] == 0))) {
+			if (OutLogisimPath == 0 && GenLogisim == FALSE) {
+				if (!((StartsWith(Arg, "--")) || (Arg[0] == 0) || IsStdinPath(Arg))) {
 					Index++;
-					OutLogisim = fopen(Arg, "w");
-					if (OutLogisim == 0) {
-						fprintf(stderr, "I could not open the Logisim output file \"%s\" for writing!\n", Arg);
-						Success = FALSE;
-						break;
-					}
 					OutLogisimPath = Arg;
 				}
 				else {
-					GenLogisim = TRUE;
+					GenLogisim = TRUE;
+				}
+			}
+			else {
+				fprintf(stderr, "Option --logisim was provided twice!\n");
+				Success = FALSE;
+				break;
+			}
+		}
+		else if (StartsWith(Arg, "--rawhex")) {
+			if (Index + 1 >= argc) { Arg = ""; }
+			else { Arg = argv[Index + 1]; }
+
+			if (OutHexPath == 0 && GenHex == FALSE) {
+				if (!((StartsWith(Arg, "--")) || (Arg[0] == 0) || IsStdinPath(Arg))) {
+					Index++;
+					OutHexPath = Arg;
+				}
+				else {
+					GenHex = TRUE;
+				}
+			}
+			else {
+				fprintf(stderr, "Option --rawhex was provided twice!\n");
+				Success = FALSE;
+				break;
+			}
+		}
+		else if (StartsWith(Arg, "--symboltable")) {
+			if (Index + 1 >= argc) { Arg = ""; }
+			else { Arg = argv[Index + 1]; }
+
+			if (OutSymbolTablePath == 0 && GenSymbolTable == FALSE) {
+				if (!((StartsWith(Arg, "--")) || (Arg[0] == 0) || IsStdinPath(Arg))) {
+					Index++;
+					OutSymbolTablePath = Arg;
+				}
+				else {
+					GenSymbolTable = TRUE;
+				}
+			}
+			else {
+				fprintf(stderr, "Option --symboltable was provided twice!\n");
+				Success = FALSE;
+				break;
+			}
+		}
+		else if (StartsWith(Arg, "--listing")) {
+			if (Index + 1 >= argc) { Arg = ""; }
+			else { Arg = argv[Index + 1]; }
+
+			if (OutListingPath == 0 && GenListing == FALSE) {
+				if (!((StartsWith(Arg, "--")) || (Arg[0] == 0) || IsStdinPath(Arg))) {
+					Index++;
+					OutListingPath = Arg;
+				}
+				else {
+					GenListing = TRUE;
+				}
+			}
+			else {
+				fprintf(stderr, "Option --listing was provided twice!\n");
+				Success = FALSE;
+				break;
+			}
+		}
+		else if (StartsWith(Arg, "--object")) {
+			if (Index + 1 >= argc) { Arg = ""; }
+			else { Arg = argv[Index + 1]; }
+
+			if (OutObjectPath == 0 && GenObject == FALSE) {
+				if (!((StartsWith(Arg, "--")) || (Arg[0] == 0) || IsStdinPath(Arg))) {
+					Index++;
+					OutObjectPath = Arg;
+				}
+				else {
+					GenObject = TRUE;
+				}
+			}
+			else {
+				fprintf(stderr, "Option --object was provided twice!\n");
+				Success = FALSE;
+				break;
+			}
+		}
+		else if (StartsWith(Arg, "--link")) {
+			Link = TRUE;
+		}
+		else if (StartsWith(Arg, "--sourcemap")) {
+			if (Index + 1 >= argc) { Arg = ""; }
+			else { Arg = argv[Index + 1]; }
+
+			if (OutSourceMapPath == 0 && GenSourceMap == FALSE) {
+				if (!((StartsWith(Arg, "--")) || (Arg[0] == 0) || IsStdinPath(Arg))) {
+					Index++;
+					OutSourceMapPath = Arg;
+				}
+				else {
+					GenSourceMap = TRUE;
+				}
+			}
+			else {
+				fprintf(stderr, "Option --sourcemap was provided twice!\n");
+				Success = FALSE;
+				break;
+			}
+		}
+		else if (StartsWith(Arg, "--cfg-json")) {
+			if (Index + 1 >= argc) { Arg = ""; }
+			else { Arg = argv[Index + 1]; }
+
+			if (OutCfgJsonPath == 0 && GenCfgJson == FALSE) {
+				if (!((StartsWith(Arg, "--")) || (Arg[0] == 0) || IsStdinPath(Arg))) {
+					Index++;
+					OutCfgJsonPath = Arg;
+				}
+				else {
+					GenCfgJson = TRUE;
 				}
 			}
 			else {
-				fprintf(stderr, "Option --logisim was provided twice!\n");
+				fprintf(stderr, "Option --cfg-json was provided twice!\n");
 				Success = FALSE;
 				break;
 			}
 		}
-		else if (StartsWith(Arg, "--rawhex")) {
+		else if (StartsWith(Arg, "--cfg")) {
 			if (Index + 1 >= argc) { Arg = ""; }
 			else { Arg = argv[Index + 1]; }
 
-			if (OutHex == 0 && GenHex == FALSE) {
-				if (!((StartsWith(Arg, "--")) || (Arg[0] == 0))) {
+			if (OutCfgDotPath == 0 && GenCfgDot == FALSE) {
+				if (!((StartsWith(Arg, "--")) || (Arg[0] == 0) || IsStdinPath(Arg))) {
 					Index++;
-					OutHex = fopen(Arg, "wb");
-					if (OutHex == 0) {
-						fprintf(stderr, "I could not open the raw hex output file \"%s\" for writing!\n", Arg);
-						Success = FALSE;
-						break;
-					}
-					OutHexPath = Arg;
+					OutCfgDotPath = Arg;
 				}
 				else {
-					GenHex = TRUE;
+					GenCfgDot = TRUE;
 				}
 			}
 			else {
-				fprintf(stderr, "Option --rawhex was provided twice!\n");
+				fprintf(stderr, "Option --cfg was provided twice!\n");
 				Success = FALSE;
 				break;
 			}
 		}
-		else if (StartsWith(Arg, "--symboltable")) {
+		else if (StartsWith(Arg, "--lsp")) {
+			// The editor owns stdin and stdout from here on, nothing else may be printed to stdout.
+			return LanguageServerMain(stdin, stdout) ? 0 : 1;
+		}
+		else if (StartsWith(Arg, "--watch")) {
+			if (Watch) {
+				fprintf(stderr, "Option --watch was provided twice!\n");
+				Success = FALSE;
+				break;
+			}
+			Watch = TRUE;
+		}
+		else if (StartsWith(Arg, "--batch")) {
+			if (Batch) {
+				fprintf(stderr, "Option --batch was provided twice!\n");
+				Success = FALSE;
+				break;
+			}
+			Batch = TRUE;
+		}
+		else if (StartsWith(Arg, "--archive")) {
 			if (Index + 1 >= argc) { Arg = ""; }
 			else { Arg = argv[Index + 1]; }
 
-			if (OutSymbolTable == 0 && GenSymbolTable == FALSE) {
-				if (!((StartsWith(Arg, "--")) || (Arg[0] == 0))) {
-					Index++;
-					OutSymbolTable = fopen(Arg, "w");
-					if (OutSymbolTable == 0) {
-						fprintf(stderr, "I could not open the symbol table output file \"%s\" for writing!\n", Arg);
-						Success = FALSE;
-						break;
-					}
-					OutSymbolTablePath = Arg;
-				}
-				else {
-					GenSymbolTable = TRUE;
-				}
+			if (Archive) {
+				fprintf(stderr, "Option --archive was provided twice!\n");
+				Success = FALSE;
+				break;
 			}
-			else {
-				fprintf(stderr, "Option --symboltable was provided twice!\n");
+			Archive = TRUE;
+			if (!((StartsWith(Arg, "--")) || (Arg[0] == 0) || IsStdinPath(Arg))) {
+				Index++;
+				ArchiveOutPath = Arg;
+			}
+		}
+		else if (StartsWith(Arg, "--simulate")) {
+			if (Index + 1 >= argc) { Arg = ""; }
+			else { Arg = argv[Index + 1]; }
+
+			if (SimulateGiven) {
+				fprintf(stderr, "Option --simulate was provided twice!\n");
 				Success = FALSE;
 				break;
 			}
+			Simulate = TRUE;
+			SimulateGiven = TRUE;
+			if (!((StartsWith(Arg, "--")) || (Arg[0] == 0) || IsStdinPath(Arg))) {
+				Index++;
+				SimulateInputPath = Arg;
+			}
 		}
-		else if (StartsWith(Arg, "--listing")) {
+		else if (StartsWith(Arg, "--profile")) {
 			if (Index + 1 >= argc) { Arg = ""; }
 			else { Arg = argv[Index + 1]; }
 
-			if (OutListing == 0 && GenListing == FALSE) {
-				if (!((StartsWith(Arg, "--")) || (Arg[0] == 0))) {
-					Index++;
-					OutListing = fopen(Arg, "w");
-					if (OutListing == 0) {
-						fprintf(stderr, "I could not open the listing output file \"%s\" for writing!\n", Arg);
-						Success = FALSE;
-						break;
-					}
-					OutListingPath = Arg;
-				}
-				else {
-					GenListing = TRUE;
-				}
+			if (Profile) {
+				fprintf(stderr, "Option --profile was provided twice!\n");
+				Success = FALSE;
+				break;
 			}
-			else {
-				fprintf(stderr, "Option --listing was provided twice!\n");
+			Simulate = TRUE;
+			Profile = TRUE;
+			if (!((StartsWith(Arg, "--")) || (Arg[0] == 0) || IsStdinPath(Arg))) {
+				Index++;
+				ProfilePath = Arg;
+			}
+		}
+		else if (StartsWith(Arg, "--flamegraph")) {
+			if (Index + 1 >= argc) { Arg = ""; }
+			else { Arg = argv[Index + 1]; }
+
+			if (Flamegraph) {
+				fprintf(stderr, "Option --flamegraph was provided twice!\n");
 				Success = FALSE;
 				break;
 			}
+			Simulate = TRUE;
+			Flamegraph = TRUE;
+			if (!((StartsWith(Arg, "--")) || (Arg[0] == 0) || IsStdinPath(Arg))) {
+				Index++;
+				FlamegraphPath = Arg;
+			}
 		}
-		else if (StartsWith(Arg, "--")) {
-			fprintf(stderr, "Unknown commandline operation encountered: \"%s\"\n", Arg);
-			Success = FALSE;
-			break;
+		else if (StartsWith(Arg, "--trace")) {
+			if (Index + 1 >= argc) { Arg = ""; }
+			else { Arg = argv[Index + 1]; }
+
+			if (Trace) {
+				fprintf(stderr, "Option --trace was provided twice!\n");
+				Success = FALSE;
+				break;
+			}
+			Simulate = TRUE;
+			Trace = TRUE;
+			if (!((StartsWith(Arg, "--")) || (Arg[0] == 0) || IsStdinPath(Arg))) {
+				Index++;
+				TracePath = Arg;
+			}
+		}
+		else if (StartsWith(Arg, "--decode-trace")) {
+			if (Index + 1 >= argc || StartsWith(argv[Index + 1], "--")) {
+				fprintf(stderr, "Option --decode-trace expects the trace's file name!\n");
+				Success = FALSE;
+				break;
+			}
+			Index++;
+			DecodeTracePath = argv[Index];
 		}
-		else if (InFile == 0) { // This must be our one input file.
-			InFile = fopen(Arg, "rb");
-			if (InFile == 0) {
-				fprintf(stderr, "I could not open the input file \"%s\" for reading!\n", Arg);
+		else if (StartsWith(Arg, "--disassemble")) {
+			if (Index + 1 >= argc) { Arg = ""; }
+			else { Arg = argv[Index + 1]; }
+
+			if (Disassemble) {
+				fprintf(stderr, "Option --disassemble was provided twice!\n");
 				Success = FALSE;
 				break;
 			}
-			if (Success) {
-				InFileSize = GetFileSize(Arg, &Success);
-				InFileName = Arg;
+			Disassemble = TRUE;
+			if (!((StartsWith(Arg, "--")) || (Arg[0] == 0) || IsStdinPath(Arg))) {
+				Index++;
+				DisassemblyPath = Arg;
 			}
 		}
-		else {
-			fprintf(stderr, "There can only be one input file, but more than one was provided!\nSecond input file path: \"%s\"\n", Arg);
+		else if (StartsWith(Arg, "--diff")) {
+			if (Index + 1 >= argc || StartsWith(argv[Index + 1], "--")) {
+				fprintf(stderr, "Option --diff expects the file name of the image to compare against!\n");
+				Success = FALSE;
+				break;
+			}
+			Index++;
+			DiffPath = argv[Index];
+		}
+		else if (StartsWith(Arg, "--symbols")) {
+			if (Index + 1 >= argc || StartsWith(argv[Index + 1], "--")) {
+				fprintf(stderr, "Option --symbols expects the symbol table's file name!\n");
+				Success = FALSE;
+				break;
+			}
+			Index++;
+			SymbolsPath = argv[Index];
+		}
+		else if (StartsWith(Arg, "--optimize")) {
+			AssemblerFlags |= ASSEMBLE_Optimize;
+			SimulatorFlags |= SIMULATE_Optimize;
+		}
+		else if (StartsWith(Arg, "--pack-data")) {
+			AssemblerFlags |= ASSEMBLE_PackData;
+			SimulatorFlags |= SIMULATE_PackData;
+		}
+		else if (StartsWith(Arg, "--interpret")) {
+			Simulate = TRUE;
+			SimulatorFlags |= SIMULATE_Interpret;
+		}
+		else if (StartsWith(Arg, "--benchmark")) {
+			Simulate = TRUE;
+			SimulatorFlags |= SIMULATE_Benchmark;
+		}
+		else if (StartsWith(Arg, "--testvectors")) {
+			if (Index + 1 >= argc || StartsWith(argv[Index + 1], "--")) {
+				fprintf(stderr, "Option --testvectors expects the test spec's file name!\n");
+				Success = FALSE;
+				break;
+			}
+			if (TestVectorPath) {
+				fprintf(stderr, "Option --testvectors was provided twice!\n");
+				Success = FALSE;
+				break;
+			}
+			Index++;
+			TestVectorPath = argv[Index];
+		}
+		else if (StartsWith(Arg, "--threads")) {
+			if (Index + 1 < argc) { ThreadCount = atoi(argv[Index + 1]); }
+			if (ThreadCount <= 0) {
+				fprintf(stderr, "Option --threads expects a number of threads greater than 0!\n");
+				Success = FALSE;
+				break;
+			}
+			Index++;
+		}
+		else if (StartsWith(Arg, "--fuzz")) {
+			if (Index + 1 < argc) { FuzzRunCount = atoi(argv[Index + 1]); }
+			if (FuzzRunCount <= 0) {
+				fprintf(stderr, "Option --fuzz expects a number of runs greater than 0!\n");
+				Success = FALSE;
+				break;
+			}
+			Index++;
+		}
+		else if (StartsWith(Arg, "--diagnostics")) {
+			if (Index + 1 >= argc) { Arg = ""; }
+			else { Arg = argv[Index + 1]; }
+
+			if (strcmp(Arg, "json") == 0) {
+				Index++;
+				DiagnosticFormat = DF_JsonLines;
+			}
+			else if (strcmp(Arg, "text") == 0) {
+				Index++;
+				DiagnosticFormat = DF_Text;
+			}
+			else {
+				fprintf(stderr, "Option --diagnostics expects either \"text\" or \"json\"!\n");
+				Success = FALSE;
+				break;
+			}
+		}
+		else if (StartsWith(Arg, "--")) {
+			fprintf(stderr, "Unknown commandline operation encountered: \"%s\"\n", Arg);
 			Success = FALSE;
 			break;
 		}
+		else {
+			InFileNames[InFileCount++] = Arg;
+		}
 
 		Index++;
 	}
 
-	if (InFile == 0) {
+	if (InFileCount > 1 && !Link && !Batch) {
+		fprintf(stderr, "There can only be one input file, but more than one was provided!\nSecond input file path: \"%s\"\n", InFileNames[1]);
+		Success = FALSE;
+	}
+	InFileName = InFileNames[0];
+	if (Link && (OutObjectPath || GenObject)) {
+		fprintf(stderr, "Objects can't be linked into another object!\n");
+		Success = FALSE;
+	}
+	if (Watch && (Link || OutObjectPath || GenObject)) {
+		fprintf(stderr, "Watch mode can't write or link objects!\n");
+		Success = FALSE;
+	}
+
+	if (Batch && (Watch || Link || OutObjectPath || GenObject)) {
+		fprintf(stderr, "Batch mode can't watch, write or link objects!\n");
+		Success = FALSE;
+	}
+	if (Batch && (OutLogisimPath || OutHexPath || OutSymbolTablePath || OutListingPath || OutSourceMapPath || OutCfgDotPath || OutCfgJsonPath)) {
+		fprintf(stderr, "Output file names cannot be given in batch mode, leave the file name blank to auto-generate one per input file.\n");
+		Success = FALSE;
+	}
+
+	if (Archive && (Batch || Watch || Link || OutObjectPath || GenObject || Simulate || Disassemble || DiffPath || DecodeTracePath || TestVectorPath || FuzzRunCount)) {
+		fprintf(stderr, "Archive mode only assembles, it can't be combined with other modes!\n");
+		Success = FALSE;
+	}
+	if (Archive && (OutLogisimPath || OutHexPath || OutSymbolTablePath || OutListingPath || OutSourceMapPath || OutCfgDotPath || OutCfgJsonPath)) {
+		fprintf(stderr, "Output file names cannot be given in archive mode, leave the file name blank to name each output after the file in the archive it came from.\n");
+		Success = FALSE;
+	}
+
+	if (InFileName == 0) {
 		fprintf(stderr, "No input file was provided!\n");
 		Success = FALSE;
 	}
 
+	int StdinReaders = (DiffPath && IsStdinPath(DiffPath)) + (Simulate && !SimulateInputPath && !(SimulatorFlags & SIMULATE_Benchmark));
+	for (int Index = 0; Index < InFileCount; Index++) {
+		StdinReaders += IsStdinPath(InFileNames[Index]);
+	}
+	if (Watch && IsStdinPath(InFileName)) {
+		fprintf(stderr, "Watch mode can't watch stdin, it needs a file or directory to watch!\n");
+		Success = FALSE;
+	}
+	else if (StdinReaders > 1) {
+		fprintf(stderr, "Only one input can be read from stdin! A simulated program takes its input from stdin unless --simulate is given a file.\n");
+		Success = FALSE;
+	}
+
+	if (Success && Batch) {
+		int GenerateOutputs[OUT_COUNT] = {
+			[OUT_Logisim] = GenLogisim,
+			[OUT_RawHex] = GenHex,
+			[OUT_SymbolTable] = GenSymbolTable,
+			[OUT_Listing] = GenListing,
+			[OUT_SourceMap] = GenSourceMap,
+			[OUT_CfgDot] = GenCfgDot,
+			[OUT_CfgJson] = GenCfgJson,
+		};
+		return BatchMain(InFileNames, InFileCount, GenerateOutputs, DiagnosticFormat, AssemblerFlags) ? 0 : 1;
+	}
+
+	if (Success && Archive) {
+		int GenerateOutputs[OUT_COUNT] = {
+			[OUT_Logisim] = GenLogisim,
+			[OUT_RawHex] = GenHex,
+			[OUT_SymbolTable] = GenSymbolTable,
+			[OUT_Listing] = GenListing,
+			[OUT_SourceMap] = GenSourceMap,
+			[OUT_CfgDot] = GenCfgDot,
+			[OUT_CfgJson] = GenCfgJson,
+		};
+		char *OutPath = ArchiveOutPath ? ArchiveOutPath : GenerateOutputPath(InFileName, ".out.tar");
+		return ArchiveMain(InFileName, OutPath, GenerateOutputs, DiagnosticFormat, AssemblerFlags) ? 0 : 1;
+	}
+
+	if (Success && Watch) {
+		char *OutputPaths[OUT_COUNT] = {
+			[OUT_Logisim] = OutLogisimPath,
+			[OUT_RawHex] = OutHexPath,
+			[OUT_SymbolTable] = OutSymbolTablePath,
+			[OUT_Listing] = OutListingPath,
+			[OUT_SourceMap] = OutSourceMapPath,
+			[OUT_CfgDot] = OutCfgDotPath,
+			[OUT_CfgJson] = OutCfgJsonPath,
+		};
+		int GenerateOutputs[OUT_COUNT] = {
+			[OUT_Logisim] = GenLogisim,
+			[OUT_RawHex] = GenHex,
+			[OUT_SymbolTable] = GenSymbolTable,
+			[OUT_Listing] = GenListing,
+			[OUT_SourceMap] = GenSourceMap,
+			[OUT_CfgDot] = GenCfgDot,
+			[OUT_CfgJson] = GenCfgJson,
+		};
+		// Watch mode only returns if it failed to start.
+		return WatchMain(InFileName, OutputPaths, GenerateOutputs, DiagnosticFormat, AssemblerFlags) ? 0 : 1;
+	}
+
+	if (Success && DecodeTracePath) {
+		InFile = OpenInputFile(InFileName);
+		if (InFile == 0) {
+			fprintf(stderr, "I could not open the input file \"%s\" for reading!\n", InFileName);
+			return 1;
+		}
+		InFileSize = GetFileSize(InFileName, &Success);
+
+		FILE *TraceFile = fopen(DecodeTracePath, "rb");
+		if (TraceFile == 0) {
+			fprintf(stderr, "I could not open the trace \"%s\" for reading!\n", DecodeTracePath);
+			fclose(InFile);
+			return 1;
+		}
+		Success = Success && TraceDecodeMain(InFile, InFileSize, InFileName, TraceFile, DiagnosticFormat);
+		return Success ? 0 : 1;
+	}
+
+	if (Success && SymbolsPath && !Disassemble && !DiffPath) {
+		fprintf(stderr, "Option --symbols only names addresses for --disassemble and --diff!\n");
+		Success = FALSE;
+	}
+
+	FILE *SymbolFile = 0;
+	uint64_t SymbolFileSize = 0;
+	if (Success && SymbolsPath) {
+		SymbolFile = fopen(SymbolsPath, "rb");
+		if (SymbolFile == 0) {
+			fprintf(stderr, "I could not open the symbol table \"%s\" for reading!\n", SymbolsPath);
+			return 1;
+		}
+		SymbolFileSize = GetFileSize(SymbolsPath, &Success);
+	}
+
+	if (Success && DiffPath) {
+		FILE *FileA = OpenInputFile(InFileName);
+		FILE *FileB = fopen(DiffPath, "rb");
+		if (FileA == 0 || FileB == 0) {
+			fprintf(stderr, "I could not open the image \"%s\" for reading!\n", FileA ? DiffPath : InFileName);
+			if (FileA) { fclose(FileA); }
+			if (FileB) { fclose(FileB); }
+			if (SymbolFile) { fclose(SymbolFile); }
+			return DIFF_Error;
+		}
+		return DiffMain(FileA, InFileName, FileB, DiffPath, SymbolFile, SymbolFileSize);
+	}
+
+	if (Success && Disassemble) {
+		InFile = OpenInputFile(InFileName);
+		if (InFile == 0) {
+			fprintf(stderr, "I could not open the input file \"%s\" for reading!\n", InFileName);
+			if (SymbolFile) { fclose(SymbolFile); }
+			return 1;
+		}
+
+		char *Path = DisassemblyPath ? DisassemblyPath : GenerateOutputPath(InFileName, ".dis.MarieAsm");
+		FILE *OutDisassembly = fopen(Path, "w");
+		if (OutDisassembly == 0) {
+			fprintf(stderr, "I could not open the disassembly output file \"%s\" for writing!\n", Path);
+			fclose(InFile);
+			if (SymbolFile) { fclose(SymbolFile); }
+			return 1;
+		}
+		Success = Success && DisassembleMain(InFile, InFileName, SymbolFile, SymbolFileSize, OutDisassembly);
+		return Success ? 0 : 1;
+	}
+
+	if (Success && FuzzRunCount) {
+		InFile = OpenInputFile(InFileName);
+		if (InFile == 0) {
+			fprintf(stderr, "I could not open the input file \"%s\" for reading!\n", InFileName);
+			return 1;
+		}
+		InFileSize = GetFileSize(InFileName, &Success);
+		Success = Success && FuzzMain(InFile, InFileSize, InFileName, FuzzRunCount, DiagnosticFormat);
+		return Success ? 0 : 1;
+	}
+
+	if (Success && TestVectorPath) {
+		InFile = OpenInputFile(InFileName);
+		if (InFile == 0) {
+			fprintf(stderr, "I could not open the input file \"%s\" for reading!\n", InFileName);
+			return 1;
+		}
+		InFileSize = GetFileSize(InFileName, &Success);
+
+		FILE *SpecFile = fopen(TestVectorPath, "rb");
+		if (SpecFile == 0) {
+			fprintf(stderr, "I could not open the test spec \"%s\" for reading!\n", TestVectorPath);
+			fclose(InFile);
+			return 1;
+		}
+		uint64_t SpecFileSize = GetFileSize(TestVectorPath, &Success);
+
+		if (ThreadCount == 0) { ThreadCount = Platform_GetProcessorCount(); }
+		Success = Success && TestVectorMain(InFile, InFileSize, InFileName, SpecFile, SpecFileSize, ThreadCount, SimulatorFlags, DiagnosticFormat);
+		return Success ? 0 : 1;
+	}
+
+	if (Success && Simulate) {
+		InFile = OpenInputFile(InFileName);
+		if (InFile == 0) {
+			fprintf(stderr, "I could not open the input file \"%s\" for reading!\n", InFileName);
+			return 1;
+		}
+		InFileSize = GetFileSize(InFileName, &Success);
+
+		// A benchmark reads all of its input before it starts, so it only takes input from a file.
+		FILE *InputValues = (SimulatorFlags & SIMULATE_Benchmark) ? 0 : stdin;
+		if (SimulateInputPath) {
+			InputValues = fopen(SimulateInputPath, "r");
+			if (InputValues == 0) {
+				fprintf(stderr, "I could not open the simulator's input file \"%s\" for reading!\n", SimulateInputPath);
+				fclose(InFile);
+				return 1;
+			}
+		}
+		FILE *OutProfile = 0;
+		if (Profile) {
+			char *Path = ProfilePath ? ProfilePath : GenerateOutputPath(InFileName, ".profile.lst");
+			OutProfile = fopen(Path, "w");
+			if (OutProfile == 0) {
+				fprintf(stderr, "I could not open the profile output file \"%s\" for writing!\n", Path);
+				fclose(InFile);
+				return 1;
+			}
+		}
+		FILE *OutFoldedStacks = 0;
+		if (Flamegraph) {
+			char *Path = FlamegraphPath ? FlamegraphPath : GenerateOutputPath(InFileName, ".folded");
+			OutFoldedStacks = fopen(Path, "w");
+			if (OutFoldedStacks == 0) {
+				fprintf(stderr, "I could not open the flamegraph output file \"%s\" for writing!\n", Path);
+				fclose(InFile);
+				return 1;
+			}
+		}
+		FILE *OutTrace = 0;
+		if (Trace) {
+			char *Path = TracePath ? TracePath : GenerateOutputPath(InFileName, ".trace");
+			OutTrace = fopen(Path, "wb");
+			if (OutTrace == 0) {
+				fprintf(stderr, "I could not open the trace output file \"%s\" for writing!\n", Path);
+				fclose(InFile);
+				return 1;
+			}
+		}
+		Success = Success && SimulatorMain(InFile, InFileSize, InFileName, InputValues, OutProfile, OutFoldedStacks, OutTrace, SimulatorFlags, DiagnosticFormat);
+		if (InputValues && InputValues != stdin) { fclose(InputValues); }
+		return Success ? 0 : 1;
+	}
+
+	if (Success && !Link) {
+		InFile = OpenInputFile(InFileName);
+		if (InFile == 0) {
+			fprintf(stderr, "I could not open the input file \"%s\" for reading!\n", InFileName);
+			Success = FALSE;
+		}
+		else {
+			InFileSize = GetFileSize(InFileName, &Success);
+		}
+	}
+
+	if (Success) {
+		if (OutLogisimPath) {
+			OutLogisim = fopen(OutLogisimPath, "w");
+			if (OutLogisim == 0) {
+				fprintf(stderr, "I could not open the Logisim output file \"%s\" for writing!\n", OutLogisimPath);
+				Success = FALSE;
+			}
+		}
+		if (OutHexPath) {
+			OutHex = fopen(OutHexPath, "wb");
+			if (OutHex == 0) {
+				fprintf(stderr, "I could not open the raw hex output file \"%s\" for writing!\n", OutHexPath);
+				Success = FALSE;
+			}
+		}
+		if (OutSymbolTablePath) {
+			OutSymbolTable = fopen(OutSymbolTablePath, "w");
+			if (OutSymbolTable == 0) {
+				fprintf(stderr, "I could not open the symbol table output file \"%s\" for writing!\n", OutSymbolTablePath);
+				Success = FALSE;
+			}
+		}
+		if (OutListingPath) {
+			OutListing = fopen(OutListingPath, "w");
+			if (OutListing == 0) {
+				fprintf(stderr, "I could not open the listing output file \"%s\" for writing!\n", OutListingPath);
+				Success = FALSE;
+			}
+		}
+		if (OutSourceMapPath) {
+			OutSourceMap = fopen(OutSourceMapPath, "w");
+			if (OutSourceMap == 0) {
+				fprintf(stderr, "I could not open the source map output file \"%s\" for writing!\n", OutSourceMapPath);
+				Success = FALSE;
+			}
+		}
+		if (OutCfgDotPath) {
+			OutCfgDot = fopen(OutCfgDotPath, "w");
+			if (OutCfgDot == 0) {
+				fprintf(stderr, "I could not open the control flow graph output file \"%s\" for writing!\n", OutCfgDotPath);
+				Success = FALSE;
+			}
+		}
+		if (OutCfgJsonPath) {
+			OutCfgJson = fopen(OutCfgJsonPath, "w");
+			if (OutCfgJson == 0) {
+				fprintf(stderr, "I could not open the control flow graph output file \"%s\" for writing!\n", OutCfgJsonPath);
+				Success = FALSE;
+			}
+		}
+		if (OutObjectPath) {
+			OutObject = fopen(OutObjectPath, "wb");
+			if (OutObject == 0) {
+				fprintf(stderr, "I could not open the object output file \"%s\" for writing!\n", OutObjectPath);
+				Success = FALSE;
+			}
+		}
+	}
+
 	if (Success) {
 		if (GenLogisim) {
 			char *AutoFileName = GenerateOutputPath(InFileName, ".LogisimImage");
@@ -272,10 +1920,88 @@ int main(int argc, char *argv[], char *envp[]) {
 				OutSymbolTablePath = AutoFileName;
 			}
 		}
+		if (GenSourceMap) {
+			char *AutoFileName = GenerateOutputPath(InFileName, ".srcmap");
+			OutSourceMap = fopen(AutoFileName, "w");
+			if (OutSourceMap == 0) {
+				fprintf(stderr, "I could not open the source map output file's auto-generated path \"%s\" for writing!\n", AutoFileName);
+				Success = FALSE;
+				free(AutoFileName);
+			}
+			else {
+				OutSourceMapPath = AutoFileName;
+			}
+		}
+		if (GenCfgDot) {
+			char *AutoFileName = GenerateOutputPath(InFileName, ".dot");
+			OutCfgDot = fopen(AutoFileName, "w");
+			if (OutCfgDot == 0) {
+				fprintf(stderr, "I could not open the control flow graph output file's auto-generated path \"%s\" for writing!\n", AutoFileName);
+				Success = FALSE;
+				free(AutoFileName);
+			}
+			else {
+				OutCfgDotPath = AutoFileName;
+			}
+		}
+		if (GenCfgJson) {
+			char *AutoFileName = GenerateOutputPath(InFileName, ".cfg.json");
+			OutCfgJson = fopen(AutoFileName, "w");
+			if (OutCfgJson == 0) {
+				fprintf(stderr, "I could not open the control flow graph output file's auto-generated path \"%s\" for writing!\n", AutoFileName);
+				Success = FALSE;
+				free(AutoFileName);
+			}
+			else {
+				OutCfgJsonPath = AutoFileName;
+			}
+		}
+		if (GenObject) {
+			char *AutoFileName = GenerateOutputPath(InFileName, ".mobj");
+			OutObject = fopen(AutoFileName, "wb");
+			if (OutObject == 0) {
+				fprintf(stderr, "I could not open the object output file's auto-generated path \"%s\" for writing!\n", AutoFileName);
+				Success = FALSE;
+				free(AutoFileName);
+			}
+			else {
+				OutObjectPath = AutoFileName;
+			}
+		}
+	}
+
+	if (Success && Link) {
+		FILE **Objects = calloc(InFileCount, sizeof(*Objects));
+		for (int Index = 0; Index < InFileCount && Success; Index++) {
+			Objects[Index] = OpenInputFile(InFileNames[Index]);
+			if (Objects[Index] == 0) {
+				fprintf(stderr, "I could not open the object \"%s\" for reading!\n", InFileNames[Index]);
+				Success = FALSE;
+			}
+		}
+		if (Success) {
+			Success = LinkMain(Objects, (const char**)InFileNames, InFileCount, OutLogisim, OutHex, OutSymbolTable, OutListing, OutSourceMap, OutCfgDot, OutCfgJson, DiagnosticFormat, AssemblerFlags);
+			if (!Success) {
+				char *OutputPaths[] = {OutLogisimPath, OutHexPath, OutSymbolTablePath, OutListingPath, OutSourceMapPath, OutCfgDotPath, OutCfgJsonPath};
+				RemoveOutputFiles(OutputPaths, ArraySize(OutputPaths));
+			}
+			free(Objects);
+			free(InFileNames);
+			return Success ? 0 : 1;
+		}
+		for (int Index = 0; Index < InFileCount; Index++) {
+			if (Objects[Index]) { fclose(Objects[Index]); }
+		}
+		free(Objects);
 	}
 
 	if (Success) {
-		Success = ApplicationMain(InFile, InFileSize, OutLogisim, OutHex, OutSymbolTable, OutListing);
+		Success = ApplicationMain(InFile, InFileSize, OutLogisim, OutHex, OutSymbolTable, OutListing, OutSourceMap, OutCfgDot, OutCfgJson, OutObject, InFileName, DiagnosticFormat, AssemblerFlags);
+		if (!Success) {
+			// ApplicationMain() closed every output, written or not. Half of a program's outputs are worse than none, so none of them are kept.
+			char *OutputPaths[] = {OutLogisimPath, OutHexPath, OutSymbolTablePath, OutListingPath, OutSourceMapPath, OutCfgDotPath, OutCfgJsonPath, OutObjectPath};
+			RemoveOutputFiles(OutputPaths, ArraySize(OutputPaths));
+		}
 	}
 	else {
 		printf("Exiting without invoking the assembler.\n");
@@ -302,6 +2028,26 @@ int main(int argc, char *argv[], char *envp[]) {
 			Assert(OutListingPath != 0);
 			remove(OutListingPath);
 		}
+		if (OutSourceMap) {
+			fclose(OutSourceMap);
+			Assert(OutSourceMapPath != 0);
+			remove(OutSourceMapPath);
+		}
+		if (OutCfgDot) {
+			fclose(OutCfgDot);
+			Assert(OutCfgDotPath != 0);
+			remove(OutCfgDotPath);
+		}
+		if (OutCfgJson) {
+			fclose(OutCfgJson);
+			Assert(OutCfgJsonPath != 0);
+			remove(OutCfgJsonPath);
+		}
+		if (OutObject) {
+			fclose(OutObject);
+			Assert(OutObjectPath != 0);
+			remove(OutObjectPath);
+		}
 
 	}
 	// Return 0 on success because 1 is generally interpreted as an error, so if you were
@@ -310,5 +2056,6 @@ int main(int argc, char *argv[], char *envp[]) {
 	// MarieAssembler --rawhex prog.hex prog.MarieAsm || echo "Assembler failed!" && exit 1
 	//
 	// It would exit
+	free(InFileNames);
 	return Success ? 0 : 1;
 }
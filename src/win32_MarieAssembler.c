@@ -16,68 +16,11 @@
 #include <shlwapi.h>
 #undef WIN32_LEAN_AND_MEAN
 #undef UNICODE
+#include <io.h>
+#include <fcntl.h>
 
 #include "Platform_MarieAssembler.h"
-
-void Platform_Breakpoint() {
-	__debugbreak();
-}
-
-size_t win32_GetFileSize(wchar_t *FileName, int *Success) {
-	LARGE_INTEGER Result = {0};
-	
-	HANDLE FileHandle = CreateFile(FileName, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
-	
-	if (GetFileSizeEx(FileHandle, &Result) == 0) {
-		DWORD Error = GetLastError();
-		wprintf(L"[Error File Handling] This program could not get the size of the provided file (%s).\nThe value of win32's GetLastError is '%d'", FileName, Error);
-		*Success = FALSE;
-	}
-	else { SetLastError(0); }
-
-	return (size_t)Result.QuadPart;
-}
-
-int IndexOfFromEnd(wchar_t *String, wchar_t Target) {
-	int Result = 0;
-
-	Result = wcslen(String) - 1;
-	
-	for(; Result >= 0; Result--) {
-		if (String[Result] == Target) { return Result; }
-	}
-	return -1;
-}
-
-int StartsWith(wchar_t *String, wchar_t *Target) {
-	int Result = FALSE;
-	int Length = wcslen(Target);
-	if (Length <= wcslen(String)) {
-		for (int Index = 0; Index <= Length; Index++) {
-			if (Index == Length) { Result = TRUE; break; }
-			if (String[Index] != Target[Index]) { break; }
-		}
-	}
-
-	return Result;
-}
-
-wchar_t* GenerateOutputPath(wchar_t *InFileName, wchar_t *PostFix) {
-	int DotIndex = IndexOfFromEnd(InFileName, L'.');
-	int PathSeperatorIndex = Max(IndexOfFromEnd(InFileName, L'\\'), IndexOfFromEnd(InFileName, L'/'));
-	if (DotIndex < PathSeperatorIndex || DotIndex == -1) {
-		// The dot we found was part of the file path.
-		// Or we didn't find a dot.
-		DotIndex = wcslen(InFileName);
-	}
-	
-	int AutoFileNameLength = DotIndex + wcslen(PostFix) + 1;
-	wchar_t *AutoFileName = calloc(AutoFileNameLength, sizeof(wchar_t));
-	
-	_snwprintf(AutoFileName, AutoFileNameLength, L"%.*s%s", DotIndex, InFileName, PostFix);
-
-	return AutoFileName;
-}
+#include "win32_Platform_MarieAssembler.c"
 
 translation_scope inline void PrintHelp(wchar_t *ApplicationName) {
 	const char* HelpMessage =
@@ -86,15 +29,16 @@ translation_scope inline void PrintHelp(wchar_t *ApplicationName) {
 		"  --logisim [FileName] ==> Outputs Logisim rom image at [FileName], or if blank <InFileName>.LogisimImage\n"
 		"  --rawhex [FileName] ==> Outputs a file containing the raw hex for the program at [FileName], or if blank <InFileName>.hex\n"
 		"  --symboltable [FileName] ==> Outputs a file containing a symbol table for the program at [FileName], or if blank <InFileName>.sym\n"
-		"  --listing [FileName] ==> Outputs a file containing a listing for the program at [FileName], or if blank <InFileName>.lst\n";
+		"  --listing [FileName] ==> Outputs a file containing a listing for the program at [FileName], or if blank <InFileName>.lst\n"
+		"  --sourcemap [FileName] ==> Outputs a file mapping each address of the program back to the line, column and byte of the source that produced it at [FileName], or if blank <InFileName>.srcmap\n";
 	
 	printf(HelpMessage, ApplicationName);
 }
 
 int wmain(int ArgCount, wchar_t **Args, wchar_t **Env) {
-	FILE *InFile = 0, *OutLogisim = 0, *OutHex = 0, *OutSymbolTable = 0, *OutListing = 0;
-	wchar_t *InFileName = 0, *OutLogisimPath = 0, *OutHexPath = 0, *OutSymbolTablePath = 0, *OutListingPath = 0;
-	int GenLogisim = FALSE, GenHex = FALSE, GenSymbolTable = FALSE, GenListing = FALSE;
+	FILE *InFile = 0, *OutLogisim = 0, *OutHex = 0, *OutSymbolTable = 0, *OutListing = 0, *OutSourceMap = 0;
+	wchar_t *InFileName = 0, *OutLogisimPath = 0, *OutHexPath = 0, *OutSymbolTablePath = 0, *OutListingPath = 0, *OutSourceMapPath = 0;
+	int GenLogisim = FALSE, GenHex = FALSE, GenSymbolTable = FALSE, GenListing = FALSE, GenSourceMap = FALSE;
 	uint64_t InFileSize = 0;
 	int Success = TRUE;
 	
@@ -106,7 +50,7 @@ int wmain(int ArgCount, wchar_t **Args, wchar_t **Env) {
 			else { Arg = Args[Index + 1]; }
 
 			if (OutLogisim == 0 && GenLogisim == FALSE) {
-				if (!((StartsWith(Arg, L"--")) || (Arg[0] == 0))) {
+				if (!((StartsWith(Arg, L"--")) || (Arg[0] == 0) || (wcscmp(Arg, L"-") == 0))) {
 					Index++;
 					OutLogisim = _wfopen(Arg, L"w");
 					if (OutLogisim == 0) {
@@ -131,7 +75,7 @@ int wmain(int ArgCount, wchar_t **Args, wchar_t **Env) {
 			else { Arg = Args[Index + 1]; }
 
 			if (OutHex == 0 && GenHex == FALSE) {
-				if (!((StartsWith(Arg, L"--")) || (Arg[0] == 0))) {
+				if (!((StartsWith(Arg, L"--")) || (Arg[0] == 0) || (wcscmp(Arg, L"-") == 0))) {
 					Index++;
 					OutHex = _wfopen(Arg, L"wb");
 					if (OutHex == 0) {
@@ -156,7 +100,7 @@ int wmain(int ArgCount, wchar_t **Args, wchar_t **Env) {
 			else { Arg = Args[Index + 1]; }
 
 			if (OutSymbolTable == 0 && GenSymbolTable == FALSE) {
-				if (!((StartsWith(Arg, L"--")) || (Arg[0] == 0))) {
+				if (!((StartsWith(Arg, L"--")) || (Arg[0] == 0) || (wcscmp(Arg, L"-") == 0))) {
 					Index++;
 					OutSymbolTable = _wfopen(Arg, L"w");
 					if (OutSymbolTable == 0) {
@@ -181,7 +125,7 @@ int wmain(int ArgCount, wchar_t **Args, wchar_t **Env) {
 			else { Arg = Args[Index + 1]; }
 
 			if (OutListing == 0 && GenListing == FALSE) {
-				if (!((StartsWith(Arg, L"--")) || (Arg[0] == 0))) {
+				if (!((StartsWith(Arg, L"--")) || (Arg[0] == 0) || (wcscmp(Arg, L"-") == 0))) {
 					Index++;
 					OutListing = _wfopen(Arg, L"w");
 					if (OutListing == 0) {
@@ -201,11 +145,42 @@ int wmain(int ArgCount, wchar_t **Args, wchar_t **Env) {
 				break;
 			}
 		}
+		else if (StartsWith(Arg, L"--sourcemap")) {
+			if (Index + 1 >= ArgCount) { Arg = L""; }
+			else { Arg = Args[Index + 1]; }
+
+			if (OutSourceMap == 0 && GenSourceMap == FALSE) {
+				if (!((StartsWith(Arg, L"--")) || (Arg[0] == 0) || (wcscmp(Arg, L"-") == 0))) {
+					Index++;
+					OutSourceMap = _wfopen(Arg, L"w");
+					if (OutSourceMap == 0) {
+						wprintf(L"I could not open the source map output file \"%s\" for writing!\n", Arg);
+						Success = FALSE;
+						break;
+					}
+					OutSourceMapPath = Arg;
+				}
+				else {
+					GenSourceMap = TRUE;
+				}
+			}
+			else {
+				wprintf(L"Option --sourcemap was provided twice!\n");
+				Success = FALSE;
+				break;
+			}
+		}
 		else if (StartsWith(Arg, L"--")) {
 			wprintf(L"Unknown commandline operation encountered: \"%s\"\n", Arg);
 			Success = FALSE;
 			break;
 		}
+		else if (InFile == 0 && wcscmp(Arg, L"-") == 0) { // The program is piped in. Its size isn't known until it has been read, and blank outputs are named stdin.<extension>.
+			_setmode(_fileno(stdin), _O_BINARY);
+			InFile = stdin;
+			InFileSize = 0;
+			InFileName = L"stdin";
+		}
 		else if (InFile == 0) { // This must be our one input file.
 			InFile = _wfopen(Arg, L"rb");
 			if (InFile == 0) {
@@ -281,10 +256,25 @@ int wmain(int ArgCount, wchar_t **Args, wchar_t **Env) {
 				OutSymbolTablePath = AutoFileName;
 			}
 		}
+		if (GenSourceMap) {
+			wchar_t *AutoFileName = GenerateOutputPath(InFileName, L".srcmap");
+			OutSourceMap = _wfopen(AutoFileName, L"w");
+			if (OutSourceMap == 0) {
+				wprintf(L"I could not open the source map output file's auto-generated path \"%s\" for writing!\n", AutoFileName);
+				Success = FALSE;
+				free(AutoFileName);
+			}
+			else {
+				OutSourceMapPath = AutoFileName;
+			}
+		}
 	}
 
 	if (Success) {
-		Success = ApplicationMain(InFile, InFileSize, OutLogisim, OutHex, OutSymbolTable, OutListing);
+		// .Include resolves against the directory of the file it's in, so the assembler needs the input's path.
+		char *InFileNameUtf8 = win32_Utf8FromWide(InFileName);
+		Success = ApplicationMain(InFile, InFileSize, OutLogisim, OutHex, OutSymbolTable, OutListing, OutSourceMap, 0, 0, 0, InFileNameUtf8, DF_Text, 0);
+		free(InFileNameUtf8);
 	}
 	else {
 		printf("Exiting without invoking the assembler.\n");
@@ -311,6 +301,11 @@ int wmain(int ArgCount, wchar_t **Args, wchar_t **Env) {
 			Assert(OutListingPath != 0);
 			DeleteFile(OutListingPath);
 		}
+		if (OutSourceMap) {
+			fclose(OutSourceMap);
+			Assert(OutSourceMapPath != 0);
+			DeleteFile(OutSourceMapPath);
+		}
 		
 	}
 
@@ -0,0 +1,157 @@
+/* File: The parts of the win32 platform layer that the console and gui front ends share, included by both win32_MarieAssembler.c and win32gui_MarieAssembler.c.
+ * Those files include <Windows.h> and Platform_MarieAssembler.h before this one.
+ */
+
+void Platform_Breakpoint() {
+	__debugbreak();
+}
+
+void* Platform_AllocateExecutableMemory(size_t Size) {
+	return VirtualAlloc(0, Size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+}
+
+void Platform_FreeExecutableMemory(void *Memory, size_t Size) {
+	VirtualFree(Memory, 0, MEM_RELEASE);
+}
+
+double Platform_GetSeconds() {
+	LARGE_INTEGER Frequency, Counter;
+	QueryPerformanceFrequency(&Frequency);
+	QueryPerformanceCounter(&Counter);
+	return (double)Counter.QuadPart / (double)Frequency.QuadPart;
+}
+
+typedef struct {
+	HANDLE Handle;
+	platform_thread_proc Proc;
+	void *Data;
+} win32_thread;
+
+translation_scope DWORD WINAPI win32_ThreadProc(LPVOID Data) {
+	win32_thread *Thread = Data;
+	Thread->Proc(Thread->Data);
+	return 0;
+}
+
+void* Platform_CreateThread(platform_thread_proc Proc, void *Data) {
+	win32_thread *Thread = calloc(1, sizeof(win32_thread));
+	Thread->Proc = Proc;
+	Thread->Data = Data;
+	Thread->Handle = CreateThread(0, 0, win32_ThreadProc, Thread, 0, 0);
+	if (Thread->Handle == 0) {
+		free(Thread);
+		return 0;
+	}
+	return Thread;
+}
+
+void Platform_JoinThread(void *Thread) {
+	win32_thread *Win32Thread = Thread;
+	WaitForSingleObject(Win32Thread->Handle, INFINITE);
+	CloseHandle(Win32Thread->Handle);
+	free(Win32Thread);
+}
+
+int Platform_GetProcessorCount() {
+	SYSTEM_INFO Info;
+	GetSystemInfo(&Info);
+	return (Info.dwNumberOfProcessors < 1) ? 1 : (int)Info.dwNumberOfProcessors;
+}
+
+void* Platform_CreateEvent() {
+	// Auto reset, so a wait clears it.
+	return CreateEventW(0, FALSE, FALSE, 0);
+}
+
+void Platform_SignalEvent(void *Event) {
+	SetEvent(Event);
+}
+
+void Platform_WaitEvent(void *Event) {
+	WaitForSingleObject(Event, INFINITE);
+}
+
+void Platform_FreeEvent(void *Event) {
+	CloseHandle(Event);
+}
+
+int Platform_GetFileInfo(const char *Path, uint64_t *ModifiedTime, uint64_t *FileId) {
+	wchar_t WidePath[MAX_PATH];
+	if (MultiByteToWideChar(CP_UTF8, 0, Path, -1, WidePath, MAX_PATH) == 0) { return FALSE; }
+	HANDLE File = CreateFileW(WidePath, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, 0);
+	if (File == INVALID_HANDLE_VALUE) { return FALSE; }
+
+	BY_HANDLE_FILE_INFORMATION Info;
+	int Success = GetFileInformationByHandle(File, &Info) != 0;
+	CloseHandle(File);
+	if (Success) {
+		*ModifiedTime = ((uint64_t)Info.ftLastWriteTime.dwHighDateTime << 32) | Info.ftLastWriteTime.dwLowDateTime;
+		*FileId = (((uint64_t)Info.nFileIndexHigh << 32) | Info.nFileIndexLow) ^ ((uint64_t)Info.dwVolumeSerialNumber << 48);
+	}
+	return Success;
+}
+
+/* Converts a path from the wide win32 apis into UTF-8, which is what the assembler and Platform_GetFileInfo() take. The result is to be freed by the caller.
+ */
+char* win32_Utf8FromWide(const wchar_t *Wide) {
+	const int Size = WideCharToMultiByte(CP_UTF8, 0, Wide, -1, 0, 0, 0, 0);
+	char *Result = calloc((Size > 0) ? Size : 1, 1);
+	if (Size > 0) { WideCharToMultiByte(CP_UTF8, 0, Wide, -1, Result, Size, 0, 0); }
+	return Result;
+}
+
+size_t win32_GetFileSize(wchar_t *FileName, int *Success) {
+	LARGE_INTEGER Result = {0};
+	
+	HANDLE FileHandle = CreateFile(FileName, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	
+	if (GetFileSizeEx(FileHandle, &Result) == 0) {
+		DWORD Error = GetLastError();
+		wprintf(L"[Error File Handling] This program could not get the size of the provided file (%s).\nThe value of win32's GetLastError is '%d'", FileName, Error);
+		*Success = FALSE;
+	}
+	else { SetLastError(0); }
+
+	return (size_t)Result.QuadPart;
+}
+
+int IndexOfFromEnd(wchar_t *String, wchar_t Target) {
+	int Result = 0;
+
+	Result = wcslen(String) - 1;
+	
+	for(; Result >= 0; Result--) {
+		if (String[Result] == Target) { return Result; }
+	}
+	return -1;
+}
+
+int StartsWith(wchar_t *String, wchar_t *Target) {
+	int Result = FALSE;
+	int Length = wcslen(Target);
+	if (Length <= wcslen(String)) {
+		for (int Index = 0; Index <= Length; Index++) {
+			if (Index == Length) { Result = TRUE; break; }
+			if (String[Index] != Target[Index]) { break; }
+		}
+	}
+
+	return Result;
+}
+
+wchar_t* GenerateOutputPath(wchar_t *InFileName, wchar_t *PostFix) {
+	int DotIndex = IndexOfFromEnd(InFileName, L'.');
+	int PathSeperatorIndex = Max(IndexOfFromEnd(InFileName, L'\\'), IndexOfFromEnd(InFileName, L'/'));
+	if (DotIndex < PathSeperatorIndex || DotIndex == -1) {
+		// The dot we found was part of the file path.
+		// Or we didn't find a dot.
+		DotIndex = wcslen(InFileName);
+	}
+	
+	int AutoFileNameLength = DotIndex + wcslen(PostFix) + 1;
+	wchar_t *AutoFileName = calloc(AutoFileNameLength, sizeof(wchar_t));
+	
+	_snwprintf(AutoFileName, AutoFileNameLength, L"%.*s%s", DotIndex, InFileName, PostFix);
+
+	return AutoFileName;
+}
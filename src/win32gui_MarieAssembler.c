@@ -18,66 +18,7 @@
 #undef UNICODE
 
 #include "Platform_MarieAssembler.h"
-
-void Platform_Breakpoint() {
-	__debugbreak();
-}
-
-size_t win32_GetFileSize(wchar_t *FileName, int *Success) {
-	LARGE_INTEGER Result = {0};
-	
-	HANDLE FileHandle = CreateFile(FileName, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
-	
-	if (GetFileSizeEx(FileHandle, &Result) == 0) {
-		DWORD Error = GetLastError();
-		wprintf(L"[Error File Handling] This program could not get the size of the provided file (%s).\nThe value of win32's GetLastError is '%d'", FileName, Error);
-		*Success = FALSE;
-	}
-	else { SetLastError(0); }
-
-	return (size_t)Result.QuadPart;
-}
-
-int IndexOfFromEnd(wchar_t *String, wchar_t Target) {
-	int Result = 0;
-
-	Result = wcslen(String) - 1;
-	
-	for(; Result >= 0; Result--) {
-		if (String[Result] == Target) { return Result; }
-	}
-	return -1;
-}
-
-int StartsWith(wchar_t *String, wchar_t *Target) {
-	int Result = FALSE;
-	int Length = wcslen(Target);
-	if (Length <= wcslen(String)) {
-		for (int Index = 0; Index <= Length; Index++) {
-			if (Index == Length) { Result = TRUE; break; }
-			if (String[Index] != Target[Index]) { break; }
-		}
-	}
-
-	return Result;
-}
-
-wchar_t* GenerateOutputPath(wchar_t *InFileName, wchar_t *PostFix) {
-	int DotIndex = IndexOfFromEnd(InFileName, L'.');
-	int PathSeperatorIndex = Max(IndexOfFromEnd(InFileName, L'\\'), IndexOfFromEnd(InFileName, L'/'));
-	if (DotIndex < PathSeperatorIndex || DotIndex == -1) {
-		// The dot we found was part of the file path.
-		// Or we didn't find a dot.
-		DotIndex = wcslen(InFileName);
-	}
-	
-	int AutoFileNameLength = DotIndex + wcslen(PostFix) + 1;
-	wchar_t *AutoFileName = calloc(AutoFileNameLength, sizeof(wchar_t));
-	
-	_snwprintf(AutoFileName, AutoFileNameLength, L"%.*s%s", DotIndex, InFileName, PostFix);
-
-	return AutoFileName;
-}
+#include "win32_Platform_MarieAssembler.c"
 
 int __declspec(dllexport) __stdcall VisualBasicEntryPoint(wchar_t *InputPath, wchar_t *LogisimPath, wchar_t *HexPath, wchar_t *SymbolTablePath, wchar_t *ListingPath) {
 	FILE *InFile = 0, *OutLogisim = 0, *OutHex = 0, *OutSymbolTable = 0, *OutListing = 0;
@@ -134,7 +75,10 @@ int __declspec(dllexport) __stdcall VisualBasicEntryPoint(wchar_t *InputPath, wc
 	}
 
 	if (Success) {
-		Success = ApplicationMain(InFile, InFileSize, OutLogisim, OutHex, OutSymbolTable, OutListing);
+		// .Include resolves against the directory of the file it's in, so the assembler needs the input's path.
+		char *InputPathUtf8 = win32_Utf8FromWide(InputPath);
+		Success = ApplicationMain(InFile, InFileSize, OutLogisim, OutHex, OutSymbolTable, OutListing, 0, 0, 0, 0, InputPathUtf8, DF_Text, 0);
+		free(InputPathUtf8);
 	}
 	else {
 		wprintf(L"Exiting without invoking the assembler.\n");